@@ -2,20 +2,18 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <PubSubClient.h>
+#include "metrics.h"
 
 namespace MQTT
 {
     unsigned long last_reconnect_attempt_ms = 0;
-    unsigned long last_heartbeat_ms = 0;
     bool was_mqtt_connected = false;
-    
-    const unsigned long HEARTBEAT_INTERVAL = 30000;
 
     void publishStatus(PubSubClient &mqttClient, const char *status_topic, const char *status)
     {
         if (mqttClient.connected())
         {
-            bool success = mqttClient.publish(status_topic, status, true);  // retained = true
+            bool success = Metrics::publish(mqttClient, status_topic, status, true);  // retained = true
             if (success) {
                 Serial.printf("MQTT Status published: %s → %s\n", status_topic, status);
             } else {
@@ -103,18 +101,15 @@ namespace MQTT
         }
     }
     
+    // Called by the scheduler every MQTT_HEARTBEAT_INTERVAL
     void heartbeat(PubSubClient &mqttClient, 
                    const char *status_topic, 
                    const char *online_message)
     {
         if (mqttClient.connected())
         {
-            if (millis() - last_heartbeat_ms > HEARTBEAT_INTERVAL)
-            {
-                last_heartbeat_ms = millis();
-                Serial.println("Sending heartbeat...");
-                publishStatus(mqttClient, status_topic, online_message);
-            }
+            Serial.println("Sending heartbeat...");
+            publishStatus(mqttClient, status_topic, online_message);
         }
     }
 
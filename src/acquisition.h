@@ -0,0 +1,272 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+#include "hal.h"
+#include "profile.h"
+#include "protection.h"
+#include "power_quality.h"
+
+// ════════════════════════════════════════════════════════════════
+// PZEM ACQUISITION TASK
+// A FreeRTOS task above loop() priority owns the PZEM: it polls all
+// registers (one Modbus read, the library caches them for 200ms)
+// every PROTECTION_POLL_INTERVAL and runs the protection engine on
+// each sample, plus the power-quality recorder. A trip drives RELAY_PIN off directly from this task,
+// so MQTT reconnects / TLS stalls in loop() can't delay it. loop()
+// only reads the latest snapshot and publishes the trip afterwards.
+//
+// Trip latency bound = poll period + Modbus read + react time (both
+// measured), on top of the meter's own ~1s measurement refresh.
+// With LOW_POWER_MODE the task's own vTaskDelayUntil wake bounds
+// automatic light sleep, and a NO_LIGHT_SLEEP lock is held while the
+// UART exchange is in flight.
+// ════════════════════════════════════════════════════════════════
+
+#if LOW_POWER_MODE
+#include <esp_pm.h>
+#endif
+
+namespace Acquisition
+{
+    typedef Protection::Engine<PROTECTION_PRETRIP_SAMPLES> Engine;
+    typedef Protection::TripRecord<PROTECTION_PRETRIP_SAMPLES> TripRecord;
+    typedef PowerQuality::Recorder<PQ_PRETRIGGER_SAMPLES, PQ_QUEUE_SIZE> PqRecorder;
+    typedef PqRecorder::Event PqEvent;
+
+    struct Stats {
+        uint32_t samples = 0;
+        uint32_t readErrors = 0;
+        uint32_t trips = 0;
+        uint32_t readUsMax = 0;         // One Modbus poll
+        uint32_t periodUsMax = 0;       // Gap between samples (detection window)
+        uint32_t reactUsMax = 0;        // Sample ready → relay pin written
+    };
+
+    Hal::PowerMeter *meter = nullptr;
+    Hal::Gpio *gpio = nullptr;
+    uint8_t relayPin = 0;
+
+    Engine engine(Protection::Limits{
+        PROTECTION_MAX_CURRENT_A,
+        PROTECTION_MAX_POWER_W,
+        true,
+        PROTECTION_CONFIRM_SAMPLES
+    });
+
+    PqRecorder pq(PowerQuality::Limits{
+        PQ_SAG_V,
+        PQ_SWELL_V,
+        PQ_INTERRUPT_V,
+        PQ_HYSTERESIS_V,
+        PQ_INTERRUPT_SAMPLES,
+        PQ_FREQ_LOW_HZ,
+        PQ_FREQ_HIGH_HZ,
+        PQ_HYSTERESIS_HZ
+    });
+
+    // Shared with loop(): snapshot, pending trip, stats
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    PowerSample latestSample;
+    TripRecord pendingTrip;
+    volatile bool tripPending = false;
+    Stats stats;
+
+    SemaphoreHandle_t meterMutex = nullptr;     // Serial2 / Modbus ownership
+    TaskHandle_t taskHandle = nullptr;
+#if LOW_POWER_MODE
+    esp_pm_lock_handle_t noSleepLock = nullptr; // UART RX is lost in light sleep
+#endif
+    uint32_t lastSampleUs = 0;
+
+    // Called from the acquisition task with every sample (trace recording)
+    void (*sampleHook)(const PowerSample &s) = nullptr;
+
+    // Exclusive meter access; keeps the chip out of light sleep meanwhile
+    void takeMeter()
+    {
+        xSemaphoreTake(meterMutex, portMAX_DELAY);
+#if LOW_POWER_MODE
+        if (noSleepLock) esp_pm_lock_acquire(noSleepLock);
+#endif
+    }
+
+    void giveMeter()
+    {
+#if LOW_POWER_MODE
+        if (noSleepLock) esp_pm_lock_release(noSleepLock);
+#endif
+        xSemaphoreGive(meterMutex);
+    }
+
+    void poll()
+    {
+        takeMeter();
+        uint32_t start = micros();
+        PowerSample s;
+        {
+            PROFILE_SCOPE(Profile::PROBE_PZEM);
+            s = meter->read();
+        }
+        uint32_t ready = micros();
+        giveMeter();
+
+        portENTER_CRITICAL(&lock);
+        uint8_t reason = engine.evaluate(s);
+        portEXIT_CRITICAL(&lock);
+
+        if (reason != Protection::NONE) {
+            gpio->write(relayPin, true);    // Active LOW - OFF
+        }
+        uint32_t done = micros();
+
+        uint32_t read_us = ready - start;
+        uint32_t period_us = lastSampleUs ? ready - lastSampleUs : 0;
+        uint32_t react_us = done - ready;
+        lastSampleUs = ready;
+
+        portENTER_CRITICAL(&lock);
+        latestSample = s;
+        pq.add(s);
+        stats.samples++;
+        if (!s.valid) stats.readErrors++;
+        if (read_us > stats.readUsMax) stats.readUsMax = read_us;
+        if (period_us > stats.periodUsMax) stats.periodUsMax = period_us;
+        if (reason != Protection::NONE) {
+            TripRecord &r = engine.record();
+            r.periodUs = period_us;
+            r.reactUs = react_us;
+            pendingTrip = r;
+            tripPending = true;
+            stats.trips++;
+            if (react_us > stats.reactUsMax) stats.reactUsMax = react_us;
+        }
+        portEXIT_CRITICAL(&lock);
+
+        if (sampleHook) sampleHook(s);
+    }
+
+    void task(void *)
+    {
+        TickType_t wake = xTaskGetTickCount();
+        for (;;) {
+            poll();
+            vTaskDelayUntil(&wake, pdMS_TO_TICKS(PROTECTION_POLL_INTERVAL));
+        }
+    }
+
+    // Program the meter alarm threshold and start polling. relay_pin
+    // must already be configured as an output.
+    void begin(Hal::PowerMeter &power_meter, Hal::Gpio &relay_gpio, uint8_t relay_pin)
+    {
+        meter = &power_meter;
+        gpio = &relay_gpio;
+        relayPin = relay_pin;
+        meterMutex = xSemaphoreCreateMutex();
+#if LOW_POWER_MODE
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "pzem", &noSleepLock);
+#endif
+
+        bool alarm_ok = meter->setPowerAlarm((uint16_t)PROTECTION_MAX_POWER_W);
+        Serial.printf("%s PZEM power alarm: %.0fW\n", alarm_ok ? "✅" : "❌", PROTECTION_MAX_POWER_W);
+
+        xTaskCreatePinnedToCore(task, "acq", PROTECTION_TASK_STACK, nullptr,
+                                PROTECTION_TASK_PRIORITY, &taskHandle, PROTECTION_TASK_CORE);
+        Serial.printf("Protection: I>%.1fA, P>%.0fW, poll %dms, task prio %d\n",
+                      PROTECTION_MAX_CURRENT_A, PROTECTION_MAX_POWER_W,
+                      PROTECTION_POLL_INTERVAL, PROTECTION_TASK_PRIORITY);
+    }
+
+    PowerSample latest()
+    {
+        portENTER_CRITICAL(&lock);
+        PowerSample s = latestSample;
+        portEXIT_CRITICAL(&lock);
+        return s;
+    }
+
+    // Copy out a trip that loop() hasn't handled yet
+    bool takeTrip(TripRecord &out)
+    {
+        if (!tripPending) return false;
+        portENTER_CRITICAL(&lock);
+        out = pendingTrip;
+        tripPending = false;
+        portEXIT_CRITICAL(&lock);
+        return true;
+    }
+
+    // Next opened / closed power-quality event, oldest first
+    bool takePqEvent(PqEvent &out)
+    {
+        portENTER_CRITICAL(&lock);
+        bool ok = pq.take(out);
+        portEXIT_CRITICAL(&lock);
+        return ok;
+    }
+
+    // {"SAG":n,"SWELL":n,"INTERRUPTION":n,"FREQ_LOW":n,"FREQ_HIGH":n,"drop":n,"v":0|1,"f":0|1}
+    size_t formatPqReport(char *buf, size_t size)
+    {
+        uint32_t counts[PowerQuality::CLASS_COUNT];
+        portENTER_CRITICAL(&lock);
+        for (uint8_t c = 0; c < PowerQuality::CLASS_COUNT; c++) counts[c] = pq.count(c);
+        uint32_t dropped = pq.dropped();
+        bool v_active = pq.active(0);
+        bool f_active = pq.active(1);
+        portEXIT_CRITICAL(&lock);
+
+        int len = snprintf(buf, size, "{");
+        for (uint8_t c = 0; c < PowerQuality::CLASS_COUNT && len > 0 && (size_t)len < size; c++) {
+            len += snprintf(buf + len, size - len, "\"%s\":%u,", PowerQuality::className(c), (unsigned)counts[c]);
+        }
+        if (len > 0 && (size_t)len < size) {
+            len += snprintf(buf + len, size - len, "\"drop\":%u,\"v\":%d,\"f\":%d}",
+                            (unsigned)dropped, v_active ? 1 : 0, f_active ? 1 : 0);
+        }
+        return len > 0 ? (size_t)len : 0;
+    }
+
+    bool tripped()
+    {
+        portENTER_CRITICAL(&lock);
+        bool t = engine.tripped();
+        portEXIT_CRITICAL(&lock);
+        return t;
+    }
+
+    // Release the latch (relay ON command). Trips again on the next
+    // sample if the overload is still there.
+    void clearTrip()
+    {
+        portENTER_CRITICAL(&lock);
+        engine.clear();
+        portEXIT_CRITICAL(&lock);
+    }
+
+    // Energy counter reset, serialized with the polling task
+    bool resetEnergy()
+    {
+        takeMeter();
+        bool ok = meter->resetEnergy();
+        giveMeter();
+        return ok;
+    }
+
+    // {"n":samples,"err":e,"trips":t,"tripped":0|1,"read_us":max,"win_us":max,
+    //  "react_us":max,"bound_us":win+react,"stack":free_words}
+    size_t formatReport(char *buf, size_t size)
+    {
+        portENTER_CRITICAL(&lock);
+        Stats s = stats;
+        bool latched = engine.tripped();
+        portEXIT_CRITICAL(&lock);
+
+        int len = snprintf(buf, size,
+            "{\"n\":%u,\"err\":%u,\"trips\":%u,\"tripped\":%d,\"read_us\":%u,\"win_us\":%u,\"react_us\":%u,\"bound_us\":%u,\"stack\":%u}",
+            (unsigned)s.samples, (unsigned)s.readErrors, (unsigned)s.trips, latched ? 1 : 0,
+            (unsigned)s.readUsMax, (unsigned)s.periodUsMax, (unsigned)s.reactUsMax,
+            (unsigned)(s.periodUsMax + s.reactUsMax),
+            (unsigned)(taskHandle ? uxTaskGetStackHighWaterMark(taskHandle) : 0));
+        return len > 0 ? (size_t)len : 0;
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+// ════════════════════════════════════════════════════════════════
+// WINDOWED AGGREGATES
+// Streaming count/mean/min/max/stddev per metric (Welford's update,
+// 20 bytes per metric and window, no sample buffers). Each window
+// closes on its own period and is formatted as one JSON frame, so
+// extremes between the raw publish points are kept.
+// ════════════════════════════════════════════════════════════════
+
+namespace Aggregate
+{
+    struct Welford {
+        uint32_t n = 0;
+        float mean = 0.0f;
+        float m2 = 0.0f;
+        float min = 0.0f;
+        float max = 0.0f;
+
+        void reset() { *this = Welford(); }
+
+        void add(float x)
+        {
+            if (isnan(x)) return;
+            n++;
+            float delta = x - mean;
+            mean += delta / n;
+            m2 += delta * (x - mean);
+            if (n == 1 || x < min) min = x;
+            if (n == 1 || x > max) max = x;
+        }
+
+        float stddev() const { return n > 1 ? sqrtf(m2 / (n - 1)) : 0.0f; }
+    };
+
+    template <uint8_t METRICS>
+    class Window
+    {
+    public:
+        Window(uint32_t period_ms, const char *const *names, const uint8_t *decimals)
+            : periodMs_(period_ms), names_(names), decimals_(decimals) {}
+
+        void add(uint8_t metric, float x)
+        {
+            if (metric < METRICS) stats_[metric].add(x);
+        }
+
+        bool due(uint32_t now_ms) const { return now_ms - startMs_ >= periodMs_; }
+
+        // Close the window: format the frame and start the next one.
+        // {"w":s,"t":utc_end,"up":s,"m":{"name":[n,mean,min,max,sd],...}}
+        size_t close(uint32_t now_ms, uint32_t utc_s, char *buf, size_t size)
+        {
+            int len = snprintf(buf, size, "{\"w\":%u,\"t\":%u,\"up\":%u,\"m\":{",
+                               (unsigned)(periodMs_ / 1000), (unsigned)utc_s, (unsigned)(now_ms / 1000));
+            bool first = true;
+            for (uint8_t i = 0; i < METRICS && len > 0 && (size_t)len < size; i++) {
+                const Welford &s = stats_[i];
+                if (s.n == 0) continue;
+                int d = decimals_[i];
+                len += snprintf(buf + len, size - len, "%s\"%s\":[%u,%.*f,%.*f,%.*f,%.*f]",
+                                first ? "" : ",", names_[i], (unsigned)s.n,
+                                d, s.mean, d, s.min, d, s.max, d + 1, s.stddev());
+                first = false;
+            }
+            if (len > 0 && (size_t)len + 3 <= size) {
+                len += snprintf(buf + len, size - len, "}}");
+            }
+
+            for (uint8_t i = 0; i < METRICS; i++) stats_[i].reset();
+            startMs_ += periodMs_;
+            if (now_ms - startMs_ >= periodMs_) startMs_ = now_ms;   // Skipped windows
+            closed_++;
+            return len > 0 ? (size_t)len : 0;
+        }
+
+        void start(uint32_t now_ms) { startMs_ = now_ms; }
+        const Welford &stats(uint8_t metric) const { return stats_[metric]; }
+        uint32_t closed() const { return closed_; }
+
+    private:
+        uint32_t periodMs_;
+        const char *const *names_;
+        const uint8_t *decimals_;
+        uint32_t startMs_ = 0;
+        uint32_t closed_ = 0;
+        Welford stats_[METRICS];
+    };
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+// ════════════════════════════════════════════════════════════════
+// STREAMING ANOMALY DETECTION
+// One EWMA mean / variance baseline per metric and hour of day, so
+// "2kW at 19:00" and "2kW at 03:00" are judged separately. A sample
+// scores z = |x - mean| / sd; an anomaly starts when z crosses the
+// threshold and ends when it drops below threshold * clear ratio, so
+// only crossings are reported. Outliers are clipped before updating
+// the baseline (a long anomaly is still absorbed, just slowly).
+// Pure logic: the caller passes hour of day and persists model().
+// ════════════════════════════════════════════════════════════════
+
+namespace Anomaly
+{
+    const uint8_t HOURS = 24;
+    const uint32_t MODEL_MAGIC = 0x414E4D31UL;      // "ANM1"
+
+    struct Baseline {
+        float mean;
+        float var;
+        uint16_t n;                 // Samples seen (saturates)
+    };
+
+    template <uint8_t METRICS>
+    struct Model {
+        uint32_t magic;
+        Baseline b[METRICS][HOURS];
+    };
+
+    struct Config {
+        float alpha;                // EWMA weight of a new sample
+        float threshold;            // z to start an anomaly
+        float clearRatio;           // z < threshold * clearRatio ends it
+        uint16_t warmup;            // Samples per hour before scoring
+    };
+
+    enum EventType : uint8_t {
+        EVENT_NONE = 0,
+        EVENT_START,
+        EVENT_END
+    };
+
+    struct Event {
+        uint8_t type = EVENT_NONE;
+        uint8_t metric = 0;
+        uint8_t hour = 0;
+        float value = 0.0f;
+        float score = 0.0f;
+        float mean = 0.0f;
+        float sd = 0.0f;
+    };
+
+    template <uint8_t METRICS>
+    class Detector
+    {
+    public:
+        // min_sd: per-metric floor, keeps a flat baseline from flagging noise
+        Detector(const Config &cfg, const float *min_sd) : cfg_(cfg), minSd_(min_sd)
+        {
+            model_.magic = MODEL_MAGIC;
+            for (uint8_t m = 0; m < METRICS; m++) {
+                for (uint8_t h = 0; h < HOURS; h++) model_.b[m][h] = Baseline{0.0f, 0.0f, 0};
+                active_[m] = false;
+                lastScore_[m] = 0.0f;
+            }
+        }
+
+        bool restore(const Model<METRICS> &m)
+        {
+            if (m.magic != MODEL_MAGIC) return false;
+            model_ = m;
+            return true;
+        }
+
+        // Score and learn one sample; true with ev filled on a crossing
+        bool add(uint8_t metric, uint8_t hour, float x, Event &ev)
+        {
+            if (metric >= METRICS || hour >= HOURS || isnan(x)) return false;
+            Baseline &b = model_.b[metric][hour];
+            samples_++;
+
+            if (b.n == 0) {
+                b.mean = x;
+                b.var = 0.0f;
+                b.n = 1;
+                return false;
+            }
+
+            float sd = sqrtf(b.var);
+            if (sd < minSd_[metric]) sd = minSd_[metric];
+            float z = fabsf(x - b.mean) / sd;
+            bool scored = b.n >= cfg_.warmup;
+            lastScore_[metric] = scored ? z : 0.0f;
+
+            uint8_t type = EVENT_NONE;
+            if (scored && !active_[metric] && z >= cfg_.threshold) {
+                active_[metric] = true;
+                type = EVENT_START;
+            } else if (active_[metric] && (!scored || z < cfg_.threshold * cfg_.clearRatio)) {
+                active_[metric] = false;
+                type = EVENT_END;
+            }
+
+            if (type != EVENT_NONE) {
+                ev.type = type;
+                ev.metric = metric;
+                ev.hour = hour;
+                ev.value = x;
+                ev.score = z;
+                ev.mean = b.mean;
+                ev.sd = sd;
+            }
+
+            // Clip outliers to the threshold band before learning
+            float limit = cfg_.threshold * sd;
+            float diff = x - b.mean;
+            if (scored && diff > limit) diff = limit;
+            if (scored && diff < -limit) diff = -limit;
+            float incr = cfg_.alpha * diff;
+            b.mean += incr;
+            b.var = (1.0f - cfg_.alpha) * (b.var + diff * incr);
+            if (b.n < 0xFFFF) b.n++;
+
+            return type != EVENT_NONE;
+        }
+
+        const Model<METRICS> &model() const { return model_; }
+        const Baseline &baseline(uint8_t metric, uint8_t hour) const { return model_.b[metric][hour]; }
+        bool active(uint8_t metric) const { return active_[metric]; }
+        float lastScore(uint8_t metric) const { return lastScore_[metric]; }
+        uint32_t samples() const { return samples_; }
+
+    private:
+        Config cfg_;
+        const float *minSd_;
+        Model<METRICS> model_;
+        bool active_[METRICS];
+        float lastScore_[METRICS];
+        uint32_t samples_ = 0;
+    };
+}
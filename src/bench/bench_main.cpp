@@ -0,0 +1,424 @@
+// ════════════════════════════════════════════════════════════════
+// HOST BENCHMARKS (env:native_bench)
+// Telemetry hot path on the simulated devices: value formatting
+// (float vs fixed-point), per-topic vs framed publishing, command
+// decoding, the per-sample filters (protection, power quality, NILM,
+// anomaly baselines),
+// windowed aggregation and a full acquisition → format → publish
+// cycle. Reports ns/op, allocations/op and bytes/op as JSON so runs
+// of different firmware versions can be diffed.
+//
+//   bench_main [-t ms] [-l label] [-o file] [name-prefix]
+// ════════════════════════════════════════════════════════════════
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <chrono>
+
+#include "../config.h"
+#include "../topics.h"
+#include "../hal_sim.h"
+#include "../metrics.h"
+#include "../commands.h"
+#include "../protection.h"
+#include "../power_quality.h"
+#include "../aggregate.h"
+#include "../nilm.h"
+#include "../anomaly.h"
+
+// ════════════════════════════════════════
+// ALLOCATION COUNTING
+// Every C++ heap allocation of the process goes through these
+// ════════════════════════════════════════
+namespace Alloc
+{
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+}
+
+void *operator new(size_t size)
+{
+    Alloc::count++;
+    Alloc::bytes += size;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+namespace
+{
+    // ════════════════════════════════════════
+    // FIXTURES
+    // ════════════════════════════════════════
+    Hal::SimClock simClock;
+    Hal::SimGpio gpio;
+    Hal::SimPzem meter(simClock, gpio);
+    Hal::SimTransport mqtt;
+
+    Protection::Engine<PROTECTION_PRETRIP_SAMPLES> protection(Protection::Limits{
+        PROTECTION_MAX_CURRENT_A, PROTECTION_MAX_POWER_W, true, PROTECTION_CONFIRM_SAMPLES});
+    PowerQuality::Recorder<PQ_PRETRIGGER_SAMPLES, PQ_QUEUE_SIZE> pq(PowerQuality::Limits{
+        PQ_SAG_V, PQ_SWELL_V, PQ_INTERRUPT_V, PQ_HYSTERESIS_V, PQ_INTERRUPT_SAMPLES, PQ_FREQ_LOW_HZ, PQ_FREQ_HIGH_HZ, PQ_HYSTERESIS_HZ});
+    Nilm::Detector<NILM_MAX_SIGNATURES> nilm(Nilm::Config{
+        NILM_NOISE_W, NILM_MIN_STEP_W, NILM_MATCH_RATIO, NILM_MATCH_MIN_W, NILM_STABLE_SAMPLES});
+    const float ANOMALY_MIN_SD[] = {ANOMALY_MIN_SD_POWER, ANOMALY_MIN_SD_TEMP};
+    Anomaly::Detector<2> anomaly(Anomaly::Config{
+        ANOMALY_ALPHA, ANOMALY_THRESHOLD, ANOMALY_CLEAR_RATIO, ANOMALY_WARMUP}, ANOMALY_MIN_SD);
+
+    const char *const AGG_NAMES[] = {"v", "i", "p", "f", "pf", "temp", "hum"};
+    const uint8_t AGG_DECIMALS[] = {1, 3, 1, 1, 2, 1, 1};
+    Aggregate::Window<7> window(AGG_SHORT_WINDOW_MS, AGG_NAMES, AGG_DECIMALS);
+
+    // Recorded meter trace, replayed by the per-sample cases
+    const uint16_t TRACE_SIZE = 1024;
+    PowerSample trace[TRACE_SIZE];
+    uint16_t traceIndex = 0;
+
+    const PowerSample &nextSample()
+    {
+        traceIndex = (traceIndex + 1) % TRACE_SIZE;
+        return trace[traceIndex];
+    }
+
+    struct Command {
+        const char *topic;
+        const char *payload;
+    };
+
+    const Command COMMANDS[] = {
+        {MQTTTopics::RELAY_CONTROL, "ON"},
+        {MQTTTopics::RELAY_CONTROL, "OFF"},
+        {MQTTTopics::RELAY_CONTROL, "TOGGLE"},
+        {MQTTTopics::AGGREGATE_RAW, "1"},
+        {MQTTTopics::PZEM_RESET, "RESET_ENERGY"},
+        {MQTTTopics::RULES_SET, "p>2000:relay=OFF"},
+        {"home/unknown/topic", "ON"}
+    };
+    const uint8_t COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+    uint8_t commandIndex = 0;
+
+    // Keeps results observable so the optimizer can't drop the work
+    volatile uint32_t sink = 0;
+
+    void setup()
+    {
+        Hal::bindClock(simClock);
+        meter.addLoad("base", 150.0f, 0.95f, -1, true);
+        int8_t fridge = meter.addLoad("fridge", 120.0f, 0.80f);
+        int8_t kettle = meter.addLoad("kettle", 1800.0f, 1.00f);
+        meter.setReadLatencyUs(0);
+
+        // 1024 samples at the acquisition rate with load steps and a sag
+        for (uint16_t i = 0; i < TRACE_SIZE; i++) {
+            meter.setLoad(fridge, (i / 150) % 3 == 0);
+            meter.setLoad(kettle, i >= 600 && i < 700);
+            if (i == 300) meter.injectVoltage(simClock.millis(), 1000, 185.0f);
+            trace[i] = meter.read();
+            simClock.advanceMs(PROTECTION_POLL_INTERVAL);
+        }
+
+        // Past the warm-up in every hour slot, so the cases score
+        Anomaly::Event ev;
+        for (uint32_t i = 0; i < (uint32_t)Anomaly::HOURS * ANOMALY_WARMUP; i++) {
+            anomaly.add(0, i % Anomaly::HOURS, trace[i % TRACE_SIZE].power, ev);
+            anomaly.add(1, i % Anomaly::HOURS, 28.5f, ev);
+        }
+        window.start(simClock.millis());
+    }
+
+    // ════════════════════════════════════════
+    // CANDIDATE: FIXED-POINT FORMATTING
+    // Scaled integer instead of the printf float path (String(v, d)
+    // and "%.*f" both end up in the soft-float dtoa on the ESP32).
+    // Rounds after scaling, so exact ties may differ from printf in
+    // the last digit.
+    // ════════════════════════════════════════
+    size_t formatFixed(char *buf, size_t size, float value, uint8_t decimals)
+    {
+        static const int32_t SCALE[] = {1, 10, 100, 1000, 10000};
+        if (decimals > 4 || size < 16) return 0;
+        if (isnan(value)) {
+            memcpy(buf, "nan", 4);
+            return 3;
+        }
+
+        char tmp[16];
+        uint8_t n = 0;
+        bool negative = value < 0.0f;
+        int32_t scaled = (int32_t)((negative ? -value : value) * SCALE[decimals] + 0.5f);
+        do {
+            tmp[n++] = (char)('0' + scaled % 10);
+            scaled /= 10;
+            if (n == decimals) tmp[n++] = '.';
+        } while (scaled > 0 || n < decimals + (decimals ? 2 : 1));     // Leading "0."
+
+        size_t len = 0;
+        if (negative) buf[len++] = '-';
+        while (n > 0) buf[len++] = tmp[--n];
+        buf[len] = '\0';
+        return len;
+    }
+
+    // ════════════════════════════════════════
+    // CASES
+    // ════════════════════════════════════════
+    const float *readings(const PowerSample &s, float *out)
+    {
+        out[0] = s.voltage;
+        out[1] = s.current;
+        out[2] = s.power;
+        out[3] = s.energy;
+        out[4] = s.frequency;
+        out[5] = s.pf;
+        return out;
+    }
+
+    const char *const RAW_TOPICS[] = {
+        MQTTTopics::VOLTAGE, MQTTTopics::CURRENT, MQTTTopics::POWER,
+        MQTTTopics::ENERGY, MQTTTopics::FREQUENCY, MQTTTopics::POWER_FACTOR
+    };
+    const uint8_t RAW_DECIMALS[] = {1, 3, 1, 3, 1, 2};
+
+    // Six readings, as the raw publish path does
+    void formatFloat()
+    {
+        float v[6];
+        readings(nextSample(), v);
+        char buf[16];
+        for (uint8_t m = 0; m < 6; m++) {
+            sink += snprintf(buf, sizeof(buf), "%.*f", RAW_DECIMALS[m], v[m]);
+        }
+    }
+
+    void formatFixedPoint()
+    {
+        float v[6];
+        readings(nextSample(), v);
+        char buf[16];
+        for (uint8_t m = 0; m < 6; m++) {
+            sink += formatFixed(buf, sizeof(buf), v[m], RAW_DECIMALS[m]);
+        }
+    }
+
+    // One topic per reading (current firmware)
+    void publishPerTopic(const PowerSample &s)
+    {
+        float v[6];
+        readings(s, v);
+        char buf[16];
+        for (uint8_t m = 0; m < 6; m++) {
+            snprintf(buf, sizeof(buf), "%.*f", RAW_DECIMALS[m], v[m]);
+            sink += Metrics::publish(mqtt, RAW_TOPICS[m], buf, false);
+        }
+    }
+
+    // One JSON frame for all readings
+    void publishFramed(const PowerSample &s)
+    {
+        char frame[128];
+        snprintf(frame, sizeof(frame), "{\"v\":%.1f,\"i\":%.3f,\"p\":%.1f,\"e\":%.3f,\"f\":%.1f,\"pf\":%.2f}",
+                 s.voltage, s.current, s.power, s.energy, s.frequency, s.pf);
+        sink += Metrics::publish(mqtt, MQTTTopics::POWER, frame, false);
+    }
+
+    void publishPerTopicCase() { publishPerTopic(nextSample()); }
+    void publishFramedCase() { publishFramed(nextSample()); }
+
+    void commandDispatch()
+    {
+        const Command &c = COMMANDS[commandIndex];
+        commandIndex = (commandIndex + 1) % COMMAND_COUNT;
+        uint8_t target = Commands::target(c.topic);
+        sink += target;
+        if (target == Commands::TARGET_RELAY || target == Commands::TARGET_RAW_PUBLISH) {
+            sink += Commands::parseSwitch(c.payload);
+        } else if (target == Commands::TARGET_PZEM_RESET) {
+            sink += Commands::isEnergyReset(c.payload);
+        }
+    }
+
+    void filterProtection()
+    {
+        sink += protection.evaluate(nextSample());
+        if (protection.tripped()) protection.clear();
+    }
+
+    void filterPowerQuality()
+    {
+        pq.add(nextSample());
+        PowerQuality::Event<PQ_PRETRIGGER_SAMPLES> ev;
+        while (pq.take(ev)) sink += ev.cls;
+    }
+
+    void filterNilm()
+    {
+        const PowerSample &s = nextSample();
+        Nilm::Event ev;
+        sink += nilm.add(s.power, s.pf, s.ms, ev);
+    }
+
+    // One closed window: mean power + temperature
+    void filterAnomaly()
+    {
+        const PowerSample &s = nextSample();
+        uint8_t hour = (traceIndex >> 4) % Anomaly::HOURS;
+        Anomaly::Event ev;
+        sink += anomaly.add(0, hour, s.power, ev);
+        sink += anomaly.add(1, hour, 28.5f + (traceIndex & 7) * 0.1f, ev);
+    }
+
+    void aggregateAdd()
+    {
+        const PowerSample &s = nextSample();
+        const float values[] = {s.voltage, s.current, s.power, s.frequency, s.pf, 28.5f, 61.0f};
+        for (uint8_t m = 0; m < 7; m++) window.add(m, values[m]);
+    }
+
+    // 300 samples (one 1 min window at the aggregate rate) + the frame
+    void aggregateClose()
+    {
+        for (uint16_t i = 0; i < AGG_SHORT_WINDOW_MS / AGG_SAMPLE_INTERVAL; i++) aggregateAdd();
+        static char frame[AGG_FRAME_SIZE];
+        sink += window.close(window.closed() * AGG_SHORT_WINDOW_MS, 0, frame, sizeof(frame));
+    }
+
+    // Meter read → filters → aggregates → publish
+    void acquisitionCycle(bool framed)
+    {
+        PowerSample s = meter.read();
+        simClock.advanceMs(PROTECTION_POLL_INTERVAL);
+        sink += protection.evaluate(s);
+        if (protection.tripped()) protection.clear();
+        pq.add(s);
+        PowerQuality::Event<PQ_PRETRIGGER_SAMPLES> ev;
+        while (pq.take(ev)) sink += ev.cls;
+        const float values[] = {s.voltage, s.current, s.power, s.frequency, s.pf};
+        for (uint8_t m = 0; m < 5; m++) window.add(m, values[m]);
+        if (framed) publishFramed(s);
+        else publishPerTopic(s);
+    }
+
+    void cyclePerTopic() { acquisitionCycle(false); }
+    void cycleFramed() { acquisitionCycle(true); }
+
+    struct Case {
+        const char *name;
+        void (*fn)();
+    };
+
+    const Case CASES[] = {
+        {"format.float_x6", formatFloat},
+        {"format.fixed_x6", formatFixedPoint},
+        {"publish.per_topic", publishPerTopicCase},
+        {"publish.framed", publishFramedCase},
+        {"command.dispatch", commandDispatch},
+        {"filter.protection", filterProtection},
+        {"filter.power_quality", filterPowerQuality},
+        {"filter.nilm", filterNilm},
+        {"filter.anomaly", filterAnomaly},
+        {"aggregate.add_x7", aggregateAdd},
+        {"aggregate.close_1min", aggregateClose},
+        {"cycle.per_topic", cyclePerTopic},
+        {"cycle.framed", cycleFramed}
+    };
+    const uint8_t CASE_COUNT = sizeof(CASES) / sizeof(CASES[0]);
+
+    // ════════════════════════════════════════
+    // RUNNER
+    // ════════════════════════════════════════
+    struct Result {
+        uint64_t iterations;
+        double nsPerOp;
+        double allocsPerOp;
+        double bytesPerOp;
+    };
+
+    typedef std::chrono::steady_clock Steady;
+
+    double runBatch(void (*fn)(), uint64_t n)
+    {
+        Steady::time_point start = Steady::now();
+        for (uint64_t i = 0; i < n; i++) fn();
+        return std::chrono::duration<double, std::nano>(Steady::now() - start).count();
+    }
+
+    // Grow the batch to ~1/5 of the budget, then keep the fastest of
+    // 5 batches (least disturbed by the host scheduler)
+    Result measure(void (*fn)(), uint32_t budget_ms)
+    {
+        const uint8_t ROUNDS = 5;
+        double target_ns = budget_ms * 1e6 / ROUNDS;
+        uint64_t n = 1;
+        while (n < (1ULL << 32)) {
+            double ns = runBatch(fn, n);
+            if (ns >= target_ns / 10) {
+                n = (uint64_t)(n * target_ns / ns) + 1;
+                break;
+            }
+            n *= 2;
+        }
+
+        Result r;
+        r.iterations = n;
+        r.nsPerOp = 0;
+        uint64_t allocs = Alloc::count;
+        uint64_t bytes = Alloc::bytes;
+        for (uint8_t i = 0; i < ROUNDS; i++) {
+            double ns = runBatch(fn, n) / n;
+            if (i == 0 || ns < r.nsPerOp) r.nsPerOp = ns;
+        }
+        r.allocsPerOp = (double)(Alloc::count - allocs) / (n * ROUNDS);
+        r.bytesPerOp = (double)(Alloc::bytes - bytes) / (n * ROUNDS);
+        return r;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t budget_ms = 500;
+    const char *label = "";
+    const char *path = nullptr;
+    const char *prefix = "";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) budget_ms = (uint32_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) label = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) path = argv[++i];
+        else prefix = argv[i];
+    }
+
+    FILE *out = stdout;
+    if (path && !(out = fopen(path, "w"))) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+
+    setup();
+
+    // {"suite":"telemetry","label":s,"compiler":s,"budget_ms":n,
+    //  "results":[{"name":s,"iters":n,"ns_op":x,"allocs_op":x,"bytes_op":x},...]}
+    fprintf(out, "{\"suite\":\"telemetry\",\"label\":\"%s\",\"compiler\":\"%s\",\"budget_ms\":%u,\"results\":[",
+            label, __VERSION__, (unsigned)budget_ms);
+    bool first = true;
+    for (uint8_t i = 0; i < CASE_COUNT; i++) {
+        const Case &c = CASES[i];
+        if (strncmp(c.name, prefix, strlen(prefix)) != 0) continue;
+
+        Result r = measure(c.fn, budget_ms);
+        fprintf(out, "%s\n{\"name\":\"%s\",\"iters\":%llu,\"ns_op\":%.1f,\"allocs_op\":%.3f,\"bytes_op\":%.1f}",
+                first ? "" : ",", c.name, (unsigned long long)r.iterations, r.nsPerOp, r.allocsPerOp, r.bytesPerOp);
+        fprintf(stderr, "%-22s %10.1f ns/op %8.3f allocs/op %8.1f B/op\n",
+                c.name, r.nsPerOp, r.allocsPerOp, r.bytesPerOp);
+        first = false;
+    }
+    fprintf(out, "\n]}\n");
+    if (out != stdout) fclose(out);
+    return 0;
+}
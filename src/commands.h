@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "topics.h"
+
+// ════════════════════════════════════════════════════════════════
+// MQTT COMMAND DECODING
+// Topic → command target and payload → switch action, shared by
+// mqttCallback and the host builds. Pure functions, no side effects.
+// ════════════════════════════════════════════════════════════════
+
+namespace Commands
+{
+    enum Target : uint8_t {
+        TARGET_NONE = 0,
+        TARGET_RELAY,
+        TARGET_RELAY_SCHEDULE,
+        TARGET_OUTPUTS,
+        TARGET_RULES,
+        TARGET_RAW_PUBLISH,
+        TARGET_PZEM_RESET,
+        TARGET_TRACE,
+        TARGET_PROFILE
+    };
+
+    enum Switch : uint8_t {
+        SWITCH_NONE = 0,
+        SWITCH_ON,
+        SWITCH_OFF,
+        SWITCH_TOGGLE
+    };
+
+    struct Route {
+        const char *topic;
+        uint8_t target;
+    };
+
+    // Subscribed topics, in subscribe order
+    const Route ROUTES[] = {
+        {MQTTTopics::RELAY_CONTROL, TARGET_RELAY},
+        {MQTTTopics::RELAY_SCHEDULE_SET, TARGET_RELAY_SCHEDULE},
+        {MQTTTopics::OUTPUTS_CONTROL, TARGET_OUTPUTS},
+        {MQTTTopics::RULES_SET, TARGET_RULES},
+        {MQTTTopics::AGGREGATE_RAW, TARGET_RAW_PUBLISH},
+        {MQTTTopics::PZEM_RESET, TARGET_PZEM_RESET},
+        {MQTTTopics::TRACE_SET, TARGET_TRACE},
+        {MQTTTopics::PROFILE_DUMP, TARGET_PROFILE}
+    };
+    const uint8_t ROUTE_COUNT = sizeof(ROUTES) / sizeof(ROUTES[0]);
+
+    inline uint8_t target(const char *topic)
+    {
+        for (uint8_t i = 0; i < ROUTE_COUNT; i++) {
+            if (strcmp(topic, ROUTES[i].topic) == 0) return ROUTES[i].target;
+        }
+        return TARGET_NONE;
+    }
+
+    // "ON"/"1", "OFF"/"0", "TOGGLE"
+    inline uint8_t parseSwitch(const char *payload)
+    {
+        if (strcmp(payload, "ON") == 0 || strcmp(payload, "1") == 0) return SWITCH_ON;
+        if (strcmp(payload, "OFF") == 0 || strcmp(payload, "0") == 0) return SWITCH_OFF;
+        if (strcmp(payload, "TOGGLE") == 0) return SWITCH_TOGGLE;
+        return SWITCH_NONE;
+    }
+
+    inline bool isEnergyReset(const char *payload)
+    {
+        return strcmp(payload, "RESET") == 0 || strcmp(payload, "reset") == 0 ||
+               strcmp(payload, "RESET_ENERGY") == 0;
+    }
+}
@@ -7,6 +7,8 @@
 #define SHT31_SCL 22U               // I2C SCL pin
 #define PZEM_RX 26U                 // PZEM RX (ESP32 GPIO26)
 #define PZEM_TX 27U                 // PZEM TX (ESP32 GPIO27)
+#define OUTPUT_HEATER_PIN 19U       // Sheddable load relay (Active LOW)
+#define OUTPUT_PUMP_PIN 32U         // Sheddable load relay (Active LOW)
 
 
 #define SHT31_I2C_ADDR 0x44         // SHT31 temperature/humidity sensor
@@ -16,27 +18,201 @@
 #define DHT_READ_INTERVAL 2000      // Read SHT31 every 2 seconds
 #define PZEM_READ_INTERVAL 3000     // Read PZEM every 3 seconds
 
-// LCD update intervals
+// LCD
+#define LCD_COLS 16
+#define LCD_ROWS 2
+#define LCD_I2C_CHUNK 120                    // Max expander bytes per Wire transaction (ESP32 buffer: 128)
+#define LCD_STATS_INTERVAL 60000             // Publish LCD refresh cost every 60s
 #define LCD_UPDATE_INTERVAL 500              // Refresh LCD display every 0.5s
 #define LCD_DISPLAY_CHANGE_INTERVAL 3000     // Change LCD screen every 3s
+#define LCD_MAX_PAGES 8                      // Page registry size
+#define LCD_DWELL_METER LCD_DISPLAY_CHANGE_INTERVAL      // V / I / relay
+#define LCD_DWELL_ENERGY LCD_DISPLAY_CHANGE_INTERVAL     // P / kWh
+#define LCD_DWELL_ENV LCD_DISPLAY_CHANGE_INTERVAL        // F / PF / T / H
+#define LCD_DWELL_BAR LCD_DISPLAY_CHANGE_INTERVAL        // Power bar graph
+#define LCD_DWELL_RELAY LCD_DISPLAY_CHANGE_INTERVAL      // Relay runtime
+#define LCD_DWELL_PROTECTION 2000                        // Protection state
+#define LCD_DWELL_DAILY LCD_DISPLAY_CHANGE_INTERVAL      // Today / month kWh
+#define LCD_BAR_MAX_POWER_W 2200.0f          // Full-scale power for the bar graph
+#define LCD_SPLASH_DURATION 2000             // Boot splash screen
+#define LCD_READY_DURATION 1000              // "SYSTEM READY" screen
+#define LCD_MESSAGE_DURATION 1500            // Reset / protection messages
 
 // System monitoring intervals
 #define SYSTEM_INFO_INTERVAL 5000    // Publish system info every 5s (rotated)
 #define RELAY_STATS_INTERVAL 60000   // Publish relay stats every 60s
+#define RELAY_HIST_BUCKETS 16        // ON-period log2 seconds buckets (last: >= ~4.5h)
+#define RELAY_STATS_SIZE 256         // Stats frame payload
 #define WIFI_CHECK_INTERVAL 30000    // Check WiFi connection every 30s
 
 // MQTT intervals
 #define MQTT_HEARTBEAT_INTERVAL 30000 // Send MQTT heartbeat every 30s
 #define MQTT_RECONNECT_DELAY 5000     // Delay between reconnect attempts
 
-#define MQTT_BUFFER_SIZE 1024        // MQTT packet buffer size
+#define MQTT_BUFFER_SIZE 2048        // MQTT packet buffer size
 #define MQTT_KEEPALIVE 60            // MQTT keepalive interval (seconds)
 
+// Publish-path metrics
+#define METRICS_PUBLISH_INTERVAL 60000 // Publish metrics report every 60s
+#define METRICS_MAX_TOPICS 24          // Per-topic counter slots
+#define METRICS_LATENCY_BUCKETS 24     // log2 µs buckets (last one >= ~4.2s)
+#define METRICS_TLS_STALL_US 250000    // publish() slower than this counts as a TLS write stall
+#define METRICS_REPORT_SIZE 1400       // Report payload buffer (must fit MQTT_BUFFER_SIZE)
+#define HEAP_STATS_SLOTS 16            // Allocation counter slots (loop stages + scheduler tasks)
+
+// Scheduler
+#define SCHED_MAX_TASKS 32             // Task table size
+#define SCHED_SLICE_US 50000           // Max time in scheduler.run() before servicing MQTT
+#define SCHED_REPORT_INTERVAL 60000    // Publish task statistics every 60s
+#define SCHED_REPORT_SIZE 1900         // Report payload buffer (must fit MQTT_BUFFER_SIZE)
+
+// Power management
+#define LOW_POWER_MODE 0               // 1 = modem sleep + automatic light sleep (esp_pm)
+#define POWER_CPU_FREQ_MHZ 80          // CPU clock in low power mode (esp_pm max)
+#define POWER_PM_MIN_FREQ_MHZ 40       // esp_pm min clock (XTAL) when no lock is held
+#define POWER_IDLE_DELAY_MS 10         // Max idle delay per loop() when awake
+#define POWER_MAX_SLEEP_MS 200         // Max loop() block with auto light sleep (button latency)
+#define POWER_WAKE_MARGIN_MS 3         // Wake this long before the next deadline
+#define POWER_BEACON_INTERVAL_MS 102   // AP beacon interval (100 TU)
+#define POWER_MAX_LISTEN_INTERVAL 10   // Max beacons skipped in modem sleep
+#define POWER_REPORT_INTERVAL 60000    // Publish power estimate every 60s
+// Current draw figures for the estimate (mA, ESP32 devkit incl. regulator)
+#define POWER_CURRENT_ACTIVE_MA 110.0f
+#define POWER_CURRENT_IDLE_MA 95.0f
+#define POWER_CURRENT_MODEM_SLEEP_MA 25.0f
+#define POWER_CURRENT_LIGHT_SLEEP_MA 1.5f
+
+// Health monitor
+#define HEALTH_CHECK_INTERVAL 1000     // Stall supervisor period
+#define HEALTH_STALL_TIMEOUT_MS 30000  // A loop stage stuck this long forces a restart
+#define HEALTH_TWDT_TIMEOUT_S 45       // Task watchdog backstop (> stall timeout)
+#define HEALTH_REPORT_INTERVAL 60000   // Publish stage timings every 60s
+#define HEALTH_FIRST_REPORT_DELAY 15000 // First report (and pending stall report) after boot
+#define HEALTH_REPORT_SIZE 320         // Report payload buffer
+
+// Over-current / over-power protection (acquisition task)
+#define PROTECTION_MAX_CURRENT_A 10.0f   // Trip above this current
+#define PROTECTION_MAX_POWER_W 2200.0f   // Trip above this power (also PZEM alarm threshold)
+#define PROTECTION_CONFIRM_SAMPLES 1     // Consecutive samples over limit before tripping
+#define PROTECTION_PRETRIP_SAMPLES 8     // History kept in the trip event
+#define PROTECTION_POLL_INTERVAL 200     // ms - PZEM poll period (= library 200ms cache: every poll reads)
+#define PROTECTION_TASK_PRIORITY 3       // Above loopTask (1)
+#define PROTECTION_TASK_CORE 1           // Same core as loop(): preempts it
+#define PROTECTION_TASK_STACK 4096
+#define PROTECTION_TRIP_CHECK_INTERVAL 100 // loop() picks up trips for publishing
+#define PROTECTION_REPORT_INTERVAL 60000 // Publish acquisition/latency stats every 60s
+#define PROTECTION_TRIP_SIZE 512         // Trip event payload buffer
+
+// Power-quality events (recorded on the acquisition task, 220V / 50Hz grid)
+#define PQ_SAG_V 198.0f                  // -10%
+#define PQ_SWELL_V 242.0f                // +10%
+#define PQ_INTERRUPT_V 80.0f             // PZEM measuring range starts at 80V
+#define PQ_HYSTERESIS_V 2.0f
+#define PQ_INTERRUPT_SAMPLES 3           // Meter silent this many polls after a valid reading = interruption
+#define PQ_FREQ_LOW_HZ 49.5f
+#define PQ_FREQ_HIGH_HZ 50.5f
+#define PQ_HYSTERESIS_HZ 0.05f
+#define PQ_PRETRIGGER_SAMPLES 8          // Samples kept before each event start
+#define PQ_QUEUE_SIZE 8                  // Opened / closed events waiting for loop()
+#define PQ_CHECK_INTERVAL 100            // loop() drains the event queue
+#define PQ_REPORT_INTERVAL 60000         // Per-class counters (retained)
+#define PQ_EVENT_SIZE 384                // One event payload
+
+// Time-of-use relay schedule (SNTP time, local = UTC + offset)
+#define TOU_UTC_OFFSET_MIN 420           // Vietnam, UTC+7, no DST
+#define TOU_NTP_SERVER_1 "pool.ntp.org"
+#define TOU_NTP_SERVER_2 "time.google.com"
+#define TOU_MIN_VALID_EPOCH 1704067200UL // 2024-01-01: earlier means clock not set yet
+#define TOU_MAX_RULES 16                 // Weekly ON windows
+#define TOU_MAX_EXCEPTIONS 16            // Per-date overrides
+#define TOU_CHECK_INTERVAL 1000          // Schedule tick (O(1) between transitions)
+#define TOU_TEXT_SIZE 640                // Rules as text (status payload / MQTT input)
+
+// Demand limiting across the sheddable outputs (priority 0 = never shed,
+// higher = shed first)
+#define OUTPUT_MAX 4
+#define OUTPUT_HEATER_PRIORITY 2
+#define OUTPUT_HEATER_LOAD_W 2500.0f     // Nominal, refined from measured steps
+#define OUTPUT_PUMP_PRIORITY 1
+#define OUTPUT_PUMP_LOAD_W 750.0f
+#define OUTPUT_MIN_ON_MS 60000           // Anti-chatter: min time on before shedding
+#define OUTPUT_MIN_OFF_MS 120000         // Anti-chatter: min time off before restoring
+#define DEMAND_LIMIT_W 3500.0f           // Contract demand limit
+#define DEMAND_HYSTERESIS_W 200.0f       // Restore only below limit - hysteresis
+#define DEMAND_SAMPLE_INTERVAL 1000      // One power sample per second into the window
+#define DEMAND_WINDOW_SAMPLES 60         // Rolling demand window (60s)
+#define DEMAND_SETTLE_MS 5000            // Min time between shed/restore actions
+#define DEMAND_REPORT_INTERVAL 60000     // Publish output/demand status every 60s
+
+// Relay persistence (NVS)
+#define RELAY_RESTORE_POLICY 1           // 0 = OFF at boot, 1 = last saved state, 2 = ON
+#define RELAY_PERSIST_COALESCE_MS 5000   // Save a state change once it held this long
+#define RELAY_PERSIST_CHECKPOINT_MS 900000 // Save counters every 15 min (<= 96 writes/day)
+#define RELAY_PERSIST_SERVICE_INTERVAL 1000
+
+// Automation rules (bytecode engine)
+#define RULES_MAX 8                      // Rules in one set
+#define RULES_MAX_CODE 48                // Bytecode bytes per rule (bounds evaluation time)
+#define RULES_MAX_STACK 8                // Evaluation stack depth
+#define RULES_MAX_NESTING 8              // Nested '(' / unary operators (compiler recursion)
+#define RULES_TEXT_SIZE 768              // Rule source kept in NVS
+#define RULES_STATUS_SIZE 640            // Status payload buffer
+#define RULES_EVAL_INTERVAL PROTECTION_POLL_INTERVAL // Check for a new sample
+#define RULES_REPORT_INTERVAL 60000      // Publish per-rule cost every 60s
+
+// Windowed aggregates (count/mean/min/max/stddev per metric)
+#define AGG_SHORT_WINDOW_MS 60000        // home/aggregate/1m
+#define AGG_LONG_WINDOW_MS 900000        // home/aggregate/15m
+#define AGG_SAMPLE_INTERVAL PROTECTION_POLL_INTERVAL // Feed each acquisition sample
+#define AGG_RAW_PUBLISH 1                // 0 = aggregates only (constrained links)
+#define AGG_FRAME_SIZE 512               // One window frame
+
+// Tiered tariff (EVN residential, VND/kWh before VAT; tiers are monthly,
+// upper bound 0 = last tier)
+#define TARIFF_TIERS {{50, 1806}, {100, 1866}, {200, 2167}, {300, 2729}, {400, 3050}, {0, 3151}}
+#define TARIFF_VAT_PERCENT 8.0f
+#define TARIFF_UPDATE_INTERVAL 10000     // Fold the energy register into the buckets
+#define TARIFF_PUBLISH_INTERVAL 60000    // Running day / month summaries (retained)
+#define TARIFF_SAVE_INTERVAL 600000      // NVS checkpoint (plus every rollover)
+
+// NILM-lite appliance detection (steady-state P / PF step changes)
+#define NILM_MAX_SIGNATURES 8            // Learned appliance table size
+#define NILM_NOISE_W 15.0f               // Sample-to-sample band counted as steady
+#define NILM_MIN_STEP_W 60.0f            // Smaller level changes are ignored
+#define NILM_MATCH_RATIO 0.15f           // Match tolerance, fraction of the step
+#define NILM_MATCH_MIN_W 30.0f           // Minimum match tolerance (W / var)
+#define NILM_STABLE_SAMPLES 4            // Samples for a new steady level (4 x 200ms)
+#define NILM_SAMPLE_INTERVAL PROTECTION_POLL_INTERVAL // Feed each acquisition sample
+#define NILM_REPORT_INTERVAL 300000      // Signature table publish (retained)
+#define NILM_SAVE_INTERVAL 1800000       // NVS checkpoint of the learned table
+#define NILM_TABLE_SIZE 512              // Signature table payload
+
+// Anomaly detection (EWMA baseline per hour of day, fed with 1 min means)
+#define ANOMALY_ALPHA 0.02f              // EWMA weight (~50 samples of memory per hour slot)
+#define ANOMALY_THRESHOLD 4.5f           // z score that starts an anomaly
+#define ANOMALY_CLEAR_RATIO 0.6f         // Ends when z < threshold * ratio
+#define ANOMALY_WARMUP 120               // Samples per hour slot before scoring (~2 days)
+#define ANOMALY_MIN_SD_POWER 20.0f       // Baseline sd floor (W)
+#define ANOMALY_MIN_SD_TEMP 0.3f         // Baseline sd floor (°C)
+#define ANOMALY_SAVE_INTERVAL 3600000    // NVS checkpoint of the model
+
+// Trace recording for host replay (home/trace/set: SERIAL | FLASH | OFF | DUMP | CLEAR)
+#define TRACE_BUFFER_SIZE 4096           // RAM buffer between flushes (~15s of samples worst case)
+#define TRACE_FLUSH_INTERVAL 500         // Drain to serial / flash
+#define TRACE_LINE_BYTES 48              // Bytes per "TRC <hex>" serial line
+#define TRACE_DUMP_BYTES 768             // Flash dump per flush, keeps loop() responsive
+#define TRACE_FLASH_PATH "/trace.bin"    // LittleFS on the spiffs partition
+#define TRACE_FLASH_MAX 1000000          // Recording stops when the file reaches this size
+
+// Profiling probes (-DPROFILE, see profile.h)
+#define PROFILE_REPORT_SIZE 320          // home/profile/report payload
+
 #define BUTTON_DEBOUNCE_DELAY 50     // Button debounce time (ms)
 
 
 #define LED_BLINK_TOTAL 6            // Total blinks for reset indicator
 #define LED_BLINK_INTERVAL 300       // Blink interval (ms)
+#define PZEM_RESET_MAX_LATENCY 50    // Reset should start within 50ms of the command
 
 #define TEMP_THRESHOLD              35.0f    // °C - Ngưỡng nhiệt độ tự động tắt relay
 #define TEMP_HYSTERESIS            2.0f     // °C - Độ trễ bật lại (bật khi T < threshold - hysteresis)
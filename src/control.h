@@ -0,0 +1,495 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include "config.h"
+#include "topics.h"
+#include "hal.h"
+#include "protection.h"
+#include "metrics.h"
+#include "commands.h"
+#include "temp_guard.h"
+#include "tou_schedule.h"
+#include "demand.h"
+#include "rules.h"
+#include "relay_stats.h"
+#include "trace.h"
+
+// ════════════════════════════════════════════════════════════════
+// LOOP-SIDE CONTROL
+// Everything loop() switches: the main relay (MQTT commands, the
+// over-temperature guard, TOU schedule edges, automation rules, boot
+// restore, state sync after a protection trip) and the sheddable
+// outputs of the demand controller. Owns the relay state, lifetime
+// on/off counters and cycle stats; status / events go out through
+// the HAL transport. main.cpp and the host sim run this same code.
+//
+// The current / power trip itself is cut by the acquisition task;
+// its latch, the energy counter, trace recording and logging come in
+// through Hooks. NVS persistence stays with the caller (hooks.persist
+// for the protective OFFs that must not wait for coalescing).
+// ════════════════════════════════════════════════════════════════
+
+namespace Control
+{
+    typedef Tou::Schedule<TOU_MAX_RULES, TOU_MAX_EXCEPTIONS> Schedule;
+    typedef Demand::Manager<OUTPUT_MAX, DEMAND_WINDOW_SAMPLES> LoadManager;
+    typedef Rules::Engine<RULES_MAX, RULES_MAX_CODE, RULES_MAX_STACK, RULES_MAX_NESTING> RuleEngine;
+    typedef Protection::TripRecord<PROTECTION_PRETRIP_SAMPLES> TripRecord;
+
+    struct Hooks {
+        bool (*tripped)();              // Latched current / power trip
+        void (*clearTrip)();            // Explicit ON command releases it
+        float (*energy)();              // Meter kWh for the cycle Wh (NAN if unknown)
+        void (*trace)(uint8_t type, uint8_t id, const char *payload, float a, float b);
+        void (*log)(const char *line);  // Serial on the device
+        void (*persist)();              // Save the relay state now (trip / over-temp OFF)
+    };
+
+    Hal::Gpio *gpio = nullptr;
+    Hal::Transport *transport = nullptr;
+    uint8_t relayPin = 0;
+    Hooks hooks = {};
+
+    // Relay (active LOW)
+    bool relayState = false;
+    uint32_t revision = 0;              // Bumped on every relay write (LCD pages)
+    TempGuard::State tempGuard;         // Over-temperature trip / auto recovery
+
+    uint64_t onTimeMs = 0;              // Lifetime, restored from NVS by the caller
+    uint64_t offTimeMs = 0;
+    uint32_t switches = 0;
+    uint32_t lastChangeMs = 0;
+    bool lastState = false;
+    RelayStats::Tracker<RELAY_HIST_BUCKETS> cycles;   // Duty / ON-period histogram / Wh
+
+    // Time-of-use relay schedule
+    Schedule schedule(TOU_UTC_OFFSET_MIN);
+    bool scheduleStatusPending = true;  // Publish once MQTT is up
+
+    // Sheddable load relays + demand controller
+    void applyOutput(const Demand::Output &output, bool on)
+    {
+        gpio->write(output.cfg.pin, !on);   // Active LOW
+    }
+    LoadManager loads(DEMAND_LIMIT_W, DEMAND_HYSTERESIS_W, DEMAND_SAMPLE_INTERVAL, DEMAND_SETTLE_MS, applyOutput);
+    bool outputsStatusPending = true;
+
+    // Automation rules
+    uint32_t rulesClock() { return Hal::micros(); }
+    RuleEngine rules(rulesClock);
+    float ruleVars[Rules::VAR_COUNT];   // Inputs of the running evaluation
+    uint32_t rulesLastSampleMs = 0;
+    bool rulesStatusPending = true;
+
+    void log(const char *fmt, ...)
+    {
+        if (hooks.log == nullptr) return;
+        char line[192];
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(line, sizeof(line), fmt, args);
+        va_end(args);
+        hooks.log(line);
+    }
+
+    inline bool tripped() { return hooks.tripped && hooks.tripped(); }
+
+    inline bool connected() { return transport && transport->connected(); }
+
+    void begin(Hal::Gpio &g, Hal::Transport &t, uint8_t pin, const Hooks &h)
+    {
+        gpio = &g;
+        transport = &t;
+        relayPin = pin;
+        hooks = h;
+
+        gpio->mode(relayPin, Hal::Gpio::MODE_OUTPUT);
+        gpio->write(relayPin, true);    // Active LOW - OFF
+        relayState = false;
+        lastState = false;
+        lastChangeMs = Hal::millis();
+        cycles.accumulate(lastChangeMs, false);
+    }
+
+    // Lifetime counters from NVS
+    void restoreCounters(uint64_t on_ms, uint64_t off_ms, uint32_t count)
+    {
+        onTimeMs = on_ms;
+        offTimeMs = off_ms;
+        switches = count;
+    }
+
+    // ════════════════════════════════════════
+    // RELAY
+    // ════════════════════════════════════════
+
+    // Close the running ON / OFF period
+    void accumulate()
+    {
+        uint32_t now = Hal::millis();
+        uint32_t duration = now - lastChangeMs;
+        if (lastState) {
+            onTimeMs += duration;
+        } else {
+            offTimeMs += duration;
+        }
+        cycles.accumulate(now, lastState);
+        lastChangeMs = now;
+    }
+
+    // Call after every relayState assignment (counts real switches)
+    void commit()
+    {
+        if (relayState != lastState) {
+            switches++;
+            cycles.transition(relayState, Hal::millis(), hooks.energy ? hooks.energy() : NAN);
+        }
+        lastState = relayState;
+        revision++;
+    }
+
+    uint32_t inStateMs() { return Hal::millis() - lastChangeMs; }
+    uint64_t onTotalMs() { return onTimeMs + (lastState ? inStateMs() : 0); }
+    uint64_t offTotalMs() { return offTimeMs + (lastState ? 0 : inStateMs()); }
+
+    void publishState(const char *event)
+    {
+        Metrics::publish(*transport, MQTTTopics::RELAY_STATUS, relayState ? "ON" : "OFF", true);
+        Metrics::publish(*transport, MQTTTopics::RELAY_EVENT, event, false);
+    }
+
+    // Switch the relay (source: nullptr = user command, else e.g. "SCHEDULE")
+    void set(bool on, const char *source = nullptr)
+    {
+        // Schedule / rule decisions go into the trace as "ON:SCHEDULE" etc.
+        if (source && hooks.trace) {
+            char command[24];
+            snprintf(command, sizeof(command), "%s:%s", on ? "ON" : "OFF", source);
+            hooks.trace(Trace::TYPE_COMMAND, Commands::TARGET_RELAY, command, NAN, NAN);
+        }
+
+        accumulate();
+
+        // Explicit ON command releases a latched protection trip
+        if (on && source == nullptr && hooks.clearTrip) {
+            hooks.clearTrip();
+        }
+
+        relayState = on;
+        gpio->write(relayPin, !on);     // Active LOW
+
+        char event[32];
+        snprintf(event, sizeof(event), "%s%s%s", on ? "ON" : "OFF", source ? ":" : "", source ? source : "");
+        publishState(event);
+        commit();
+
+        if (!on) {
+            tempGuard.clear();
+        }
+        log("Relay: %s%s%s", on ? "ON" : "OFF", source ? " by " : "", source ? source : "");
+    }
+
+    void toggle()
+    {
+        set(!relayState);
+    }
+
+    // Schedule / rule switch: ON is skipped while a current / power or
+    // over-temperature trip is latched
+    bool autoSwitch(bool on, const char *source)
+    {
+        if (on && (tripped() || tempGuard.offByOverTemp)) {
+            log("%s ON skipped: protection tripped", source);
+            return false;
+        }
+        if (on != relayState) {
+            set(on, source);
+        }
+        return true;
+    }
+
+    // Relay was already cut by the acquisition task; sync state, publish
+    // the new state and the trip record (retained). The pin is driven
+    // OFF again: a user ON handled between the cut and this call (up to
+    // PROTECTION_TRIP_CHECK_INTERVAL) cleared the latch and drove it back ON.
+    void tripOff(const TripRecord &trip)
+    {
+        accumulate();
+        relayState = false;
+        gpio->write(relayPin, true);    // Active LOW - OFF
+        commit();
+        if (hooks.persist) hooks.persist();
+
+        // Manual ON required: don't let temperature recovery switch it back
+        tempGuard.clear();
+
+        char event[32];
+        snprintf(event, sizeof(event), "OFF:%s", Protection::reasonName(trip.reason));
+        publishState(event);
+
+        static char payload[PROTECTION_TRIP_SIZE];
+        Protection::formatTrip(trip, payload, sizeof(payload));
+        bool ok = Metrics::publish(*transport, MQTTTopics::PROTECTION_TRIP, payload, true);
+        log("%s Trip: %s", ok ? "✅" : "❌", payload);
+    }
+
+    // Over-temperature guard, every TEMP_CHECK_INTERVAL; returns the
+    // TempGuard action applied (the caller shows it)
+    uint8_t checkTemperature(float temperature)
+    {
+        if (hooks.trace) {
+            hooks.trace(Trace::TYPE_CHECK, Trace::CHECK_TEMPERATURE, nullptr, NAN, NAN);
+        }
+        uint8_t action = TempGuard::evaluate(tempGuard, temperature, relayState, tripped(),
+                                             TEMP_THRESHOLD, TEMP_HYSTERESIS);
+        if (action == TempGuard::ACTION_NONE) {
+            return action;
+        }
+
+        bool on = action == TempGuard::ACTION_RECOVER;
+        accumulate();
+        relayState = on;
+        gpio->write(relayPin, !on);
+        publishState(on ? "ON:TEMP_RECOVERED" : "OFF:OVER_TEMP");
+        commit();
+        if (!on && hooks.persist) hooks.persist();
+        return action;
+    }
+
+    // {"on_s":..,"off_s":..,"sw":..,...} (see RelayStats::Tracker::formatFrame)
+    size_t formatStats(char *buf, size_t size)
+    {
+        accumulate();
+        return cycles.formatFrame(buf, size, onTimeMs, offTimeMs, switches);
+    }
+
+    // ════════════════════════════════════════
+    // TIME-OF-USE SCHEDULE
+    // ════════════════════════════════════════
+
+    // Rules from home/relay/schedule/set (see Tou::Schedule::parse)
+    bool setSchedule(const char *text)
+    {
+        if (!schedule.parse(text)) {
+            log("Schedule rejected: %s", text);
+            Metrics::publish(*transport, MQTTTopics::RELAY_EVENT, "SCHEDULE:INVALID", false);
+            return false;
+        }
+        log("Schedule: %u rules, %u exceptions", schedule.ruleCount(), schedule.exceptionCount());
+        scheduleStatusPending = true;
+        return true;
+    }
+
+    // {"sync":0|1,"on":0|1,"next":utc,"n":scans,"rules":"MTWTF--/22:00-06:00;..."}
+    void publishSchedule(uint32_t utc)
+    {
+        if (!connected()) {
+            return;
+        }
+
+        static char rules[TOU_TEXT_SIZE];
+        static char payload[TOU_TEXT_SIZE + 96];
+        schedule.format(rules, sizeof(rules));
+        snprintf(payload, sizeof(payload), "{\"sync\":%d,\"on\":%d,\"next\":%u,\"n\":%u,\"rules\":\"%s\"}",
+                 utc >= TOU_MIN_VALID_EPOCH ? 1 : 0, schedule.state() ? 1 : 0,
+                 (unsigned)schedule.nextTransitionUtc(), (unsigned)schedule.evaluations(), rules);
+
+        if (Metrics::publish(*transport, MQTTTopics::RELAY_SCHEDULE, payload, true)) {
+            scheduleStatusPending = false;
+        }
+        log("Schedule: %s", payload);
+    }
+
+    // Runs offline too once the clock is set (utc = 0 before SNTP sync)
+    void scheduleTask(uint32_t utc)
+    {
+        if (utc < TOU_MIN_VALID_EPOCH) {
+            return;
+        }
+
+        uint8_t edge = schedule.update(utc);
+        if (edge != Tou::EDGE_NONE) {
+            autoSwitch(edge == Tou::EDGE_ON, "SCHEDULE");
+            scheduleStatusPending = true;
+        }
+
+        if (scheduleStatusPending) {
+            publishSchedule(utc);
+        }
+    }
+
+    // ════════════════════════════════════════
+    // LOAD OUTPUTS / DEMAND LIMITING
+    // ════════════════════════════════════════
+    void addOutput(const Demand::OutputConfig &cfg)
+    {
+        gpio->mode(cfg.pin, Hal::Gpio::MODE_OUTPUT);
+        gpio->write(cfg.pin, true);     // Active LOW - OFF
+        loads.add(cfg);
+        log("Output '%s': GPIO%d, priority %d, ~%.0fW", cfg.name, cfg.pin, cfg.priority, cfg.loadW);
+    }
+
+    // "heater:ON" / "pump:OFF" from home/outputs/control
+    void controlOutput(const char *command)
+    {
+        const char *sep = strchr(command, ':');
+        if (sep == nullptr || sep - command >= 16) {
+            return;
+        }
+
+        char name[16];
+        memcpy(name, command, sep - command);
+        name[sep - command] = '\0';
+
+        int8_t index = loads.find(name);
+        if (index < 0) {
+            log("Unknown output: %s", name);
+            return;
+        }
+
+        bool on = strcmp(sep + 1, "ON") == 0 || strcmp(sep + 1, "1") == 0;
+        loads.request(index, on, Hal::millis());
+
+        const Demand::Output &o = loads.output(index);
+        log("Output %s: %s%s", name, on ? "ON" : "OFF", o.shed ? " (shed, waiting)" : "");
+        outputsStatusPending = true;
+    }
+
+    void publishOutputsStatus()
+    {
+        if (!connected()) {
+            return;
+        }
+
+        char payload[256];
+        loads.formatStatus(payload, sizeof(payload), Hal::millis());
+        if (Metrics::publish(*transport, MQTTTopics::OUTPUTS_STATUS, payload, true)) {
+            outputsStatusPending = false;
+        }
+    }
+
+    // One power sample per DEMAND_SAMPLE_INTERVAL into the rolling window; shed/restore
+    void demandTask(float power)
+    {
+        Demand::Event ev;
+        if (loads.tick(Hal::millis(), power, ev)) {
+            const Demand::Output &o = loads.output(ev.output);
+            char payload[128];
+            snprintf(payload, sizeof(payload),
+                     "{\"act\":\"%s\",\"out\":\"%s\",\"prio\":%d,\"demand\":%.0f,\"load\":%.0f,\"limit\":%.0f}",
+                     Demand::actionName(ev.action), o.cfg.name, o.cfg.priority,
+                     ev.demandW, ev.loadW, loads.limitW());
+            log("Demand %s: %s", Demand::actionName(ev.action), payload);
+            Metrics::publish(*transport, MQTTTopics::OUTPUTS_EVENT, payload, false);
+            outputsStatusPending = true;
+        }
+
+        if (outputsStatusPending) {
+            publishOutputsStatus();
+        }
+    }
+
+    // ════════════════════════════════════════
+    // AUTOMATION RULES
+    // ════════════════════════════════════════
+
+    // Compiled before it replaces the running set
+    bool loadRules(const char *text)
+    {
+        rulesStatusPending = true;
+        if (!rules.load(text)) {
+            log("Rules rejected: %s", rules.error());
+            return false;
+        }
+        log("Rules: %u active", rules.count());
+        return true;
+    }
+
+    void onRuleFired(uint8_t rule, uint8_t action)
+    {
+        const char *name = rules.rule(rule).name;
+        log("Rule '%s' fired: %s", name, Rules::ACTION_NAMES[action]);
+
+        if (action == Rules::ACTION_RELAY_OFF) {
+            autoSwitch(false, "RULE");
+        } else if (action == Rules::ACTION_RELAY_ON) {
+            autoSwitch(true, "RULE");
+        }
+
+        char payload[160];
+        snprintf(payload, sizeof(payload),
+                 "{\"rule\":\"%s\",\"act\":\"%s\",\"p\":%.1f,\"i\":%.3f,\"temp\":%.1f,\"hum\":%.1f}",
+                 name, Rules::ACTION_NAMES[action], ruleVars[Rules::VAR_POWER], ruleVars[Rules::VAR_CURRENT],
+                 ruleVars[Rules::VAR_TEMPERATURE], ruleVars[Rules::VAR_HUMIDITY]);
+        Metrics::publish(*transport, MQTTTopics::RULES_EVENT, payload, false);
+    }
+
+    // {"n":..,"err":..,"r":[[name,action,bytes,evals,fires,avg_us,max_us],...]} (retained)
+    void publishRulesStatus()
+    {
+        if (!connected()) {
+            return;
+        }
+
+        static char payload[RULES_STATUS_SIZE];
+        rules.formatStatus(payload, sizeof(payload));
+        if (Metrics::publish(*transport, MQTTTopics::RULES_STATUS, payload, true)) {
+            rulesStatusPending = false;
+        }
+        log("Rules: %s", payload);
+    }
+
+    // Evaluate once per new acquisition sample
+    void rulesTask(const PowerSample &sample, float temperature, float humidity)
+    {
+        if (rulesStatusPending) {
+            publishRulesStatus();
+        }
+
+        if (rules.count() == 0 || sample.ms == rulesLastSampleMs) {
+            return;
+        }
+        rulesLastSampleMs = sample.ms;
+
+        ruleVars[Rules::VAR_VOLTAGE] = sample.voltage;
+        ruleVars[Rules::VAR_CURRENT] = sample.current;
+        ruleVars[Rules::VAR_POWER] = sample.power;
+        ruleVars[Rules::VAR_ENERGY] = sample.energy;
+        ruleVars[Rules::VAR_FREQUENCY] = sample.frequency;
+        ruleVars[Rules::VAR_PF] = sample.pf;
+        ruleVars[Rules::VAR_TEMPERATURE] = temperature;
+        ruleVars[Rules::VAR_HUMIDITY] = humidity;
+        ruleVars[Rules::VAR_RELAY] = relayState ? 1.0f : 0.0f;
+
+        rules.evaluate(ruleVars, Hal::millis(), onRuleFired);
+    }
+
+    // ════════════════════════════════════════
+    // COMMANDS
+    // ════════════════════════════════════════
+
+    // mqttCallback(): relay and output commands are applied here; the
+    // target is returned so the caller handles the rest (schedule and
+    // rules persist to NVS, raw publish, PZEM reset, trace, profile)
+    uint8_t handleMessage(const char *topic, const char *payload)
+    {
+        uint8_t target = Commands::target(topic);
+        if (target != Commands::TARGET_TRACE && target != Commands::TARGET_PROFILE && hooks.trace) {
+            hooks.trace(Trace::TYPE_COMMAND, target, payload, NAN, NAN);
+        }
+
+        if (target == Commands::TARGET_RELAY) {
+            switch (Commands::parseSwitch(payload)) {
+            case Commands::SWITCH_ON: set(true); break;
+            case Commands::SWITCH_OFF: set(false); break;
+            case Commands::SWITCH_TOGGLE: toggle(); break;
+            }
+        } else if (target == Commands::TARGET_OUTPUTS) {
+            controlOutput(payload);
+        }
+        return target;
+    }
+}
@@ -0,0 +1,240 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+// ════════════════════════════════════════════════════════════════
+// DEMAND LIMITING / LOAD SHEDDING
+// Outputs (extra relays) carry a priority: 0 = never shed, higher
+// numbers are shed first and restored last. Demand is the rolling
+// average of the power samples fed to tick(). Because that average
+// lags, decisions use a projection: each recent switch's load is
+// removed from / added to the part of the window recorded before it.
+// Minimum on/off times and a settle delay between actions prevent
+// relay chatter. Pure logic (caller passes time, power and a pin
+// write hook), so load traces can be replayed on the host.
+// ════════════════════════════════════════════════════════════════
+
+namespace Demand
+{
+    enum Action : uint8_t {
+        ACTION_NONE = 0,
+        ACTION_SHED,
+        ACTION_RESTORE
+    };
+
+    inline const char *actionName(uint8_t action)
+    {
+        switch (action) {
+            case ACTION_SHED: return "shed";
+            case ACTION_RESTORE: return "restore";
+            default: return "none";
+        }
+    }
+
+    struct OutputConfig {
+        const char *name;
+        uint8_t pin;
+        uint8_t priority;           // 0 = critical (never shed)
+        float loadW;                // Nominal load, refined from measured steps
+        uint32_t minOnMs;
+        uint32_t minOffMs;
+    };
+
+    struct Output {
+        OutputConfig cfg;
+        bool wanted = false;        // Requested by the user / schedule
+        bool on = false;            // Actual relay state
+        bool shed = false;          // Held off by the demand controller
+        uint32_t changedMs = 0;
+        float stepFromW = NAN;      // Power before the last switch (load learning)
+        uint32_t sheds = 0;
+    };
+
+    struct Event {
+        uint8_t action = ACTION_NONE;
+        uint8_t output = 0;
+        float demandW = 0.0f;       // Projected demand when deciding
+        float loadW = 0.0f;
+    };
+
+    typedef void (*ApplyFn)(const Output &output, bool on);
+
+    template <uint8_t MAX_OUTPUTS, uint16_t WINDOW>
+    class Manager
+    {
+    public:
+        Manager(float limit_w, float hysteresis_w, uint32_t sample_ms, uint32_t settle_ms, ApplyFn apply)
+            : limitW_(limit_w), hysteresisW_(hysteresis_w), sampleMs_(sample_ms),
+              settleMs_(settle_ms), apply_(apply) {}
+
+        int8_t add(const OutputConfig &cfg)
+        {
+            if (count_ >= MAX_OUTPUTS) return -1;
+            outputs_[count_].cfg = cfg;
+            return count_++;
+        }
+
+        // User / schedule request. OFF is immediate; ON is immediate
+        // unless the output is currently shed (then it waits for restore).
+        void request(uint8_t i, bool on, uint32_t now_ms)
+        {
+            if (i >= count_) return;
+            Output &o = outputs_[i];
+            o.wanted = on;
+            if (!on) o.shed = false;
+            if (on != o.on && !o.shed) set(o, on, now_ms);
+        }
+
+        // One power sample per call (every sample_ms). Returns true with
+        // ev filled when an output was shed or restored.
+        bool tick(uint32_t now_ms, float power_w, Event &ev)
+        {
+            if (!isnan(power_w)) push(power_w);
+            learn(now_ms, power_w);
+
+            if (filled_ == 0 || (acted_ && now_ms - lastActionMs_ < settleMs_)) return false;
+
+            float projected = projectedW(now_ms);
+            int8_t pick = -1;
+
+            if (projected > limitW_) {
+                // Least important first; among equals the most recently switched on
+                for (uint8_t i = 0; i < count_; i++) {
+                    const Output &o = outputs_[i];
+                    if (!o.on || o.cfg.priority == 0 || now_ms - o.changedMs < o.cfg.minOnMs) continue;
+                    if (pick < 0 || o.cfg.priority > outputs_[pick].cfg.priority ||
+                        (o.cfg.priority == outputs_[pick].cfg.priority &&
+                         (int32_t)(o.changedMs - outputs_[pick].changedMs) > 0)) {
+                        pick = i;
+                    }
+                }
+                if (pick < 0) return false;
+                Output &o = outputs_[pick];
+                o.shed = true;
+                o.sheds++;
+                set(o, false, now_ms);
+                ev.action = ACTION_SHED;
+            } else {
+                // Most important shed output that fits under the limit
+                for (uint8_t i = 0; i < count_; i++) {
+                    const Output &o = outputs_[i];
+                    if (!o.shed || !o.wanted || now_ms - o.changedMs < o.cfg.minOffMs) continue;
+                    if (projected + o.cfg.loadW > limitW_ - hysteresisW_) continue;
+                    if (pick < 0 || o.cfg.priority < outputs_[pick].cfg.priority) pick = i;
+                }
+                if (pick < 0) return false;
+                Output &o = outputs_[pick];
+                o.shed = false;
+                set(o, true, now_ms);
+                ev.action = ACTION_RESTORE;
+            }
+
+            ev.output = pick;
+            ev.demandW = projected;
+            ev.loadW = outputs_[pick].cfg.loadW;
+            acted_ = true;
+            lastActionMs_ = now_ms;
+            return true;
+        }
+
+        // Rolling average of the samples in the window
+        float demandW() const { return filled_ ? (float)(sum_ / filled_) : 0.0f; }
+
+        // Window average once the recent switches have fully rolled in
+        float projectedW(uint32_t now_ms) const
+        {
+            float demand = demandW();
+            uint32_t window_ms = (uint32_t)filled_ * sampleMs_;
+            if (window_ms == 0) return demand;
+            for (uint8_t i = 0; i < count_; i++) {
+                const Output &o = outputs_[i];
+                uint32_t age = now_ms - o.changedMs;
+                if (o.changedMs == 0 || age >= window_ms) continue;
+                float share = o.cfg.loadW * (float)(window_ms - age) / (float)window_ms;
+                demand += o.on ? share : -share;
+            }
+            return demand;
+        }
+
+        uint8_t count() const { return count_; }
+        const Output &output(uint8_t i) const { return outputs_[i]; }
+        float limitW() const { return limitW_; }
+
+        int8_t find(const char *name) const
+        {
+            for (uint8_t i = 0; i < count_; i++) {
+                const char *a = outputs_[i].cfg.name;
+                const char *b = name;
+                while (*a && *a == *b) { a++; b++; }
+                if (*a == '\0' && *b == '\0') return i;
+            }
+            return -1;
+        }
+
+        // {"limit":W,"demand":W,"proj":W,"o":[[name,wanted,on,shed,load_w,sheds],...]}
+        size_t formatStatus(char *buf, size_t size, uint32_t now_ms) const
+        {
+            int len = snprintf(buf, size, "{\"limit\":%.0f,\"demand\":%.1f,\"proj\":%.1f,\"o\":[",
+                               limitW_, demandW(), projectedW(now_ms));
+            for (uint8_t i = 0; i < count_ && len > 0 && (size_t)len < size; i++) {
+                const Output &o = outputs_[i];
+                len += snprintf(buf + len, size - len, "%s[\"%s\",%d,%d,%d,%.0f,%u]",
+                                i ? "," : "", o.cfg.name, o.wanted, o.on, o.shed,
+                                o.cfg.loadW, (unsigned)o.sheds);
+            }
+            if (len > 0 && (size_t)len + 3 <= size) {
+                len += snprintf(buf + len, size - len, "]}");
+            }
+            return len > 0 ? (size_t)len : 0;
+        }
+
+    private:
+        float limitW_;
+        float hysteresisW_;
+        uint32_t sampleMs_;
+        uint32_t settleMs_;
+        ApplyFn apply_;
+
+        Output outputs_[MAX_OUTPUTS];
+        uint8_t count_ = 0;
+
+        float window_[WINDOW];
+        uint16_t head_ = 0;
+        uint16_t filled_ = 0;
+        double sum_ = 0.0;
+
+        bool acted_ = false;
+        uint32_t lastActionMs_ = 0;
+
+        void push(float w)
+        {
+            if (filled_ == WINDOW) sum_ -= window_[head_];
+            else filled_++;
+            window_[head_] = w;
+            sum_ += w;
+            head_ = (head_ + 1) % WINDOW;
+        }
+
+        void set(Output &o, bool on, uint32_t now_ms)
+        {
+            o.on = on;
+            o.changedMs = now_ms ? now_ms : 1;      // 0 = never switched
+            o.stepFromW = filled_ ? window_[(head_ + WINDOW - 1) % WINDOW] : NAN;
+            if (apply_) apply_(o, on);
+        }
+
+        // Once settled, the power step across a switch is that output's load
+        void learn(uint32_t now_ms, float power_w)
+        {
+            if (isnan(power_w)) return;
+            for (uint8_t i = 0; i < count_; i++) {
+                Output &o = outputs_[i];
+                if (isnan(o.stepFromW) || now_ms - o.changedMs < settleMs_) continue;
+                float step = o.on ? power_w - o.stepFromW : o.stepFromW - power_w;
+                if (step > 0.0f) o.cfg.loadW = 0.5f * o.cfg.loadW + 0.5f * step;
+                o.stepFromW = NAN;
+            }
+        }
+    };
+}
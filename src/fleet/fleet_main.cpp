@@ -0,0 +1,587 @@
+// ════════════════════════════════════════════════════════════════
+// FLEET LOAD GENERATOR (env:native_fleet)
+// Emulates N devices against a real broker (local mosquitto), each on
+// its own MQTT connection with the firmware's topics, LWT, heartbeat,
+// raw PZEM / SHT31 publishing and relay command handling. Readings
+// come from the simulated devices of hal_sim.h on the host clock.
+// Device k publishes under "<prefix><k>/home/..."; with -D device 0
+// uses the bare "home/..." topics so the Node-RED flow shows it live.
+//
+// A monitor connection subscribes to the fleet and measures:
+// - telemetry latency (device publish → monitor delivery)
+// - command round trip (relay/control → relay/status)
+// - LWT delivery after abrupt disconnects (-k)
+// and reports message rates and latency percentiles, JSON at the end.
+//
+//   fleet_main [-h host] [-p port] [-u user -P pass] [-n devices]
+//              [-d seconds] [-s speedup] [-c commands/s] [-k kills/min]
+//              [-r connects/s] [-x prefix] [-D] [-o file]
+// ════════════════════════════════════════════════════════════════
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+
+#include "../config.h"
+#include "../topics.h"
+#include "../commands.h"
+#include "../histogram.h"
+#include "../hal_sim.h"
+#include "../hal_posix.h"
+#include "../metrics.h"
+
+namespace
+{
+    struct Options {
+        const char *host = "127.0.0.1";
+        uint16_t port = 1883;
+        const char *username = nullptr;
+        const char *password = nullptr;
+        uint32_t devices = 100;
+        uint32_t durationS = 60;
+        float speedup = 1.0f;           // Divides the firmware publish intervals
+        float commandsPerS = 2.0f;
+        float killsPerMin = 0.0f;
+        uint32_t connectsPerS = 200;
+        const char *prefix = "fleet/";
+        bool dashboard = false;
+        const char *output = nullptr;
+    } opt;
+
+    const uint32_t RECONNECT_DELAY_MS = 5000;
+    const uint32_t COMMAND_TIMEOUT_MS = 5000;
+    const uint32_t REPORT_INTERVAL_MS = 5000;
+    const uint8_t LATENCY_BUCKETS = 28;             // µs, up to ~67 s
+
+    Hal::PosixClock hostClock;
+    Hal::SimRandom rng(12345);
+    volatile sig_atomic_t stopRequested = 0;
+
+    struct Stats {
+        LogHistogram<LATENCY_BUCKETS> telemetryUs;
+        LogHistogram<LATENCY_BUCKETS> commandUs;
+        LogHistogram<LATENCY_BUCKETS> lwtUs;
+        uint32_t commandsSent = 0;
+        uint32_t commandsAcked = 0;
+        uint32_t commandsLost = 0;
+        uint32_t kills = 0;
+        uint32_t connects = 0;
+        uint32_t connectFailures = 0;
+        uint32_t monitorReceived = 0;
+    } stats;
+
+    // ════════════════════════════════════════
+    // DEVICE
+    // ════════════════════════════════════════
+
+    // Prepends the device prefix; the firmware code publishes with the
+    // MQTTTopics constants (so Metrics keys its table on them)
+    class SiteTransport : public Hal::Transport
+    {
+    public:
+        SiteTransport(Hal::MqttSocket &socket, const char *prefix) : socket_(socket), prefix_(prefix) {}
+
+        bool connected() override { return socket_.connected(); }
+        bool publish(const char *topic, const char *payload, bool retained) override
+        {
+            char full[Hal::MqttSocket::TOPIC_MAX];
+            snprintf(full, sizeof(full), "%s%s", prefix_, topic);
+            return socket_.publish(full, payload, retained);
+        }
+        bool subscribe(const char *topic) override
+        {
+            char full[Hal::MqttSocket::TOPIC_MAX];
+            snprintf(full, sizeof(full), "%s%s", prefix_, topic);
+            return socket_.subscribe(full);
+        }
+        void loop() override { socket_.loop(); }
+
+        // Device-relative topic of an inbound message
+        const char *strip(const char *topic) const
+        {
+            size_t n = strlen(prefix_);
+            return strncmp(topic, prefix_, n) == 0 ? topic + n : topic;
+        }
+
+    private:
+        Hal::MqttSocket &socket_;
+        const char *prefix_;
+    };
+
+    void onDeviceMessage(void *ctx, const char *topic, const char *payload);
+
+    struct Device {
+        uint32_t id;
+        char prefix[32];
+        char clientId[48];
+        char willTopic[Hal::MqttSocket::TOPIC_MAX];
+        Hal::SimGpio gpio;
+        Hal::SimPzem meter;
+        Hal::SimSht31 climate;
+        Hal::MqttSocket socket;
+        SiteTransport site;
+        bool relayOn = false;
+        bool online = false;            // CONNACK seen, subscribed
+        uint32_t reconnectAtMs = 0;
+        uint32_t nextPzemMs = 0;
+        uint32_t nextClimateMs = 0;
+        uint32_t nextHeartbeatMs = 0;
+        uint32_t nextSysInfoMs = 0;
+        uint8_t sysInfoIndex = 0;
+        uint32_t startMs = 0;
+
+        // Latency bookkeeping (read by the monitor)
+        uint32_t powerSentUs = 0;
+        bool powerInFlight = false;
+        uint32_t commandSentUs = 0;
+        uint32_t commandSentMs = 0;
+        bool commandPending = false;
+        bool commandOn = false;
+        uint32_t killedUs = 0;
+        bool lwtPending = false;
+
+        Device(uint32_t index, bool bare)
+            : id(index), meter(hostClock, gpio, index * 2 + 1), climate(hostClock, meter, index * 2 + 2),
+              socket(onDeviceMessage, this), site(socket, prefix)
+        {
+            if (bare) prefix[0] = '\0';
+            else snprintf(prefix, sizeof(prefix), "%s%u/", opt.prefix, (unsigned)index);
+            snprintf(clientId, sizeof(clientId), "fleet-%u", (unsigned)index);
+            snprintf(willTopic, sizeof(willTopic), "%s%s", prefix, MQTTTopics::MQTT_STATUS);
+
+            // Household mix, phase-shifted per device
+            meter.addLoad("base", 80.0f + rng.next() % 150, 0.95f, -1, true);
+            meter.addLoad("fridge", 120.0f, 0.80f, -1, rng.next() % 3 == 0);
+            meter.addLoad("heater", 1000.0f + rng.next() % 1000, 0.99f, RELAY_PIN);
+            meter.setReadLatencyUs(0);
+            meter.setPowerAlarm((uint16_t)PROTECTION_MAX_POWER_W);
+            gpio.mode(RELAY_PIN, Hal::Gpio::MODE_OUTPUT);
+            gpio.write(RELAY_PIN, true);
+            climate.begin();
+        }
+
+        uint32_t interval(uint32_t firmware_ms) const
+        {
+            uint32_t ms = (uint32_t)(firmware_ms / opt.speedup);
+            return ms ? ms : 1;
+        }
+
+        void connect(uint32_t now)
+        {
+            Hal::MqttSocket::Options o = {clientId, opt.username, opt.password,
+                                          willTopic, MQTTTopics::MQTT_LWT, true, MQTT_KEEPALIVE};
+            online = false;
+            if (socket.open(opt.host, opt.port, o)) {
+                stats.connects++;
+            } else {
+                stats.connectFailures++;
+                reconnectAtMs = now + RECONNECT_DELAY_MS;
+            }
+        }
+
+        // As in reconnectWithLWT(): subscribe, announce online, restore status
+        void onConnected(uint32_t now)
+        {
+            online = true;
+            startMs = now;
+            site.subscribe(MQTTTopics::RELAY_CONTROL);
+            Metrics::publish(site, MQTTTopics::MQTT_STATUS, MQTTTopics::MQTT_ONLINE, true);
+            Metrics::publish(site, MQTTTopics::RELAY_STATUS, relayOn ? "ON" : "OFF", true);
+
+            // Random phase so the fleet doesn't publish in lockstep
+            nextPzemMs = now + rng.next() % interval(PZEM_READ_INTERVAL);
+            nextClimateMs = now + rng.next() % interval(DHT_READ_INTERVAL);
+            nextSysInfoMs = now + rng.next() % interval(SYSTEM_INFO_INTERVAL);
+            nextHeartbeatMs = now + interval(MQTT_HEARTBEAT_INTERVAL);
+        }
+
+        void publishFloat(const char *topic, float value, uint8_t decimals)
+        {
+            char buf[16];
+            snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+            Metrics::publish(site, topic, buf, false);
+        }
+
+        void setRelay(bool on)
+        {
+            relayOn = on;
+            gpio.write(RELAY_PIN, !on);         // Active LOW
+            Metrics::publish(site, MQTTTopics::RELAY_STATUS, on ? "ON" : "OFF", true);
+            Metrics::publish(site, MQTTTopics::RELAY_EVENT, on ? "ON:MQTT" : "OFF:MQTT", false);
+        }
+
+        void onMessage(const char *topic, const char *payload)
+        {
+            if (Commands::target(site.strip(topic)) != Commands::TARGET_RELAY) return;
+            switch (Commands::parseSwitch(payload)) {
+            case Commands::SWITCH_ON: setRelay(true); break;
+            case Commands::SWITCH_OFF: setRelay(false); break;
+            case Commands::SWITCH_TOGGLE: setRelay(!relayOn); break;
+            }
+        }
+
+        void kill(uint32_t now)
+        {
+            socket.close();
+            online = false;
+            powerInFlight = false;
+            commandPending = false;
+            killedUs = hostClock.micros();
+            lwtPending = true;
+            reconnectAtMs = now + RECONNECT_DELAY_MS;
+            stats.kills++;
+        }
+
+        void tick(uint32_t now)
+        {
+            if (socket.state() == Hal::MqttSocket::STATE_CLOSED) {
+                if (online) {                   // Broker closed it
+                    online = false;
+                    reconnectAtMs = now + RECONNECT_DELAY_MS;
+                }
+                return;
+            }
+            if (!online) {
+                if (socket.connected()) onConnected(now);
+                return;
+            }
+
+            if ((int32_t)(now - nextPzemMs) >= 0) {
+                nextPzemMs += interval(PZEM_READ_INTERVAL);
+                PowerSample s = meter.read();
+                publishFloat(MQTTTopics::VOLTAGE, s.voltage, 1);
+                publishFloat(MQTTTopics::CURRENT, s.current, 3);
+                if (!powerInFlight) {
+                    powerSentUs = hostClock.micros();
+                    powerInFlight = true;
+                }
+                publishFloat(MQTTTopics::POWER, s.power, 1);
+                publishFloat(MQTTTopics::ENERGY, s.energy, 3);
+                publishFloat(MQTTTopics::FREQUENCY, s.frequency, 1);
+                publishFloat(MQTTTopics::POWER_FACTOR, s.pf, 2);
+            }
+            if ((int32_t)(now - nextClimateMs) >= 0) {
+                nextClimateMs += interval(DHT_READ_INTERVAL);
+                float t, h;
+                if (climate.read(t, h)) {
+                    publishFloat(MQTTTopics::TEMPERATURE, t, 1);
+                    publishFloat(MQTTTopics::HUMIDITY, h, 1);
+                }
+            }
+            if ((int32_t)(now - nextSysInfoMs) >= 0) {
+                nextSysInfoMs += interval(SYSTEM_INFO_INTERVAL);
+                char buf[16];
+                switch (sysInfoIndex++ % 3) {
+                case 0:
+                    snprintf(buf, sizeof(buf), "%d", -50 - (int)(rng.next() % 30));
+                    Metrics::publish(site, MQTTTopics::SYSTEM_RSSI, buf, false);
+                    break;
+                case 1:
+                    snprintf(buf, sizeof(buf), "%u", (unsigned)((now - startMs) / 1000));
+                    Metrics::publish(site, MQTTTopics::SYSTEM_UPTIME, buf, false);
+                    break;
+                default:
+                    snprintf(buf, sizeof(buf), "%.1f", 180.0f + (rng.next() % 200) / 10.0f);
+                    Metrics::publish(site, MQTTTopics::SYSTEM_HEAP, buf, false);
+                    break;
+                }
+            }
+            if ((int32_t)(now - nextHeartbeatMs) >= 0) {
+                nextHeartbeatMs += interval(MQTT_HEARTBEAT_INTERVAL);
+                Metrics::publish(site, MQTTTopics::MQTT_STATUS, MQTTTopics::MQTT_ONLINE, true);
+            }
+        }
+    };
+
+    void onDeviceMessage(void *ctx, const char *topic, const char *payload)
+    {
+        static_cast<Device *>(ctx)->onMessage(topic, payload);
+    }
+
+    Device **devices = nullptr;
+
+    // ════════════════════════════════════════
+    // MONITOR / COMMANDER
+    // ════════════════════════════════════════
+    void onMonitorMessage(void *ctx, const char *topic, const char *payload);
+    Hal::MqttSocket monitor(onMonitorMessage);
+
+    // Device index and device-relative topic; -1 if not a fleet topic
+    int32_t deviceOf(const char *topic, const char **rest)
+    {
+        size_t n = strlen(opt.prefix);
+        if (strncmp(topic, opt.prefix, n) == 0) {
+            char *end = nullptr;
+            unsigned long id = strtoul(topic + n, &end, 10);
+            if (end == topic + n || *end != '/' || id >= opt.devices) return -1;
+            *rest = end + 1;
+            return (int32_t)id;
+        }
+        if (opt.dashboard) {
+            *rest = topic;
+            return 0;
+        }
+        return -1;
+    }
+
+    void onMonitorMessage(void *, const char *topic, const char *payload)
+    {
+        stats.monitorReceived++;
+        const char *rest = nullptr;
+        int32_t id = deviceOf(topic, &rest);
+        if (id < 0) return;
+        Device &d = *devices[id];
+        uint32_t now = hostClock.micros();
+
+        if (strcmp(rest, MQTTTopics::POWER) == 0 && d.powerInFlight) {
+            d.powerInFlight = false;
+            stats.telemetryUs.add(now - d.powerSentUs);
+        } else if (strcmp(rest, MQTTTopics::RELAY_STATUS) == 0 && d.commandPending) {
+            if (strcmp(payload, d.commandOn ? "ON" : "OFF") == 0) {
+                d.commandPending = false;
+                stats.commandsAcked++;
+                stats.commandUs.add(now - d.commandSentUs);
+            }
+        } else if (strcmp(rest, MQTTTopics::MQTT_STATUS) == 0 && d.lwtPending &&
+                   strcmp(payload, MQTTTopics::MQTT_LWT) == 0) {
+            d.lwtPending = false;
+            stats.lwtUs.add(now - d.killedUs);
+        }
+    }
+
+    void subscribeMonitor()
+    {
+        const char *const watched[] = {MQTTTopics::POWER, MQTTTopics::RELAY_STATUS, MQTTTopics::MQTT_STATUS};
+        char topic[Hal::MqttSocket::TOPIC_MAX];
+        for (uint8_t i = 0; i < 3; i++) {
+            snprintf(topic, sizeof(topic), "%s+/%s", opt.prefix, watched[i]);
+            monitor.subscribe(topic);
+            if (opt.dashboard) monitor.subscribe(watched[i]);
+        }
+    }
+
+    // Relay command to a random online device, opposite of its state
+    void sendCommand(uint32_t now_ms)
+    {
+        Device &d = *devices[rng.next() % opt.devices];
+        if (!d.online) return;
+        if (d.commandPending) {
+            if (now_ms - d.commandSentMs < COMMAND_TIMEOUT_MS) return;
+            stats.commandsLost++;
+        }
+        char topic[Hal::MqttSocket::TOPIC_MAX];
+        snprintf(topic, sizeof(topic), "%s%s", d.prefix, MQTTTopics::RELAY_CONTROL);
+        d.commandOn = !d.relayOn;
+        d.commandSentUs = hostClock.micros();
+        d.commandSentMs = now_ms;
+        d.commandPending = true;
+        if (monitor.publish(topic, d.commandOn ? "ON" : "OFF", false)) stats.commandsSent++;
+        else d.commandPending = false;
+    }
+
+    // ════════════════════════════════════════
+    // REPORTING
+    // ════════════════════════════════════════
+    struct Totals {
+        uint32_t online;
+        uint64_t published;
+        uint64_t dropped;
+    };
+
+    Totals totals()
+    {
+        Totals t = {0, 0, 0};
+        for (uint32_t i = 0; i < opt.devices; i++) {
+            t.online += devices[i]->online;
+            t.published += devices[i]->socket.published();
+            t.dropped += devices[i]->socket.dropped();
+        }
+        return t;
+    }
+
+    template <uint8_t N>
+    int formatLatency(char *buf, size_t size, const LogHistogram<N> &h)
+    {
+        return snprintf(buf, size, "[%u,%u,%u,%u,%u]", (unsigned)h.percentile(50), (unsigned)h.percentile(90),
+                        (unsigned)h.percentile(99), (unsigned)h.max, (unsigned)h.count);
+    }
+
+    void report(uint32_t elapsed_ms, uint64_t &last_published, uint32_t &last_received, uint32_t interval_ms)
+    {
+        Totals t = totals();
+        fprintf(stderr, "t=%4us online %u/%u  out %7.0f/s  in %7.0f/s  tel p50/p99 %u/%u us  cmd p50/p99 %u/%u us  drops %llu\n",
+                (unsigned)(elapsed_ms / 1000), (unsigned)t.online, (unsigned)opt.devices,
+                (t.published - last_published) * 1000.0 / interval_ms,
+                (stats.monitorReceived - last_received) * 1000.0 / interval_ms,
+                (unsigned)stats.telemetryUs.percentile(50), (unsigned)stats.telemetryUs.percentile(99),
+                (unsigned)stats.commandUs.percentile(50), (unsigned)stats.commandUs.percentile(99),
+                (unsigned long long)t.dropped);
+        last_published = t.published;
+        last_received = stats.monitorReceived;
+    }
+
+    // {"devices":n,"online":n,"duration_s":s,"speedup":x,"connects":n,"connect_fail":n,
+    //  "published":n,"pub_rate":x,"dropped":n,"monitor_recv":n,"recv_rate":x,
+    //  "telemetry_us":[p50,p90,p99,max,n],"command_us":[...],"lwt_us":[...],
+    //  "commands":[sent,acked,lost],"kills":n,"metrics":{...}}
+    void writeSummary(FILE *out, uint32_t elapsed_ms)
+    {
+        Totals t = totals();
+        double s = elapsed_ms / 1000.0;
+        char tel[64], cmd[64], lwt[64];
+        formatLatency(tel, sizeof(tel), stats.telemetryUs);
+        formatLatency(cmd, sizeof(cmd), stats.commandUs);
+        formatLatency(lwt, sizeof(lwt), stats.lwtUs);
+        static char metrics[METRICS_REPORT_SIZE];
+        Metrics::formatReport(metrics, sizeof(metrics));
+
+        fprintf(out,
+            "{\"devices\":%u,\"online\":%u,\"duration_s\":%.1f,\"speedup\":%.1f,\"connects\":%u,\"connect_fail\":%u,"
+            "\"published\":%llu,\"pub_rate\":%.1f,\"dropped\":%llu,\"monitor_recv\":%u,\"recv_rate\":%.1f,"
+            "\"telemetry_us\":%s,\"command_us\":%s,\"lwt_us\":%s,\"commands\":[%u,%u,%u],\"kills\":%u,\"metrics\":%s}\n",
+            (unsigned)opt.devices, (unsigned)t.online, s, opt.speedup, (unsigned)stats.connects,
+            (unsigned)stats.connectFailures, (unsigned long long)t.published, t.published / s,
+            (unsigned long long)t.dropped, (unsigned)stats.monitorReceived, stats.monitorReceived / s,
+            tel, cmd, lwt, (unsigned)stats.commandsSent, (unsigned)stats.commandsAcked,
+            (unsigned)stats.commandsLost, (unsigned)stats.kills, metrics);
+    }
+
+    void onSignal(int) { stopRequested = 1; }
+
+    bool parseArgs(int argc, char **argv)
+    {
+        for (int i = 1; i < argc; i++) {
+            const char *a = argv[i];
+            if (strcmp(a, "-D") == 0) { opt.dashboard = true; continue; }
+            if (i + 1 >= argc) return false;
+            const char *v = argv[++i];
+            if (strcmp(a, "-h") == 0) opt.host = v;
+            else if (strcmp(a, "-p") == 0) opt.port = (uint16_t)atoi(v);
+            else if (strcmp(a, "-u") == 0) opt.username = v;
+            else if (strcmp(a, "-P") == 0) opt.password = v;
+            else if (strcmp(a, "-n") == 0) opt.devices = (uint32_t)atoi(v);
+            else if (strcmp(a, "-d") == 0) opt.durationS = (uint32_t)atoi(v);
+            else if (strcmp(a, "-s") == 0) opt.speedup = (float)atof(v);
+            else if (strcmp(a, "-c") == 0) opt.commandsPerS = (float)atof(v);
+            else if (strcmp(a, "-k") == 0) opt.killsPerMin = (float)atof(v);
+            else if (strcmp(a, "-r") == 0) opt.connectsPerS = (uint32_t)atoi(v);
+            else if (strcmp(a, "-x") == 0) opt.prefix = v;
+            else if (strcmp(a, "-o") == 0) opt.output = v;
+            else return false;
+        }
+        return opt.devices > 0 && opt.speedup > 0.0f && opt.connectsPerS > 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (!parseArgs(argc, argv)) {
+        fprintf(stderr, "usage: %s [-h host] [-p port] [-u user -P pass] [-n devices] [-d seconds]\n"
+                        "       [-s speedup] [-c commands/s] [-k kills/min] [-r connects/s] [-x prefix] [-D] [-o file]\n",
+                argv[0]);
+        return 2;
+    }
+    Hal::bindClock(hostClock);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    Hal::MqttSocket::Options mon = {"fleet-monitor", opt.username, opt.password, nullptr, nullptr, false, MQTT_KEEPALIVE};
+    if (!monitor.open(opt.host, opt.port, mon)) {
+        fprintf(stderr, "cannot connect to %s:%u\n", opt.host, (unsigned)opt.port);
+        return 1;
+    }
+    while (!monitor.connected() && monitor.state() != Hal::MqttSocket::STATE_CLOSED) monitor.loop();
+    if (!monitor.connected()) {
+        fprintf(stderr, "broker refused the connection (CONNACK %u)\n", (unsigned)monitor.connackCode());
+        return 1;
+    }
+    subscribeMonitor();
+
+    devices = new Device *[opt.devices];
+    for (uint32_t i = 0; i < opt.devices; i++) devices[i] = new Device(i, opt.dashboard && i == 0);
+    struct pollfd *fds = new pollfd[opt.devices + 1];
+    Device **polled = new Device *[opt.devices + 1];
+
+    uint32_t start = Hal::millis();
+    Metrics::lastReportMs = start;      // Rates over the run
+    uint32_t nextConnect = 0;           // Devices connected so far (ramp)
+    double commandCredit = 0.0;
+    double killCredit = 0.0;
+    uint32_t lastTick = start;
+    uint32_t nextReport = start + REPORT_INTERVAL_MS;
+    uint64_t lastPublished = 0;
+    uint32_t lastReceived = 0;
+
+    while (!stopRequested) {
+        uint32_t now = Hal::millis();
+        uint32_t elapsed = now - start;
+        if (elapsed >= opt.durationS * 1000UL) break;
+
+        // Connection ramp, then reconnects
+        uint32_t ramp = (uint32_t)((uint64_t)elapsed * opt.connectsPerS / 1000) + 1;
+        while (nextConnect < opt.devices && nextConnect < ramp) devices[nextConnect++]->connect(now);
+        for (uint32_t i = 0; i < nextConnect; i++) {
+            Device &d = *devices[i];
+            if (d.socket.state() == Hal::MqttSocket::STATE_CLOSED && !d.online &&
+                (int32_t)(now - d.reconnectAtMs) >= 0) {
+                d.connect(now);
+            }
+            d.tick(now);
+        }
+
+        double dt = (now - lastTick) / 1000.0;
+        lastTick = now;
+        commandCredit += dt * opt.commandsPerS;
+        killCredit += dt * opt.killsPerMin / 60.0;
+        for (; commandCredit >= 1.0; commandCredit -= 1.0) sendCommand(now);
+        for (; killCredit >= 1.0; killCredit -= 1.0) {
+            Device &d = *devices[rng.next() % opt.devices];
+            if (d.online) d.kill(now);
+        }
+
+        // Wait for traffic on any connection (1 ms granularity)
+        nfds_t n = 0;
+        fds[n].fd = monitor.fd();
+        fds[n].events = POLLIN | (monitor.pendingOutput() ? POLLOUT : 0);
+        polled[n++] = nullptr;
+        for (uint32_t i = 0; i < nextConnect; i++) {
+            Hal::MqttSocket &s = devices[i]->socket;
+            if (s.fd() < 0) continue;
+            fds[n].fd = s.fd();
+            fds[n].events = POLLIN | (s.pendingOutput() ? POLLOUT : 0);
+            polled[n++] = devices[i];
+        }
+        if (poll(fds, n, 1) > 0) {
+            for (nfds_t i = 0; i < n; i++) {
+                if (!fds[i].revents) continue;
+                if (polled[i]) polled[i]->socket.loop();
+                else monitor.loop();
+            }
+        }
+        monitor.loop();
+        if (!monitor.connected()) {
+            fprintf(stderr, "monitor connection lost\n");
+            break;
+        }
+
+        if ((int32_t)(now - nextReport) >= 0) {
+            report(elapsed, lastPublished, lastReceived, REPORT_INTERVAL_MS);
+            nextReport += REPORT_INTERVAL_MS;
+        }
+    }
+
+    uint32_t elapsed = Hal::millis() - start;
+    for (uint32_t i = 0; i < opt.devices; i++) devices[i]->socket.disconnect();
+    monitor.disconnect();
+
+    FILE *out = stdout;
+    if (opt.output && !(out = fopen(opt.output, "w"))) {
+        fprintf(stderr, "cannot open %s\n", opt.output);
+        out = stdout;
+    }
+    writeSummary(out, elapsed);
+    if (out != stdout) fclose(out);
+    return 0;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "protection.h"
+
+// ════════════════════════════════════════════════════════════════
+// HARDWARE ABSTRACTION LAYER
+// Interfaces for everything the firmware logic touches: clock, GPIO,
+// the PZEM over Modbus, the SHT31, the I2C bus (LCD) and the MQTT
+// transport. hal_esp32.h binds them to the Arduino core and
+// libraries, hal_sim.h to simulated devices for the native build.
+// Modules take these by reference; the time helpers below go through
+// the clock bound at startup.
+// ════════════════════════════════════════════════════════════════
+
+namespace Hal
+{
+    class Clock
+    {
+    public:
+        virtual ~Clock() {}
+        virtual uint32_t millis() = 0;
+        virtual uint32_t micros() = 0;
+        virtual void delayMicros(uint32_t us) = 0;
+    };
+
+    class Gpio
+    {
+    public:
+        enum Mode : uint8_t {
+            MODE_INPUT = 0,
+            MODE_OUTPUT,
+            MODE_INPUT_PULLUP
+        };
+
+        virtual ~Gpio() {}
+        virtual void mode(uint8_t pin, uint8_t mode) = 0;
+        virtual void write(uint8_t pin, bool level) = 0;
+        virtual bool read(uint8_t pin) = 0;
+    };
+
+    // PZEM-004T v3 (Modbus RTU over UART)
+    class PowerMeter
+    {
+    public:
+        virtual ~PowerMeter() {}
+        virtual PowerSample read() = 0;             // valid = false on a Modbus error
+        virtual bool resetEnergy() = 0;
+        virtual bool setPowerAlarm(uint16_t watts) = 0;
+    };
+
+    // SHT31 temperature / humidity
+    class ClimateSensor
+    {
+    public:
+        virtual ~ClimateSensor() {}
+        virtual bool begin() = 0;
+        virtual bool read(float &temperature, float &humidity) = 0;   // NAN on error
+    };
+
+    class I2cBus
+    {
+    public:
+        virtual ~I2cBus() {}
+        virtual bool write(uint8_t addr, const uint8_t *data, size_t len) = 0;
+        virtual bool probe(uint8_t addr) = 0;
+    };
+
+    class Transport
+    {
+    public:
+        virtual ~Transport() {}
+        virtual bool connected() = 0;
+        virtual bool publish(const char *topic, const char *payload, bool retained) = 0;
+        virtual bool subscribe(const char *topic) = 0;
+        virtual void loop() = 0;
+    };
+
+    // Clock used by the time helpers (metrics, LCD driver, ...)
+    Clock *boundClock = nullptr;
+
+    inline void bindClock(Clock &clock) { boundClock = &clock; }
+    inline uint32_t millis() { return boundClock ? boundClock->millis() : 0; }
+    inline uint32_t micros() { return boundClock ? boundClock->micros() : 0; }
+    inline void delayMicros(uint32_t us)
+    {
+        if (boundClock) boundClock->delayMicros(us);
+    }
+}
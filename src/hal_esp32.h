@@ -0,0 +1,127 @@
+#pragma once
+#include <Arduino.h>
+#include <Wire.h>
+#include <PubSubClient.h>
+#include <PZEM004Tv30.h>
+#include <Adafruit_SHT31.h>
+#include "hal.h"
+
+// ════════════════════════════════════════════════════════════════
+// HAL BINDINGS - ESP32 / ARDUINO CORE
+// ════════════════════════════════════════════════════════════════
+
+namespace Hal
+{
+    class ArduinoClock : public Clock
+    {
+    public:
+        uint32_t millis() override { return ::millis(); }
+        uint32_t micros() override { return ::micros(); }
+        void delayMicros(uint32_t us) override
+        {
+            if (us >= 1000) delay(us / 1000);
+            delayMicroseconds(us % 1000);
+        }
+    };
+
+    class ArduinoGpio : public Gpio
+    {
+    public:
+        void mode(uint8_t pin, uint8_t mode) override
+        {
+            static const uint8_t MODES[] = {INPUT, OUTPUT, INPUT_PULLUP};
+            pinMode(pin, MODES[mode]);
+        }
+        void write(uint8_t pin, bool level) override { digitalWrite(pin, level ? HIGH : LOW); }
+        bool read(uint8_t pin) override { return digitalRead(pin) == HIGH; }
+    };
+
+    class PzemMeter : public PowerMeter
+    {
+    public:
+        explicit PzemMeter(PZEM004Tv30 &pzem) : pzem_(pzem) {}
+
+        // Read every register; stop at the first failure so a missing
+        // meter costs one timeout instead of one per value
+        PowerSample read() override
+        {
+            PowerSample s;
+            s.ms = ::millis();
+            s.voltage = pzem_.voltage();
+            if (isnan(s.voltage)) return s;
+
+            s.current = pzem_.current();
+            s.power = pzem_.power();
+            s.energy = pzem_.energy();
+            s.frequency = pzem_.frequency();
+            s.pf = pzem_.pf();
+            s.powerAlarm = pzem_.getPowerAlarm();
+            s.valid = !isnan(s.current);
+            return s;
+        }
+
+        bool resetEnergy() override { return pzem_.resetEnergy(); }
+        bool setPowerAlarm(uint16_t watts) override { return pzem_.setPowerAlarm(watts); }
+
+    private:
+        PZEM004Tv30 &pzem_;
+    };
+
+    class Sht31Sensor : public ClimateSensor
+    {
+    public:
+        Sht31Sensor(Adafruit_SHT31 &sht31, uint8_t addr) : sht31_(sht31), addr_(addr) {}
+
+        bool begin() override { return sht31_.begin(addr_); }
+
+        bool read(float &temperature, float &humidity) override
+        {
+            temperature = sht31_.readTemperature();
+            humidity = sht31_.readHumidity();
+            return !isnan(temperature) && !isnan(humidity);
+        }
+
+    private:
+        Adafruit_SHT31 &sht31_;
+        uint8_t addr_;
+    };
+
+    class WireBus : public I2cBus
+    {
+    public:
+        explicit WireBus(TwoWire &wire) : wire_(wire) {}
+
+        bool write(uint8_t addr, const uint8_t *data, size_t len) override
+        {
+            wire_.beginTransmission(addr);
+            wire_.write(data, len);
+            return wire_.endTransmission() == 0;
+        }
+
+        bool probe(uint8_t addr) override
+        {
+            wire_.beginTransmission(addr);
+            return wire_.endTransmission() == 0;
+        }
+
+    private:
+        TwoWire &wire_;
+    };
+
+    class PubSubTransport : public Transport
+    {
+    public:
+        explicit PubSubTransport(PubSubClient &client) : client_(client) {}
+
+        bool connected() override { return client_.connected(); }
+        bool publish(const char *topic, const char *payload, bool retained) override
+        {
+            return client_.publish(topic, payload, retained);
+        }
+        bool subscribe(const char *topic) override { return client_.subscribe(topic); }
+        void loop() override { client_.loop(); }
+
+    private:
+        PubSubClient &client_;
+    };
+}
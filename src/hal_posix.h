@@ -0,0 +1,342 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "hal.h"
+
+// ════════════════════════════════════════════════════════════════
+// HAL BINDINGS - POSIX HOST (host tools against a real broker)
+// Monotonic clock, and a minimal MQTT 3.1.1 client (QoS 0, LWT,
+// keepalive) over a non-blocking TCP socket, so many connections can
+// share one poll() loop. Packets are queued in a fixed output buffer;
+// a full buffer fails the publish instead of blocking.
+// ════════════════════════════════════════════════════════════════
+
+namespace Hal
+{
+    class PosixClock : public Clock
+    {
+    public:
+        uint32_t millis() override { return (uint32_t)(nowUs() / 1000); }
+        uint32_t micros() override { return (uint32_t)nowUs(); }
+        void delayMicros(uint32_t us) override
+        {
+            struct timespec ts = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000};
+            nanosleep(&ts, nullptr);
+        }
+
+        uint64_t nowUs() const
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+        }
+    };
+
+    class MqttSocket : public Transport
+    {
+    public:
+        typedef void (*MessageFn)(void *ctx, const char *topic, const char *payload);
+
+        static const uint16_t IN_SIZE = 4096;
+        static const uint16_t OUT_SIZE = 4096;
+        static const uint16_t TOPIC_MAX = 128;
+        static const uint16_t PAYLOAD_MAX = 2048;
+
+        enum State : uint8_t {
+            STATE_CLOSED = 0,
+            STATE_CONNECTING,       // CONNECT sent, waiting for CONNACK
+            STATE_CONNECTED
+        };
+
+        MqttSocket(MessageFn on_message = nullptr, void *ctx = nullptr)
+            : onMessage_(on_message), ctx_(ctx) {}
+        ~MqttSocket() { close(); }
+
+        struct Options {
+            const char *clientId;
+            const char *username;       // nullptr: none
+            const char *password;
+            const char *willTopic;      // nullptr: no LWT
+            const char *willMessage;
+            bool willRetain;
+            uint16_t keepAliveS;
+        };
+
+        // TCP connect (blocking) and queue CONNECT; connected() turns
+        // true on CONNACK
+        bool open(const char *host, uint16_t port, const Options &opt)
+        {
+            close();
+            char service[8];
+            snprintf(service, sizeof(service), "%u", (unsigned)port);
+            struct addrinfo hints;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            struct addrinfo *res = nullptr;
+            if (getaddrinfo(host, service, &hints, &res) != 0) return false;
+
+            for (struct addrinfo *ai = res; ai && fd_ < 0; ai = ai->ai_next) {
+                int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+                if (fd < 0) continue;
+                if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) fd_ = fd;
+                else ::close(fd);
+            }
+            freeaddrinfo(res);
+            if (fd_ < 0) return false;
+
+            int one = 1;
+            setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL, 0) | O_NONBLOCK);
+
+            keepAliveMs_ = (uint32_t)opt.keepAliveS * 1000;
+            uint8_t flags = 0x02;                                   // Clean session
+            if (opt.willTopic) flags |= 0x04 | (opt.willRetain ? 0x20 : 0);
+            if (opt.username) flags |= 0x80;
+            if (opt.username && opt.password) flags |= 0x40;
+
+            uint32_t len = 10 + 2 + strlen(opt.clientId);
+            if (opt.willTopic) len += 4 + strlen(opt.willTopic) + strlen(opt.willMessage);
+            if (opt.username) len += 2 + strlen(opt.username);
+            if (opt.username && opt.password) len += 2 + strlen(opt.password);
+
+            if (!beginPacket(0x10, len)) {
+                close();
+                return false;
+            }
+            putString("MQTT");
+            putByte(4);                                             // Protocol level 3.1.1
+            putByte(flags);
+            putByte((uint8_t)(opt.keepAliveS >> 8));
+            putByte((uint8_t)opt.keepAliveS);
+            putString(opt.clientId);
+            if (opt.willTopic) {
+                putString(opt.willTopic);
+                putString(opt.willMessage);
+            }
+            if (opt.username) putString(opt.username);
+            if (opt.username && opt.password) putString(opt.password);
+
+            state_ = STATE_CONNECTING;
+            flush();
+            return fd_ >= 0;
+        }
+
+        // Graceful: DISCONNECT, the broker drops the LWT
+        void disconnect()
+        {
+            if (state_ == STATE_CONNECTED && beginPacket(0xE0, 0)) flush();
+            close();
+        }
+
+        // Drop the TCP connection without DISCONNECT (broker sends the LWT)
+        void close()
+        {
+            if (fd_ >= 0) ::close(fd_);
+            fd_ = -1;
+            state_ = STATE_CLOSED;
+            inLen_ = 0;
+            outLen_ = 0;
+        }
+
+        bool connected() override { return state_ == STATE_CONNECTED; }
+
+        bool publish(const char *topic, const char *payload, bool retained) override
+        {
+            if (state_ != STATE_CONNECTED) return false;
+            size_t topic_len = strlen(topic);
+            size_t payload_len = strlen(payload);
+            if (!beginPacket(retained ? 0x31 : 0x30, 2 + topic_len + payload_len)) {
+                dropped_++;
+                return false;
+            }
+            putString(topic);
+            putBytes(payload, payload_len);
+            published_++;
+            flush();
+            return true;
+        }
+
+        bool subscribe(const char *topic) override
+        {
+            if (state_ != STATE_CONNECTED) return false;
+            if (!beginPacket(0x82, 2 + 2 + strlen(topic) + 1)) return false;
+            packetId_ = packetId_ == 0xFFFF ? 1 : packetId_ + 1;
+            putByte((uint8_t)(packetId_ >> 8));
+            putByte((uint8_t)packetId_);
+            putString(topic);
+            putByte(0);                                             // QoS 0
+            flush();
+            return true;
+        }
+
+        // Send queued bytes, read and dispatch what arrived, keepalive
+        void loop() override
+        {
+            if (fd_ < 0) return;
+            flush();
+            receive();
+            if (state_ == STATE_CONNECTED && keepAliveMs_ &&
+                Hal::millis() - lastSendMs_ >= keepAliveMs_ / 2 && outLen_ == 0) {
+                if (beginPacket(0xC0, 0)) flush();
+            }
+        }
+
+        int fd() const { return fd_; }
+        uint8_t state() const { return state_; }
+        bool pendingOutput() const { return outLen_ > 0; }
+        uint8_t connackCode() const { return connackCode_; }
+        uint32_t published() const { return published_; }
+        uint32_t received() const { return received_; }
+        uint32_t dropped() const { return dropped_; }
+
+    private:
+        MessageFn onMessage_;
+        void *ctx_;
+        int fd_ = -1;
+        uint8_t state_ = STATE_CLOSED;
+        uint8_t connackCode_ = 0;
+        uint16_t packetId_ = 0;
+        uint32_t keepAliveMs_ = 0;
+        uint32_t lastSendMs_ = 0;
+
+        uint8_t in_[IN_SIZE];
+        uint16_t inLen_ = 0;
+        uint8_t out_[OUT_SIZE];
+        uint16_t outLen_ = 0;
+
+        uint32_t published_ = 0;
+        uint32_t received_ = 0;
+        uint32_t dropped_ = 0;
+
+        // Fixed header; false if the whole packet doesn't fit the buffer
+        bool beginPacket(uint8_t type, uint32_t len)
+        {
+            uint8_t header[5];
+            uint8_t n = 0;
+            header[n++] = type;
+            uint32_t rest = len;
+            do {
+                uint8_t b = rest % 128;
+                rest /= 128;
+                header[n++] = rest ? (b | 0x80) : b;
+            } while (rest && n < 5);
+            if (fd_ < 0 || outLen_ + n + len > OUT_SIZE) return false;
+            putBytes(header, n);
+            return true;
+        }
+
+        void putByte(uint8_t b) { out_[outLen_++] = b; }
+        void putBytes(const void *data, size_t len)
+        {
+            memcpy(out_ + outLen_, data, len);
+            outLen_ += len;
+        }
+        void putString(const char *s)
+        {
+            size_t len = strlen(s);
+            putByte((uint8_t)(len >> 8));
+            putByte((uint8_t)len);
+            putBytes(s, len);
+        }
+
+        void flush()
+        {
+            while (fd_ >= 0 && outLen_ > 0) {
+                ssize_t n = send(fd_, out_, outLen_, MSG_NOSIGNAL);
+                if (n < 0) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) close();
+                    return;
+                }
+                memmove(out_, out_ + n, outLen_ - n);
+                outLen_ -= n;
+                lastSendMs_ = Hal::millis();
+            }
+        }
+
+        void receive()
+        {
+            while (fd_ >= 0) {
+                ssize_t n = recv(fd_, in_ + inLen_, IN_SIZE - inLen_, 0);
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                    close();
+                    return;
+                }
+                if (n < 0) return;
+                inLen_ += n;
+                if (!parse()) {
+                    close();            // Oversized or malformed packet
+                    return;
+                }
+            }
+        }
+
+        // Dispatch every complete packet in the input buffer
+        bool parse()
+        {
+            uint16_t pos = 0;
+            while (inLen_ - pos >= 2) {
+                uint32_t len = 0;
+                uint32_t mult = 1;
+                uint16_t i = pos + 1;
+                for (;;) {
+                    if (i >= inLen_) goto partial;
+                    uint8_t b = in_[i++];
+                    len += (b & 0x7F) * mult;
+                    if (!(b & 0x80)) break;
+                    mult *= 128;
+                    if (mult > 128 * 128 * 128) return false;
+                }
+                if (i - pos + len > IN_SIZE) return false;
+                if (i + len > inLen_) goto partial;
+                handle(in_[pos], in_ + i, len);
+                if (fd_ < 0) return true;
+                pos = i + len;
+            }
+        partial:
+            memmove(in_, in_ + pos, inLen_ - pos);
+            inLen_ -= pos;
+            return true;
+        }
+
+        void handle(uint8_t type, const uint8_t *body, uint32_t len)
+        {
+            switch (type >> 4) {
+            case 2:                                                 // CONNACK
+                connackCode_ = len >= 2 ? body[1] : 0xFF;
+                if (connackCode_ == 0) state_ = STATE_CONNECTED;
+                else close();
+                break;
+            case 3: {                                               // PUBLISH
+                if (len < 2) return;
+                uint16_t topic_len = (uint16_t)(body[0] << 8 | body[1]);
+                uint32_t offset = 2 + topic_len + ((type & 0x06) ? 2 : 0);
+                if (offset > len) return;
+                received_++;
+                if (!onMessage_) return;
+                char topic[TOPIC_MAX];
+                char payload[PAYLOAD_MAX];
+                uint16_t t = topic_len < TOPIC_MAX - 1 ? topic_len : TOPIC_MAX - 1;
+                memcpy(topic, body + 2, t);
+                topic[t] = '\0';
+                uint32_t p = len - offset < PAYLOAD_MAX - 1 ? len - offset : PAYLOAD_MAX - 1;
+                memcpy(payload, body + offset, p);
+                payload[p] = '\0';
+                onMessage_(ctx_, topic, payload);
+                break;
+            }
+            default:                                                // SUBACK, PINGRESP
+                break;
+            }
+        }
+    };
+}
@@ -0,0 +1,440 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "hal.h"
+
+// ════════════════════════════════════════════════════════════════
+// HAL BINDINGS - SIMULATED DEVICES (native build)
+// Deterministic models: a manual clock, GPIO levels, a PZEM fed by
+// switchable loads (with injectable sags / Modbus errors), an SHT31
+// warmed by the measured power, an HD44780 decoded from the PCF8574
+// byte stream, and an in-memory MQTT transport.
+// ════════════════════════════════════════════════════════════════
+
+namespace Hal
+{
+    // xorshift32: same noise sequence on every run for a given seed
+    class SimRandom
+    {
+    public:
+        explicit SimRandom(uint32_t seed = 1) : state_(seed ? seed : 1) {}
+
+        uint32_t next()
+        {
+            state_ ^= state_ << 13;
+            state_ ^= state_ >> 17;
+            state_ ^= state_ << 5;
+            return state_;
+        }
+
+        // Uniform in [-1, 1]
+        float noise() { return (next() & 0xFFFF) / 32767.5f - 1.0f; }
+
+    private:
+        uint32_t state_;
+    };
+
+    class SimClock : public Clock
+    {
+    public:
+        uint32_t millis() override { return (uint32_t)(nowUs_ / 1000); }
+        uint32_t micros() override { return (uint32_t)nowUs_; }
+        void delayMicros(uint32_t us) override { nowUs_ += us; }
+
+        void advanceMs(uint32_t ms) { nowUs_ += (uint64_t)ms * 1000; }
+        void advanceUs(uint32_t us) { nowUs_ += us; }
+        uint64_t nowUs() const { return nowUs_; }
+
+    private:
+        uint64_t nowUs_ = 0;
+    };
+
+    class SimGpio : public Gpio
+    {
+    public:
+        static const uint8_t PINS = 40;
+
+        SimGpio()
+        {
+            for (uint8_t i = 0; i < PINS; i++) levels_[i] = true;    // Pull-ups / relays OFF
+        }
+
+        void mode(uint8_t pin, uint8_t mode) override
+        {
+            if (pin < PINS) modes_[pin] = mode;
+        }
+
+        void write(uint8_t pin, bool level) override
+        {
+            if (pin >= PINS) return;
+            if (levels_[pin] != level) edges_[pin]++;
+            levels_[pin] = level;
+        }
+
+        bool read(uint8_t pin) override { return pin < PINS ? levels_[pin] : true; }
+
+        uint32_t edges(uint8_t pin) const { return pin < PINS ? edges_[pin] : 0; }
+
+    private:
+        bool levels_[PINS];
+        uint8_t modes_[PINS] = {0};
+        uint32_t edges_[PINS] = {0};
+    };
+
+    // Load behind the meter, optionally switched by an active-LOW relay pin
+    struct SimLoad {
+        const char *name;
+        float watts;
+        float pf;
+        int8_t pin;                 // -1: switched with setLoad() only
+        bool on;
+    };
+
+    class SimPzem : public PowerMeter
+    {
+    public:
+        static const uint8_t MAX_LOADS = 8;
+
+        SimPzem(Clock &clock, Gpio &gpio, uint32_t seed = 1)
+            : clock_(clock), gpio_(gpio), rng_(seed) {}
+
+        int8_t addLoad(const char *name, float watts, float pf, int8_t pin = -1, bool on = false)
+        {
+            if (loadCount_ >= MAX_LOADS) return -1;
+            loads_[loadCount_] = SimLoad{name, watts, pf, pin, on};
+            return loadCount_++;
+        }
+
+        void setLoad(uint8_t i, bool on)
+        {
+            if (i < loadCount_) loads_[i].on = on;
+        }
+
+        // Voltage held at volts for [start, start + duration)
+        void injectVoltage(uint32_t start_ms, uint32_t duration_ms, float volts)
+        {
+            eventStartMs_ = start_ms;
+            eventDurationMs_ = duration_ms;
+            eventVolts_ = volts;
+        }
+
+        void setErrorEvery(uint32_t n) { errorEvery_ = n; }
+        void setReadLatencyUs(uint32_t us) { readLatencyUs_ = us; }
+        void setNominal(float volts, float hz) { nominalV_ = volts; nominalHz_ = hz; }
+
+        PowerSample read() override
+        {
+            uint32_t now = clock_.millis();
+            clock_.delayMicros(readLatencyUs_);
+            integrate(now);
+            reads_++;
+
+            PowerSample s;
+            s.ms = now;
+            if (errorEvery_ && reads_ % errorEvery_ == 0) {
+                errors_++;
+                return s;
+            }
+
+            float p = 0.0f;
+            float q = 0.0f;
+            for (uint8_t i = 0; i < loadCount_; i++) {
+                if (!active(loads_[i])) continue;
+                float w = loads_[i].watts * (1.0f + 0.01f * rng_.noise());
+                p += w;
+                q += w * sqrtf(1.0f - loads_[i].pf * loads_[i].pf) / loads_[i].pf;
+            }
+            float v = nominalV_ + 1.5f * rng_.noise();
+            if (now - eventStartMs_ < eventDurationMs_) v = eventVolts_ + 0.5f * rng_.noise();
+            float va = sqrtf(p * p + q * q);
+
+            s.voltage = v;
+            s.current = va / v;
+            s.power = p;
+            s.energy = (float)(energyWh_ / 1000.0);
+            s.frequency = nominalHz_ + 0.02f * rng_.noise();
+            s.pf = va > 0.0f ? p / va : 0.0f;
+            s.powerAlarm = p > alarmW_;
+            s.valid = true;
+            lastPowerW_ = p;
+            return s;
+        }
+
+        bool resetEnergy() override
+        {
+            energyWh_ = 0.0;
+            return true;
+        }
+
+        bool setPowerAlarm(uint16_t watts) override
+        {
+            alarmW_ = watts;
+            return true;
+        }
+
+        float lastPowerW() const { return lastPowerW_; }
+        uint32_t reads() const { return reads_; }
+        uint32_t errors() const { return errors_; }
+
+    private:
+        Clock &clock_;
+        Gpio &gpio_;
+        SimRandom rng_;
+        SimLoad loads_[MAX_LOADS];
+        uint8_t loadCount_ = 0;
+
+        float nominalV_ = 220.0f;
+        float nominalHz_ = 50.0f;
+        uint32_t eventStartMs_ = 0;
+        uint32_t eventDurationMs_ = 0;
+        float eventVolts_ = 0.0f;
+        uint32_t errorEvery_ = 0;
+        uint32_t readLatencyUs_ = 28000;        // 25 byte reply at 9600 baud
+        uint16_t alarmW_ = 0xFFFF;
+
+        double energyWh_ = 0.0;
+        uint32_t lastIntegrateMs_ = 0;
+        float lastPowerW_ = 0.0f;
+        uint32_t reads_ = 0;
+        uint32_t errors_ = 0;
+
+        bool active(const SimLoad &l) { return l.pin < 0 ? l.on : !gpio_.read(l.pin); }
+
+        void integrate(uint32_t now)
+        {
+            energyWh_ += lastPowerW_ * (now - lastIntegrateMs_) / 3600000.0;
+            lastIntegrateMs_ = now;
+        }
+    };
+
+    // Ambient plus a first-order rise proportional to the metered power
+    class SimSht31 : public ClimateSensor
+    {
+    public:
+        SimSht31(Clock &clock, SimPzem &meter, uint32_t seed = 2)
+            : clock_(clock), meter_(meter), rng_(seed) {}
+
+        void setAmbient(float celsius) { ambient_ = celsius; }
+        void setPresent(bool present) { present_ = present; }
+
+        bool begin() override { return present_; }
+
+        bool read(float &temperature, float &humidity) override
+        {
+            if (!present_) {
+                temperature = humidity = NAN;
+                return false;
+            }
+            uint32_t now = clock_.millis();
+            float target = ambient_ + DEG_PER_KW * meter_.lastPowerW() / 1000.0f;
+            float k = (now - lastMs_) / (TAU_MS + (float)(now - lastMs_));
+            temp_ += (target - temp_) * k;
+            lastMs_ = now;
+
+            temperature = temp_ + 0.05f * rng_.noise();
+            humidity = 65.0f - (temp_ - ambient_) * 2.0f + 0.5f * rng_.noise();
+            return true;
+        }
+
+    private:
+        static constexpr float DEG_PER_KW = 3.0f;
+        static constexpr float TAU_MS = 600000.0f;
+
+        Clock &clock_;
+        SimPzem &meter_;
+        SimRandom rng_;
+        bool present_ = true;
+        float ambient_ = 28.0f;
+        float temp_ = 28.0f;
+        uint32_t lastMs_ = 0;
+    };
+
+    // I2C bus with an HD44780 behind a PCF8574: latches nibbles on EN
+    // falling edges and keeps the DDRAM contents for the first two rows
+    class SimLcd : public I2cBus
+    {
+    public:
+        static const uint8_t COLS = 40;
+
+        SimLcd(uint8_t lcd_addr, uint8_t sensor_addr) : lcdAddr_(lcd_addr), sensorAddr_(sensor_addr)
+        {
+            memset(ddram_, ' ', sizeof(ddram_));
+        }
+
+        bool write(uint8_t addr, const uint8_t *data, size_t len) override
+        {
+            if (addr != lcdAddr_) return addr == sensorAddr_;
+            transactions_++;
+            bytes_ += len + 1;
+            for (size_t i = 0; i < len; i++) expander(data[i]);
+            return true;
+        }
+
+        bool probe(uint8_t addr) override { return addr == lcdAddr_ || addr == sensorAddr_; }
+
+        // Visible text of a row (cols characters)
+        const char *row(uint8_t r, uint8_t cols)
+        {
+            if (cols > COLS) cols = COLS;
+            memcpy(text_, ddram_[r & 1], cols);
+            text_[cols] = '\0';
+            return text_;
+        }
+
+        uint32_t transactions() const { return transactions_; }
+        uint32_t bytes() const { return bytes_; }
+
+    private:
+        uint8_t lcdAddr_;
+        uint8_t sensorAddr_;
+        char ddram_[2][COLS];
+        char text_[COLS + 1];
+        bool fourBit_ = false;
+        bool enHigh_ = false;
+        bool haveHigh_ = false;
+        uint8_t high_ = 0;
+        uint8_t cursorRow_ = 0;
+        uint8_t cursorCol_ = 0;
+        bool cgram_ = false;
+        uint32_t transactions_ = 0;
+        uint32_t bytes_ = 0;
+
+        void expander(uint8_t bits)
+        {
+            bool en = bits & 0x04;
+            if (enHigh_ && !en) nibble(bits & 0xF0, bits & 0x01);
+            enHigh_ = en;
+        }
+
+        void nibble(uint8_t value, bool rs)
+        {
+            if (!fourBit_) {
+                if (value == 0x20) fourBit_ = true;     // Init: switch to 4-bit
+                return;
+            }
+            if (!haveHigh_) {
+                high_ = value;
+                haveHigh_ = true;
+                return;
+            }
+            haveHigh_ = false;
+            uint8_t byte = high_ | (value >> 4);
+            if (rs) data(byte);
+            else command(byte);
+        }
+
+        void command(uint8_t cmd)
+        {
+            if (cmd == 0x01) {
+                memset(ddram_, ' ', sizeof(ddram_));
+                cursorRow_ = cursorCol_ = 0;
+                cgram_ = false;
+            } else if (cmd & 0x80) {
+                uint8_t addr = cmd & 0x7F;
+                cursorRow_ = addr >= 0x40 ? 1 : 0;
+                cursorCol_ = (addr & 0x3F) % COLS;
+                cgram_ = false;
+            } else if (cmd & 0x40) {
+                cgram_ = true;
+            }
+        }
+
+        void data(uint8_t c)
+        {
+            if (cgram_) return;                         // Glyph bitmaps
+            ddram_[cursorRow_][cursorCol_] = c < 8 ? '#' : (char)c;    // Custom glyphs as '#'
+            cursorCol_ = (cursorCol_ + 1) % COLS;
+        }
+    };
+
+    // In-memory broker: counts traffic, optionally echoes to a stream,
+    // and queues injected commands for the subscribed callback
+    class SimTransport : public Transport
+    {
+    public:
+        typedef void (*MessageFn)(const char *topic, const char *payload);
+
+        static const uint8_t MAX_SUBSCRIPTIONS = 16;
+        static const uint8_t INBOX = 4;
+        static const uint16_t PAYLOAD_MAX = 256;
+
+        explicit SimTransport(MessageFn on_message = nullptr) : onMessage_(on_message) {}
+
+        void setConnected(bool connected) { connected_ = connected; }
+        void setEcho(FILE *out) { echo_ = out; }
+
+        bool connected() override { return connected_; }
+
+        bool publish(const char *topic, const char *payload, bool retained) override
+        {
+            if (!connected_) return false;
+            published_++;
+            bytes_ += strlen(topic) + strlen(payload);
+            if (retained) retained_++;
+            if (echo_) fprintf(echo_, "%s%s %s\n", retained ? "[R] " : "", topic, payload);
+            return true;
+        }
+
+        bool subscribe(const char *topic) override
+        {
+            if (subscriptionCount_ >= MAX_SUBSCRIPTIONS) return false;
+            subscriptions_[subscriptionCount_++] = topic;
+            return true;
+        }
+
+        void loop() override
+        {
+            while (inboxCount_ > 0 && onMessage_) {
+                Message &m = inbox_[inboxTail_];
+                inboxTail_ = (inboxTail_ + 1) % INBOX;
+                inboxCount_--;
+                onMessage_(m.topic, m.payload);
+            }
+        }
+
+        // Deliver a command on the next loop() if the topic is subscribed
+        bool inject(const char *topic, const char *payload)
+        {
+            if (!subscribed(topic) || inboxCount_ >= INBOX) return false;
+            Message &m = inbox_[inboxHead_];
+            m.topic = topic;
+            snprintf(m.payload, sizeof(m.payload), "%s", payload);
+            inboxHead_ = (inboxHead_ + 1) % INBOX;
+            inboxCount_++;
+            return true;
+        }
+
+        uint32_t published() const { return published_; }
+        uint32_t bytes() const { return bytes_; }
+        uint32_t retained() const { return retained_; }
+
+    private:
+        struct Message {
+            const char *topic;
+            char payload[PAYLOAD_MAX];
+        };
+
+        MessageFn onMessage_;
+        bool connected_ = true;
+        FILE *echo_ = nullptr;
+        const char *subscriptions_[MAX_SUBSCRIPTIONS];
+        uint8_t subscriptionCount_ = 0;
+        Message inbox_[INBOX];
+        uint8_t inboxHead_ = 0;
+        uint8_t inboxTail_ = 0;
+        uint8_t inboxCount_ = 0;
+        uint32_t published_ = 0;
+        uint32_t bytes_ = 0;
+        uint32_t retained_ = 0;
+
+        bool subscribed(const char *topic) const
+        {
+            for (uint8_t i = 0; i < subscriptionCount_; i++) {
+                if (strcmp(subscriptions_[i], topic) == 0) return true;
+            }
+            return false;
+        }
+    };
+}
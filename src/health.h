@@ -0,0 +1,183 @@
+#pragma once
+#include <Arduino.h>
+#include <Ticker.h>
+#include <esp_task_wdt.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include "config.h"
+#include "histogram.h"
+
+// ════════════════════════════════════════════════════════════════
+// LOOP HEALTH MONITOR
+// Each loop() stage is timed with the 64-bit esp_timer clock (count,
+// max, p99); the CPU cycle counter wraps every ~18s at 240MHz. The
+// loop task is registered with the ESP task watchdog, and a
+// Ticker-driven supervisor catches a stage that overruns
+// HEALTH_STALL_TIMEOUT_MS. The stall report is kept in RTC memory and
+// the chip is restarted; nothing is published from the timer task
+// (no TLS there). After reboot, pendingStall() returns the report and
+// loop() publishes it.
+// ════════════════════════════════════════════════════════════════
+
+namespace Health
+{
+    enum Stage : uint8_t {
+        STAGE_LOOP = 0,
+        STAGE_MQTT_CONNECT,
+        STAGE_MQTT_LOOP,
+        STAGE_BUTTON,
+        STAGE_SCHEDULER,
+        STAGE_IDLE,
+        STAGE_COUNT
+    };
+
+    const char *const STAGE_NAMES[STAGE_COUNT] = {
+        "loop", "mqtt_conn", "mqtt_loop", "button", "sched", "idle"
+    };
+
+    struct StageStats {
+        uint32_t count = 0;
+        uint32_t maxUs = 0;
+        LogHistogram<28> durationUs;
+    };
+
+    struct StallReport {
+        uint32_t magic;
+        uint8_t stage;
+        char detail[16];                // e.g. scheduler task name
+        uint32_t stalledMs;
+        uint32_t uptimeS;
+    };
+
+    const uint32_t STALL_MAGIC = 0x5354414CUL;   // "STAL"
+    typedef const char *(*DetailFn)();          // Extra context for the report
+
+    // Survives esp_restart() and watchdog panics
+    RTC_NOINIT_ATTR StallReport rtcStall;
+
+    StageStats stages[STAGE_COUNT];
+
+    // Innermost active stage, shared with the supervisor (esp_timer task)
+    const uint8_t MAX_DEPTH = 4;
+    volatile uint8_t depth = 0;
+    volatile uint8_t stack[MAX_DEPTH];
+    volatile uint32_t enteredUs[MAX_DEPTH];     // 32-bit copy: read whole by the supervisor
+    int64_t enteredAt[MAX_DEPTH];               // loop() only, for durations
+
+    DetailFn detailFn = nullptr;
+    bool stallTriggered = false;
+    StallReport bootStall = {};
+    Ticker supervisorTicker;
+
+    void enter(Stage stage)
+    {
+        if (depth >= MAX_DEPTH) return;
+        uint8_t d = depth;
+        stack[d] = stage;
+        enteredAt[d] = esp_timer_get_time();
+        enteredUs[d] = (uint32_t)enteredAt[d];
+        depth = d + 1;
+    }
+
+    void exit(Stage stage)
+    {
+        if (depth == 0 || stack[depth - 1] != stage) return;
+        uint8_t d = depth - 1;
+        int64_t elapsed = esp_timer_get_time() - enteredAt[d];
+        uint32_t us = elapsed > (int64_t)UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+        depth = d;
+
+        StageStats &s = stages[stage];
+        s.count++;
+        if (us > s.maxUs) s.maxUs = us;
+        s.durationUs.add(us);
+    }
+
+    // RAII helper: Health::Scope scope(Health::STAGE_MQTT_LOOP);
+    struct Scope {
+        Stage stage;
+        explicit Scope(Stage s) : stage(s) { enter(s); }
+        ~Scope() { exit(stage); }
+    };
+
+    // Ticker callback (esp_timer task): detect a stuck stage
+    void supervise()
+    {
+        uint8_t d = depth;
+        if (d == 0 || stallTriggered) return;
+
+        uint32_t stalled_ms = ((uint32_t)esp_timer_get_time() - enteredUs[d - 1]) / 1000;
+        if (stalled_ms < HEALTH_STALL_TIMEOUT_MS) return;
+
+        stallTriggered = true;
+        rtcStall.magic = STALL_MAGIC;
+        rtcStall.stage = stack[d - 1];
+        rtcStall.stalledMs = stalled_ms;
+        rtcStall.uptimeS = millis() / 1000;
+        const char *detail = detailFn ? detailFn() : nullptr;
+        strncpy(rtcStall.detail, detail ? detail : "", sizeof(rtcStall.detail) - 1);
+        rtcStall.detail[sizeof(rtcStall.detail) - 1] = '\0';
+
+        Serial.printf("STALL: stage '%s' (%s) stuck for %u ms - restarting\n",
+                      STAGE_NAMES[rtcStall.stage], rtcStall.detail, rtcStall.stalledMs);
+
+        Serial.flush();
+        ESP.restart();
+    }
+
+    void begin(DetailFn detail)
+    {
+        detailFn = detail;
+
+        // Pick up the report left by the previous boot
+        if (rtcStall.magic == STALL_MAGIC && rtcStall.stage < STAGE_COUNT) {
+            bootStall = rtcStall;
+            Serial.printf("Previous boot stalled in '%s' (%s) after %u ms\n",
+                          STAGE_NAMES[bootStall.stage], bootStall.detail, bootStall.stalledMs);
+        }
+        rtcStall.magic = 0;
+
+        // Hard backstop if even the supervisor can't run
+        esp_task_wdt_init(HEALTH_TWDT_TIMEOUT_S, true);
+        esp_task_wdt_add(NULL);
+
+        supervisorTicker.attach_ms(HEALTH_CHECK_INTERVAL, supervise);
+        Serial.printf("Health: stall timeout %dms, task WDT %ds\n",
+                      HEALTH_STALL_TIMEOUT_MS, HEALTH_TWDT_TIMEOUT_S);
+    }
+
+    // Called once per loop() iteration
+    void feed()
+    {
+        esp_task_wdt_reset();
+    }
+
+    // Stall report from the previous boot (magic == 0 if none)
+    const StallReport &pendingStall() { return bootStall; }
+    void clearPendingStall() { bootStall.magic = 0; }
+
+    size_t formatStall(const StallReport &report, char *buf, size_t size)
+    {
+        int len = snprintf(buf, size, "{\"stage\":\"%s\",\"detail\":\"%s\",\"ms\":%u,\"up\":%u}",
+                           STAGE_NAMES[report.stage], report.detail,
+                           (unsigned)report.stalledMs, (unsigned)report.uptimeS);
+        return len > 0 ? (size_t)len : 0;
+    }
+
+    // {"rst":reset_reason,"st":[[stage,count,p99_us,max_us],...]}
+    size_t formatReport(char *buf, size_t size)
+    {
+        int len = snprintf(buf, size, "{\"rst\":%d,\"st\":[", (int)esp_reset_reason());
+        for (uint8_t i = 0; i < STAGE_COUNT && len > 0 && (size_t)len < size; i++) {
+            const StageStats &s = stages[i];
+            len += snprintf(buf + len, size - len, "%s[\"%s\",%u,%u,%u]",
+                            i ? "," : "", STAGE_NAMES[i], (unsigned)s.count,
+                            (unsigned)s.durationUs.percentile(99),
+                            (unsigned)s.maxUs);
+        }
+        if (len > 0 && (size_t)len + 3 <= size) {
+            len += snprintf(buf + len, size - len, "]}");
+        }
+        return len > 0 ? (size_t)len : 0;
+    }
+}
@@ -0,0 +1,210 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+// ════════════════════════════════════════════════════════════════
+// HEAP ALLOCATION TRACKING
+// Counts malloc/calloc/realloc calls and requested bytes per
+// subsystem. The subsystem is the innermost Scope (loop() stages),
+// refined by detailFn (the running scheduler task). Scopes belong to
+// one task, the loop task; allocations from any other task (WiFi,
+// lwIP, timers, acquisition) land in "other".
+//
+// The hooks are compiled with HEAP_STATS_WRAP and need the linker
+// flags -Wl,--wrap=malloc,--wrap=free,--wrap=calloc,--wrap=realloc
+// (envs esp32doit-devkit-v1-heap and native_heap only).
+// Without them the counters stay at zero and only the heap layout
+// (free, largest block, minimum free) is reported. mbedTLS allocates
+// through heap_caps_calloc(), so TLS buffers only show up in the
+// layout numbers, not in the counters.
+// ════════════════════════════════════════════════════════════════
+
+namespace HeapStats
+{
+    struct Slot {
+        const char *name;
+        uint32_t allocs;
+        uint32_t bytes;                 // Requested bytes (not live bytes)
+    };
+
+    struct Layout {
+        uint32_t freeBytes = 0;
+        uint32_t largestBlock = 0;
+        uint32_t minFree = 0;           // Lowest free heap since boot
+    };
+
+    typedef const char *(*DetailFn)();
+    typedef Layout (*LayoutFn)();
+
+    // Slot 0 = "other"; the rest are filled in first-use order, by the
+    // scoped task only, so no lock is needed to add one
+    Slot slots[HEAP_STATS_SLOTS] = {{"other", 0, 0}};
+    volatile uint8_t slotCount = 1;
+    uint32_t frees = 0;
+
+    // Not thread_local: the hooks also run before FreeRTOS starts
+    const char *volatile current = nullptr;
+    const void *volatile owner = nullptr;      // Task that opened the scopes
+    DetailFn detailFn = nullptr;
+    LayoutFn layoutFn = nullptr;
+
+#ifdef ARDUINO
+    inline const void *self() { return xTaskGetCurrentTaskHandle(); }
+#else
+    inline const void *self() { return nullptr; }
+#endif
+
+    // RAII helper: HeapStats::Scope scope("mqtt_loop");
+    struct Scope {
+        const char *previous;
+        explicit Scope(const char *name) : previous(current)
+        {
+            owner = self();
+            current = name;
+        }
+        ~Scope() { current = previous; }
+    };
+
+    inline void begin(DetailFn detail, LayoutFn layout)
+    {
+        detailFn = detail;
+        layoutFn = layout;
+    }
+
+    inline Slot &slotFor(const char *name)
+    {
+        uint8_t n = slotCount;
+        // Names are string constants, pointer compare is enough
+        for (uint8_t i = 1; i < n; i++) {
+            if (slots[i].name == name) return slots[i];
+        }
+        if (n >= HEAP_STATS_SLOTS) return slots[0];
+        slots[n].name = name;
+        slotCount = n + 1;
+        return slots[n];
+    }
+
+    inline void onAlloc(size_t size)
+    {
+        const char *name = current;
+        Slot *slot = &slots[0];
+        if (name && owner == self()) {
+            const char *detail = detailFn ? detailFn() : nullptr;
+            slot = &slotFor(detail ? detail : name);
+        }
+        __atomic_fetch_add(&slot->allocs, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&slot->bytes, (uint32_t)size, __ATOMIC_RELAXED);
+    }
+
+    inline void onFree() { __atomic_fetch_add(&frees, 1, __ATOMIC_RELAXED); }
+
+    inline uint32_t totalAllocs()
+    {
+        uint32_t total = 0;
+        for (uint8_t i = 0; i < slotCount; i++) total += slots[i].allocs;
+        return total;
+    }
+
+    inline uint32_t totalBytes()
+    {
+        uint32_t total = 0;
+        for (uint8_t i = 0; i < slotCount; i++) total += slots[i].bytes;
+        return total;
+    }
+
+    // 100 - largest block as % of free heap (0 = one contiguous block)
+    inline uint8_t fragmentation(const Layout &l)
+    {
+        if (l.freeBytes == 0) return 0;
+        return (uint8_t)(100 - (uint64_t)l.largestBlock * 100 / l.freeBytes);
+    }
+
+    // Appends ,"heap":[free,largest,min_free,frag%],
+    // "alloc":[allocs,frees,bytes,[[subsystem,allocs,bytes],...]]
+    // (heap only when a layout source is bound)
+    size_t formatReport(char *buf, size_t size)
+    {
+        int len = 0;
+        if (layoutFn) {
+            Layout l = layoutFn();
+            len = snprintf(buf, size, ",\"heap\":[%u,%u,%u,%u]", (unsigned)l.freeBytes,
+                           (unsigned)l.largestBlock, (unsigned)l.minFree, (unsigned)fragmentation(l));
+        }
+        if (len >= 0 && (size_t)len < size) {
+            len += snprintf(buf + len, size - len, ",\"alloc\":[%u,%u,%u,[", (unsigned)totalAllocs(),
+                            (unsigned)frees, (unsigned)totalBytes());
+        }
+        // Slots that don't fit are dropped; the closing brackets always
+        // fit, or nothing is appended
+        if (len <= 0 || (size_t)len + 3 > size) return 0;
+        uint8_t n = slotCount;
+        for (uint8_t i = 0; i < n; i++) {
+            char entry[48];
+            int e = snprintf(entry, sizeof(entry), "%s[\"%s\",%u,%u]", i ? "," : "", slots[i].name,
+                             (unsigned)slots[i].allocs, (unsigned)slots[i].bytes);
+            if (e <= 0 || e >= (int)sizeof(entry) || (size_t)(len + e + 3) > size) break;
+            memcpy(buf + len, entry, e);
+            len += e;
+        }
+        len += snprintf(buf + len, size - len, "]]");
+        return (size_t)len;
+    }
+}
+
+#ifdef HEAP_STATS_WRAP
+extern "C" {
+    void *__real_malloc(size_t size);
+    void __real_free(void *ptr);
+    void *__real_calloc(size_t n, size_t size);
+    void *__real_realloc(void *ptr, size_t size);
+
+    void *__wrap_malloc(size_t size)
+    {
+        HeapStats::onAlloc(size);
+        return __real_malloc(size);
+    }
+
+    void __wrap_free(void *ptr)
+    {
+        if (ptr) HeapStats::onFree();
+        __real_free(ptr);
+    }
+
+    void *__wrap_calloc(size_t n, size_t size)
+    {
+        HeapStats::onAlloc(n * size);
+        return __real_calloc(n, size);
+    }
+
+    // String growth goes through here
+    void *__wrap_realloc(void *ptr, size_t size)
+    {
+        if (size) HeapStats::onAlloc(size);
+        if (ptr) HeapStats::onFree();
+        return __real_realloc(ptr, size);
+    }
+}
+
+#ifndef ARDUINO
+// On the host libstdc++'s operator new calls malloc inside the shared
+// library, which the linker wrap doesn't reach
+void *operator new(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+    if (!p) abort();
+    return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+#endif
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// ════════════════════════════════════════════════════════════════
+// LOG2-BUCKETED HISTOGRAM
+// Bucket 0 holds the value 0, bucket i holds [2^(i-1), 2^i).
+// The last bucket collects everything above its lower bound.
+// ════════════════════════════════════════════════════════════════
+
+template <uint8_t N>
+struct LogHistogram
+{
+    uint32_t buckets[N];
+    uint32_t count;
+    uint32_t max;
+
+    LogHistogram() { reset(); }
+
+    void reset()
+    {
+        memset(buckets, 0, sizeof(buckets));
+        count = 0;
+        max = 0;
+    }
+
+    static uint8_t bucketOf(uint32_t value)
+    {
+        uint8_t b = value == 0 ? 0 : (uint8_t)(32 - __builtin_clz(value));
+        return b < N ? b : N - 1;
+    }
+
+    // Upper bound of a bucket (inclusive), used to report percentiles
+    static uint32_t upperBound(uint8_t bucket)
+    {
+        if (bucket == 0) return 0;
+        if (bucket >= 32) return UINT32_MAX;
+        return (1UL << bucket) - 1;
+    }
+
+    void add(uint32_t value)
+    {
+        buckets[bucketOf(value)]++;
+        count++;
+        if (value > max) max = value;
+    }
+
+    // Percentile estimate (0-100), rounded up to the bucket bound and
+    // clamped to the observed maximum
+    uint32_t percentile(uint8_t pct) const
+    {
+        if (count == 0) return 0;
+        uint32_t rank = (uint32_t)(((uint64_t)count * pct + 99) / 100);
+        if (rank == 0) rank = 1;
+        uint32_t seen = 0;
+        for (uint8_t i = 0; i < N; i++) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                uint32_t bound = upperBound(i);
+                return (i == N - 1 || bound > max) ? max : bound;
+            }
+        }
+        return max;
+    }
+};
@@ -0,0 +1,122 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+// ════════════════════════════════════════════════════════════════
+// LCD SHADOW FRAMEBUFFER
+// Screens are rendered into a back buffer; flush() diffs it against
+// what the panel currently shows and only sends changed cells with
+// cursor-addressed writes. No clear(), so no 2ms blank / flicker.
+// Works with any display exposing writeRun(col, row, text, len).
+// ════════════════════════════════════════════════════════════════
+
+template <uint8_t COLS, uint8_t ROWS>
+class LcdBuffer
+{
+public:
+    struct Stats {
+        uint32_t flushes = 0;
+        uint32_t cellsWritten = 0;
+        uint32_t cursorMoves = 0;
+    };
+
+    LcdBuffer()
+    {
+        clear();
+        invalidate();
+    }
+
+    // Blank the back buffer (nothing is sent until flush)
+    void clear()
+    {
+        memset(next_, ' ', sizeof(next_));
+    }
+
+    // Panel content unknown (after init / external clear): redraw all
+    void invalidate()
+    {
+        memset(shown_, 0, sizeof(shown_));
+    }
+
+    // Write text at (col,row), clipped to the row
+    void print(uint8_t col, uint8_t row, const char *text)
+    {
+        if (row >= ROWS) return;
+        for (; col < COLS && *text; col++, text++) {
+            next_[row][col] = *text;
+        }
+    }
+
+    void printf(uint8_t col, uint8_t row, const char *fmt, ...)
+        __attribute__((format(printf, 4, 5)))
+    {
+        char line[COLS + 1];
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(line, sizeof(line), fmt, args);
+        va_end(args);
+        print(col, row, line);
+    }
+
+    // Replace a whole row (padded with spaces)
+    void setRow(uint8_t row, const char *text)
+    {
+        if (row >= ROWS) return;
+        memset(next_[row], ' ', COLS);
+        print(0, row, text);
+    }
+
+    void putChar(uint8_t col, uint8_t row, char c)
+    {
+        if (row < ROWS && col < COLS) next_[row][col] = c;
+    }
+
+    // Send changed cells. Runs separated by fewer than MERGE_GAP unchanged
+    // cells are merged: rewriting a cell costs the same as a cursor move.
+    // Returns the number of LCD sends (characters + cursor commands).
+    // Each run goes to the display as one writeRun() call.
+    template <class Display>
+    uint16_t flush(Display &lcd)
+    {
+        const uint8_t MERGE_GAP = 2;
+        uint16_t sends = 0;
+
+        for (uint8_t row = 0; row < ROWS; row++) {
+            uint8_t col = 0;
+            while (col < COLS) {
+                if (next_[row][col] == shown_[row][col]) {
+                    col++;
+                    continue;
+                }
+
+                // Extend the run while changes keep appearing within MERGE_GAP
+                uint8_t start = col;
+                uint8_t end = col + 1;
+                for (uint8_t probe = end; probe < COLS && probe < end + MERGE_GAP; probe++) {
+                    if (next_[row][probe] != shown_[row][probe]) end = probe + 1;
+                }
+
+                lcd.writeRun(start, row, &next_[row][start], end - start);
+                memcpy(&shown_[row][start], &next_[row][start], end - start);
+                stats_.cursorMoves++;
+                sends++;
+                stats_.cellsWritten += end - start;
+                sends += end - start;
+                col = end;
+            }
+        }
+
+        stats_.flushes++;
+        return sends;
+    }
+
+    const char *row(uint8_t r) const { return next_[r]; }     // Not NUL-terminated
+    const Stats &stats() const { return stats_; }
+
+private:
+    char next_[ROWS][COLS];
+    char shown_[ROWS][COLS];
+    Stats stats_;
+};
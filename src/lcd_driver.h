@@ -0,0 +1,195 @@
+#pragma once
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+// ════════════════════════════════════════════════════════════════
+// HD44780 OVER PCF8574 I2C BACKPACK - BATCHED WRITES
+// LiquidCrystal_I2C sends every nibble as three single-byte Wire
+// transactions (data, EN high, EN low): 6 transactions per character.
+// This driver packs the expander byte sequence for a whole run
+// (cursor command + characters) into one Wire transaction. The
+// PCF8574 latches each byte as it is ACKed, so at 100kHz each byte
+// holds for ~90µs - well above the 450ns EN pulse and the 37µs
+// HD44780 execution time.
+// ════════════════════════════════════════════════════════════════
+
+class LcdDriver
+{
+public:
+    // PCF8574 → HD44780 wiring used by the common backpacks
+    static const uint8_t PIN_RS = 0x01;
+    static const uint8_t PIN_EN = 0x04;
+    static const uint8_t PIN_BACKLIGHT = 0x08;
+
+    static const uint8_t CMD_CLEAR = 0x01;
+    static const uint8_t CMD_ENTRY_MODE = 0x06;         // Increment, no shift
+    static const uint8_t CMD_DISPLAY_ON = 0x0C;         // Display on, cursor/blink off
+    static const uint8_t CMD_FUNCTION_SET = 0x28;       // 4-bit, 2 lines, 5x8
+    static const uint8_t CMD_SET_CGRAM = 0x40;
+    static const uint8_t CMD_SET_DDRAM = 0x80;
+
+    struct Stats {
+        uint32_t transactions = 0;
+        uint32_t busBytes = 0;          // Including the address byte
+        uint32_t errors = 0;            // endTransmission() != 0
+    };
+
+    LcdDriver(Hal::I2cBus &bus, uint8_t addr, uint8_t cols, uint8_t rows)
+        : bus_(bus), addr_(addr), cols_(cols), rows_(rows) {}
+
+    // Datasheet 4-bit init sequence (fig. 24). Caller has begun Wire.
+    void init()
+    {
+        Hal::delayMicros(50000);
+        expanderWrite(0);
+
+        // Three times 0x3 (8-bit), then 0x2 to switch to 4-bit
+        for (uint8_t i = 0; i < 3; i++) {
+            writeNibbleSlow(0x30);
+            Hal::delayMicros(4500);
+        }
+        writeNibbleSlow(0x20);
+        Hal::delayMicros(150);
+
+        command(CMD_FUNCTION_SET);
+        command(CMD_DISPLAY_ON);
+        command(CMD_ENTRY_MODE);
+        clear();
+    }
+
+    void backlight(bool on = true)
+    {
+        backlight_ = on ? PIN_BACKLIGHT : 0;
+        expanderWrite(0);
+    }
+
+    void clear()
+    {
+        command(CMD_CLEAR);
+        Hal::delayMicros(2000);       // Clear takes 1.52ms
+    }
+
+    void command(uint8_t value)
+    {
+        begin();
+        pushByte(value, 0);
+        end();
+    }
+
+    void setCursor(uint8_t col, uint8_t row)
+    {
+        command(ddramAddress(col, row));
+    }
+
+    size_t write(uint8_t value)
+    {
+        begin();
+        pushByte(value, PIN_RS);
+        end();
+        return 1;
+    }
+
+    // Cursor move + characters, batched into as few transactions as the
+    // Wire buffer allows (one for a full 16-column row)
+    void writeRun(uint8_t col, uint8_t row, const char *text, uint8_t len)
+    {
+        begin();
+        pushByte(ddramAddress(col, row), 0);
+        for (uint8_t i = 0; i < len; i++) {
+            pushByte((uint8_t)text[i], PIN_RS);
+        }
+        end();
+    }
+
+    // Load a 5x8 custom glyph (location 0-7) in one batched write
+    void createChar(uint8_t location, const uint8_t charmap[8])
+    {
+        begin();
+        pushByte(CMD_SET_CGRAM | ((location & 0x07) << 3), 0);
+        for (uint8_t i = 0; i < 8; i++) {
+            pushByte(charmap[i], PIN_RS);
+        }
+        end();
+    }
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    // 4 expander bytes per LCD byte + one setup byte on RS changes
+    static const uint8_t CHUNK = LCD_I2C_CHUNK;
+
+    Hal::I2cBus &bus_;
+    uint8_t addr_;
+    uint8_t cols_;
+    uint8_t rows_;
+    uint8_t backlight_ = PIN_BACKLIGHT;
+
+    uint8_t buf_[CHUNK];
+    uint8_t len_ = 0;
+    int16_t lastMode_ = -1;             // RS level of the last byte queued
+
+    uint8_t ddramAddress(uint8_t col, uint8_t row) const
+    {
+        static const uint8_t ROW_OFFSETS[4] = {0x00, 0x40, 0x14, 0x54};
+        if (row >= rows_) row = rows_ - 1;
+        if (col >= cols_) col = cols_ - 1;
+        return CMD_SET_DDRAM | (ROW_OFFSETS[row & 0x03] + col);
+    }
+
+    void begin()
+    {
+        len_ = 0;
+        lastMode_ = -1;
+    }
+
+    void end()
+    {
+        if (len_ == 0) return;
+        if (!bus_.write(addr_, buf_, len_)) stats_.errors++;
+        stats_.transactions++;
+        stats_.busBytes += len_ + 1;
+        len_ = 0;
+        lastMode_ = -1;
+    }
+
+    void pushByte(uint8_t value, uint8_t mode)
+    {
+        // Worst case 5 bytes; start a new transaction if they don't fit
+        if (len_ + 5 > CHUNK) end();
+        pushNibble(value & 0xF0, mode);
+        pushNibble((value << 4) & 0xF0, mode);
+    }
+
+    void pushNibble(uint8_t nibble, uint8_t mode)
+    {
+        uint8_t bits = nibble | mode | backlight_;
+        if (lastMode_ != mode) {
+            // RS must be stable before EN rises
+            buf_[len_++] = bits;
+            lastMode_ = mode;
+        }
+        buf_[len_++] = bits | PIN_EN;  // EN high: data latched on the falling edge
+        buf_[len_++] = bits;           // EN low
+    }
+
+    // Init-time nibble with explicit settle delays
+    void writeNibbleSlow(uint8_t nibble)
+    {
+        expanderWrite(nibble);
+        expanderWrite(nibble | PIN_EN);
+        Hal::delayMicros(1);
+        expanderWrite(nibble);
+        Hal::delayMicros(50);
+    }
+
+    void expanderWrite(uint8_t bits)
+    {
+        uint8_t byte = bits | backlight_;
+        if (!bus_.write(addr_, &byte, 1)) stats_.errors++;
+        stats_.transactions++;
+        stats_.busBytes += 2;
+    }
+
+    Stats stats_;
+};
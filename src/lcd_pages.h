@@ -0,0 +1,151 @@
+#pragma once
+#include <stdint.h>
+
+// ════════════════════════════════════════════════════════════════
+// LCD PAGE REGISTRY
+// Each page is a render function into the shadow buffer plus an
+// input-version function. Pages rotate by their own dwell time; a
+// page is only re-rendered while visible and when its version
+// changes, so formatting work is skipped for unchanged screens.
+// ════════════════════════════════════════════════════════════════
+
+template <class Buffer, uint8_t MAX_PAGES>
+class LcdPages
+{
+public:
+    typedef void (*RenderFn)(Buffer &buf);
+    typedef uint32_t (*VersionFn)();        // Changes when the page inputs change
+    typedef bool (*EnabledFn)();            // Optional: skip page in rotation
+
+    struct Stats {
+        uint32_t renders = 0;
+        uint32_t skipped = 0;               // update() with nothing to redraw
+    };
+
+    int8_t add(const char *name, RenderFn render, VersionFn version,
+               uint32_t dwell_ms, EnabledFn enabled = nullptr)
+    {
+        if (count_ >= MAX_PAGES || render == nullptr) return -1;
+        Page &p = pages_[count_];
+        p.name = name;
+        p.render = render;
+        p.version = version;
+        p.dwellMs = dwell_ms;
+        p.enabled = enabled;
+        return count_++;
+    }
+
+    // Force a redraw on the next update (e.g. after an overlay)
+    void invalidate() { dirty_ = true; }
+
+    // Rotate if the dwell expired, then render the visible page if its
+    // inputs changed. Returns true when the buffer was redrawn.
+    bool update(uint32_t now_ms, Buffer &buf)
+    {
+        if (count_ == 0) return false;
+
+        if (!started_) {
+            started_ = true;
+            shownSinceMs_ = now_ms;
+            dirty_ = true;
+        } else if (now_ms - shownSinceMs_ >= pages_[current_].dwellMs) {
+            advance();
+            shownSinceMs_ = now_ms;
+        }
+
+        const Page &p = pages_[current_];
+        uint32_t version = p.version ? p.version() : 0;
+        if (!dirty_ && version == lastVersion_) {
+            stats_.skipped++;
+            return false;
+        }
+
+        buf.clear();
+        p.render(buf);
+        lastVersion_ = version;
+        dirty_ = false;
+        stats_.renders++;
+        return true;
+    }
+
+    // Jump to the next enabled page now
+    void advance()
+    {
+        for (uint8_t i = 0; i < count_; i++) {
+            current_ = (current_ + 1) % count_;
+            const Page &p = pages_[current_];
+            if (p.enabled == nullptr || p.enabled()) break;
+        }
+        dirty_ = true;
+    }
+
+    const char *currentName() const { return count_ ? pages_[current_].name : ""; }
+    const Stats &stats() const { return stats_; }
+
+private:
+    struct Page {
+        const char *name;
+        RenderFn render;
+        VersionFn version;
+        uint32_t dwellMs;
+        EnabledFn enabled;
+    };
+
+    Page pages_[MAX_PAGES];
+    uint8_t count_ = 0;
+    uint8_t current_ = 0;
+    uint32_t shownSinceMs_ = 0;
+    uint32_t lastVersion_ = 0;
+    bool started_ = false;
+    bool dirty_ = true;
+    Stats stats_;
+};
+
+// ════════════════════════════════════════════════════════════════
+// BAR GRAPH (custom glyphs)
+// CGRAM slots 1-4 hold 1-4 filled pixel columns; a full cell uses the
+// ROM block 0xFF. Slot 0 is avoided because the shadow buffer uses 0
+// to mark unknown cells.
+// ════════════════════════════════════════════════════════════════
+
+namespace LcdBar
+{
+    const uint8_t GLYPH_FIRST = 1;
+    const char FULL_BLOCK = (char)0xFF;
+
+    const uint8_t GLYPHS[4][8] = {
+        {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10},
+        {0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18},
+        {0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C},
+        {0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E},
+    };
+
+    template <class Display>
+    void loadGlyphs(Display &lcd)
+    {
+        for (uint8_t i = 0; i < 4; i++) {
+            lcd.createChar(GLYPH_FIRST + i, GLYPHS[i]);
+        }
+    }
+
+    // Draw value/max as a bar of `width` cells (5 pixel columns each)
+    template <class Buffer>
+    void render(Buffer &buf, uint8_t col, uint8_t row, uint8_t width, float value, float max)
+    {
+        uint16_t total = (uint16_t)width * 5;
+        uint16_t pixels = 0;
+        if (max > 0.0f && value > 0.0f) {
+            float ratio = value / max;
+            pixels = ratio >= 1.0f ? total : (uint16_t)(ratio * total + 0.5f);
+        }
+
+        for (uint8_t i = 0; i < width; i++) {
+            uint16_t cell = pixels > 5 ? 5 : pixels;
+            pixels -= cell;
+            char c = cell == 5 ? FULL_BLOCK
+                   : cell == 0 ? ' '
+                   : (char)(GLYPH_FIRST + cell - 1);
+            buf.putChar(col + i, row, c);
+        }
+    }
+}
@@ -12,40 +12,123 @@
 #include "ca_cert_emqx.h"
 #include <PubSubClient.h>
 #include "MQTT.h"
+#include "metrics.h"
+#include "heap_stats.h"
+#include "profile.h"
+#include "scheduler.h"
+#include "power.h"
+#include "health.h"
+#include "lcd_driver.h"
+#include "screens.h"
+#include "acquisition.h"
+#include "control.h"
+#include "relay_store.h"
+#include "aggregate.h"
+#include "tariff.h"
+#include "nilm.h"
+#include "anomaly.h"
+#include "commands.h"
+#include "trace.h"
+#include "hal_esp32.h"
 
 // Libraries
-#include <Ticker.h>
 #include <Wire.h>
 #include <Adafruit_SHT31.h>
 #include <PZEM004Tv30.h>
-#include <LiquidCrystal_I2C.h>
+#include <Preferences.h>
+#include <LittleFS.h>
+#include <time.h>
+#include <esp_heap_caps.h>
 
 namespace
 {
     // WiFi & MQTT
     const char *ssid = WiFiSecrets::ssid;
     const char *password = WiFiSecrets::pass;
-    String client_id_string;
-    const char *client_id;
+    char client_id[24];                 // "esp32-" + MAC, no separators
 
-    // Hardware Objects
+    // Hardware Objects (device access goes through the HAL, see hal.h)
     Adafruit_SHT31 sht31 = Adafruit_SHT31();
     PZEM004Tv30 pzem(Serial2, PZEM_RX, PZEM_TX);
-    LiquidCrystal_I2C lcd(LCD_I2C_ADDR, 16, 2);
+    Hal::ArduinoClock halClock;
+    Hal::ArduinoGpio gpio;
+    Hal::PzemMeter powerMeter(pzem);
+    Hal::Sht31Sensor climate(sht31, SHT31_I2C_ADDR);
+    Hal::WireBus i2c(Wire);
+    LcdDriver lcd(i2c, LCD_I2C_ADDR, LCD_COLS, LCD_ROWS);
     
     WiFiClientSecure tlsClient;
     PubSubClient mqttClient(tlsClient);
+    Hal::PubSubTransport mqttTransport(mqttClient);   // Control publishes through the HAL
 
-    // Tickers
-    Ticker dhtTicker;
-    Ticker pzemTicker;
-    Ticker lcdTicker;
-    Ticker ledBlinkTicker;
-    Ticker systemInfoTicker;
-    Ticker tempCheckTicker;  
+    // Scheduler (replaces Tickers + millis() polling)
+    uint32_t schedulerClock() { return micros(); }
+    Sched::Scheduler<SCHED_MAX_TASKS> scheduler(schedulerClock);
+    int8_t ledBlinkTask = Sched::INVALID_TASK;
+    
+    // Relay, TOU schedule, demand outputs and rules live in Control
+    // (control.h); schedule rules and rule source are kept in NVS here
+    
+    // Windowed aggregates (1 min / 15 min frames)
+    enum AggMetric : uint8_t {
+        AGG_VOLTAGE = 0,
+        AGG_CURRENT,
+        AGG_POWER,
+        AGG_FREQUENCY,
+        AGG_PF,
+        AGG_TEMPERATURE,
+        AGG_HUMIDITY,
+        AGG_COUNT
+    };
+    const char *const AGG_NAMES[AGG_COUNT] = {"v", "i", "p", "f", "pf", "temp", "hum"};
+    const uint8_t AGG_DECIMALS[AGG_COUNT] = {1, 3, 1, 1, 2, 1, 1};
+    Aggregate::Window<AGG_COUNT> aggShort(AGG_SHORT_WINDOW_MS, AGG_NAMES, AGG_DECIMALS);
+    Aggregate::Window<AGG_COUNT> aggLong(AGG_LONG_WINDOW_MS, AGG_NAMES, AGG_DECIMALS);
+    uint32_t aggLastSampleMs = 0;
+    bool rawPublish = AGG_RAW_PUBLISH;   // false: only aggregate frames go out
+    
+    // Day / month energy and tiered cost (state kept in NVS)
+    const Tariff::Tier TARIFF_TABLE[] = TARIFF_TIERS;
+    Tariff::Ledger energyLedger(TARIFF_TABLE, sizeof(TARIFF_TABLE) / sizeof(TARIFF_TABLE[0]), TARIFF_VAT_PERCENT);
+    uint32_t tariffLastSaveMs = 0;
+    uint8_t tariffClosedPending = Tariff::CLOSED_NONE;   // Closed summaries not yet published
+    
+    // NILM-lite appliance signatures (learned table kept in NVS)
+    const Nilm::Config NILM_CONFIG = {NILM_NOISE_W, NILM_MIN_STEP_W, NILM_MATCH_RATIO,
+                                      NILM_MATCH_MIN_W, NILM_STABLE_SAMPLES};
+    Nilm::Detector<NILM_MAX_SIGNATURES> nilm(NILM_CONFIG);
+    uint32_t nilmLastSampleMs = 0;
+    uint32_t nilmLastSaveMs = 0;
+    uint32_t nilmSavedSteps = 0;
+    
+    // Anomaly baselines per hour of day (model kept in NVS)
+    enum AnomalyMetric : uint8_t {
+        ANOMALY_POWER = 0,
+        ANOMALY_TEMPERATURE,
+        ANOMALY_COUNT
+    };
+    const char *const ANOMALY_NAMES[ANOMALY_COUNT] = {"p", "temp"};
+    const float ANOMALY_MIN_SD[ANOMALY_COUNT] = {ANOMALY_MIN_SD_POWER, ANOMALY_MIN_SD_TEMP};
+    const Anomaly::Config ANOMALY_CONFIG = {ANOMALY_ALPHA, ANOMALY_THRESHOLD, ANOMALY_CLEAR_RATIO, ANOMALY_WARMUP};
+    Anomaly::Detector<ANOMALY_COUNT> anomaly(ANOMALY_CONFIG, ANOMALY_MIN_SD);
+    uint32_t anomalyLastSaveMs = 0;
+    
+    // Trace recording for host replay (session only, see trace.h)
+    enum TraceMode : uint8_t {
+        TRACE_OFF = 0,
+        TRACE_SERIAL,
+        TRACE_FLASH
+    };
+    const char *const TRACE_MODE_NAMES[] = {"OFF", "SERIAL", "FLASH"};
+    uint8_t traceMode = TRACE_OFF;
+    Trace::Writer<TRACE_BUFFER_SIZE> traceWriter;
+    portMUX_TYPE traceLock = portMUX_INITIALIZER_UNLOCKED;   // Acquisition task + loop()
+    bool traceFsMounted = false;
+    uint32_t traceFileBytes = 0;
+    int32_t traceDumpOffset = -1;        // >= 0 while the file is dumped to serial
+    bool traceStatusPending = false;
     
     // State Variables
-    bool relayState = false;
     bool ledResetActive = false;
     int ledBlinkCount = 0;
     
@@ -53,60 +136,85 @@ namespace
     bool currentButtonState = HIGH;
     unsigned long lastDebounceTime = 0;
     
-    int lcdDisplayMode = 0;
-    unsigned long lastLcdUpdate = 0;
-    
-    unsigned long relay_on_time = 0;
-    unsigned long relay_off_time = 0;
-    unsigned long last_state_change = 0;
-    bool last_relay_state = false;
+    // PZEM energy reset (requested from MQTT/button, run by scheduler)
+    int8_t pzemResetTask = Sched::INVALID_TASK;
+    bool pzemResetPending = false;
+    uint32_t pzemResetRequestUs = 0;
     
     int currentSystemInfoIndex = 0;
-    
-    bool relayOffByOverTemp = false;     // Relay bị tắt do quá nhiệt
-    bool wasRelayOnBeforeTrip = false;   // Trạng thái relay trước khi trip
-    
-    // Display Data Struct
-    struct DisplayData {
-        float voltage = 0.0f;
-        float current = 0.0f;
-        float power = 0.0f;
-        float energy = 0.0f;
-        float frequency = 0.0f;
-        float powerFactor = 0.0f;
-        float temperature = 0.0f;
-        float humidity = 0.0f;
-        bool relayState = false;
-        bool dataValid = false;
-    } displayData;
 }
 
 // Function Prototypes
 void ledBlinkCallback();
 void startLedResetIndicator();
 void publishSystemInfoByIndex();
-void updateRelayStats();
+bool publishValue(const char *topic, float value, uint8_t decimals, bool retained = false);
+HeapStats::Layout heapLayout();
+void persistRelayTask();
+void persistRelayNow();
 void publishRelayStats();
-void updateLCD();
+void publishLcdStats();
+void publishRelayStatsTask();
+void publishMetricsTask();
+void publishSchedulerReport();
+void heartbeatTask();
+void publishPowerReport();
+void publishHealthReport();
+void handleProtectionTrip();
+void publishProtectionReport();
+void handlePowerQualityEvents();
+void publishPowerQualityReport();
+const char *currentTaskName();
 void dhtReadPublish();
 void pzemReadPublish();
-void controlRelay(bool state);
-void toggleRelay();
 void resetPzemEnergy();
+void requestPzemReset();
 void handleButton();
 void mqttCallback(char *topic, uint8_t *payload, unsigned int length);
 void scanI2C();
 void checkTemperatureProtection();  
+void logLine(const char *line);
+float meterEnergy();
+void loadRelaySchedule();
+void saveRelaySchedule();
+void setRelaySchedule(const char *text);
+void relayScheduleTask();
+void demandTask();
+void loadRules();
+void setRules(const char *text);
+void rulesTask();
+void aggregateTask();
+void loadEnergyLedger();
+void saveEnergyLedger();
+void localDate(int32_t &day, int32_t &month);
+size_t formatEnergySummary(char *buf, size_t size, const Tariff::Summary &summary, bool monthly);
+void tariffTask();
+void publishClosedSummaries();
+void publishEnergySummaries();
+void loadNilmTable();
+void saveNilmTable();
+void nilmTask();
+void publishNilmSignatures();
+void loadAnomalyModel();
+void saveAnomalyModel();
+void checkAnomalies();
+void publishAggregate(Aggregate::Window<AGG_COUNT> &window, const char *topic);
+void traceSample(const PowerSample &s);
+void traceInput(uint8_t type, uint8_t id, const char *payload, float a, float b);
+void setTraceMode(const char *command);
+void traceTask();
+void publishTraceStatus();
+void dumpProfile(const char *command);
 
 // LED Blink Callback (cho PZEM reset indicator)
 void ledBlinkCallback()
 {
     if (ledBlinkCount < LED_BLINK_TOTAL) {
-        digitalWrite(LED_RESET_PIN, !digitalRead(LED_RESET_PIN));
+        gpio.write(LED_RESET_PIN, !gpio.read(LED_RESET_PIN));
         ledBlinkCount++;
     } else {
-        ledBlinkTicker.detach();
-        digitalWrite(LED_RESET_PIN, LOW);
+        scheduler.stop(ledBlinkTask);
+        gpio.write(LED_RESET_PIN, LOW);
         ledResetActive = false;
         ledBlinkCount = 0;
     }
@@ -116,8 +224,8 @@ void startLedResetIndicator()
 {
     ledResetActive = true;
     ledBlinkCount = 0;
-    digitalWrite(LED_RESET_PIN, HIGH);
-    ledBlinkTicker.attach_ms(LED_BLINK_INTERVAL, ledBlinkCallback);
+    gpio.write(LED_RESET_PIN, HIGH);
+    scheduler.start(ledBlinkTask, LED_BLINK_INTERVAL);
 }
 
 // Scan I2C Devices (Debug)
@@ -128,8 +236,7 @@ void scanI2C()
     
     for (byte i = 8; i < 120; i++)
     {
-        Wire.beginTransmission(i);
-        if (Wire.endTransmission() == 0)
+        if (i2c.probe(i))
         {
             Serial.print("   Found device at 0x");
             if (i < 16) Serial.print("0");
@@ -156,93 +263,68 @@ void scanI2C()
 
 void checkTemperatureProtection()
 {
-    float currentTemp = displayData.temperature;
-    
-    // Skip nếu temperature không hợp lệ
-    if (isnan(currentTemp) || currentTemp < -40 || currentTemp > 125) {
-        return;
-    }
+    float currentTemp = Screens::data.temperature;
+    uint8_t action = Control::checkTemperature(currentTemp);
     
     // ════════════════════════════════════════
     // CASE 1: Nhiệt độ QUÁ NGƯỠNG
     // ════════════════════════════════════════
-    if (currentTemp > TEMP_THRESHOLD)
+    if (action == TempGuard::ACTION_TRIP)
     {
-        if (relayState == true)  // Relay đang ON
-        {
-            Serial.println("════════════════════════════════════════");
-            Serial.printf("OVER TEMPERATURE PROTECTION!\n");
-            Serial.printf("   Current: %.1f°C > Threshold: %.1f°C\n", 
-                         currentTemp, TEMP_THRESHOLD);
-            Serial.println("AUTO TURNING RELAY OFF!");
-            Serial.println("════════════════════════════════════════");
-            
-            // Lưu trạng thái trước khi tắt
-            wasRelayOnBeforeTrip = true;
-            relayOffByOverTemp = true;
-            
-            // Tắt relay (gọi function có sẵn)
-            updateRelayStats();
-            relayState = false;
-            displayData.relayState = false;
-            digitalWrite(RELAY_PIN, HIGH); // Active LOW - OFF
-            
-            // Publish status
-            mqttClient.publish(MQTTTopics::RELAY_STATUS, "OFF", true);
-            mqttClient.publish(MQTTTopics::RELAY_EVENT, "OFF:OVER_TEMP", false);
-            
-            last_relay_state = relayState;
-            
-            // Hiển thị LCD
-            lcd.clear();
-            lcd.setCursor(0, 0);
-            lcd.print("OVER TEMP!");
-            lcd.setCursor(0, 1);
-            lcd.printf("%.1fC RELAY OFF", currentTemp);
-        }
+        Serial.println("════════════════════════════════════════");
+        Serial.printf("OVER TEMPERATURE PROTECTION!\n");
+        Serial.printf("   Current: %.1f°C > Threshold: %.1f°C\n", 
+                     currentTemp, TEMP_THRESHOLD);
+        Serial.println("AUTO TURNING RELAY OFF!");
+        Serial.println("════════════════════════════════════════");
+        
+        // Hiển thị LCD
+        char line[17];
+        snprintf(line, sizeof(line), "%.1fC RELAY OFF", currentTemp);
+        Screens::showMessage("OVER TEMP!", line, LCD_MESSAGE_DURATION);
     }
     
     // ════════════════════════════════════════
     // CASE 2: Nhiệt độ TRỞ VỀ AN TOÀN
     // ════════════════════════════════════════
-    else if (currentTemp < (TEMP_THRESHOLD - TEMP_HYSTERESIS))
+    else if (action == TempGuard::ACTION_RECOVER)
     {
-        if (relayOffByOverTemp && wasRelayOnBeforeTrip)
-        {
-            Serial.println("════════════════════════════════════════");
-            Serial.printf("Temperature back to safe level\n");
-            Serial.printf("Current: %.1f°C < %.1f°C\n", 
-                         currentTemp, TEMP_THRESHOLD - TEMP_HYSTERESIS);
-            Serial.println("AUTO TURNING RELAY ON!");
-            Serial.println("════════════════════════════════════════");
-            
-            // Bật relay trở lại
-            updateRelayStats();
-            relayState = true;
-            displayData.relayState = true;
-            digitalWrite(RELAY_PIN, LOW); // Active LOW - ON
-            
-            // Publish status
-            mqttClient.publish(MQTTTopics::RELAY_STATUS, "ON", true);
-            mqttClient.publish(MQTTTopics::RELAY_EVENT, "ON:TEMP_RECOVERED", false);
-            
-            last_relay_state = relayState;
-            
-            // Reset flags
-            relayOffByOverTemp = false;
-            wasRelayOnBeforeTrip = false;
-            
-            // Hiển thị LCD
-            lcd.clear();
-            lcd.setCursor(0, 0);
-            lcd.print("TEMP RECOVERED");
-            lcd.setCursor(0, 1);
-            lcd.printf("%.1fC RELAY ON", currentTemp);
-        }
+        Serial.println("════════════════════════════════════════");
+        Serial.printf("Temperature back to safe level\n");
+        Serial.printf("Current: %.1f°C < %.1f°C\n", 
+                     currentTemp, TEMP_THRESHOLD - TEMP_HYSTERESIS);
+        Serial.println("AUTO TURNING RELAY ON!");
+        Serial.println("════════════════════════════════════════");
+        
+        // Hiển thị LCD
+        char line[17];
+        snprintf(line, sizeof(line), "%.1fC RELAY ON", currentTemp);
+        Screens::showMessage("TEMP RECOVERED", line, LCD_MESSAGE_DURATION);
     }
 }
 
-// Publish System Info (Rotated by Ticker)
+// Fixed-decimal reading, formatted on the stack (no String temporary)
+bool publishValue(const char *topic, float value, uint8_t decimals, bool retained)
+{
+    char payload[24];
+    {
+        PROFILE_SCOPE(Profile::PROBE_FORMAT);
+        snprintf(payload, sizeof(payload), "%.*f", decimals, value);
+    }
+    return Metrics::publish(mqttClient, topic, payload, retained);
+}
+
+// Heap layout for the metrics report (8-bit capable heap)
+HeapStats::Layout heapLayout()
+{
+    HeapStats::Layout layout;
+    layout.freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    layout.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    layout.minFree = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    return layout;
+}
+
+// Publish System Info (Rotated by scheduler)
 void publishSystemInfoByIndex()
 {
     if (!mqttClient.connected()) {
@@ -252,25 +334,31 @@ void publishSystemInfoByIndex()
     switch (currentSystemInfoIndex) {
         case 0: {
             int rssi = WiFi.RSSI();
-            bool ok = mqttClient.publish(MQTTTopics::SYSTEM_RSSI, String(rssi).c_str(), false);
+            char payload[12];
+            snprintf(payload, sizeof(payload), "%d", rssi);
+            bool ok = Metrics::publish(mqttClient, MQTTTopics::SYSTEM_RSSI, payload, false);
             Serial.printf("%s RSSI: %d dBm\n", ok ? "✅" : "❌", rssi);
             break;
         }
         case 1: {
-            String ip = WiFi.localIP().toString();
-            bool ok = mqttClient.publish(MQTTTopics::SYSTEM_IP, ip.c_str(), true);
-            Serial.printf("%s IP: %s\n", ok ? "✅" : "❌", ip.c_str());
+            IPAddress addr = WiFi.localIP();
+            char ip[16];
+            snprintf(ip, sizeof(ip), "%u.%u.%u.%u", addr[0], addr[1], addr[2], addr[3]);
+            bool ok = Metrics::publish(mqttClient, MQTTTopics::SYSTEM_IP, ip, true);
+            Serial.printf("%s IP: %s\n", ok ? "✅" : "❌", ip);
             break;
         }
         case 2: {
             unsigned long uptime = millis() / 1000;
-            bool ok = mqttClient.publish(MQTTTopics::SYSTEM_UPTIME, String(uptime).c_str(), false);
+            char payload[12];
+            snprintf(payload, sizeof(payload), "%lu", uptime);
+            bool ok = Metrics::publish(mqttClient, MQTTTopics::SYSTEM_UPTIME, payload, false);
             Serial.printf("%s Uptime: %lu seconds\n", ok ? "✅" : "❌", uptime);
             break;
         }
         case 3: {
             float heap = ESP.getFreeHeap() / 1024.0;
-            bool ok = mqttClient.publish(MQTTTopics::SYSTEM_HEAP, String(heap, 1).c_str(), false);
+            bool ok = publishValue(MQTTTopics::SYSTEM_HEAP, heap, 1);
             Serial.printf("%s Heap: %.1f KB\n", ok ? "✅" : "❌", heap);
             break;
         }
@@ -279,101 +367,608 @@ void publishSystemInfoByIndex()
     currentSystemInfoIndex = (currentSystemInfoIndex + 1) % 4;
 }
 
-// Update Relay Statistics
-void updateRelayStats()
+// Control hooks: Serial log, meter energy for the relay cycle stats
+void logLine(const char *line)
 {
-    unsigned long current_time = millis();
-    unsigned long duration = current_time - last_state_change;
-    
-    if (last_relay_state) {
-        relay_on_time += duration;
-    } else {
-        relay_off_time += duration;
-    }
-    
-    last_state_change = current_time;
+    Serial.println(line);
+}
+
+float meterEnergy()
+{
+    PowerSample sample = Acquisition::latest();
+    return sample.valid ? sample.energy : NAN;
+}
+
+// Coalesced NVS save of state + lifetime counters (see RelayStore)
+void persistRelayTask()
+{
+    RelayStore::service(millis(), Control::relayState, Control::onTotalMs(), Control::offTotalMs(),
+                        Control::switches);
+}
+
+// Control hook: trip / over-temperature OFF goes to NVS at once
+void persistRelayNow()
+{
+    RelayStore::saveNow(millis(), Control::relayState, Control::onTotalMs(), Control::offTotalMs(),
+                        Control::switches);
 }
 
-// Publish Relay Statistics
+// Publish Relay Statistics (lifetime seconds + cycling, see RelayStats)
 void publishRelayStats()
 {
     if (mqttClient.connected())
     {
-        String stats = "ON:" + String(relay_on_time / 1000) + 
-                      ",OFF:" + String(relay_off_time / 1000);
-        bool success = mqttClient.publish(MQTTTopics::RELAY_STATS, stats.c_str(), false);
+        char stats[RELAY_STATS_SIZE];
+        Control::formatStats(stats, sizeof(stats));
+        bool success = Metrics::publish(mqttClient, MQTTTopics::RELAY_STATS, stats, false);
         Serial.printf("%s Relay Stats: %s\n", 
-                     success ? "✅" : "❌", stats.c_str());
+                     success ? "✅" : "❌", stats);
+        
+        char persist[128];
+        RelayStore::formatReport(persist, sizeof(persist), millis());
+        Metrics::publish(mqttClient, MQTTTopics::RELAY_PERSIST, persist, false);
+        Serial.printf("   NVS: %s\n", persist);
     }
 }
 
-// Update LCD Display (Rotates through 3 screens)
-void updateLCD()
+// ════════════════════════════════════════
+// TIME-OF-USE SCHEDULE
+// ════════════════════════════════════════
+void loadRelaySchedule()
 {
-    lcd.clear();
+    Preferences prefs;
+    prefs.begin("tou", true);
+    uint32_t words[Control::Schedule::MAX_WORDS];
+    size_t bytes = prefs.getBytes("rules", words, sizeof(words));
+    prefs.end();
     
-    switch (lcdDisplayMode) {
-        case 0: // Voltage & Current
-            lcd.setCursor(0, 0);
-            lcd.print("V:");
-            lcd.print(displayData.voltage, 1);
-            lcd.print("V");
-            
-            lcd.setCursor(10, 0);
-            lcd.print("R:");
-            lcd.print(displayData.relayState ? "ON" : "OF");
-            
-            lcd.setCursor(0, 1);
-            lcd.print("I:");
-            lcd.print(displayData.current, 3);
-            lcd.print("A");
-            break;
-            
-        case 1: // Power & Energy
-            lcd.setCursor(0, 0);
-            lcd.print("P:");
-            lcd.print(displayData.power, 1);
-            lcd.print("W");
-            
-            lcd.setCursor(0, 1);
-            lcd.print("E:");
-            lcd.print(displayData.energy, 3);
-            lcd.print("kWh");
-            break;
-            
-        case 2: // Frequency, PF, Temp, Humidity
-            lcd.setCursor(0, 0);
-            lcd.print("F:");
-            lcd.print(displayData.frequency, 1);
-            lcd.print("Hz");
-            
-            lcd.setCursor(9, 0);
-            lcd.print("PF:");
-            lcd.print(displayData.powerFactor, 2);
-            
-            lcd.setCursor(0, 1);
-            lcd.print("T:");
-            lcd.print(displayData.temperature, 1);
-            lcd.print("C");
-            
-            lcd.setCursor(9, 1);
-            lcd.print("H:");
-            lcd.print(displayData.humidity, 0);
-            lcd.print("%");
-            break;
+    if (bytes >= sizeof(uint32_t) && Control::schedule.deserialize(words, bytes / sizeof(uint32_t))) {
+        Serial.printf("Schedule: %u rules, %u exceptions loaded\n",
+                      Control::schedule.ruleCount(), Control::schedule.exceptionCount());
+    }
+}
+
+void saveRelaySchedule()
+{
+    uint32_t words[Control::Schedule::MAX_WORDS];
+    uint8_t count = Control::schedule.serialize(words);
+    
+    Preferences prefs;
+    prefs.begin("tou", false);
+    prefs.putBytes("rules", words, count * sizeof(uint32_t));
+    prefs.end();
+}
+
+// Rules from home/relay/schedule/set (see Tou::Schedule::parse)
+void setRelaySchedule(const char *text)
+{
+    if (Control::setSchedule(text)) {
+        saveRelaySchedule();
+    }
+}
+
+// Runs offline too: the RTC keeps time once SNTP has set it
+void relayScheduleTask()
+{
+    time_t now = time(nullptr);
+    Control::scheduleTask(now >= (time_t)TOU_MIN_VALID_EPOCH ? (uint32_t)now : 0);
+}
+
+// ════════════════════════════════════════
+// LOAD OUTPUTS / DEMAND LIMITING
+// ════════════════════════════════════════
+
+// One power sample per second into the rolling window; shed/restore
+void demandTask()
+{
+    PowerSample sample = Acquisition::latest();
+    Control::demandTask(sample.valid ? sample.power : NAN);
+}
+
+// ════════════════════════════════════════
+// AUTOMATION RULES
+// ════════════════════════════════════════
+void loadRules()
+{
+    static char text[RULES_TEXT_SIZE];
+    Preferences prefs;
+    prefs.begin("rules", true);
+    size_t len = prefs.getString("src", text, sizeof(text));
+    prefs.end();
+    
+    if (len > 0 && !Control::loadRules(text)) {
+        Serial.println("Rules: stored rules rejected");
+    }
+}
+
+// From home/rules/set; stored once it compiles
+void setRules(const char *text)
+{
+    if (!Control::loadRules(text)) {
+        return;
+    }
+    
+    Preferences prefs;
+    prefs.begin("rules", false);
+    prefs.putString("src", text);
+    prefs.end();
+}
+
+// Evaluate once per new acquisition sample
+void rulesTask()
+{
+    Control::rulesTask(Acquisition::latest(), Screens::data.temperature, Screens::data.humidity);
+}
+
+// ════════════════════════════════════════
+// WINDOWED AGGREGATES
+// ════════════════════════════════════════
+void publishAggregate(Aggregate::Window<AGG_COUNT> &window, const char *topic)
+{
+    static char frame[AGG_FRAME_SIZE];
+    time_t now = time(nullptr);
+    uint32_t utc = now >= (time_t)TOU_MIN_VALID_EPOCH ? (uint32_t)now : 0;
+    {
+        PROFILE_SCOPE(Profile::PROBE_FORMAT);
+        window.close(millis(), utc, frame, sizeof(frame));
     }
     
-    if (millis() - lastLcdUpdate >= LCD_DISPLAY_CHANGE_INTERVAL) {
-        lcdDisplayMode = (lcdDisplayMode + 1) % 3;
-        lastLcdUpdate = millis();
+    if (mqttClient.connected()) {
+        bool ok = Metrics::publish(mqttClient, topic, frame, false);
+        Serial.printf("%s Aggregate: %s\n", ok ? "✅" : "❌", frame);
     }
 }
 
+// Feed every acquisition sample (extremes between raw publishes are kept)
+void aggregateTask()
+{
+    PowerSample sample = Acquisition::latest();
+    if (sample.valid && sample.ms != aggLastSampleMs) {
+        aggLastSampleMs = sample.ms;
+        const float values[] = {sample.voltage, sample.current, sample.power, sample.frequency, sample.pf};
+        for (uint8_t m = AGG_VOLTAGE; m <= AGG_PF; m++) {
+            aggShort.add(m, values[m]);
+            aggLong.add(m, values[m]);
+        }
+    }
+    
+    uint32_t now = millis();
+    if (aggShort.due(now)) {
+        checkAnomalies();
+        publishAggregate(aggShort, MQTTTopics::AGGREGATE_SHORT);
+    }
+    if (aggLong.due(now)) {
+        publishAggregate(aggLong, MQTTTopics::AGGREGATE_LONG);
+    }
+}
+
+// ════════════════════════════════════════
+// ANOMALY DETECTION
+// ════════════════════════════════════════
+void loadAnomalyModel()
+{
+    Anomaly::Model<ANOMALY_COUNT> model;
+    Preferences prefs;
+    prefs.begin("anomaly", true);
+    size_t bytes = prefs.getBytes("model", &model, sizeof(model));
+    prefs.end();
+    
+    if (bytes == sizeof(model) && anomaly.restore(model)) {
+        Serial.println("Anomaly model restored");
+    }
+    anomalyLastSaveMs = millis();
+}
+
+void saveAnomalyModel()
+{
+    Preferences prefs;
+    prefs.begin("anomaly", false);
+    prefs.putBytes("model", &anomaly.model(), sizeof(Anomaly::Model<ANOMALY_COUNT>));
+    prefs.end();
+    anomalyLastSaveMs = millis();
+}
+
+// Score the 1 min means of the closing short window (needs local time)
+void checkAnomalies()
+{
+    time_t now = time(nullptr);
+    if (now < (time_t)TOU_MIN_VALID_EPOCH) {
+        return;
+    }
+    uint8_t hour = (uint8_t)(((now + TOU_UTC_OFFSET_MIN * 60L) / 3600) % 24);
+    
+    const uint8_t sources[ANOMALY_COUNT] = {AGG_POWER, AGG_TEMPERATURE};
+    for (uint8_t m = 0; m < ANOMALY_COUNT; m++) {
+        const Aggregate::Welford &stats = aggShort.stats(sources[m]);
+        Anomaly::Event ev;
+        if (stats.n == 0 || !anomaly.add(m, hour, stats.mean, ev)) {
+            continue;
+        }
+        
+        char payload[160];
+        snprintf(payload, sizeof(payload),
+                 "{\"m\":\"%s\",\"state\":\"%s\",\"h\":%d,\"x\":%.2f,\"z\":%.1f,\"mean\":%.2f,\"sd\":%.2f}",
+                 ANOMALY_NAMES[m], ev.type == Anomaly::EVENT_START ? "START" : "END",
+                 ev.hour, ev.value, ev.score, ev.mean, ev.sd);
+        if (mqttClient.connected()) {
+            Metrics::publish(mqttClient, MQTTTopics::ANOMALY_EVENT, payload, false);
+        }
+        Serial.printf("Anomaly: %s\n", payload);
+    }
+    
+    if (millis() - anomalyLastSaveMs >= ANOMALY_SAVE_INTERVAL) {
+        saveAnomalyModel();
+    }
+}
+
+// ════════════════════════════════════════
+// TARIFF / ENERGY LEDGER
+// ════════════════════════════════════════
+void loadEnergyLedger()
+{
+    Tariff::State state;
+    Preferences prefs;
+    prefs.begin("tariff", true);
+    size_t bytes = prefs.getBytes("state", &state, sizeof(state));
+    prefs.end();
+    
+    if (bytes == sizeof(state) && energyLedger.restore(state)) {
+        Serial.printf("Energy ledger: day %.3fkWh, month %.3fkWh\n",
+                      energyLedger.day().kwh, energyLedger.month().kwh);
+    }
+}
+
+void saveEnergyLedger()
+{
+    Preferences prefs;
+    prefs.begin("tariff", false);
+    prefs.putBytes("state", &energyLedger.state(), sizeof(Tariff::State));
+    prefs.end();
+    tariffLastSaveMs = millis();
+}
+
+// Local day number and year * 12 + month - 1 (-1 until SNTP sync)
+void localDate(int32_t &day, int32_t &month)
+{
+    time_t now = time(nullptr);
+    if (now < (time_t)TOU_MIN_VALID_EPOCH) {
+        day = month = -1;
+        return;
+    }
+    time_t local = now + TOU_UTC_OFFSET_MIN * 60L;
+    struct tm tm;
+    gmtime_r(&local, &tm);
+    day = (int32_t)(local / 86400);
+    month = (tm.tm_year + 1900) * 12 + tm.tm_mon;
+}
+
+// {"day":"2026-10-19","kwh":..,"cost":..} / {"month":"2026-10",...}
+size_t formatEnergySummary(char *buf, size_t size, const Tariff::Summary &summary, bool monthly)
+{
+    char period[12];
+    if (monthly) {
+        snprintf(period, sizeof(period), "%04d-%02d", (int)(summary.key / 12), (int)(summary.key % 12 + 1));
+    } else {
+        time_t t = (time_t)summary.key * 86400;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        strftime(period, sizeof(period), "%Y-%m-%d", &tm);
+    }
+    int len = snprintf(buf, size, "{\"%s\":\"%s\",\"kwh\":%.3f,\"cost\":%.0f}",
+                       monthly ? "month" : "day", summary.key >= 0 ? period : "",
+                       summary.kwh, summary.cost);
+    return len > 0 ? (size_t)len : 0;
+}
+
+void tariffTask()
+{
+    PowerSample sample = Acquisition::latest();
+    int32_t day, month;
+    localDate(day, month);
+    
+    uint8_t closed = energyLedger.update(sample.valid ? sample.energy : NAN, day, month);
+    tariffClosedPending |= closed;
+    publishClosedSummaries();
+    
+    if (closed != Tariff::CLOSED_NONE || millis() - tariffLastSaveMs >= TARIFF_SAVE_INTERVAL) {
+        saveEnergyLedger();
+    }
+}
+
+// Closed day / month summaries (retained), retried every tariffTask
+// run until the broker takes them. Offline across two rollovers only
+// the latest closed bucket is kept.
+void publishClosedSummaries()
+{
+    if (tariffClosedPending == Tariff::CLOSED_NONE || !mqttClient.connected()) {
+        return;
+    }
+    
+    char payload[96];
+    if (tariffClosedPending & Tariff::CLOSED_DAY) {
+        formatEnergySummary(payload, sizeof(payload), energyLedger.closedDay(), false);
+        bool ok = Metrics::publish(mqttClient, MQTTTopics::ENERGY_DAILY, payload, true);
+        if (ok) tariffClosedPending &= ~Tariff::CLOSED_DAY;
+        Serial.printf("%s Day closed: %s\n", ok ? "✅" : "❌", payload);
+    }
+    if (tariffClosedPending & Tariff::CLOSED_MONTH) {
+        formatEnergySummary(payload, sizeof(payload), energyLedger.closedMonth(), true);
+        bool ok = Metrics::publish(mqttClient, MQTTTopics::ENERGY_MONTHLY, payload, true);
+        if (ok) tariffClosedPending &= ~Tariff::CLOSED_MONTH;
+        Serial.printf("%s Month closed: %s\n", ok ? "✅" : "❌", payload);
+    }
+}
+
+// Running day / month buckets (retained)
+void publishEnergySummaries()
+{
+    if (!mqttClient.connected()) {
+        return;
+    }
+    
+    char payload[96];
+    formatEnergySummary(payload, sizeof(payload), energyLedger.day(), false);
+    bool ok = Metrics::publish(mqttClient, MQTTTopics::ENERGY_TODAY, payload, true);
+    Serial.printf("%s Today: %s\n", ok ? "✅" : "❌", payload);
+    
+    formatEnergySummary(payload, sizeof(payload), energyLedger.month(), true);
+    Metrics::publish(mqttClient, MQTTTopics::ENERGY_MONTH, payload, true);
+}
+
+// ════════════════════════════════════════
+// NILM-LITE APPLIANCE DETECTION
+// ════════════════════════════════════════
+void loadNilmTable()
+{
+    Nilm::Table<NILM_MAX_SIGNATURES> table;
+    Preferences prefs;
+    prefs.begin("nilm", true);
+    size_t bytes = prefs.getBytes("table", &table, sizeof(table));
+    prefs.end();
+    
+    if (bytes == sizeof(table) && nilm.restore(table)) {
+        Serial.printf("NILM: %d learned signatures\n", nilm.count());
+    }
+}
+
+void saveNilmTable()
+{
+    Nilm::Table<NILM_MAX_SIGNATURES> table = nilm.table();
+    Preferences prefs;
+    prefs.begin("nilm", false);
+    prefs.putBytes("table", &table, sizeof(table));
+    prefs.end();
+    nilmLastSaveMs = millis();
+    nilmSavedSteps = nilm.steps();
+}
+
+// Feed each acquisition sample; one event per detected step
+void nilmTask()
+{
+    PowerSample sample = Acquisition::latest();
+    if (!sample.valid || sample.ms == nilmLastSampleMs) {
+        return;
+    }
+    nilmLastSampleMs = sample.ms;
+    
+    Nilm::Event ev;
+    if (nilm.add(sample.power, sample.pf, sample.ms, ev)) {
+        static const char *const EVENT_NAMES[] = {"", "ON", "OFF", "UNKNOWN_OFF"};
+        char payload[96];
+        snprintf(payload, sizeof(payload), "{\"app\":%d,\"state\":\"%s\",\"new\":%d,\"dp\":%.0f,\"dq\":%.0f}",
+                 ev.id, EVENT_NAMES[ev.type], ev.learned ? 1 : 0, ev.dp, ev.dq);
+        if (mqttClient.connected()) {
+            Metrics::publish(mqttClient, MQTTTopics::NILM_EVENT, payload, false);
+        }
+        Serial.printf("NILM: %s\n", payload);
+        
+        // A new signature is saved right away so its id is stable
+        if (ev.learned) {
+            saveNilmTable();
+        }
+    }
+    
+    if (nilm.steps() != nilmSavedSteps && millis() - nilmLastSaveMs >= NILM_SAVE_INTERVAL) {
+        saveNilmTable();
+    }
+}
+
+// [[id,p,q,count,on,on_total_s],...] (retained)
+void publishNilmSignatures()
+{
+    if (!mqttClient.connected()) {
+        return;
+    }
+    
+    static char payload[NILM_TABLE_SIZE];
+    nilm.formatSignatures(payload, sizeof(payload), millis());
+    bool ok = Metrics::publish(mqttClient, MQTTTopics::NILM_SIGNATURES, payload, true);
+    Serial.printf("%s NILM signatures: %s\n", ok ? "✅" : "❌", payload);
+}
+
+// Scheduled publish tasks
+void publishRelayStatsTask()
+{
+    if (mqttClient.connected()) {
+        publishRelayStats();
+    }
+}
+
+void publishMetricsTask()
+{
+    bool ok = false;
+    const char *report = Metrics::publishReport(mqttClient, MQTTTopics::SYSTEM_METRICS, ok);
+    if (report) {
+        Serial.printf("%s Metrics: %s\n", ok ? "✅" : "❌", report);
+    }
+}
+
+void publishSchedulerReport()
+{
+    static uint32_t reportedMisses = 0;
+    uint32_t misses = 0;
+    for (uint8_t i = 0; i < scheduler.count(); i++) {
+        misses += scheduler.task(i).stats.misses;
+    }
+    if (misses != reportedMisses) {
+        Serial.printf("Deadline misses: %u (last: %s, %u ms late)\n", misses,
+                      scheduler.task(scheduler.lastMissTask()).name,
+                      scheduler.lastMissLateUs() / 1000);
+        reportedMisses = misses;
+    }
+
+    if (!mqttClient.connected()) {
+        return;
+    }
+
+    static char report[SCHED_REPORT_SIZE];
+    scheduler.formatReport(report, sizeof(report));
+    bool ok = Metrics::publish(mqttClient, MQTTTopics::SYSTEM_SCHEDULER, report, false);
+    Serial.printf("%s Scheduler: %s\n", ok ? "✅" : "❌", report);
+}
+
+void publishPowerReport()
+{
+    if (!mqttClient.connected()) {
+        return;
+    }
+
+    char report[128];
+    Power::formatReport(report, sizeof(report));
+    bool ok = Metrics::publish(mqttClient, MQTTTopics::SYSTEM_POWER, report, false);
+    Serial.printf("%s Power: %s\n", ok ? "✅" : "❌", report);
+}
+
+void publishHealthReport()
+{
+    if (!mqttClient.connected()) {
+        return;
+    }
+
+    static char report[HEALTH_REPORT_SIZE];
+    
+    // Stall that forced the previous reboot (retained)
+    const Health::StallReport &stall = Health::pendingStall();
+    if (stall.magic == Health::STALL_MAGIC) {
+        Health::formatStall(stall, report, sizeof(report));
+        if (Metrics::publish(mqttClient, MQTTTopics::SYSTEM_STALL, report, true)) {
+            Serial.printf("✅ Stall report: %s\n", report);
+            Health::clearPendingStall();
+        }
+    }
+
+    Health::formatReport(report, sizeof(report));
+    bool ok = Metrics::publish(mqttClient, MQTTTopics::SYSTEM_HEALTH, report, false);
+    Serial.printf("%s Health: %s\n", ok ? "✅" : "❌", report);
+}
+
+const char *currentTaskName()
+{
+    int8_t id = scheduler.running();
+    return id >= 0 ? scheduler.task(id).name : nullptr;
+}
+
+// Relay was already cut by the acquisition task; sync state and publish
+void handleProtectionTrip()
+{
+    static Acquisition::TripRecord trip;
+    if (!Acquisition::takeTrip(trip)) {
+        return;
+    }
+    
+    const char *reason = Protection::reasonName(trip.reason);
+    Serial.println("════════════════════════════════════════");
+    Serial.printf("PROTECTION TRIP: %s\n", reason);
+    Serial.printf("   I: %.3fA, P: %.1fW (limits %.1fA / %.0fW)\n",
+                  trip.sample.current, trip.sample.power,
+                  PROTECTION_MAX_CURRENT_A, PROTECTION_MAX_POWER_W);
+    Serial.printf("   Window: %u us, react: %u us\n", trip.periodUs, trip.reactUs);
+    Serial.println("════════════════════════════════════════");
+    
+    Control::tripOff(trip);
+    
+    char line[17];
+    snprintf(line, sizeof(line), "%.2fA %.0fW", trip.sample.current, trip.sample.power);
+    Screens::showMessage(reason, line, LCD_MESSAGE_DURATION);
+}
+
+void publishProtectionReport()
+{
+    if (!mqttClient.connected()) {
+        return;
+    }
+    
+    char report[192];
+    Acquisition::formatReport(report, sizeof(report));
+    bool ok = Metrics::publish(mqttClient, MQTTTopics::PROTECTION_STATUS, report, false);
+    Serial.printf("%s Protection: %s\n", ok ? "✅" : "❌", report);
+}
+
+// Drain the power-quality queue filled by the acquisition task
+void handlePowerQualityEvents()
+{
+    static Acquisition::PqEvent event;
+    static char payload[PQ_EVENT_SIZE];
+    while (Acquisition::takePqEvent(event)) {
+        PowerQuality::formatEvent(event, payload, sizeof(payload));
+        if (mqttClient.connected()) {
+            Metrics::publish(mqttClient, MQTTTopics::PQ_EVENT, payload, false);
+        }
+        Serial.printf("Power quality: %s\n", payload);
+    }
+}
+
+void publishPowerQualityReport()
+{
+    if (!mqttClient.connected()) {
+        return;
+    }
+    
+    char report[160];
+    Acquisition::formatPqReport(report, sizeof(report));
+    bool ok = Metrics::publish(mqttClient, MQTTTopics::PQ_STATUS, report, true);
+    Serial.printf("%s Power quality: %s\n", ok ? "✅" : "❌", report);
+}
+
+void heartbeatTask()
+{
+    MQTT::heartbeat(mqttClient, MQTTTopics::MQTT_STATUS, MQTTTopics::MQTT_ONLINE);
+}
+
+// {"n":refreshes,"cells":c,"cursor":m,"tx":i2c_transactions,"bytes":i2c_bytes,
+//  "bpr":bytes/refresh,"full":legacy clear+redraw bytes,"err":nacks,"us":[avg,max],
+//  "pg":[renders,skipped]}
+void publishLcdStats()
+{
+    if (!mqttClient.connected()) {
+        return;
+    }
+    
+    const Screens::Frame::Stats &stats = Screens::buffer.stats();
+    const LcdDriver::Stats &bus = lcd.stats();
+    uint32_t refreshes = stats.flushes ? stats.flushes : 1;
+    // Reference: LiquidCrystal_I2C clear() + one cursor move per row + every
+    // cell, at 6 single-byte transactions (12 bus bytes) per send
+    const uint32_t full = (1 + LCD_ROWS + LCD_COLS * LCD_ROWS) * 12;
+    
+    char report[192];
+    snprintf(report, sizeof(report),
+             "{\"n\":%u,\"cells\":%u,\"cursor\":%u,\"tx\":%u,\"bytes\":%u,\"bpr\":%u,\"full\":%u,\"err\":%u,\"us\":[%u,%u],\"pg\":[%u,%u]}",
+             stats.flushes, stats.cellsWritten, stats.cursorMoves, bus.transactions, bus.busBytes,
+             bus.busBytes / refreshes, full, bus.errors, Screens::refreshUsTotal / refreshes, Screens::refreshUsMax,
+             Screens::pages.stats().renders, Screens::pages.stats().skipped);
+    bool ok = Metrics::publish(mqttClient, MQTTTopics::SYSTEM_LCD, report, false);
+    Serial.printf("%s LCD: %s\n", ok ? "✅" : "❌", report);
+}
+
 // Read & Publish SHT31 Data
 void dhtReadPublish()
 {
-    float temperature = sht31.readTemperature();
-    float humidity = sht31.readHumidity();
+    float temperature, humidity;
+    {
+        PROFILE_SCOPE(Profile::PROBE_SHT31);
+        climate.read(temperature, humidity);
+    }
 
     if (isnan(temperature) || isnan(humidity))
     {
@@ -381,142 +976,135 @@ void dhtReadPublish()
         return;
     }
 
-    Serial.printf("Temperature: %.1f°C, Humidity: %.1f%%\n", temperature, humidity);
+    Screens::data.temperature = temperature;
+    Screens::data.humidity = humidity;
+    Screens::revision++;
+    traceInput(Trace::TYPE_CLIMATE, 0, nullptr, temperature, humidity);
+    
+    aggShort.add(AGG_TEMPERATURE, temperature);
+    aggShort.add(AGG_HUMIDITY, humidity);
+    aggLong.add(AGG_TEMPERATURE, temperature);
+    aggLong.add(AGG_HUMIDITY, humidity);
+    
+    if (!rawPublish) {
+        return;
+    }
 
-    displayData.temperature = temperature;
-    displayData.humidity = humidity;
+    Serial.printf("Temperature: %.1f°C, Humidity: %.1f%%\n", temperature, humidity);
 
-    mqttClient.publish(MQTTTopics::TEMPERATURE, String(temperature, 1).c_str(), false);
-    mqttClient.publish(MQTTTopics::HUMIDITY, String(humidity, 1).c_str(), false);
+    publishValue(MQTTTopics::TEMPERATURE, temperature, 1);
+    publishValue(MQTTTopics::HUMIDITY, humidity, 1);
 }
 
-// Read & Publish PZEM Data
+// Publish PZEM Data (latest sample from the acquisition task)
 void pzemReadPublish()
 {
-    float voltage = pzem.voltage();
-    float current = pzem.current();
-    float power = pzem.power();
-    float energy = pzem.energy();
-    float frequency = pzem.frequency();
-    float pf = pzem.pf();
-
-    displayData.voltage = voltage;
-    displayData.current = current;
-    displayData.power = power;
-    displayData.energy = energy;
-    displayData.frequency = frequency;
-    displayData.powerFactor = pf;
-    displayData.dataValid = !isnan(voltage) && !isnan(current);
+    PowerSample sample = Acquisition::latest();
+    float voltage = sample.voltage;
+    float current = sample.current;
+    float power = sample.power;
+    float energy = sample.energy;
+    float frequency = sample.frequency;
+    float pf = sample.pf;
+
+    Screens::data.voltage = voltage;
+    Screens::data.current = current;
+    Screens::data.power = power;
+    Screens::data.energy = energy;
+    Screens::data.frequency = frequency;
+    Screens::data.powerFactor = pf;
+    Screens::data.dataValid = !isnan(voltage) && !isnan(current);
+    Screens::revision++;
+    
+    if (!rawPublish) {
+        return;
+    }
 
     if (!isnan(voltage)) {
         Serial.printf("Voltage: %.1fV\n", voltage);
-        mqttClient.publish(MQTTTopics::VOLTAGE, String(voltage, 1).c_str(), false);
+        publishValue(MQTTTopics::VOLTAGE, voltage, 1);
     }
 
     if (!isnan(current)) {
         Serial.printf("Current: %.3fA\n", current);
-        mqttClient.publish(MQTTTopics::CURRENT, String(current, 3).c_str(), false);
+        publishValue(MQTTTopics::CURRENT, current, 3);
     }
 
     if (!isnan(power)) {
         Serial.printf("Power: %.1fW\n", power);
-        mqttClient.publish(MQTTTopics::POWER, String(power, 1).c_str(), false);
+        publishValue(MQTTTopics::POWER, power, 1);
     }
 
     if (!isnan(energy)) {
         Serial.printf("Energy: %.3fkWh\n", energy);
-        mqttClient.publish(MQTTTopics::ENERGY, String(energy, 3).c_str(), false);
+        publishValue(MQTTTopics::ENERGY, energy, 3);
     }
 
     if (!isnan(frequency)) {
         Serial.printf("Frequency: %.1fHz\n", frequency);
-        mqttClient.publish(MQTTTopics::FREQUENCY, String(frequency, 1).c_str(), false);
+        publishValue(MQTTTopics::FREQUENCY, frequency, 1);
     }
 
     if (!isnan(pf)) {
         Serial.printf("PF: %.2f\n", pf);
-        mqttClient.publish(MQTTTopics::POWER_FACTOR, String(pf, 2).c_str(), false);
+        publishValue(MQTTTopics::POWER_FACTOR, pf, 2);
     }
 
     Serial.println("─────────────────");
 }
 
-// Control Relay
-void controlRelay(bool state)
+// Request PZEM energy reset (safe to call from mqttCallback)
+void requestPzemReset()
 {
-    updateRelayStats();
-    
-    relayState = state;
-    displayData.relayState = state;
-    digitalWrite(RELAY_PIN, relayState ? LOW : HIGH); // Active LOW
-    
-    mqttClient.publish(MQTTTopics::RELAY_STATUS, relayState ? "ON" : "OFF", true);
+    if (pzemResetPending) {
+        Serial.println("PZEM reset already pending");
+        return;
+    }
     
-    String event = String(relayState ? "ON" : "OFF");
-    mqttClient.publish(MQTTTopics::RELAY_EVENT, event.c_str(), false);
+    Serial.println("Resetting PZEM energy...");
+    pzemResetPending = true;
+    pzemResetRequestUs = micros();
     
-    last_relay_state = relayState;
+    startLedResetIndicator();
+    Screens::showMessage("RESETTING...", "PZEM ENERGY", LCD_MESSAGE_DURATION);
     
-    if (state == false) {
-        relayOffByOverTemp = false;
-        wasRelayOnBeforeTrip = false;
-    }
-
-    Serial.printf("Relay: %s\n", relayState ? "ON" : "OFF");
-}
-
-// Toggle Relay
-void toggleRelay()
-{
-    controlRelay(!relayState);
+    // Runs from loop() right after mqttClient.loop() returns
+    scheduler.start(pzemResetTask);
 }
 
-// Reset PZEM Energy
+// Reset PZEM Energy (scheduler one-shot)
 void resetPzemEnergy()
 {
-    Serial.println("Resetting PZEM energy...");
-    
-    startLedResetIndicator();
-    
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("RESETTING...");
-    lcd.setCursor(0, 1);
-    lcd.print("PZEM ENERGY");
-    delay(500);
-    
-    bool success = pzem.resetEnergy();
+    bool success = Acquisition::resetEnergy();
     
     if (success) {
         Serial.println("PZEM energy reset successful");
-        mqttClient.publish(MQTTTopics::PZEM_STATUS, "RESET_SUCCESS", false);
-        mqttClient.publish(MQTTTopics::ENERGY, "0.000", false);
+        Metrics::publish(mqttClient, MQTTTopics::PZEM_STATUS, "RESET_SUCCESS", false);
+        Metrics::publish(mqttClient, MQTTTopics::ENERGY, "0.000", false);
         
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print("RESET SUCCESS!");
-        lcd.setCursor(0, 1);
-        lcd.print("Energy: 0.000kWh");
-        delay(1500);
+        Screens::showMessage("RESET SUCCESS!", "Energy: 0.000kWh", LCD_MESSAGE_DURATION);
         
-        displayData.energy = 0.0f;
+        Screens::data.energy = 0.0f;
+        Screens::revision++;
     } else {
         Serial.println("PZEM energy reset failed");
-        mqttClient.publish(MQTTTopics::PZEM_STATUS, "RESET_FAILED", false);
+        Metrics::publish(mqttClient, MQTTTopics::PZEM_STATUS, "RESET_FAILED", false);
         
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print("RESET FAILED!");
-        lcd.setCursor(0, 1);
-        lcd.print("Check PZEM");
-        delay(1500);
+        Screens::showMessage("RESET FAILED!", "Check PZEM", LCD_MESSAGE_DURATION);
     }
+    
+    // Command-to-ack latency (request → status published)
+    uint32_t latency_us = micros() - pzemResetRequestUs;
+    Metrics::recordCommandAck(latency_us);
+    Serial.printf("PZEM reset ack latency: %.1f ms\n", latency_us / 1000.0f);
+    
+    pzemResetPending = false;
 }
 
 // Handle Button Press
 void handleButton()
 {
-    bool reading = digitalRead(BUTTON_PIN);
+    bool reading = gpio.read(BUTTON_PIN);
     
     if (reading != lastButtonState) {
         lastDebounceTime = millis();
@@ -528,7 +1116,7 @@ void handleButton()
             
             if (currentButtonState == LOW) {
                 Serial.println("Button pressed - Resetting energy");
-                resetPzemEnergy();
+                requestPzemReset();
             }
         }
     }
@@ -545,30 +1133,252 @@ void mqttCallback(char *topic, uint8_t *payload, unsigned int length)
     
     Serial.printf("MQTT Message: %s → %s\n", topic, command);
     
-    if (strcmp(topic, MQTTTopics::RELAY_CONTROL) == 0)
+    // Relay / output commands are applied by Control
+    switch (Control::handleMessage(topic, command))
     {
-        if (strcmp(command, "ON") == 0 || strcmp(command, "1") == 0) {
-            controlRelay(true);
+    case Commands::TARGET_RELAY_SCHEDULE:
+        setRelaySchedule(command);
+        break;
+    case Commands::TARGET_RULES:
+        setRules(command);
+        break;
+    case Commands::TARGET_RAW_PUBLISH:
+        rawPublish = Commands::parseSwitch(command) == Commands::SWITCH_ON;
+        Serial.printf("Raw sensor publishing: %s\n", rawPublish ? "ON" : "OFF (aggregates only)");
+        break;
+    case Commands::TARGET_PZEM_RESET:
+        if (Commands::isEnergyReset(command)) {
+            requestPzemReset();
         }
-        else if (strcmp(command, "OFF") == 0 || strcmp(command, "0") == 0) {
-            controlRelay(false);
+        break;
+    case Commands::TARGET_TRACE:
+        setTraceMode(command);
+        break;
+    case Commands::TARGET_PROFILE:
+        dumpProfile(command);
+        break;
+    }
+}
+
+// ════════════════════════════════════════
+// TRACE RECORDING
+// ════════════════════════════════════════
+
+// Acquisition task hook: every PZEM sample
+void traceSample(const PowerSample &s)
+{
+    portENTER_CRITICAL(&traceLock);
+    traceWriter.power(s);
+    portEXIT_CRITICAL(&traceLock);
+}
+
+// loop() inputs: climate reading, command, timed check
+void traceInput(uint8_t type, uint8_t id, const char *payload, float a, float b)
+{
+    if (traceMode == TRACE_OFF) {
+        return;
+    }
+    uint32_t now = millis();
+    portENTER_CRITICAL(&traceLock);
+    if (type == Trace::TYPE_CLIMATE) traceWriter.climate(now, a, b);
+    else if (type == Trace::TYPE_COMMAND) traceWriter.command(now, id, payload);
+    else traceWriter.check(now, id);
+    portEXIT_CRITICAL(&traceLock);
+}
+
+bool mountTraceFs()
+{
+    if (!traceFsMounted) {
+        traceFsMounted = LittleFS.begin(true);     // Format on first use
+        if (!traceFsMounted) {
+            Serial.println("Trace: LittleFS mount failed");
+            return false;
         }
-        else if (strcmp(command, "TOGGLE") == 0) {
-            toggleRelay();
+        File file = LittleFS.open(TRACE_FLASH_PATH, FILE_READ);
+        traceFileBytes = file ? file.size() : 0;
+        if (file) file.close();
+    }
+    return true;
+}
+
+// "TRC <hex>" lines, picked out of the serial log by the replayer
+void printTraceLines(const uint8_t *data, size_t len)
+{
+    char line[4 + TRACE_LINE_BYTES * 2 + 1];
+    for (size_t off = 0; off < len; off += TRACE_LINE_BYTES) {
+        size_t n = len - off < TRACE_LINE_BYTES ? len - off : TRACE_LINE_BYTES;
+        memcpy(line, "TRC ", 4);
+        for (size_t i = 0; i < n; i++) {
+            snprintf(line + 4 + i * 2, 3, "%02x", data[off + i]);
         }
+        Serial.println(line);
     }
-    else if (strcmp(topic, MQTTTopics::PZEM_RESET) == 0)
-    {
-        if (strcmp(command, "RESET") == 0 || strcmp(command, "reset") == 0 || 
-            strcmp(command, "RESET_ENERGY") == 0) {
-            resetPzemEnergy();
+}
+
+// Drain the RAM buffer to the active sink
+void flushTrace()
+{
+    if (traceWriter.pending() == 0) {
+        return;
+    }
+    
+    File file;
+    if (traceMode == TRACE_FLASH) {
+        file = LittleFS.open(TRACE_FLASH_PATH, FILE_APPEND);
+    }
+    
+    uint8_t chunk[TRACE_LINE_BYTES * 8];
+    for (;;) {
+        portENTER_CRITICAL(&traceLock);
+        size_t n = traceWriter.read(chunk, sizeof(chunk));
+        portEXIT_CRITICAL(&traceLock);
+        if (n == 0) break;
+        
+        if (traceMode == TRACE_SERIAL) {
+            printTraceLines(chunk, n);
+        } else if (file) {
+            traceFileBytes += file.write(chunk, n);
         }
     }
+    if (file) file.close();
+    
+    if (traceMode == TRACE_FLASH && traceFileBytes >= TRACE_FLASH_MAX) {
+        Serial.printf("Trace file full (%u bytes), recording stopped\n", (unsigned)traceFileBytes);
+        Acquisition::sampleHook = nullptr;
+        traceMode = TRACE_OFF;
+        traceStatusPending = true;
+    }
+}
+
+void stopTrace()
+{
+    Acquisition::sampleHook = nullptr;
+    flushTrace();
+    traceMode = TRACE_OFF;
+}
+
+void startTrace(uint8_t mode)
+{
+    if (mode == TRACE_FLASH && (!mountTraceFs() || traceFileBytes >= TRACE_FLASH_MAX)) {
+        Serial.println("Trace: flash unavailable or full (CLEAR first)");
+        return;
+    }
+    if (traceMode != TRACE_OFF) {
+        stopTrace();
+    }
+    
+    // New session header, then the state the replayer starts from
+    char state[24];
+    snprintf(state, sizeof(state), "STATE:%d,%d,%d,%d", Control::relayState ? 1 : 0,
+             Control::tempGuard.offByOverTemp ? 1 : 0, Control::tempGuard.wasOnBeforeTrip ? 1 : 0,
+             Acquisition::tripped() ? 1 : 0);
+    uint32_t now = millis();
+    portENTER_CRITICAL(&traceLock);
+    traceWriter.begin(now);
+    traceWriter.command(now, Commands::TARGET_RELAY, state);
+    traceWriter.climate(now, Screens::data.temperature, Screens::data.humidity);
+    portEXIT_CRITICAL(&traceLock);
+    traceMode = mode;
+    Acquisition::sampleHook = traceSample;
+    Serial.printf("Trace recording to %s\n", TRACE_MODE_NAMES[mode]);
+}
+
+void setTraceMode(const char *command)
+{
+    if (strcmp(command, "SERIAL") == 0) {
+        startTrace(TRACE_SERIAL);
+    } else if (strcmp(command, "FLASH") == 0) {
+        startTrace(TRACE_FLASH);
+    } else if (strcmp(command, "OFF") == 0) {
+        stopTrace();
+    } else if (strcmp(command, "DUMP") == 0) {
+        if (traceMode == TRACE_FLASH) flushTrace();
+        if (mountTraceFs() && traceFileBytes > 0) traceDumpOffset = 0;
+    } else if (strcmp(command, "CLEAR") == 0) {
+        if (traceMode == TRACE_FLASH) stopTrace();
+        traceDumpOffset = -1;
+        if (mountTraceFs()) LittleFS.remove(TRACE_FLASH_PATH);
+        traceFileBytes = 0;
+    }
+    traceStatusPending = true;
+}
+
+// Flush the recording; dump the flash file a slice at a time
+void traceTask()
+{
+    if (traceMode != TRACE_OFF) {
+        flushTrace();
+    }
+    
+    if (traceDumpOffset >= 0) {
+        File file = LittleFS.open(TRACE_FLASH_PATH, FILE_READ);
+        uint8_t chunk[TRACE_DUMP_BYTES];
+        size_t n = 0;
+        if (file && file.seek(traceDumpOffset)) {
+            n = file.read(chunk, sizeof(chunk));
+        }
+        if (file) file.close();
+        
+        printTraceLines(chunk, n);
+        traceDumpOffset += n;
+        if (n < sizeof(chunk)) {
+            Serial.printf("Trace dump done: %d bytes\n", (int)traceDumpOffset);
+            traceDumpOffset = -1;
+            traceStatusPending = true;
+        }
+    }
+    
+    if (traceStatusPending) {
+        publishTraceStatus();
+    }
+}
+
+// {"mode":s,"records":n,"lost":n,"pending":bytes,"file":bytes,"dump":offset|-1}
+void publishTraceStatus()
+{
+    if (!mqttClient.connected()) {
+        return;
+    }
+    
+    char payload[128];
+    portENTER_CRITICAL(&traceLock);
+    uint32_t records = traceWriter.records();
+    uint32_t lost = traceWriter.lost();
+    uint16_t pending = traceWriter.pending();
+    portEXIT_CRITICAL(&traceLock);
+    snprintf(payload, sizeof(payload),
+             "{\"mode\":\"%s\",\"records\":%u,\"lost\":%u,\"pending\":%u,\"file\":%u,\"dump\":%d}",
+             TRACE_MODE_NAMES[traceMode], (unsigned)records, (unsigned)lost, (unsigned)pending,
+             (unsigned)traceFileBytes, (int)traceDumpOffset);
+    bool ok = Metrics::publish(mqttClient, MQTTTopics::TRACE_STATUS, payload, false);
+    if (ok) {
+        traceStatusPending = false;
+    }
+    Serial.printf("%s Trace: %s\n", ok ? "✅" : "❌", payload);
+}
+
+// ════════════════════════════════════════
+// PROFILING (home/profile/dump)
+// ════════════════════════════════════════
+// DUMP: publish the probe table and print it; RESET: same, then clear
+void dumpProfile(const char *command)
+{
+    char payload[PROFILE_REPORT_SIZE];
+    Profile::formatReport(payload, sizeof(payload));
+    bool ok = Metrics::publish(mqttClient, MQTTTopics::PROFILE_REPORT, payload, false);
+    Serial.printf("%s Profile%s\n", ok ? "✅" : "❌", Profile::ENABLED ? ":" : " (build without -DPROFILE):");
+    Profile::print(Serial);
+
+    if (strcmp(command, "RESET") == 0) {
+        Profile::reset();
+    }
 }
 
 // SETUP
 void setup()
 {
+    HeapStats::Scope heapScope("setup");
+    Hal::bindClock(halClock);
     Serial.begin(115200);
     delay(10);
     
@@ -589,36 +1399,44 @@ void setup()
     scanI2C();
     
     // SHT31 Init
-    if (!sht31.begin(SHT31_I2C_ADDR)) {
+    if (!climate.begin()) {
         Serial.printf("SHT31 not found at 0x%02X\n", SHT31_I2C_ADDR);
     } else {
         Serial.printf("SHT31 sensor found at 0x%02X\n", SHT31_I2C_ADDR);
     }
     
     // LCD Init
-    lcd.init();
-    lcd.backlight();
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("ESP32 IoT System");
-    lcd.setCursor(0, 1);
-    lcd.print("Starting...");
+    Screens::begin(lcd, energyLedger);
+    Screens::showMessage("ESP32 IoT System", "Starting...", LCD_SPLASH_DURATION);
     Serial.printf("LCD initialized at 0x%02X\n", LCD_I2C_ADDR);
-    delay(2000);
     
     // GPIO Init
-    pinMode(LED_RESET_PIN, OUTPUT);
-    pinMode(RELAY_PIN, OUTPUT);
-    pinMode(BUTTON_PIN, INPUT_PULLUP);
+    gpio.mode(LED_RESET_PIN, Hal::Gpio::MODE_OUTPUT);
+    gpio.mode(BUTTON_PIN, Hal::Gpio::MODE_INPUT_PULLUP);
+    gpio.write(LED_RESET_PIN, LOW);
+    
+    // Relay OFF (Active LOW); switched only through Control from here on
+    Control::Hooks hooks = {Acquisition::tripped, Acquisition::clearTrip, meterEnergy, traceInput, logLine,
+                            persistRelayNow};
+    Control::begin(gpio, mqttTransport, RELAY_PIN, hooks);
     
-    digitalWrite(LED_RESET_PIN, LOW);
-    digitalWrite(RELAY_PIN, HIGH); // Active LOW - OFF
-    relayState = false;
-    displayData.relayState = false;
-    last_relay_state = false;
-    last_state_change = millis();
+    // Lifetime counters from NVS; saved state is applied once protection runs
+    if (RelayStore::begin()) {
+        const RelayStore::Record &saved = RelayStore::record();
+        Control::restoreCounters(saved.onMs, saved.offMs, saved.switches);
+        Serial.printf("Relay NVS: last %s, ON %lus, OFF %lus, %u switches, %u writes\n",
+                      saved.state ? "ON" : "OFF", (unsigned long)(saved.onMs / 1000),
+                      (unsigned long)(saved.offMs / 1000), saved.switches, saved.writes);
+    }
     
     Serial.println("Relay: OFF (active LOW)");
+    const Demand::OutputConfig outputs[] = {
+        {"heater", OUTPUT_HEATER_PIN, OUTPUT_HEATER_PRIORITY, OUTPUT_HEATER_LOAD_W, OUTPUT_MIN_ON_MS, OUTPUT_MIN_OFF_MS},
+        {"pump", OUTPUT_PUMP_PIN, OUTPUT_PUMP_PRIORITY, OUTPUT_PUMP_LOAD_W, OUTPUT_MIN_ON_MS, OUTPUT_MIN_OFF_MS},
+    };
+    for (const Demand::OutputConfig &cfg : outputs) {
+        Control::addOutput(cfg);
+    }
     Serial.printf("LED Reset: GPIO%d\n", LED_RESET_PIN);
     Serial.printf("Button: GPIO%d\n", BUTTON_PIN);
     Serial.printf("PZEM: Serial2 (RX=GPIO%d, TX=GPIO%d)\n", PZEM_RX, PZEM_TX);
@@ -627,10 +1445,19 @@ void setup()
     Serial.println("════════════════════════════════════════");
     setup_wifi(ssid, password);
     
+    // SNTP (UTC; the schedule applies TOU_UTC_OFFSET_MIN itself)
+    configTime(0, 0, TOU_NTP_SERVER_1, TOU_NTP_SERVER_2);
+    loadRelaySchedule();
+    loadRules();
+    loadEnergyLedger();
+    loadNilmTable();
+    loadAnomalyModel();
+    
     // MQTT Setup
-    client_id_string = "esp32-" + WiFi.macAddress();
-    client_id_string.replace(":", "");
-    client_id = client_id_string.c_str();
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    snprintf(client_id, sizeof(client_id), "esp32-%02X%02X%02X%02X%02X%02X",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
     
     Serial.println("════════════════════════════════════════");
     Serial.printf(" MQTT Client ID: %s\n", client_id);
@@ -644,20 +1471,62 @@ void setup()
     Serial.printf("MQTT Buffer: %d bytes\n", MQTT_BUFFER_SIZE);
     Serial.printf("MQTT Keepalive: %ds\n", MQTT_KEEPALIVE);
     
-    // Start Tickers
-    dhtTicker.attach_ms(DHT_READ_INTERVAL, dhtReadPublish);
-    pzemTicker.attach_ms(PZEM_READ_INTERVAL, pzemReadPublish);
-    lcdTicker.attach_ms(LCD_UPDATE_INTERVAL, updateLCD);
-    systemInfoTicker.attach_ms(SYSTEM_INFO_INTERVAL, publishSystemInfoByIndex);
-    tempCheckTicker.attach_ms(TEMP_CHECK_INTERVAL, checkTemperatureProtection);  
+    Power::begin();
+    aggShort.start(millis());
+    aggLong.start(millis());
+    
+    // PZEM polling + over-current/over-power trip, independent of MQTT
+    Acquisition::begin(powerMeter, gpio, RELAY_PIN);
+    
+    if (RelayStore::bootState()) {
+        Serial.printf("Restoring relay ON (policy %d)\n", RELAY_RESTORE_POLICY);
+        Control::set(true, "RESTORE");
+    }
+    
+    // Register scheduled tasks (priority decides order when several are due)
+    scheduler.add("trip", handleProtectionTrip, PROTECTION_TRIP_CHECK_INTERVAL, Sched::PRIO_CRITICAL);
+    scheduler.add("pq", handlePowerQualityEvents, PQ_CHECK_INTERVAL, Sched::PRIO_HIGH);
+    scheduler.add("pzem", pzemReadPublish, PZEM_READ_INTERVAL, Sched::PRIO_HIGH);
+    scheduler.add("temp", checkTemperatureProtection, TEMP_CHECK_INTERVAL, Sched::PRIO_HIGH, TEMP_CHECK_INTERVAL);
+    scheduler.add("tou", relayScheduleTask, TOU_CHECK_INTERVAL, Sched::PRIO_HIGH);
+    scheduler.add("demand", demandTask, DEMAND_SAMPLE_INTERVAL, Sched::PRIO_HIGH);
+    scheduler.add("rules", rulesTask, RULES_EVAL_INTERVAL, Sched::PRIO_HIGH);
+    scheduler.add("aggregate", aggregateTask, AGG_SAMPLE_INTERVAL, Sched::PRIO_NORMAL);
+    scheduler.add("tariff", tariffTask, TARIFF_UPDATE_INTERVAL, Sched::PRIO_NORMAL);
+    scheduler.add("nilm", nilmTask, NILM_SAMPLE_INTERVAL, Sched::PRIO_NORMAL);
+    scheduler.add("sht31", dhtReadPublish, DHT_READ_INTERVAL, Sched::PRIO_NORMAL);
+    scheduler.add("lcd", Screens::update, LCD_UPDATE_INTERVAL, Sched::PRIO_NORMAL);
+    scheduler.add("lcdstats", publishLcdStats, LCD_STATS_INTERVAL, Sched::PRIO_LOW, LCD_STATS_INTERVAL);
+    pzemResetTask = scheduler.add("pzemreset", resetPzemEnergy, 0, Sched::PRIO_HIGH, 0, PZEM_RESET_MAX_LATENCY, 0, false);
+    ledBlinkTask = scheduler.add("led", ledBlinkCallback, LED_BLINK_INTERVAL, Sched::PRIO_NORMAL, 0, 0, 0, false);
+    scheduler.add("wifi", checkWiFiConnection, WIFI_CHECK_INTERVAL, Sched::PRIO_NORMAL, WIFI_CHECK_INTERVAL);
+    scheduler.add("sysinfo", publishSystemInfoByIndex, SYSTEM_INFO_INTERVAL, Sched::PRIO_LOW);
+    scheduler.add("heartbeat", heartbeatTask, MQTT_HEARTBEAT_INTERVAL, Sched::PRIO_LOW, MQTT_HEARTBEAT_INTERVAL);
+    scheduler.add("relaynvs", persistRelayTask, RELAY_PERSIST_SERVICE_INTERVAL, Sched::PRIO_LOW);
+    scheduler.add("relaystats", publishRelayStatsTask, RELAY_STATS_INTERVAL, Sched::PRIO_LOW, RELAY_STATS_INTERVAL);
+    scheduler.add("metrics", publishMetricsTask, METRICS_PUBLISH_INTERVAL, Sched::PRIO_LOW, METRICS_PUBLISH_INTERVAL);
+    scheduler.add("sched", publishSchedulerReport, SCHED_REPORT_INTERVAL, Sched::PRIO_LOW, SCHED_REPORT_INTERVAL);
+    scheduler.add("power", publishPowerReport, POWER_REPORT_INTERVAL, Sched::PRIO_LOW, POWER_REPORT_INTERVAL);
+    scheduler.add("health", publishHealthReport, HEALTH_REPORT_INTERVAL, Sched::PRIO_LOW, HEALTH_FIRST_REPORT_DELAY);
+    scheduler.add("energysum", publishEnergySummaries, TARIFF_PUBLISH_INTERVAL, Sched::PRIO_LOW, TARIFF_PUBLISH_INTERVAL);
+    scheduler.add("rulestats", Control::publishRulesStatus, RULES_REPORT_INTERVAL, Sched::PRIO_LOW, RULES_REPORT_INTERVAL);
+    scheduler.add("outputs", Control::publishOutputsStatus, DEMAND_REPORT_INTERVAL, Sched::PRIO_LOW, DEMAND_REPORT_INTERVAL);
+    scheduler.add("protstats", publishProtectionReport, PROTECTION_REPORT_INTERVAL, Sched::PRIO_LOW, PROTECTION_REPORT_INTERVAL);
+    scheduler.add("pqstats", publishPowerQualityReport, PQ_REPORT_INTERVAL, Sched::PRIO_LOW, PQ_REPORT_INTERVAL);
+    scheduler.add("nilmsigs", publishNilmSignatures, NILM_REPORT_INTERVAL, Sched::PRIO_LOW, NILM_REPORT_INTERVAL);
+    scheduler.add("trace", traceTask, TRACE_FLUSH_INTERVAL, Sched::PRIO_LOW);
     
     Serial.println("════════════════════════════════════════");
-    Serial.println("Ticker Intervals:");
+    Serial.printf("Scheduler: %d tasks\n", scheduler.count());
+    Serial.println("Task Intervals:");
     Serial.printf("   SHT31: %dms\n", DHT_READ_INTERVAL);
     Serial.printf("   PZEM: %dms\n", PZEM_READ_INTERVAL);
     Serial.printf("   LCD: %dms\n", LCD_UPDATE_INTERVAL);
     Serial.printf("   System Info: %dms\n", SYSTEM_INFO_INTERVAL);
     Serial.printf("   Relay Stats: %dms\n", RELAY_STATS_INTERVAL);
+    Serial.printf("   Metrics: %dms\n", METRICS_PUBLISH_INTERVAL);
+    Serial.printf("   WiFi Check: %dms\n", WIFI_CHECK_INTERVAL);
+    Serial.printf("   Heartbeat: %dms\n", MQTT_HEARTBEAT_INTERVAL);
     Serial.printf("   Temp Check: %dms\n", TEMP_CHECK_INTERVAL);  
     
     Serial.println("════════════════════════════════════════");
@@ -667,55 +1536,98 @@ void setup()
     Serial.printf("   Auto OFF when T > %.1f°C\n", TEMP_THRESHOLD);
     Serial.printf("   Auto ON when T < %.1f°C (if was ON before)\n", 
                   TEMP_THRESHOLD - TEMP_HYSTERESIS);
+    Serial.println("  Over-current / Over-power Protection:");
+    Serial.printf("   Trip when I > %.1fA or P > %.0fW (latched until relay ON)\n",
+                  PROTECTION_MAX_CURRENT_A, PROTECTION_MAX_POWER_W);
+    Serial.printf("   Poll: %dms (acquisition task)\n", PROTECTION_POLL_INTERVAL);
+    Serial.printf("  Demand limit: %.0fW over %ds (outputs shed by priority)\n",
+                  DEMAND_LIMIT_W, DEMAND_WINDOW_SAMPLES * DEMAND_SAMPLE_INTERVAL / 1000);
     
     Serial.println("════════════════════════════════════════");
     Serial.println("System ready!");
     Serial.println("MQTT Topics:");
-    Serial.println("   System: home/system/* (mqtt, rssi, ip, uptime, heap)");
-    Serial.println("   Relay:  home/relay/* (control, status, event, stats)");
+    Serial.println("   System: home/system/* (mqtt, rssi, ip, uptime, heap, metrics, scheduler, power, health, stall, lcd)");
+    Serial.println("   Relay:  home/relay/* (control, status, event, stats, schedule)");
     Serial.println("   Sensors: home/* (temperature, humidity, voltage, etc.)");
+    Serial.println("   Protection: home/protection/* (trip, status)");
+    Serial.println("   Power quality: home/pq/* (event, status)");
+    Serial.println("   Outputs: home/outputs/* (control, status, event)");
+    Serial.println("   Rules: home/rules/* (set, status, event)");
+    Serial.println("   Aggregates: home/aggregate/* (1m, 15m, raw)");
+    Serial.println("   Energy: home/energy/* (today, month, daily, monthly)");
+    Serial.println("   NILM: home/nilm/* (event, signatures)");
+    Serial.println("   Anomaly: home/anomaly/event");
+    Serial.println("   Profile: home/profile/* (dump, report)");
     Serial.println("════════════════════════════════════════\n");
     
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("SYSTEM READY");
-    lcd.setCursor(0, 1);
-    lcd.print("Connecting MQTT");
-    delay(1000);
+    Screens::showMessage("SYSTEM READY", "Connecting MQTT", LCD_READY_DURATION);
+    
+    // Allocations in scheduler tasks are counted per task name
+    HeapStats::begin(currentTaskName, heapLayout);
+    
+    // Watchdog + stall supervisor last, so setup() itself is not covered
+    Health::begin(currentTaskName);
 }
 
 // MAIN LOOP
 void loop()
 {
+    Health::enter(Health::STAGE_LOOP);
+    
     const char *subscribe_topics[] = {
         MQTTTopics::RELAY_CONTROL,
-        MQTTTopics::PZEM_RESET
+        MQTTTopics::RELAY_SCHEDULE_SET,
+        MQTTTopics::OUTPUTS_CONTROL,
+        MQTTTopics::RULES_SET,
+        MQTTTopics::AGGREGATE_RAW,
+        MQTTTopics::PZEM_RESET,
+        MQTTTopics::TRACE_SET,
+        MQTTTopics::PROFILE_DUMP
     };
     
-    MQTT::reconnectWithLWT(
-        mqttClient, 
-        client_id, 
-        EMQX::username, 
-        EMQX::password,
-        subscribe_topics, 
-        2,
-        MQTTTopics::MQTT_STATUS,
-        MQTTTopics::MQTT_LWT,
-        MQTTTopics::MQTT_ONLINE
-    );
-    
-    mqttClient.loop();
-    handleButton();
+    {
+        Health::Scope stage(Health::STAGE_MQTT_CONNECT);
+        HeapStats::Scope heap(Health::STAGE_NAMES[Health::STAGE_MQTT_CONNECT]);
+        MQTT::reconnectWithLWT(
+            mqttClient, 
+            client_id, 
+            EMQX::username, 
+            EMQX::password,
+            subscribe_topics, 
+            sizeof(subscribe_topics) / sizeof(subscribe_topics[0]),
+            MQTTTopics::MQTT_STATUS,
+            MQTTTopics::MQTT_LWT,
+            MQTTTopics::MQTT_ONLINE
+        );
+    }
+    
+    {
+        Health::Scope stage(Health::STAGE_MQTT_LOOP);
+        HeapStats::Scope heap(Health::STAGE_NAMES[Health::STAGE_MQTT_LOOP]);
+        PROFILE_SCOPE(Profile::PROBE_MQTT_LOOP);
+        mqttClient.loop();
+    }
     
-    MQTT::heartbeat(mqttClient, MQTTTopics::MQTT_STATUS, MQTTTopics::MQTT_ONLINE);
-    checkWiFiConnection();
+    {
+        Health::Scope stage(Health::STAGE_BUTTON);
+        HeapStats::Scope heap(Health::STAGE_NAMES[Health::STAGE_BUTTON]);
+        handleButton();
+    }
     
-    // Relay Stats (every 60s)
-    static unsigned long lastStatsPublish = 0;
-    if (mqttClient.connected() && (millis() - lastStatsPublish > RELAY_STATS_INTERVAL)) {
-        lastStatsPublish = millis();
-        publishRelayStats();
+    // All periodic work (sensors, LCD, publishing, WiFi check, heartbeat)
+    {
+        Health::Scope stage(Health::STAGE_SCHEDULER);
+        HeapStats::Scope heap(Health::STAGE_NAMES[Health::STAGE_SCHEDULER]);
+        scheduler.run(SCHED_SLICE_US);
     }
     
-    delay(10);
+    Health::exit(Health::STAGE_LOOP);
+    Health::feed();
+    
+    // Block until just before the next deadline (auto light sleep meanwhile)
+    {
+        Health::Scope stage(Health::STAGE_IDLE);
+        HeapStats::Scope heap(Health::STAGE_NAMES[Health::STAGE_IDLE]);
+        Power::idle(scheduler.timeToNextUs());
+    }
 }
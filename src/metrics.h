@@ -0,0 +1,179 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "hal.h"
+#include "histogram.h"
+#include "heap_stats.h"
+#include "profile.h"
+
+// ════════════════════════════════════════════════════════════════
+// PUBLISH-PATH METRICS
+// Wraps mqttClient.publish() with per-topic counters, a log2
+// latency histogram (µs) and a TLS write-stall counter. Works with
+// PubSubClient or any Hal::Transport.
+// ════════════════════════════════════════════════════════════════
+
+namespace Metrics
+{
+    struct TopicStats {
+        const char *topic;
+        uint32_t attempts;
+        uint32_t failures;
+        uint32_t bytes;
+    };
+
+    TopicStats topicStats[METRICS_MAX_TOPICS];
+    uint8_t topicCount = 0;
+
+    LogHistogram<METRICS_LATENCY_BUCKETS> publishLatencyUs;   // reset every report
+    uint32_t tlsWriteStalls = 0;
+    uint32_t totalAttempts = 0;
+    uint32_t totalFailures = 0;
+    uint32_t totalBytes = 0;
+
+    // Command → ack latency (e.g. home/pzem/reset → home/pzem/status)
+    uint32_t commandAcks = 0;
+    uint32_t commandAckLastUs = 0;
+    uint32_t commandAckMaxUs = 0;
+
+    uint32_t lastReportBytes = 0;
+    unsigned long lastReportMs = 0;
+
+    TopicStats *findTopic(const char *topic)
+    {
+        // Topics are MQTTTopics constants, so pointer compare hits first
+        for (uint8_t i = 0; i < topicCount; i++) {
+            if (topicStats[i].topic == topic) return &topicStats[i];
+        }
+        for (uint8_t i = 0; i < topicCount; i++) {
+            if (strcmp(topicStats[i].topic, topic) == 0) return &topicStats[i];
+        }
+        if (topicCount >= METRICS_MAX_TOPICS) return nullptr;
+
+        TopicStats &entry = topicStats[topicCount++];
+        entry.topic = topic;
+        entry.attempts = 0;
+        entry.failures = 0;
+        entry.bytes = 0;
+        return &entry;
+    }
+
+    void record(const char *topic, size_t bytes, uint32_t elapsed_us, bool success)
+    {
+        TopicStats *stats = findTopic(topic);
+        if (stats) {
+            stats->attempts++;
+            if (success) stats->bytes += bytes;
+            else stats->failures++;
+        }
+
+        totalAttempts++;
+        if (success) totalBytes += bytes;
+        else totalFailures++;
+
+        publishLatencyUs.add(elapsed_us);
+        if (elapsed_us >= METRICS_TLS_STALL_US) {
+            tlsWriteStalls++;
+        }
+    }
+
+    void recordCommandAck(uint32_t latency_us)
+    {
+        commandAcks++;
+        commandAckLastUs = latency_us;
+        if (latency_us > commandAckMaxUs) commandAckMaxUs = latency_us;
+    }
+
+    // Drop-in replacement for mqttClient.publish()
+    template <class Client>
+    bool publish(Client &mqttClient, const char *topic, const char *payload, bool retained)
+    {
+        size_t bytes = strlen(topic) + strlen(payload);
+
+        uint32_t start = Hal::micros();
+        bool success;
+        {
+            PROFILE_SCOPE(Profile::PROBE_PUBLISH);
+            success = mqttClient.publish(topic, payload, retained);
+        }
+        uint32_t elapsed = Hal::micros() - start;
+
+        record(topic, bytes, elapsed, success);
+        return success;
+    }
+
+    // Compact JSON report:
+    // {"up":s,"n":attempts,"fail":f,"bytes":b,"bps":rate,"stall":tls,
+    //  "lat":[p50,p99,max,count],"ack":[n,last_us,max_us],"hist":[...],
+    //  "heap":[...],"alloc":[...] (heap_stats.h),"t":[[topic,n,fail,bytes],...]}
+    size_t formatReport(char *buf, size_t size)
+    {
+        unsigned long now = Hal::millis();
+        unsigned long elapsed_ms = now - lastReportMs;
+        uint32_t interval_bytes = totalBytes - lastReportBytes;
+        uint32_t bps = elapsed_ms ? (uint32_t)((uint64_t)interval_bytes * 1000 / elapsed_ms) : 0;
+
+        // Every part is appended only if the closing brackets still fit:
+        // a short buffer drops histogram buckets / heap / topics, never
+        // the JSON structure
+        const size_t TAIL = 10;         // "]" + ",\"t\":[" + "]}" + NUL
+        int len = snprintf(buf, size,
+            "{\"up\":%lu,\"n\":%u,\"fail\":%u,\"bytes\":%u,\"bps\":%u,\"stall\":%u,"
+            "\"lat\":[%u,%u,%u,%u],\"ack\":[%u,%u,%u],\"hist\":[",
+            now / 1000, totalAttempts, totalFailures, totalBytes, bps, tlsWriteStalls,
+            publishLatencyUs.percentile(50), publishLatencyUs.percentile(99),
+            publishLatencyUs.max, publishLatencyUs.count,
+            commandAcks, commandAckLastUs, commandAckMaxUs);
+        bool fits = len > 0 && (size_t)len + TAIL <= size;
+
+        for (uint8_t i = 0; i < METRICS_LATENCY_BUCKETS && fits; i++) {
+            char entry[12];
+            int n = snprintf(entry, sizeof(entry), i ? ",%u" : "%u", publishLatencyUs.buckets[i]);
+            if ((size_t)(len + n) + TAIL > size) break;
+            memcpy(buf + len, entry, n);
+            len += n;
+        }
+        if (fits) {
+            buf[len++] = ']';
+            len += HeapStats::formatReport(buf + len, size - len - (TAIL - 1));
+            len += snprintf(buf + len, size - len, ",\"t\":[");
+        }
+
+        for (uint8_t i = 0; i < topicCount && fits; i++) {
+            const TopicStats &t = topicStats[i];
+            // Leave room for the closing brackets, drop topics that don't fit
+            char entry[96];
+            int n = snprintf(entry, sizeof(entry), "%s[\"%s\",%u,%u,%u]",
+                             i ? "," : "", t.topic, t.attempts, t.failures, t.bytes);
+            if (n <= 0 || (size_t)(len + n + 3) > size) break;
+            memcpy(buf + len, entry, n);
+            len += n;
+        }
+        if (fits) {
+            len += snprintf(buf + len, size - len, "]}");
+        }
+
+        lastReportMs = now;
+        lastReportBytes = totalBytes;
+        return fits ? (size_t)len : 0;
+    }
+
+    // Returns the published report (nullptr when not connected)
+    template <class Client>
+    const char *publishReport(Client &mqttClient, const char *metrics_topic, bool &ok)
+    {
+        if (!mqttClient.connected()) {
+            return nullptr;
+        }
+
+        static char report[METRICS_REPORT_SIZE];
+        formatReport(report, sizeof(report));
+        ok = publish(mqttClient, metrics_topic, report, false);
+
+        // Latency histogram covers one reporting interval
+        publishLatencyUs.reset();
+        return report;
+    }
+}
@@ -0,0 +1,274 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+// ════════════════════════════════════════════════════════════════
+// NILM-LITE APPLIANCE DETECTION
+// Watches consecutive P / PF samples for steady-state level changes
+// (a level must hold for NILM_STABLE_SAMPLES within the noise band).
+// Each step (ΔP, ΔQ) is matched against a fixed table of learned
+// signatures: a rising step switches the nearest signature ON or
+// learns a new one, a falling step switches the closest ON signature
+// OFF. Constant memory, O(MAX_SIGNATURES) work per sample.
+// Pure logic: samples are passed in, so traces can be replayed.
+// The learned table is exported as a blob so ids survive a reboot.
+// ════════════════════════════════════════════════════════════════
+
+namespace Nilm
+{
+    struct Config {
+        float noiseW;               // Samples within this band count as steady
+        float minStepW;             // Smaller level changes are ignored
+        float matchRatio;           // Match tolerance, fraction of the signature's ΔP
+        float matchMinW;            // ... but never tighter than this
+        uint8_t stableSamples;      // Samples needed for a new steady level
+    };
+
+    struct Signature {
+        float p = 0.0f;             // Step size (W), running mean
+        float q = 0.0f;             // Reactive step (var), running mean
+        uint16_t count = 0;         // Matched steps
+        bool on = false;
+        uint32_t onSinceMs = 0;
+        uint32_t onTotalS = 0;
+    };
+
+    enum EventType : uint8_t {
+        EVENT_NONE = 0,
+        EVENT_ON,
+        EVENT_OFF,
+        EVENT_UNMATCHED_OFF         // Falling step with no ON signature nearby
+    };
+
+    struct Event {
+        uint8_t type = EVENT_NONE;
+        uint8_t id = 0;             // Signature index
+        bool learned = false;       // ON event created a new signature
+        float dp = 0.0f;
+        float dq = 0.0f;
+    };
+
+    const uint32_t TABLE_MAGIC = 0x4E494C31UL;      // "NIL1"
+
+    template <uint8_t MAX_SIGNATURES>
+    struct Table {
+        uint32_t magic;
+        uint8_t count;
+        Signature sigs[MAX_SIGNATURES];
+    };
+
+    // Reactive power from P and PF (sign unknown: magnitude only)
+    inline float reactive(float p, float pf)
+    {
+        if (isnan(p) || isnan(pf) || pf <= 0.0f || pf > 1.0f) return 0.0f;
+        return p * sqrtf(1.0f - pf * pf) / pf;
+    }
+
+    template <uint8_t MAX_SIGNATURES>
+    class Detector
+    {
+    public:
+        explicit Detector(const Config &cfg) : cfg_(cfg) {}
+
+        // Feed one sample; returns true with ev filled on an appliance event
+        bool add(float p, float pf, uint32_t now_ms, Event &ev)
+        {
+            if (isnan(p)) return false;
+            float q = reactive(p, pf);
+
+            if (!isnan(lastP_) && fabsf(p - lastP_) <= cfg_.noiseW) {
+                runCount_++;
+                runP_ += p;
+                runQ_ += q;
+            } else {
+                runCount_ = 1;
+                runP_ = p;
+                runQ_ = q;
+            }
+            lastP_ = p;
+
+            if (runCount_ < cfg_.stableSamples) return false;
+
+            float level_p = runP_ / runCount_;
+            float level_q = runQ_ / runCount_;
+            if (!haveLevel_) {
+                haveLevel_ = true;
+                levelP_ = level_p;
+                levelQ_ = level_q;
+                return false;
+            }
+
+            float dp = level_p - levelP_;
+            float dq = level_q - levelQ_;
+            if (fabsf(dp) < cfg_.minStepW) {
+                // Same level: follow slow drift
+                levelP_ = level_p;
+                levelQ_ = level_q;
+                return false;
+            }
+
+            levelP_ = level_p;
+            levelQ_ = level_q;
+            steps_++;
+            return dp > 0 ? rising(dp, dq, now_ms, ev) : falling(-dp, -dq, now_ms, ev);
+        }
+
+        uint8_t count() const { return count_; }
+        const Signature &signature(uint8_t i) const { return sigs_[i]; }
+        uint32_t steps() const { return steps_; }
+        uint32_t learned() const { return learned_; }      // Bumped on every new signature
+
+        Table<MAX_SIGNATURES> table() const
+        {
+            Table<MAX_SIGNATURES> t;
+            t.magic = TABLE_MAGIC;
+            t.count = count_;
+            for (uint8_t i = 0; i < MAX_SIGNATURES; i++) t.sigs[i] = sigs_[i];
+            return t;
+        }
+
+        // Restore a saved table; appliance states restart as OFF
+        bool restore(const Table<MAX_SIGNATURES> &t)
+        {
+            if (t.magic != TABLE_MAGIC || t.count > MAX_SIGNATURES) return false;
+            count_ = t.count;
+            for (uint8_t i = 0; i < count_; i++) {
+                sigs_[i] = t.sigs[i];
+                sigs_[i].on = false;
+            }
+            return true;
+        }
+
+        // [[id,p,q,count,on,on_total_s],...]
+        size_t formatSignatures(char *buf, size_t size, uint32_t now_ms) const
+        {
+            int len = snprintf(buf, size, "[");
+            for (uint8_t i = 0; i < count_ && len > 0 && (size_t)len < size; i++) {
+                const Signature &s = sigs_[i];
+                uint32_t on_s = s.onTotalS + (s.on ? (now_ms - s.onSinceMs) / 1000 : 0);
+                len += snprintf(buf + len, size - len, "%s[%u,%.0f,%.0f,%u,%d,%u]",
+                                i ? "," : "", i, s.p, s.q, s.count, s.on ? 1 : 0, (unsigned)on_s);
+            }
+            if (len > 0 && (size_t)len + 2 <= size) {
+                len += snprintf(buf + len, size - len, "]");
+            }
+            return len > 0 ? (size_t)len : 0;
+        }
+
+    private:
+        Config cfg_;
+        Signature sigs_[MAX_SIGNATURES];
+        uint8_t count_ = 0;
+
+        float lastP_ = NAN;
+        float runP_ = 0.0f;
+        float runQ_ = 0.0f;
+        uint16_t runCount_ = 0;
+        bool haveLevel_ = false;
+        float levelP_ = 0.0f;
+        float levelQ_ = 0.0f;
+        uint32_t steps_ = 0;
+        uint32_t learned_ = 0;
+
+        float distance(const Signature &s, float dp, float dq) const
+        {
+            float a = s.p - dp;
+            float b = s.q - dq;
+            return sqrtf(a * a + b * b);
+        }
+
+        float tolerance(const Signature &s) const
+        {
+            float t = s.p * cfg_.matchRatio;
+            return t > cfg_.matchMinW ? t : cfg_.matchMinW;
+        }
+
+        // Nearest signature within tolerance, optionally only ON / OFF ones
+        int8_t nearest(float dp, float dq, bool want_on) const
+        {
+            int8_t best = -1;
+            float best_d = 0.0f;
+            for (uint8_t i = 0; i < count_; i++) {
+                const Signature &s = sigs_[i];
+                if (s.on != want_on) continue;
+                float d = distance(s, dp, dq);
+                if (d <= tolerance(s) && (best < 0 || d < best_d)) {
+                    best = i;
+                    best_d = d;
+                }
+            }
+            return best;
+        }
+
+        void learn(Signature &s, float dp, float dq)
+        {
+            // Running mean, capped so the centroid keeps adapting
+            uint16_t n = s.count < 32 ? s.count + 1 : 32;
+            s.p += (dp - s.p) / n;
+            s.q += (dq - s.q) / n;
+            if (s.count < 0xFFFF) s.count++;
+        }
+
+        bool rising(float dp, float dq, uint32_t now_ms, Event &ev)
+        {
+            int8_t id = nearest(dp, dq, false);
+            ev.learned = false;
+            if (id < 0) {
+                id = allocate();
+                if (id < 0) return false;
+                ev.learned = true;
+                learned_++;
+            }
+
+            Signature &s = sigs_[id];
+            learn(s, dp, dq);
+            s.on = true;
+            s.onSinceMs = now_ms;
+
+            ev.type = EVENT_ON;
+            ev.id = id;
+            ev.dp = dp;
+            ev.dq = dq;
+            return true;
+        }
+
+        bool falling(float dp, float dq, uint32_t now_ms, Event &ev)
+        {
+            int8_t id = nearest(dp, dq, true);
+            ev.learned = false;
+            ev.dp = -dp;
+            ev.dq = -dq;
+            if (id < 0) {
+                ev.type = EVENT_UNMATCHED_OFF;
+                ev.id = 0;
+                return true;
+            }
+
+            Signature &s = sigs_[id];
+            learn(s, dp, dq);
+            s.on = false;
+            s.onTotalS += (now_ms - s.onSinceMs) / 1000;
+
+            ev.type = EVENT_OFF;
+            ev.id = id;
+            return true;
+        }
+
+        // Free slot, else recycle the least seen signature that is OFF
+        int8_t allocate()
+        {
+            if (count_ < MAX_SIGNATURES) {
+                sigs_[count_] = Signature();
+                return count_++;
+            }
+            int8_t victim = -1;
+            for (uint8_t i = 0; i < count_; i++) {
+                if (sigs_[i].on) continue;
+                if (victim < 0 || sigs_[i].count < sigs_[victim].count) victim = i;
+            }
+            if (victim >= 0) sigs_[victim] = Signature();
+            return victim;
+        }
+    };
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include <esp_sleep.h>
+#include <esp_pm.h>
+#include <driver/gpio.h>
+#include "config.h"
+
+// ════════════════════════════════════════════════════════════════
+// POWER MANAGEMENT
+// LOW_POWER_MODE=1: WiFi max modem sleep with a listen interval that
+// fits MQTT_KEEPALIVE, CPU clocked down, and ESP-IDF automatic light
+// sleep: loop() just blocks until the next deadline and the idle task
+// sleeps whenever every task is blocked. The WiFi driver keeps the
+// association (and the TLS socket) alive across it, and the acquisition
+// task's own 200ms wake bounds each sleep, so there is no manual
+// esp_light_sleep_start() here. Needs CONFIG_PM_ENABLE and tickless
+// idle in the sdkconfig; otherwise only modem sleep is used. Always
+// keeps time-in-state accounting to estimate the average current draw.
+// ════════════════════════════════════════════════════════════════
+
+namespace Power
+{
+    // Beacons the station may skip between wake-ups. Incoming packets
+    // wait at most listen_interval * beacon interval, which must stay
+    // well under the keepalive so PINGRESP/commands aren't delayed.
+    const uint16_t LISTEN_INTERVAL =
+        (MQTT_KEEPALIVE * 1000UL / 10 / POWER_BEACON_INTERVAL_MS) > POWER_MAX_LISTEN_INTERVAL
+            ? POWER_MAX_LISTEN_INTERVAL
+            : (MQTT_KEEPALIVE * 1000UL / 10 / POWER_BEACON_INTERVAL_MS);
+
+    struct Stats {
+        uint64_t activeUs = 0;          // CPU busy (loop body)
+        uint64_t idleUs = 0;            // Blocked between tasks, awake
+        uint64_t sleepUs = 0;           // Blocked with automatic light sleep on (upper bound)
+        uint32_t sleeps = 0;            // Blocking waits with light sleep on
+        uint32_t oversleepMaxUs = 0;    // Woke later than planned
+    } stats;
+
+    uint32_t lastWakeUs = 0;
+    bool autoLightSleep = false;        // esp_pm_configure() accepted light_sleep_enable
+
+    void begin()
+    {
+        lastWakeUs = micros();
+
+#if LOW_POWER_MODE
+        setCpuFrequencyMhz(POWER_CPU_FREQ_MHZ);
+
+        esp_pm_config_esp32_t pm;
+        pm.max_freq_mhz = POWER_CPU_FREQ_MHZ;
+        pm.min_freq_mhz = POWER_PM_MIN_FREQ_MHZ;
+        pm.light_sleep_enable = true;
+        esp_err_t err = esp_pm_configure(&pm);
+        autoLightSleep = err == ESP_OK;
+        if (!autoLightSleep) {
+            Serial.printf("⚠️ Auto light sleep unavailable (%s), modem sleep only\n", esp_err_to_name(err));
+        }
+
+        // Listen interval is applied on the next association
+        wifi_config_t conf;
+        if (esp_wifi_get_config(WIFI_IF_STA, &conf) == ESP_OK) {
+            conf.sta.listen_interval = LISTEN_INTERVAL;
+            esp_wifi_set_config(WIFI_IF_STA, &conf);
+        }
+        WiFi.setSleep(WIFI_PS_MAX_MODEM);
+
+        gpio_wakeup_enable((gpio_num_t)BUTTON_PIN, GPIO_INTR_LOW_LEVEL);
+        esp_sleep_enable_gpio_wakeup();
+
+        Serial.printf("Low power: CPU %d-%dMHz, modem sleep, auto light sleep %s, listen interval %u beacons\n",
+                      POWER_PM_MIN_FREQ_MHZ, POWER_CPU_FREQ_MHZ, autoLightSleep ? "on" : "off",
+                      LISTEN_INTERVAL);
+#endif
+    }
+
+    // Called at the end of loop() with the time until the next scheduled
+    // deadline. Blocks no longer than the deadline minus a wake margin;
+    // with automatic light sleep the idle task sleeps through the wait
+    // (the button GPIO and the acquisition task wake it early).
+    void idle(uint32_t time_to_next_us)
+    {
+        uint32_t now = micros();
+        stats.activeUs += now - lastWakeUs;
+
+        uint32_t margin_us = POWER_WAKE_MARGIN_MS * 1000UL;
+        uint32_t budget_us = time_to_next_us > margin_us ? time_to_next_us - margin_us : 0;
+
+        // Awake: keep the original 10ms loop pacing. Light sleep: block
+        // longer so the idle task gets a useful sleep window.
+        uint32_t cap_ms = autoLightSleep ? POWER_MAX_SLEEP_MS : POWER_IDLE_DELAY_MS;
+        uint32_t wait_ms = budget_us / 1000;
+        if (wait_ms > cap_ms) wait_ms = cap_ms;
+        if (wait_ms == 0) wait_ms = 1;
+        delay(wait_ms);
+
+        lastWakeUs = micros();
+        uint32_t waited = lastWakeUs - now;
+        if (autoLightSleep) {
+            stats.sleepUs += waited;
+            stats.sleeps++;
+            uint32_t planned = wait_ms * 1000UL;
+            if (waited > planned && waited - planned > stats.oversleepMaxUs) {
+                stats.oversleepMaxUs = waited - planned;
+            }
+        } else {
+            stats.idleUs += waited;
+        }
+    }
+
+    // Time-weighted average current estimate (mA)
+    float averageCurrentMa()
+    {
+        uint64_t total = stats.activeUs + stats.idleUs + stats.sleepUs;
+        if (total == 0) return 0.0f;
+
+#if LOW_POWER_MODE
+        const float idle_ma = POWER_CURRENT_MODEM_SLEEP_MA;
+#else
+        const float idle_ma = POWER_CURRENT_IDLE_MA;
+#endif
+        double charge = (double)stats.activeUs * POWER_CURRENT_ACTIVE_MA
+                      + (double)stats.idleUs * idle_ma
+                      + (double)stats.sleepUs * POWER_CURRENT_LIGHT_SLEEP_MA;
+        return (float)(charge / (double)total);
+    }
+
+    // {"lp":mode,"ma":avg,"active":%,"idle":%,"sleep":%,"n":sleeps,"late":oversleep_ms}
+    size_t formatReport(char *buf, size_t size)
+    {
+        uint64_t total = stats.activeUs + stats.idleUs + stats.sleepUs;
+        float scale = total ? 100.0f / (float)total : 0.0f;
+        int len = snprintf(buf, size,
+            "{\"lp\":%d,\"ma\":%.1f,\"active\":%.1f,\"idle\":%.1f,\"sleep\":%.1f,\"n\":%u,\"late\":%u}",
+            LOW_POWER_MODE, averageCurrentMa(),
+            stats.activeUs * scale, stats.idleUs * scale, stats.sleepUs * scale,
+            (unsigned)stats.sleeps, (unsigned)(stats.oversleepMaxUs / 1000));
+        return len > 0 ? (size_t)len : 0;
+    }
+}
@@ -0,0 +1,277 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include "protection.h"
+
+// ════════════════════════════════════════════════════════════════
+// POWER-QUALITY EVENT RECORDER
+// Runs on every acquisition sample. Voltage and frequency are two
+// independent channels; a channel opens an event when it leaves its
+// band (sag / swell / interruption, under / over frequency) and
+// closes it once back inside the band minus the hysteresis. Each
+// event keeps start, end, duration, the extreme value and the last
+// PRETRIGGER samples before the start. Opened and closed events are
+// queued for loop() to publish; per-class counters are lifetime.
+// Time resolution is the acquisition poll period.
+// The PZEM stops answering below ~80V, so an interruption shows up as
+// a run of invalid samples: interruptSamples in a row right after an
+// in-band or sag reading are fed to the voltage channel as 0V (a sag
+// open at that moment deepens into the interruption). Isolated Modbus
+// errors, or a meter that never answered, are not events.
+// ════════════════════════════════════════════════════════════════
+
+namespace PowerQuality
+{
+    enum EventClass : uint8_t {
+        CLASS_SAG = 0,
+        CLASS_SWELL,
+        CLASS_INTERRUPTION,
+        CLASS_FREQ_LOW,
+        CLASS_FREQ_HIGH,
+        CLASS_COUNT
+    };
+
+    inline const char *className(uint8_t c)
+    {
+        static const char *const NAMES[CLASS_COUNT] = {"SAG", "SWELL", "INTERRUPTION", "FREQ_LOW", "FREQ_HIGH"};
+        return c < CLASS_COUNT ? NAMES[c] : "?";
+    }
+
+    struct Limits {
+        float sagV;                 // Below: sag
+        float swellV;               // Above: swell
+        float interruptV;           // Below: interruption
+        float hysteresisV;
+        uint8_t interruptSamples;   // Invalid samples in a row = interruption
+        float freqLowHz;
+        float freqHighHz;
+        float hysteresisHz;
+    };
+
+    struct Point {
+        uint32_t ms;
+        float voltage;
+        float frequency;
+    };
+
+    template <uint8_t PRETRIGGER>
+    struct Event {
+        uint8_t cls = CLASS_SAG;
+        bool open = true;           // false once the channel is back in band
+        uint32_t startMs = 0;
+        uint32_t endMs = 0;
+        float extreme = NAN;        // Min for sag / interruption / low f, max otherwise
+        uint16_t samples = 0;       // Out-of-band samples
+        uint8_t preCount = 0;
+        Point pre[PRETRIGGER];      // Oldest first
+
+        uint32_t durationMs() const { return endMs - startMs; }
+    };
+
+    // {"c":"SAG","open":0,"t0":ms,"dur":ms,"x":198.2,"n":4,"pre":[[dt,V,f],...]}
+    template <uint8_t PRETRIGGER>
+    size_t formatEvent(const Event<PRETRIGGER> &e, char *buf, size_t size)
+    {
+        bool volts = e.cls <= CLASS_INTERRUPTION;
+        int len = snprintf(buf, size, "{\"c\":\"%s\",\"open\":%d,\"t0\":%u,\"dur\":%u,\"x\":%.*f,\"n\":%u,\"pre\":[",
+                           className(e.cls), e.open ? 1 : 0, (unsigned)e.startMs,
+                           (unsigned)e.durationMs(), volts ? 1 : 2, e.extreme, e.samples);
+        for (uint8_t i = 0; i < e.preCount && len > 0 && (size_t)len < size; i++) {
+            const Point &p = e.pre[i];
+            len += snprintf(buf + len, size - len, "%s[%d,%.1f,%.2f]", i ? "," : "",
+                            (int)(p.ms - e.startMs), p.voltage, p.frequency);
+        }
+        if (len > 0 && (size_t)len + 3 <= size) {
+            len += snprintf(buf + len, size - len, "]}");
+        }
+        return len > 0 ? (size_t)len : 0;
+    }
+
+    template <uint8_t PRETRIGGER, uint8_t QUEUE>
+    class Recorder
+    {
+    public:
+        typedef PowerQuality::Event<PRETRIGGER> Event;
+
+        explicit Recorder(const Limits &limits) : limits_(limits) {}
+
+        // One acquisition sample; opened / closed events go to the queue
+        void add(const PowerSample &s)
+        {
+            if (!s.valid) {
+                missing(s.ms);
+                return;
+            }
+            missingRun_ = 0;
+            if (!isnan(s.voltage)) lastV_ = s.voltage;
+            Point p = {s.ms, s.voltage, s.frequency};
+
+            voltageChannel(p);
+            frequencyChannel(p);
+
+            ring_[ringHead_] = p;
+            ringHead_ = (ringHead_ + 1) % PRETRIGGER;
+            if (ringCount_ < PRETRIGGER) ringCount_++;
+        }
+
+        bool take(Event &out)
+        {
+            if (queueCount_ == 0) return false;
+            out = queue_[queueTail_];
+            queueTail_ = (queueTail_ + 1) % QUEUE;
+            queueCount_--;
+            return true;
+        }
+
+        uint32_t count(uint8_t cls) const { return cls < CLASS_COUNT ? counts_[cls] : 0; }
+        uint32_t dropped() const { return dropped_; }
+        bool active(uint8_t channel) const { return channel ? freq_.active : volt_.active; }
+
+    private:
+        struct Channel {
+            bool active = false;
+            Event event;
+        };
+
+        Limits limits_;
+        Channel volt_;
+        Channel freq_;
+
+        Point ring_[PRETRIGGER];
+        uint8_t ringHead_ = 0;
+        uint8_t ringCount_ = 0;
+
+        Event queue_[QUEUE];
+        uint8_t queueHead_ = 0;
+        uint8_t queueTail_ = 0;
+        uint8_t queueCount_ = 0;
+        uint32_t dropped_ = 0;
+        uint32_t counts_[CLASS_COUNT] = {0};
+
+        float lastV_ = NAN;             // Last valid voltage
+        uint8_t missingRun_ = 0;        // Invalid samples in a row
+        uint32_t missingSinceMs_ = 0;
+
+        void push(const Event &e)
+        {
+            if (queueCount_ == QUEUE) {
+                dropped_++;
+                return;
+            }
+            queue_[queueHead_] = e;
+            queueHead_ = (queueHead_ + 1) % QUEUE;
+            queueCount_++;
+        }
+
+        static bool lowClass(uint8_t cls)
+        {
+            return cls == CLASS_SAG || cls == CLASS_INTERRUPTION || cls == CLASS_FREQ_LOW;
+        }
+
+        void open(Channel &ch, uint8_t cls, const Point &p, float value)
+        {
+            Event &e = ch.event;
+            e = Event();
+            e.cls = cls;
+            e.startMs = p.ms;
+            e.endMs = p.ms;
+            e.extreme = value;
+            e.samples = 1;
+            e.preCount = ringCount_;
+            uint8_t first = (ringHead_ + PRETRIGGER - ringCount_) % PRETRIGGER;
+            for (uint8_t i = 0; i < ringCount_; i++) e.pre[i] = ring_[(first + i) % PRETRIGGER];
+
+            ch.active = true;
+            counts_[cls]++;
+            push(e);
+        }
+
+        void extend(Channel &ch, uint8_t cls, const Point &p, float value)
+        {
+            Event &e = ch.event;
+            // Sag deepening into an interruption is one event, reclassified
+            if (cls == CLASS_INTERRUPTION && e.cls == CLASS_SAG) {
+                e.cls = CLASS_INTERRUPTION;
+                counts_[CLASS_INTERRUPTION]++;
+            }
+            if (lowClass(e.cls) ? value < e.extreme : value > e.extreme) e.extreme = value;
+            e.endMs = p.ms;
+            if (e.samples < 0xFFFF) e.samples++;
+        }
+
+        void close(Channel &ch, const Point &p)
+        {
+            ch.event.open = false;
+            ch.event.endMs = p.ms;
+            ch.active = false;
+            push(ch.event);
+        }
+
+        // Meter silent: an interruption once the run is long enough and
+        // the supply was not in a swell before. It starts at the first
+        // missing sample; later ones extend it until the meter answers.
+        void missing(uint32_t ms)
+        {
+            if (missingRun_ == 0) missingSinceMs_ = ms;
+            if (missingRun_ < 0xFF) missingRun_++;
+            if (missingRun_ < limits_.interruptSamples || !(lastV_ <= limits_.swellV)) return;
+
+            Point p = {missingRun_ == limits_.interruptSamples ? missingSinceMs_ : ms, 0.0f, NAN};
+            voltageChannel(p);
+        }
+
+        void voltageChannel(const Point &p)
+        {
+            float v = p.voltage;
+            if (isnan(v)) return;
+
+            int8_t cls = -1;
+            if (v < limits_.interruptV) cls = CLASS_INTERRUPTION;
+            else if (v < limits_.sagV) cls = CLASS_SAG;
+            else if (v > limits_.swellV) cls = CLASS_SWELL;
+
+            if (!volt_.active) {
+                if (cls >= 0) open(volt_, cls, p, v);
+                return;
+            }
+            bool low = lowClass(volt_.event.cls);
+            bool back = low ? v >= limits_.sagV + limits_.hysteresisV
+                            : v <= limits_.swellV - limits_.hysteresisV;
+            if (back) {
+                close(volt_, p);
+                if (cls >= 0) open(volt_, cls, p, v);   // Straight from sag to swell
+            } else if (cls >= 0 && lowClass(cls) == low) {
+                extend(volt_, cls, p, v);
+            } else {
+                volt_.event.endMs = p.ms;               // Inside the hysteresis band
+            }
+        }
+
+        void frequencyChannel(const Point &p)
+        {
+            float f = p.frequency;
+            if (isnan(f)) return;
+
+            int8_t cls = -1;
+            if (f < limits_.freqLowHz) cls = CLASS_FREQ_LOW;
+            else if (f > limits_.freqHighHz) cls = CLASS_FREQ_HIGH;
+
+            if (!freq_.active) {
+                if (cls >= 0) open(freq_, cls, p, f);
+                return;
+            }
+            bool low = freq_.event.cls == CLASS_FREQ_LOW;
+            bool back = low ? f >= limits_.freqLowHz + limits_.hysteresisHz
+                            : f <= limits_.freqHighHz - limits_.hysteresisHz;
+            if (back) {
+                close(freq_, p);
+                if (cls >= 0) open(freq_, cls, p, f);
+            } else if (cls >= 0 && (cls == CLASS_FREQ_LOW) == low) {
+                extend(freq_, cls, p, f);
+            } else {
+                freq_.event.endMs = p.ms;
+            }
+        }
+    };
+}
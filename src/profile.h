@@ -0,0 +1,126 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "hal.h"
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+// ════════════════════════════════════════════════════════════════
+// CYCLE-COUNT PROFILING PROBES
+// PROFILE_SCOPE(Profile::PROBE_X) times the rest of the enclosing
+// block with the CPU cycle counter and adds it to a fixed table
+// (calls, total cycles, max cycles). Only with -DPROFILE (env
+// esp32doit-devkit-v1-profile); in release builds the macro expands
+// to nothing and the table is empty.
+//
+// Each probe is updated by one task only (PZEM: acquisition task,
+// the rest: loop task), so no lock; a dump taken while a probe is
+// being updated can be off by one call. The cycle counter is per
+// core, both tasks are pinned.
+// ════════════════════════════════════════════════════════════════
+
+namespace Profile
+{
+    enum Probe : uint8_t {
+        PROBE_PZEM = 0,         // Modbus read (acquisition task)
+        PROBE_SHT31,            // I2C read
+        PROBE_LCD,              // I2C flush of changed cells
+        PROBE_PUBLISH,          // mqttClient.publish() (TLS write)
+        PROBE_MQTT_LOOP,        // mqttClient.loop() (TLS read + callbacks)
+        PROBE_FORMAT,           // Payload formatting (readings, aggregates, reports)
+        PROBE_COUNT
+    };
+
+    const char *const PROBE_NAMES[PROBE_COUNT] = {
+        "pzem", "sht31", "lcd", "publish", "mqtt_loop", "format"
+    };
+
+    struct Entry {
+        uint32_t count = 0;
+        uint64_t totalCycles = 0;
+        uint32_t maxCycles = 0;
+    };
+
+#ifdef PROFILE
+    const bool ENABLED = true;
+#else
+    const bool ENABLED = false;
+#endif
+
+    Entry table[PROBE_COUNT];
+
+#ifdef ARDUINO
+    inline uint32_t cycles() { return ESP.getCycleCount(); }
+    inline uint32_t cyclesPerUs() { return ESP.getCpuFreqMHz(); }
+#else
+    inline uint32_t cycles() { return Hal::micros(); }       // Host: 1 "cycle" = 1µs
+    inline uint32_t cyclesPerUs() { return 1; }
+#endif
+
+    inline void add(uint8_t probe, uint32_t elapsed)
+    {
+        Entry &e = table[probe];
+        e.count++;
+        e.totalCycles += elapsed;
+        if (elapsed > e.maxCycles) e.maxCycles = elapsed;
+    }
+
+    // RAII helper behind PROFILE_SCOPE
+    struct Scope {
+        uint8_t probe;
+        uint32_t start;
+        explicit Scope(uint8_t p) : probe(p), start(cycles()) {}
+        ~Scope() { add(probe, cycles() - start); }
+    };
+
+    inline void reset()
+    {
+        for (uint8_t i = 0; i < PROBE_COUNT; i++) table[i] = Entry();
+    }
+
+    // {"on":1,"mhz":240,"p":[[probe,calls,total_cycles,max_cycles],...]}
+    size_t formatReport(char *buf, size_t size)
+    {
+        int len = snprintf(buf, size, "{\"on\":%d,\"mhz\":%u,\"p\":[", ENABLED ? 1 : 0,
+                           (unsigned)cyclesPerUs());
+        // Probes that don't fit are dropped; the closing brackets always fit
+        if (len <= 0 || (size_t)len + 3 > size) return 0;
+        for (uint8_t i = 0; i < PROBE_COUNT; i++) {
+            const Entry &e = table[i];
+            char entry[64];
+            int n = snprintf(entry, sizeof(entry), "%s[\"%s\",%u,%llu,%u]", i ? "," : "", PROBE_NAMES[i],
+                             (unsigned)e.count, (unsigned long long)e.totalCycles, (unsigned)e.maxCycles);
+            if (n <= 0 || n >= (int)sizeof(entry) || (size_t)(len + n + 3) > size) break;
+            memcpy(buf + len, entry, n);
+            len += n;
+        }
+        len += snprintf(buf + len, size - len, "]}");
+        return (size_t)len;
+    }
+
+    // Serial table in µs
+    template <class Output>
+    void print(Output &out)
+    {
+        uint32_t mhz = cyclesPerUs() ? cyclesPerUs() : 1;
+        out.printf("%-10s %10s %12s %10s %10s\n", "probe", "calls", "total_us", "avg_us", "max_us");
+        for (uint8_t i = 0; i < PROBE_COUNT; i++) {
+            const Entry &e = table[i];
+            uint64_t total_us = e.totalCycles / mhz;
+            out.printf("%-10s %10u %12llu %10u %10u\n", PROBE_NAMES[i], (unsigned)e.count,
+                       (unsigned long long)total_us, (unsigned)(e.count ? total_us / e.count : 0),
+                       (unsigned)(e.maxCycles / mhz));
+        }
+    }
+}
+
+#ifdef PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(probe) Profile::Scope PROFILE_CONCAT(profileScope_, __LINE__)(probe)
+#else
+#define PROFILE_SCOPE(probe) ((void)0)
+#endif
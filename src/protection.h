@@ -0,0 +1,157 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+// ════════════════════════════════════════════════════════════════
+// FAST OVER-CURRENT / OVER-POWER PROTECTION
+// Pure decision logic, evaluated for every acquisition sample on the
+// high-priority acquisition task. Keeps a ring of recent samples so
+// a trip record carries the pre-trip history. A trip is latched
+// until clear() (relay switched ON again by the user).
+// ════════════════════════════════════════════════════════════════
+
+struct PowerSample {
+    uint32_t ms = 0;                // millis() at acquisition
+    float voltage = NAN;
+    float current = NAN;
+    float power = NAN;
+    float energy = NAN;
+    float frequency = NAN;
+    float pf = NAN;
+    bool powerAlarm = false;        // PZEM alarm register (power > threshold)
+    bool valid = false;
+};
+
+namespace Protection
+{
+    enum Reason : uint8_t {
+        NONE = 0,
+        POWER_ALARM,                // Meter's own alarm threshold
+        OVER_CURRENT,
+        OVER_POWER
+    };
+
+    inline const char *reasonName(uint8_t reason)
+    {
+        switch (reason) {
+            case POWER_ALARM: return "POWER_ALARM";
+            case OVER_CURRENT: return "OVER_CURRENT";
+            case OVER_POWER: return "OVER_POWER";
+            default: return "NONE";
+        }
+    }
+
+    struct Limits {
+        float maxCurrentA;
+        float maxPowerW;
+        bool useMeterAlarm;
+        uint8_t confirmSamples;     // Consecutive samples over limit before trip
+    };
+
+    template <uint8_t PRETRIP>
+    struct TripRecord {
+        uint8_t reason = NONE;
+        PowerSample sample;         // Sample that tripped
+        uint32_t periodUs = 0;      // Since the previous sample (detection window)
+        uint32_t reactUs = 0;       // Sample ready → relay written
+        uint8_t preCount = 0;
+        PowerSample pre[PRETRIP];   // Oldest first
+    };
+
+    // {"reason":r,"ms":..,"v":..,"i":..,"p":..,"win_us":..,"react_us":..,"pre":[[ms,v,i,p],...]}
+    template <uint8_t PRETRIP>
+    size_t formatTrip(const TripRecord<PRETRIP> &r, char *buf, size_t size)
+    {
+        int len = snprintf(buf, size,
+            "{\"reason\":\"%s\",\"ms\":%u,\"v\":%.1f,\"i\":%.3f,\"p\":%.1f,\"win_us\":%u,\"react_us\":%u,\"pre\":[",
+            reasonName(r.reason), (unsigned)r.sample.ms, r.sample.voltage, r.sample.current,
+            r.sample.power, (unsigned)r.periodUs, (unsigned)r.reactUs);
+        for (uint8_t i = 0; i < r.preCount && len > 0 && (size_t)len < size; i++) {
+            const PowerSample &p = r.pre[i];
+            len += snprintf(buf + len, size - len, "%s[%u,%.1f,%.3f,%.1f]",
+                            i ? "," : "", (unsigned)p.ms, p.voltage, p.current, p.power);
+        }
+        if (len > 0 && (size_t)len + 3 <= size) {
+            len += snprintf(buf + len, size - len, "]}");
+        }
+        return len > 0 ? (size_t)len : 0;
+    }
+
+    template <uint8_t PRETRIP>
+    class Engine
+    {
+    public:
+        explicit Engine(const Limits &limits) : limits_(limits) {}
+
+        // Returns the trip reason when this sample trips (only once until clear())
+        uint8_t evaluate(const PowerSample &s)
+        {
+            uint8_t reason = check(s);
+
+            if (!tripped_) {
+                if (reason != NONE) {
+                    if (++overCount_ >= limits_.confirmSamples) {
+                        tripped_ = true;
+                        capture(reason, s);
+                        remember(s);
+                        return reason;
+                    }
+                } else {
+                    overCount_ = 0;
+                }
+            }
+
+            remember(s);
+            return NONE;
+        }
+
+        bool tripped() const { return tripped_; }
+        void clear()
+        {
+            tripped_ = false;
+            overCount_ = 0;
+        }
+
+        TripRecord<PRETRIP> &record() { return record_; }
+        const Limits &limits() const { return limits_; }
+
+    private:
+        Limits limits_;
+        bool tripped_ = false;
+        uint8_t overCount_ = 0;
+        PowerSample ring_[PRETRIP];
+        uint8_t ringHead_ = 0;
+        uint8_t ringCount_ = 0;
+        TripRecord<PRETRIP> record_;
+
+        uint8_t check(const PowerSample &s) const
+        {
+            if (!s.valid) return NONE;
+            if (limits_.useMeterAlarm && s.powerAlarm) return POWER_ALARM;
+            if (!isnan(s.current) && s.current > limits_.maxCurrentA) return OVER_CURRENT;
+            if (!isnan(s.power) && s.power > limits_.maxPowerW) return OVER_POWER;
+            return NONE;
+        }
+
+        void remember(const PowerSample &s)
+        {
+            ring_[ringHead_] = s;
+            ringHead_ = (ringHead_ + 1) % PRETRIP;
+            if (ringCount_ < PRETRIP) ringCount_++;
+        }
+
+        void capture(uint8_t reason, const PowerSample &s)
+        {
+            record_.reason = reason;
+            record_.sample = s;
+            record_.periodUs = 0;
+            record_.reactUs = 0;
+            record_.preCount = ringCount_;
+            uint8_t start = (ringHead_ + PRETRIP - ringCount_) % PRETRIP;
+            for (uint8_t i = 0; i < ringCount_; i++) {
+                record_.pre[i] = ring_[(start + i) % PRETRIP];
+            }
+        }
+    };
+}
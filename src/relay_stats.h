@@ -0,0 +1,141 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include "histogram.h"
+
+// ════════════════════════════════════════════════════════════════
+// RELAY CYCLING STATISTICS
+// Complements the lifetime ON/OFF totals: log2 histogram of ON-period
+// lengths (seconds), rolling 24h duty cycle from 24 hourly slots of
+// uptime, and energy per ON-period from the PZEM energy register
+// delta. Session values (not persisted). Pure logic: the caller
+// passes millis() and the meter reading.
+// ════════════════════════════════════════════════════════════════
+
+namespace RelayStats
+{
+    const uint32_t SLOT_MS = 3600000UL;
+    const uint8_t SLOTS = 24;
+
+    template <uint8_t BUCKETS>
+    class Tracker
+    {
+    public:
+        // Account time up to now_ms in the state held since the last call
+        // (relative steps, so the millis() wrap doesn't disturb the slots)
+        void accumulate(uint32_t now_ms, bool on)
+        {
+            if (!started_) {
+                started_ = true;
+                lastMs_ = now_ms;
+                return;
+            }
+            uint32_t dt = now_ms - lastMs_;
+            lastMs_ = now_ms;
+            if (dt >= SLOTS * SLOT_MS) {
+                for (uint8_t i = 0; i < SLOTS; i++) onMs_[i] = on ? SLOT_MS : 0;
+                slotElapsedMs_ = 0;
+                spanMs_ = SLOTS * SLOT_MS;
+                return;
+            }
+            while (dt > 0) {
+                uint32_t step = SLOT_MS - slotElapsedMs_;
+                if (step > dt) step = dt;
+                if (on) onMs_[slot_] += step;
+                slotElapsedMs_ += step;
+                if (spanMs_ < SLOTS * SLOT_MS) spanMs_ += step;
+                dt -= step;
+                if (slotElapsedMs_ == SLOT_MS) {
+                    slot_ = (slot_ + 1) % SLOTS;
+                    onMs_[slot_] = 0;
+                    slotElapsedMs_ = 0;
+                }
+            }
+        }
+
+        // Relay switched: closes an ON-period on the falling edge
+        void transition(bool on, uint32_t now_ms, float meter_kwh)
+        {
+            if (on) {
+                periodStartMs_ = now_ms;
+                periodStartKwh_ = meter_kwh;
+                inPeriod_ = true;
+                return;
+            }
+            if (!inPeriod_) return;
+            inPeriod_ = false;
+
+            uint32_t dur_s = (now_ms - periodStartMs_) / 1000;
+            durations_.add(dur_s);
+            lastDurationS_ = dur_s;
+
+            // Unknown if a reading is missing or the register was reset
+            float wh = NAN;
+            if (!isnan(meter_kwh) && !isnan(periodStartKwh_) && meter_kwh >= periodStartKwh_) {
+                wh = (meter_kwh - periodStartKwh_) * 1000.0f;
+                energyWh_ += wh;
+                energyPeriods_++;
+                if (wh > maxWh_) maxWh_ = wh;
+            }
+            lastWh_ = wh;
+        }
+
+        // Duty over the last 24h (or since start if shorter), percent
+        float duty24h() const
+        {
+            uint32_t window = (SLOTS - 1) * SLOT_MS + slotElapsedMs_;
+            uint32_t span = spanMs_ < window ? spanMs_ : window;
+            if (span == 0) return 0.0f;
+            uint64_t on = 0;
+            for (uint8_t i = 0; i < SLOTS; i++) on += onMs_[i];
+            return (float)(on * 100.0 / span);
+        }
+
+        const LogHistogram<BUCKETS> &durations() const { return durations_; }
+        float averageWh() const { return energyPeriods_ ? energyWh_ / energyPeriods_ : NAN; }
+
+        // {"on":s,"off":s,"sw":n,"duty":%,"last":[s,Wh],"avg_wh":x,"max_wh":x,
+        //  "p50":s,"p90":s,"h":[...]} (h = ON-period log2 seconds buckets)
+        size_t formatFrame(char *buf, size_t size, uint64_t on_ms, uint64_t off_ms, uint32_t switches) const
+        {
+            float avg = averageWh();
+            int len = snprintf(buf, size,
+                "{\"on\":%llu,\"off\":%llu,\"sw\":%u,\"duty\":%.1f,\"last\":[%u,%.0f],\"avg_wh\":%.0f,\"max_wh\":%.0f,\"p50\":%u,\"p90\":%u,\"h\":[",
+                (unsigned long long)(on_ms / 1000), (unsigned long long)(off_ms / 1000), (unsigned)switches,
+                duty24h(), (unsigned)lastDurationS_, isnan(lastWh_) ? -1.0f : lastWh_,
+                isnan(avg) ? -1.0f : avg, maxWh_,
+                (unsigned)durations_.percentile(50), (unsigned)durations_.percentile(90));
+
+            // Trailing empty buckets are left out
+            uint8_t used = BUCKETS;
+            while (used > 0 && durations_.buckets[used - 1] == 0) used--;
+            for (uint8_t i = 0; i < used && len > 0 && (size_t)len < size; i++) {
+                len += snprintf(buf + len, size - len, "%s%u", i ? "," : "", (unsigned)durations_.buckets[i]);
+            }
+            if (len > 0 && (size_t)len + 3 <= size) {
+                len += snprintf(buf + len, size - len, "]}");
+            }
+            return len > 0 ? (size_t)len : 0;
+        }
+
+    private:
+        bool started_ = false;
+        uint32_t lastMs_ = 0;
+        uint8_t slot_ = 0;
+        uint32_t slotElapsedMs_ = 0;
+        uint32_t spanMs_ = 0;           // Accounted time, capped at 24h
+        uint32_t onMs_[SLOTS] = {0};
+
+        bool inPeriod_ = false;
+        uint32_t periodStartMs_ = 0;
+        float periodStartKwh_ = NAN;
+
+        LogHistogram<BUCKETS> durations_;
+        uint32_t lastDurationS_ = 0;
+        float lastWh_ = NAN;
+        float energyWh_ = 0.0f;
+        float maxWh_ = 0.0f;
+        uint32_t energyPeriods_ = 0;
+    };
+}
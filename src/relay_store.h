@@ -0,0 +1,148 @@
+#pragma once
+#include <Arduino.h>
+#include <Preferences.h>
+#include "config.h"
+
+// ════════════════════════════════════════════════════════════════
+// RELAY STATE PERSISTENCE (NVS)
+// Relay state, lifetime on/off time and switch count are kept as one
+// blob, so a save is a single NVS write. Saves are coalesced: a state
+// change is written once it has held for RELAY_PERSIST_COALESCE_MS
+// (a burst of toggles costs one write), counters only at the
+// RELAY_PERSIST_CHECKPOINT_MS checkpoint. A protective OFF (trip,
+// over-temperature) is written at once through saveNow(): with
+// RESTORE_LAST a reset inside the coalescing window would otherwise
+// switch the load back ON at boot. The write count is stored
+// too, so flash wear can be tracked per day and over the lifetime.
+// ════════════════════════════════════════════════════════════════
+
+namespace RelayStore
+{
+    enum RestorePolicy : uint8_t {
+        RESTORE_OFF = 0,            // Always start OFF (legacy behaviour)
+        RESTORE_LAST,               // State saved before the reset
+        RESTORE_ON
+    };
+
+    const uint32_t RECORD_MAGIC = 0x524C5931UL;     // "RLY1"
+
+    struct Record {
+        uint32_t magic;
+        uint8_t state;
+        uint64_t onMs;              // Lifetime time ON
+        uint64_t offMs;             // Lifetime time OFF
+        uint32_t switches;
+        uint32_t writes;            // NVS saves, lifetime
+    };
+
+    Record saved = {RECORD_MAGIC, 0, 0, 0, 0, 0};
+    bool loaded = false;
+
+    bool statePending = false;      // State differs from the saved one
+    uint32_t stateChangeMs = 0;
+    uint32_t lastWriteMs = 0;
+    uint32_t sessionWrites = 0;
+    uint32_t dayWrites = 0;         // Writes in the current 24h of uptime
+    uint32_t day = 0;
+
+    // Load the last record; returns false on first boot / bad data
+    bool begin()
+    {
+        Preferences prefs;
+        prefs.begin("relay", true);
+        Record r;
+        size_t bytes = prefs.getBytes("state", &r, sizeof(r));
+        prefs.end();
+
+        loaded = bytes == sizeof(r) && r.magic == RECORD_MAGIC;
+        if (loaded) saved = r;
+        lastWriteMs = millis();
+        return loaded;
+    }
+
+    // Relay state to apply at boot under the configured policy
+    bool bootState()
+    {
+        switch (RELAY_RESTORE_POLICY) {
+            case RESTORE_LAST: return loaded && saved.state;
+            case RESTORE_ON: return true;
+            default: return false;
+        }
+    }
+
+    const Record &record() { return saved; }
+
+    void write(uint32_t now_ms, bool state, uint64_t on_ms, uint64_t off_ms, uint32_t switches)
+    {
+        Record r = saved;
+        r.state = state;
+        r.onMs = on_ms;
+        r.offMs = off_ms;
+        r.switches = switches;
+        r.writes = saved.writes + 1;
+
+        Preferences prefs;
+        prefs.begin("relay", false);
+        bool ok = prefs.putBytes("state", &r, sizeof(r)) == sizeof(r);
+        prefs.end();
+        if (!ok) return;
+
+        saved = r;
+        statePending = false;
+        lastWriteMs = now_ms;
+        sessionWrites++;
+        if (now_ms / 86400000UL != day) {
+            day = now_ms / 86400000UL;
+            dayWrites = 0;
+        }
+        dayWrites++;
+    }
+
+    // Protective OFF: write the state now instead of coalescing
+    void saveNow(uint32_t now_ms, bool state, uint64_t on_ms, uint64_t off_ms, uint32_t switches)
+    {
+        if ((uint8_t)state == saved.state) {
+            statePending = false;
+            return;
+        }
+        write(now_ms, state, on_ms, off_ms, switches);
+    }
+
+    // Called periodically with the live values; writes only when due
+    void service(uint32_t now_ms, bool state, uint64_t on_ms, uint64_t off_ms, uint32_t switches)
+    {
+        if ((uint8_t)state != saved.state) {
+            if (!statePending) {
+                statePending = true;
+                stateChangeMs = now_ms;
+            }
+        } else {
+            statePending = false;   // Toggled back before it was saved
+        }
+
+        bool state_due = statePending && now_ms - stateChangeMs >= RELAY_PERSIST_COALESCE_MS;
+        bool counters_changed = switches != saved.switches ||
+                                on_ms / 1000 != saved.onMs / 1000 || off_ms / 1000 != saved.offMs / 1000;
+        bool checkpoint_due = counters_changed && now_ms - lastWriteMs >= RELAY_PERSIST_CHECKPOINT_MS;
+
+        if (state_due || checkpoint_due) {
+            write(now_ms, state, on_ms, off_ms, switches);
+        }
+    }
+
+    // Average over this uptime, for flash lifetime checks
+    float writesPerDay(uint32_t now_ms)
+    {
+        if (now_ms < 60000UL) return 0.0f;
+        return sessionWrites * 86400000.0f / now_ms;
+    }
+
+    // {"policy":p,"writes":lifetime,"session":n,"day":today,"wpd":avg_per_day}
+    size_t formatReport(char *buf, size_t size, uint32_t now_ms)
+    {
+        int len = snprintf(buf, size, "{\"policy\":%d,\"writes\":%u,\"session\":%u,\"day\":%u,\"wpd\":%.1f}",
+                           RELAY_RESTORE_POLICY, (unsigned)saved.writes, (unsigned)sessionWrites,
+                           (unsigned)dayWrites, writesPerDay(now_ms));
+        return len > 0 ? (size_t)len : 0;
+    }
+}
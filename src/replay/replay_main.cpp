@@ -0,0 +1,293 @@
+// ════════════════════════════════════════════════════════════════
+// TRACE REPLAY (env:native_replay)
+// Feeds a recorded trace (trace.h) back through the relay logic on
+// the trace's own clock: protection engine and power-quality recorder
+// on every PZEM sample, then the firmware's own Control code (see
+// control.h) for the over-temperature guard at each recorded
+// checkTemperatureProtection() run, relay commands as decoded by
+// mqttCallback() and schedule / rule switches as recorded. Every output
+// (relay status / events, trips, PQ events) becomes one line
+// "<ms> <topic> <payload>" and goes into an FNV-1a digest: the same
+// trace always gives the same lines and digest, so two firmware
+// builds can be compared exactly.
+//
+// Input: the raw file (FLASH mode / DUMP) or a serial capture, where
+// only the "TRC <hex>" lines are used.
+//
+//   replay_main <trace> [-v] [-o lines.txt]
+// ════════════════════════════════════════════════════════════════
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../config.h"
+#include "../topics.h"
+#include "../commands.h"
+#include "../hal.h"
+#include "../protection.h"
+#include "../power_quality.h"
+#include "../control.h"
+#include "../trace.h"
+
+namespace
+{
+    // Firmware modules, configured as in main.cpp / acquisition.h
+    Protection::Engine<PROTECTION_PRETRIP_SAMPLES> protection(Protection::Limits{
+        PROTECTION_MAX_CURRENT_A, PROTECTION_MAX_POWER_W, true, PROTECTION_CONFIRM_SAMPLES});
+    PowerQuality::Recorder<PQ_PRETRIGGER_SAMPLES, PQ_QUEUE_SIZE> pq(PowerQuality::Limits{
+        PQ_SAG_V, PQ_SWELL_V, PQ_INTERRUPT_V, PQ_HYSTERESIS_V, PQ_INTERRUPT_SAMPLES, PQ_FREQ_LOW_HZ, PQ_FREQ_HIGH_HZ, PQ_HYSTERESIS_HZ});
+    float temperature = NAN;
+    float energy = NAN;
+
+    struct Counters {
+        uint32_t records[Trace::TYPE_GAP + 1] = {0};
+        uint32_t lines = 0;
+        uint32_t trips = 0;
+        uint32_t pqEvents = 0;
+        uint32_t lost = 0;
+        uint32_t firstMs = 0;
+        uint32_t lastMs = 0;
+    } counters;
+
+    // ════════════════════════════════════════
+    // OUTPUT
+    // ════════════════════════════════════════
+    FILE *echo = nullptr;
+    uint64_t digest = 14695981039346656037ULL;     // FNV-1a 64 offset basis
+
+    void hash(const char *s)
+    {
+        for (; *s; s++) {
+            digest ^= (uint8_t)*s;
+            digest *= 1099511628211ULL;
+        }
+    }
+
+    void emit(uint32_t ms, const char *topic, const char *payload)
+    {
+        char line[640];
+        snprintf(line, sizeof(line), "%u %s %s\n", (unsigned)ms, topic, payload);
+        hash(line);
+        counters.lines++;
+        if (echo) fputs(line, echo);
+    }
+
+    // Trace clock: the time of the record being replayed
+    class TraceClock : public Hal::Clock
+    {
+    public:
+        uint32_t ms = 0;
+        uint32_t millis() override { return ms; }
+        uint32_t micros() override { return ms * 1000; }
+        void delayMicros(uint32_t) override {}
+    } traceClock;
+
+    // Control publishes into the digest
+    class DigestTransport : public Hal::Transport
+    {
+    public:
+        bool connected() override { return true; }
+        bool publish(const char *topic, const char *payload, bool) override
+        {
+            emit(traceClock.ms, topic, payload);
+            return true;
+        }
+        bool subscribe(const char *) override { return true; }
+        void loop() override {}
+    } transport;
+
+    // Relay pin is not modelled
+    class NullGpio : public Hal::Gpio
+    {
+    public:
+        void mode(uint8_t, uint8_t) override {}
+        void write(uint8_t, bool) override {}
+        bool read(uint8_t) override { return true; }
+    } gpio;
+
+    bool protectionTripped() { return protection.tripped(); }
+    void clearProtection() { protection.clear(); }
+    float meterEnergy() { return energy; }
+
+    // ════════════════════════════════════════
+    // FIRMWARE HANDLERS (side effects as in main.cpp)
+    // ════════════════════════════════════════
+
+    // Acquisition::poll() + handleProtectionTrip() + handlePowerQualityEvents()
+    void onPower(const PowerSample &s)
+    {
+        if (s.valid) energy = s.energy;
+        if (protection.evaluate(s) != Protection::NONE) {
+            counters.trips++;
+            Control::tripOff(protection.record());
+        }
+
+        pq.add(s);
+        PowerQuality::Event<PQ_PRETRIGGER_SAMPLES> ev;
+        char payload[PQ_EVENT_SIZE];
+        while (pq.take(ev)) {
+            counters.pqEvents++;
+            PowerQuality::formatEvent(ev, payload, sizeof(payload));
+            emit(s.ms, MQTTTopics::PQ_EVENT, payload);
+        }
+    }
+
+    // checkTemperatureProtection()
+    void onTemperatureCheck()
+    {
+        Control::checkTemperature(temperature);
+    }
+
+    // mqttCallback(), plus the recorded "ON:SCHEDULE" style switches
+    // and the "STATE:relay,overtemp,wason,tripped" session snapshot (a
+    // trip latched before the session can't be re-created; it only
+    // shows in the state line)
+    void onCommand(uint32_t ms, uint8_t target, const char *payload)
+    {
+        if (target != Commands::TARGET_RELAY) {
+            char line[Trace::PAYLOAD_MAX + 16];
+            snprintf(line, sizeof(line), "%u %s", (unsigned)target, payload);
+            emit(ms, "cmd", line);      // Not modelled, kept for the digest
+            return;
+        }
+
+        if (strncmp(payload, "STATE:", 6) == 0) {
+            int on = 0, over = 0, was = 0, tripped = 0;
+            sscanf(payload + 6, "%d,%d,%d,%d", &on, &over, &was, &tripped);
+            Control::relayState = Control::lastState = on;
+            Control::tempGuard.offByOverTemp = over;
+            Control::tempGuard.wasOnBeforeTrip = was;
+            if (!tripped) protection.clear();
+            emit(ms, "state", payload + 6);
+            return;
+        }
+
+        const char *colon = strchr(payload, ':');
+        if (colon) {
+            bool on = strncmp(payload, "ON", colon - payload) == 0;
+            Control::set(on, colon + 1);
+            return;
+        }
+
+        switch (Commands::parseSwitch(payload)) {
+        case Commands::SWITCH_ON: Control::set(true); break;
+        case Commands::SWITCH_OFF: Control::set(false); break;
+        case Commands::SWITCH_TOGGLE: Control::toggle(); break;
+        }
+    }
+
+    // ════════════════════════════════════════
+    // INPUT
+    // ════════════════════════════════════════
+    int hexDigit(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // Raw stream as is, or the "TRC <hex>" lines of a serial log
+    size_t load(const char *path, uint8_t *&data)
+    {
+        FILE *f = fopen(path, "rb");
+        if (!f) return 0;
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        data = (uint8_t *)malloc(size > 0 ? size : 1);
+        size_t len = fread(data, 1, size, f);
+        fclose(f);
+        if (len >= 4 && memcmp(data, Trace::MAGIC, 4) == 0) return len;
+
+        size_t out = 0;
+        for (size_t i = 0; i + 4 <= len;) {
+            bool line_start = i == 0 || data[i - 1] == '\n';
+            if (!line_start || memcmp(data + i, "TRC ", 4) != 0) {
+                i++;
+                continue;
+            }
+            for (i += 4; i + 1 < len; i += 2) {
+                int hi = hexDigit(data[i]);
+                int lo = hexDigit(data[i + 1]);
+                if (hi < 0 || lo < 0) break;
+                data[out++] = (uint8_t)(hi << 4 | lo);      // out never passes i
+            }
+        }
+        return out;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = nullptr;
+    const char *output = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) echo = stdout;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) output = argv[++i];
+        else path = argv[i];
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s <trace> [-v] [-o lines.txt]\n", argv[0]);
+        return 2;
+    }
+    if (output && !(echo = fopen(output, "w"))) {
+        fprintf(stderr, "cannot open %s\n", output);
+        return 1;
+    }
+
+    uint8_t *data = nullptr;
+    size_t len = load(path, data);
+    if (len == 0) {
+        fprintf(stderr, "no trace data in %s\n", path);
+        return 1;
+    }
+
+    // No trace / log / persist hooks: replaying must not record itself
+    Hal::bindClock(traceClock);
+    Control::Hooks hooks = {protectionTripped, clearProtection, meterEnergy, nullptr, nullptr, nullptr};
+    Control::begin(gpio, transport, RELAY_PIN, hooks);
+
+    Trace::Reader reader(data, len);
+    Trace::Record r;
+    bool first = true;
+    while (reader.next(r)) {
+        if (first) counters.firstMs = r.ms;
+        first = false;
+        counters.lastMs = r.ms;
+        traceClock.ms = r.ms;
+        counters.records[r.type]++;
+        switch (r.type) {
+        case Trace::TYPE_POWER: onPower(r.sample); break;
+        case Trace::TYPE_CLIMATE: temperature = r.temperature; break;
+        case Trace::TYPE_COMMAND: onCommand(r.ms, r.id, r.payload); break;
+        case Trace::TYPE_CHECK:
+            if (r.id == Trace::CHECK_TEMPERATURE) onTemperatureCheck();
+            break;
+        case Trace::TYPE_GAP: {
+            counters.lost += r.lost;
+            char lost[16];
+            snprintf(lost, sizeof(lost), "%u", (unsigned)r.lost);
+            emit(r.ms, "gap", lost);
+            break;
+        }
+        }
+    }
+    if (echo && echo != stdout) fclose(echo);
+
+    FILE *out = echo == stdout ? stderr : stdout;
+    fprintf(out, "Trace: %u bytes, %u session(s), %.1f s%s\n", (unsigned)len, (unsigned)reader.sessions(),
+            (counters.lastMs - counters.firstMs) / 1000.0,
+            reader.error() ? " (stopped at a corrupt record)" : "");
+    fprintf(out, "Records: power %u, climate %u, command %u, check %u, gap %u (%u lost)\n",
+            (unsigned)counters.records[Trace::TYPE_POWER], (unsigned)counters.records[Trace::TYPE_CLIMATE],
+            (unsigned)counters.records[Trace::TYPE_COMMAND], (unsigned)counters.records[Trace::TYPE_CHECK],
+            (unsigned)counters.records[Trace::TYPE_GAP], (unsigned)counters.lost);
+    fprintf(out, "Outputs: %u lines, relay switches %u, trips %u, pq events %u, relay %s\n",
+            (unsigned)counters.lines, (unsigned)Control::switches, (unsigned)counters.trips,
+            (unsigned)counters.pqEvents, Control::relayState ? "ON" : "OFF");
+    fprintf(out, "Digest: %016llx\n", (unsigned long long)digest);
+    free(data);
+    return reader.error() ? 3 : 0;
+}
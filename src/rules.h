@@ -0,0 +1,452 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// ════════════════════════════════════════════════════════════════
+// AUTOMATION RULE ENGINE
+// Rules arrive as text and are compiled to a small stack bytecode:
+//
+//   name: <expr> [for <N>s|ms|m] -> relay_off | relay_on | event
+//   e.g.  overload: p > 1800 && pf < 0.6 for 10s -> relay_off
+//
+// Variables: v i p e f pf temp hum relay. Operators: + - * / ! && ||
+// and comparisons. Code length, stack depth and parenthesis / unary
+// nesting are capped at compile time, so one evaluation and the
+// recursive-descent compiler's own stack use are both bounded. A rule fires once when its
+// condition has held for the hold time, and re-arms when it goes
+// false. Evaluation cost per rule is measured with the injected clock.
+// ════════════════════════════════════════════════════════════════
+
+namespace Rules
+{
+    enum Var : uint8_t {
+        VAR_VOLTAGE = 0,
+        VAR_CURRENT,
+        VAR_POWER,
+        VAR_ENERGY,
+        VAR_FREQUENCY,
+        VAR_PF,
+        VAR_TEMPERATURE,
+        VAR_HUMIDITY,
+        VAR_RELAY,
+        VAR_COUNT
+    };
+
+    const char *const VAR_NAMES[VAR_COUNT] = {
+        "v", "i", "p", "e", "f", "pf", "temp", "hum", "relay"
+    };
+
+    enum Action : uint8_t {
+        ACTION_EVENT = 0,
+        ACTION_RELAY_OFF,
+        ACTION_RELAY_ON,
+        ACTION_COUNT
+    };
+
+    const char *const ACTION_NAMES[ACTION_COUNT] = {
+        "event", "relay_off", "relay_on"
+    };
+
+    enum Op : uint8_t {
+        OP_VAR = 1,                 // + var index
+        OP_CONST,                   // + 4 byte float
+        OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_NEG,
+        OP_GT, OP_GE, OP_LT, OP_LE, OP_EQ, OP_NE,
+        OP_AND, OP_OR, OP_NOT
+    };
+
+    typedef uint32_t (*ClockFn)();      // µs
+    typedef void (*FireFn)(uint8_t rule, uint8_t action);
+
+    struct RuleStats {
+        uint32_t evals = 0;
+        uint32_t fires = 0;
+        uint32_t totalUs = 0;
+        uint32_t maxUs = 0;
+    };
+
+    template <uint8_t MAX_RULES, uint8_t MAX_CODE, uint8_t MAX_STACK, uint8_t MAX_NESTING = 8>
+    class Engine
+    {
+    public:
+        struct Rule {
+            char name[12];
+            uint8_t code[MAX_CODE];
+            uint8_t len;
+            uint8_t action;
+            uint32_t holdMs;
+            uint32_t trueSinceMs;
+            bool holding;
+            bool fired;
+            RuleStats stats;
+        };
+
+        explicit Engine(ClockFn clock) : clock_(clock) {}
+
+        // Replace all rules (lines separated by '\n' or ';'). Nothing
+        // changes on error; error() describes the first bad rule.
+        bool load(const char *text)
+        {
+            Engine next(clock_);
+            char line[96];
+            const char *p = text;
+
+            while (*p) {
+                size_t len = strcspn(p, ";\n");
+                if (len >= sizeof(line)) return fail("rule too long");
+                memcpy(line, p, len);
+                line[len] = '\0';
+                p += len;
+                if (*p) p++;
+
+                const char *t = line;
+                while (*t == ' ' || *t == '\r') t++;
+                if (*t == '\0') continue;
+                if (next.count_ >= MAX_RULES) return fail("too many rules");
+                if (!next.compileRule(t, next.rules_[next.count_])) {
+                    return fail(next.error_);
+                }
+                next.count_++;
+            }
+
+            *this = next;
+            error_[0] = '\0';
+            return true;
+        }
+
+        // Evaluate every rule against one sample
+        void evaluate(const float vars[VAR_COUNT], uint32_t now_ms, FireFn fire)
+        {
+            for (uint8_t r = 0; r < count_; r++) {
+                Rule &rule = rules_[r];
+                uint32_t start = clock_();
+                bool cond = run(rule, vars) != 0.0f;
+                uint32_t elapsed = clock_() - start;
+
+                rule.stats.evals++;
+                rule.stats.totalUs += elapsed;
+                if (elapsed > rule.stats.maxUs) rule.stats.maxUs = elapsed;
+
+                if (!cond) {
+                    rule.holding = false;
+                    rule.fired = false;
+                    continue;
+                }
+                if (!rule.holding) {
+                    rule.holding = true;
+                    rule.trueSinceMs = now_ms;
+                }
+                if (!rule.fired && now_ms - rule.trueSinceMs >= rule.holdMs) {
+                    rule.fired = true;
+                    rule.stats.fires++;
+                    if (fire) fire(r, rule.action);
+                }
+            }
+        }
+
+        uint8_t count() const { return count_; }
+        const Rule &rule(uint8_t i) const { return rules_[i]; }
+        const char *error() const { return error_; }
+
+        // {"n":count,"err":"...","r":[[name,action,code_bytes,evals,fires,avg_us,max_us],...]}
+        size_t formatStatus(char *buf, size_t size) const
+        {
+            int len = snprintf(buf, size, "{\"n\":%u,\"err\":\"%s\",\"r\":[", count_, error_);
+            for (uint8_t i = 0; i < count_ && len > 0 && (size_t)len < size; i++) {
+                const Rule &r = rules_[i];
+                len += snprintf(buf + len, size - len, "%s[\"%s\",\"%s\",%u,%u,%u,%u,%u]",
+                                i ? "," : "", r.name, ACTION_NAMES[r.action], r.len,
+                                (unsigned)r.stats.evals, (unsigned)r.stats.fires,
+                                (unsigned)(r.stats.evals ? r.stats.totalUs / r.stats.evals : 0),
+                                (unsigned)r.stats.maxUs);
+            }
+            if (len > 0 && (size_t)len + 3 <= size) {
+                len += snprintf(buf + len, size - len, "]}");
+            }
+            return len > 0 ? (size_t)len : 0;
+        }
+
+    private:
+        ClockFn clock_;
+        Rule rules_[MAX_RULES];
+        uint8_t count_ = 0;
+        char error_[40] = "";
+
+        // Compiler state
+        const char *src_ = nullptr;
+        Rule *out_ = nullptr;
+        uint8_t depth_ = 0;
+        uint8_t maxDepth_ = 0;
+        uint8_t nesting_ = 0;           // Open '(' / unary operators (recursion depth)
+
+        bool fail(const char *msg)
+        {
+            if (msg != error_) {
+                strncpy(error_, msg, sizeof(error_) - 1);
+                error_[sizeof(error_) - 1] = '\0';
+            }
+            return false;
+        }
+
+        // ── Interpreter ──
+        float run(const Rule &rule, const float vars[VAR_COUNT]) const
+        {
+            float stack[MAX_STACK];
+            uint8_t sp = 0;
+            for (uint8_t pc = 0; pc < rule.len;) {
+                uint8_t op = rule.code[pc++];
+                if (op == OP_VAR) {
+                    stack[sp++] = vars[rule.code[pc++]];
+                } else if (op == OP_CONST) {
+                    memcpy(&stack[sp++], &rule.code[pc], sizeof(float));
+                    pc += sizeof(float);
+                } else if (op == OP_NEG) {
+                    stack[sp - 1] = -stack[sp - 1];
+                } else if (op == OP_NOT) {
+                    stack[sp - 1] = stack[sp - 1] == 0.0f ? 1.0f : 0.0f;
+                } else {
+                    float b = stack[--sp];
+                    float a = stack[sp - 1];
+                    float r;
+                    switch (op) {
+                        case OP_ADD: r = a + b; break;
+                        case OP_SUB: r = a - b; break;
+                        case OP_MUL: r = a * b; break;
+                        case OP_DIV: r = a / b; break;
+                        case OP_GT: r = a > b; break;
+                        case OP_GE: r = a >= b; break;
+                        case OP_LT: r = a < b; break;
+                        case OP_LE: r = a <= b; break;
+                        case OP_EQ: r = a == b; break;
+                        case OP_NE: r = a != b; break;
+                        case OP_AND: r = (a != 0.0f && !isnan(a)) && (b != 0.0f && !isnan(b)); break;
+                        default: r = (a != 0.0f && !isnan(a)) || (b != 0.0f && !isnan(b)); break;
+                    }
+                    stack[sp - 1] = r;
+                }
+            }
+            return sp ? stack[0] : 0.0f;
+        }
+
+        // ── Compiler ──
+        bool compileRule(const char *text, Rule &rule)
+        {
+            rule = Rule();
+
+            const char *colon = strchr(text, ':');
+            const char *arrow = strstr(text, "->");
+            if (!colon || !arrow || colon > arrow) return fail("expected 'name: expr -> action'");
+
+            size_t name_len = colon - text;
+            while (name_len && text[name_len - 1] == ' ') name_len--;
+            if (name_len == 0 || name_len >= sizeof(rule.name)) return fail("bad rule name");
+            memcpy(rule.name, text, name_len);
+
+            // Action
+            const char *act = arrow + 2;
+            while (*act == ' ') act++;
+            size_t act_len = strcspn(act, " \r");
+            bool found = false;
+            for (uint8_t a = 0; a < ACTION_COUNT; a++) {
+                if (strlen(ACTION_NAMES[a]) == act_len && strncmp(act, ACTION_NAMES[a], act_len) == 0) {
+                    rule.action = a;
+                    found = true;
+                }
+            }
+            if (!found) return fail("unknown action");
+
+            // Condition, with an optional trailing "for <duration>"
+            char cond[80];
+            size_t cond_len = arrow - (colon + 1);
+            if (cond_len >= sizeof(cond)) return fail("condition too long");
+            memcpy(cond, colon + 1, cond_len);
+            cond[cond_len] = '\0';
+
+            char *hold = strstr(cond, " for ");
+            if (hold) {
+                *hold = '\0';
+                if (!parseDuration(hold + 5, rule.holdMs)) return fail("bad duration");
+            }
+
+            src_ = cond;
+            out_ = &rule;
+            depth_ = 0;
+            maxDepth_ = 0;
+            nesting_ = 0;
+            if (!parseOr()) return false;
+            skipSpace();
+            if (*src_ != '\0') return fail("unexpected text in condition");
+            if (depth_ != 1) return fail("bad expression");
+            return true;
+        }
+
+        static bool parseDuration(const char *s, uint32_t &ms)
+        {
+            char *end;
+            unsigned long n = strtoul(s, &end, 10);
+            if (end == s) return false;
+            while (*end == ' ') end++;
+            if (strncmp(end, "ms", 2) == 0) ms = n, end += 2;
+            else if (*end == 's') ms = n * 1000UL, end++;
+            else if (*end == 'm') ms = n * 60000UL, end++;
+            else if (*end == '\0') ms = n * 1000UL;
+            else return false;
+            while (*end == ' ') end++;
+            return *end == '\0';
+        }
+
+        void skipSpace()
+        {
+            while (*src_ == ' ' || *src_ == '\t') src_++;
+        }
+
+        bool emit(uint8_t op, int8_t stack_change)
+        {
+            if (out_->len >= MAX_CODE) return fail("rule too complex");
+            out_->code[out_->len++] = op;
+            if (stack_change > 0) {
+                if (++depth_ > MAX_STACK) return fail("expression too deep");
+                if (depth_ > maxDepth_) maxDepth_ = depth_;
+            } else if (stack_change < 0) {
+                depth_--;
+            }
+            return true;
+        }
+
+        bool emitByte(uint8_t b)
+        {
+            if (out_->len >= MAX_CODE) return fail("rule too complex");
+            out_->code[out_->len++] = b;
+            return true;
+        }
+
+        // Each level costs ~7 compiler frames on the loop() stack
+        bool enter()
+        {
+            if (++nesting_ > MAX_NESTING) return fail("nesting too deep");
+            return true;
+        }
+
+        bool match(const char *tok)
+        {
+            skipSpace();
+            size_t n = strlen(tok);
+            if (strncmp(src_, tok, n) != 0) return false;
+            src_ += n;
+            return true;
+        }
+
+        bool parseOr()
+        {
+            if (!parseAnd()) return false;
+            while (match("||")) {
+                if (!parseAnd() || !emit(OP_OR, -1)) return false;
+            }
+            return true;
+        }
+
+        bool parseAnd()
+        {
+            if (!parseCompare()) return false;
+            while (match("&&")) {
+                if (!parseCompare() || !emit(OP_AND, -1)) return false;
+            }
+            return true;
+        }
+
+        bool parseCompare()
+        {
+            if (!parseSum()) return false;
+            static const char *const OPS[6] = {">=", "<=", "==", "!=", ">", "<"};
+            static const uint8_t CODES[6] = {OP_GE, OP_LE, OP_EQ, OP_NE, OP_GT, OP_LT};
+            for (uint8_t i = 0; i < 6; i++) {
+                if (match(OPS[i])) {
+                    return parseSum() && emit(CODES[i], -1);
+                }
+            }
+            return true;
+        }
+
+        bool parseSum()
+        {
+            if (!parseTerm()) return false;
+            for (;;) {
+                if (match("+")) {
+                    if (!parseTerm() || !emit(OP_ADD, -1)) return false;
+                } else if (match("-")) {
+                    if (!parseTerm() || !emit(OP_SUB, -1)) return false;
+                } else {
+                    return true;
+                }
+            }
+        }
+
+        bool parseTerm()
+        {
+            if (!parseUnary()) return false;
+            for (;;) {
+                if (match("*")) {
+                    if (!parseUnary() || !emit(OP_MUL, -1)) return false;
+                } else if (match("/")) {
+                    if (!parseUnary() || !emit(OP_DIV, -1)) return false;
+                } else {
+                    return true;
+                }
+            }
+        }
+
+        bool parseUnary()
+        {
+            skipSpace();
+            if (src_[0] == '!' && src_[1] != '=') {
+                src_++;
+                if (!enter() || !parseUnary()) return false;
+                nesting_--;
+                return emit(OP_NOT, 0);
+            }
+            if (match("-")) {
+                if (!enter() || !parseUnary()) return false;
+                nesting_--;
+                return emit(OP_NEG, 0);
+            }
+            return parsePrimary();
+        }
+
+        bool parsePrimary()
+        {
+            skipSpace();
+            if (match("(")) {
+                if (!enter() || !parseOr()) return false;
+                if (!match(")")) return fail("missing ')'");
+                nesting_--;
+                return true;
+            }
+
+            if ((*src_ >= '0' && *src_ <= '9') || *src_ == '.') {
+                char *end;
+                float value = strtof(src_, &end);
+                src_ = end;
+                uint8_t bytes[sizeof(float)];
+                memcpy(bytes, &value, sizeof(float));
+                if (!emit(OP_CONST, 1)) return false;
+                for (uint8_t i = 0; i < sizeof(float); i++) {
+                    if (!emitByte(bytes[i])) return false;
+                }
+                return true;
+            }
+
+            size_t n = 0;
+            while ((src_[n] >= 'a' && src_[n] <= 'z') || (src_[n] >= 'A' && src_[n] <= 'Z')) n++;
+            for (uint8_t v = 0; v < VAR_COUNT && n; v++) {
+                if (strlen(VAR_NAMES[v]) == n && strncmp(src_, VAR_NAMES[v], n) == 0) {
+                    src_ += n;
+                    return emit(OP_VAR, 1) && emitByte(v);
+                }
+            }
+            return fail("unknown variable");
+        }
+    };
+}
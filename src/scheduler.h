@@ -0,0 +1,319 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include "histogram.h"
+
+// ════════════════════════════════════════════════════════════════
+// DEADLINE-DRIVEN COOPERATIVE SCHEDULER
+// Periodic tasks sit in an indexed min-heap ordered by next deadline
+// (ties broken by priority). run() is called from loop(): every task
+// that is due executes in priority order, then is re-armed at a fixed
+// rate. No Arduino dependency - the clock is injected, so the same
+// code runs against a virtual clock on the host.
+// ════════════════════════════════════════════════════════════════
+
+namespace Sched
+{
+    typedef uint32_t (*ClockFn)();      // Monotonic µs clock (wraps at 2^32)
+    typedef void (*TaskFn)();
+
+    enum Priority : uint8_t {
+        PRIO_CRITICAL = 0,
+        PRIO_HIGH = 1,
+        PRIO_NORMAL = 2,
+        PRIO_LOW = 3
+    };
+
+    const int8_t INVALID_TASK = -1;
+
+    struct TaskStats {
+        uint32_t runs = 0;
+        uint32_t misses = 0;            // Started later than due + max latency
+        uint32_t overruns = 0;          // Ran longer than budget
+        uint32_t skipped = 0;           // Whole periods dropped while late
+        uint32_t maxRunUs = 0;
+        uint32_t lastRunUs = 0;
+        uint64_t totalRunUs = 0;
+        LogHistogram<24> jitterUs;      // start - due
+    };
+
+    struct Task {
+        const char *name = nullptr;
+        TaskFn fn = nullptr;
+        uint32_t periodUs = 0;          // 0 = one-shot
+        uint32_t dueUs = 0;
+        uint32_t maxLatencyUs = 0;      // Deadline = due + maxLatency
+        uint32_t budgetUs = 0;          // Expected worst-case runtime
+        uint8_t priority = PRIO_NORMAL;
+        bool active = false;
+        TaskStats stats;
+    };
+
+    // Wrap-safe "a is before b"
+    inline bool before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+    template <uint8_t MAX_TASKS>
+    class Scheduler
+    {
+    public:
+        explicit Scheduler(ClockFn clock) : clock_(clock) {}
+
+        // Register a task (period 0 = one-shot, re-armed with start()).
+        // maxLatency/budget default to a quarter of the period; first run
+        // is after first_delay_ms.
+        int8_t add(const char *name, TaskFn fn, uint32_t period_ms, uint8_t priority,
+                   uint32_t first_delay_ms = 0, uint32_t max_latency_ms = 0,
+                   uint32_t budget_ms = 0, bool start_active = true)
+        {
+            if (count_ >= MAX_TASKS || fn == nullptr) return INVALID_TASK;
+
+            int8_t id = count_++;
+            Task &t = tasks_[id];
+            t.name = name;
+            t.fn = fn;
+            t.periodUs = period_ms * 1000UL;
+            t.priority = priority;
+            // One-shot tasks (period 0) are unbounded unless limits are given
+            uint32_t quarter = t.periodUs ? t.periodUs / 4 : UINT32_MAX;
+            t.maxLatencyUs = max_latency_ms ? max_latency_ms * 1000UL : quarter;
+            t.budgetUs = budget_ms ? budget_ms * 1000UL : quarter;
+            pos_[id] = -1;
+
+            if (start_active) start(id, first_delay_ms);
+            return id;
+        }
+
+        // (Re)arm a task to run after delay_ms, then every period
+        void start(int8_t id, uint32_t delay_ms = 0)
+        {
+            if (id < 0 || id >= count_) return;
+            Task &t = tasks_[id];
+            t.active = true;
+            t.dueUs = clock_() + delay_ms * 1000UL;
+            if (pos_[id] < 0) push(id);
+            else fix(pos_[id]);
+        }
+
+        void stop(int8_t id)
+        {
+            if (id < 0 || id >= count_) return;
+            tasks_[id].active = false;
+            if (pos_[id] >= 0) remove(pos_[id]);
+        }
+
+        // Task currently executing (INVALID_TASK outside run())
+        int8_t running() const { return running_; }
+
+        bool isActive(int8_t id) const
+        {
+            return id >= 0 && id < count_ && tasks_[id].active;
+        }
+
+        // Execute every due task, highest priority first. Returns the
+        // number of tasks run. Stops early once slice_us is used up so
+        // loop() can service MQTT between bursts.
+        uint8_t run(uint32_t slice_us = UINT32_MAX)
+        {
+            uint32_t start = clock_();
+            uint8_t executed = 0;
+
+            while (size_ > 0) {
+                uint32_t now = clock_();
+                int8_t id = nextReady(now);
+                if (id < 0) break;
+
+                execute(id, now);
+                executed++;
+
+                if (clock_() - start >= slice_us) break;
+            }
+            return executed;
+        }
+
+        // µs until the earliest deadline (0 if overdue, UINT32_MAX if idle)
+        uint32_t timeToNextUs() const
+        {
+            if (size_ == 0) return UINT32_MAX;
+            uint32_t now = clock_();
+            uint32_t due = tasks_[heap_[0]].dueUs;
+            return before(now, due) ? due - now : 0;
+        }
+
+        uint8_t count() const { return count_; }
+        const Task &task(int8_t id) const { return tasks_[id]; }
+
+        // Most recent deadline miss, for reporting
+        int8_t lastMissTask() const { return lastMissTask_; }
+        uint32_t lastMissLateUs() const { return lastMissLateUs_; }
+
+        // {"miss":[name,late_ms],"t":[[name,runs,miss,overrun,skip,jit_p99_us,jit_max_us,run_max_us,run_avg_us],...]}
+        size_t formatReport(char *buf, size_t size) const
+        {
+            int len = snprintf(buf, size, "{\"miss\":[\"%s\",%u],\"t\":[",
+                               lastMissTask_ >= 0 ? tasks_[lastMissTask_].name : "",
+                               (unsigned)(lastMissLateUs_ / 1000));
+
+            for (uint8_t i = 0; i < count_ && len > 0 && (size_t)len < size; i++) {
+                const TaskStats &s = tasks_[i].stats;
+                uint32_t avg = s.runs ? (uint32_t)(s.totalRunUs / s.runs) : 0;
+                char entry[128];
+                int n = snprintf(entry, sizeof(entry), "%s[\"%s\",%u,%u,%u,%u,%u,%u,%u,%u]",
+                                 i ? "," : "", tasks_[i].name,
+                                 (unsigned)s.runs, (unsigned)s.misses, (unsigned)s.overruns,
+                                 (unsigned)s.skipped, (unsigned)s.jitterUs.percentile(99),
+                                 (unsigned)s.jitterUs.max, (unsigned)s.maxRunUs, (unsigned)avg);
+                if (n <= 0 || (size_t)(len + n + 3) > size) break;
+                for (int k = 0; k < n; k++) buf[len + k] = entry[k];
+                len += n;
+            }
+            if (len > 0 && (size_t)len + 3 <= size) {
+                len += snprintf(buf + len, size - len, "]}");
+            }
+            return len > 0 ? (size_t)len : 0;
+        }
+
+    private:
+        ClockFn clock_;
+        Task tasks_[MAX_TASKS];
+        int8_t heap_[MAX_TASKS];
+        int8_t pos_[MAX_TASKS];
+        uint8_t count_ = 0;
+        uint8_t size_ = 0;
+
+        int8_t lastMissTask_ = INVALID_TASK;
+        uint32_t lastMissLateUs_ = 0;
+        volatile int8_t running_ = INVALID_TASK;
+
+        // Highest-priority task among those already due, or -1
+        int8_t nextReady(uint32_t now) const
+        {
+            int8_t best = INVALID_TASK;
+            // Due tasks form a connected subtree at the heap root
+            uint8_t stack[MAX_TASKS];
+            uint8_t sp = 0;
+            stack[sp++] = 0;
+            while (sp > 0) {
+                uint8_t i = stack[--sp];
+                if (i >= size_) continue;
+                const Task &t = tasks_[heap_[i]];
+                if (before(now, t.dueUs)) continue;
+
+                if (best < 0 || t.priority < tasks_[best].priority ||
+                    (t.priority == tasks_[best].priority && before(t.dueUs, tasks_[best].dueUs))) {
+                    best = heap_[i];
+                }
+                // Each node is pushed at most once, so the stack never exceeds MAX_TASKS
+                if (2 * i + 1 < size_) stack[sp++] = 2 * i + 1;
+                if (2 * i + 2 < size_) stack[sp++] = 2 * i + 2;
+            }
+            return best;
+        }
+
+        void execute(int8_t id, uint32_t now)
+        {
+            Task &t = tasks_[id];
+            TaskStats &s = t.stats;
+
+            uint32_t late = now - t.dueUs;
+            s.jitterUs.add(late);
+            if (late > t.maxLatencyUs) {
+                s.misses++;
+                lastMissTask_ = id;
+                lastMissLateUs_ = late;
+            }
+
+            // Re-arm before running so the task may stop() itself
+            if (t.periodUs == 0) {
+                t.active = false;
+                remove(pos_[id]);
+            } else {
+                t.dueUs += t.periodUs;
+                if (!before(now, t.dueUs)) {
+                    // Fell a whole period behind: drop the backlog
+                    uint32_t behind = (now - t.dueUs) / t.periodUs + 1;
+                    s.skipped += behind;
+                    t.dueUs += behind * t.periodUs;
+                }
+                fix(pos_[id]);
+            }
+
+            uint32_t begin = clock_();
+            running_ = id;
+            t.fn();
+            running_ = INVALID_TASK;
+            uint32_t elapsed = clock_() - begin;
+
+            s.runs++;
+            s.lastRunUs = elapsed;
+            s.totalRunUs += elapsed;
+            if (elapsed > s.maxRunUs) s.maxRunUs = elapsed;
+            if (elapsed > t.budgetUs) s.overruns++;
+        }
+
+        // ── Indexed binary heap ──────────────────────────────────
+        bool less(int8_t a, int8_t b) const
+        {
+            const Task &ta = tasks_[a];
+            const Task &tb = tasks_[b];
+            if (ta.dueUs != tb.dueUs) return before(ta.dueUs, tb.dueUs);
+            return ta.priority < tb.priority;
+        }
+
+        void place(uint8_t i, int8_t id)
+        {
+            heap_[i] = id;
+            pos_[id] = i;
+        }
+
+        void siftUp(uint8_t i)
+        {
+            int8_t id = heap_[i];
+            while (i > 0) {
+                uint8_t parent = (i - 1) / 2;
+                if (!less(id, heap_[parent])) break;
+                place(i, heap_[parent]);
+                i = parent;
+            }
+            place(i, id);
+        }
+
+        void siftDown(uint8_t i)
+        {
+            int8_t id = heap_[i];
+            while (true) {
+                uint8_t child = 2 * i + 1;
+                if (child >= size_) break;
+                if (child + 1 < size_ && less(heap_[child + 1], heap_[child])) child++;
+                if (!less(heap_[child], id)) break;
+                place(i, heap_[child]);
+                i = child;
+            }
+            place(i, id);
+        }
+
+        void fix(uint8_t i)
+        {
+            int8_t id = heap_[i];
+            siftUp(i);
+            siftDown(pos_[id]);
+        }
+
+        void push(int8_t id)
+        {
+            place(size_, id);
+            size_++;
+            siftUp(size_ - 1);
+        }
+
+        void remove(int8_t i)
+        {
+            if (i < 0 || i >= size_) return;
+            int8_t id = heap_[i];
+            pos_[id] = -1;
+            size_--;
+            if (i == size_) return;
+            place(i, heap_[size_]);
+            fix(i);
+        }
+    };
+}
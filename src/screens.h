@@ -0,0 +1,184 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include "config.h"
+#include "hal.h"
+#include "profile.h"
+#include "lcd_buffer.h"
+#include "lcd_driver.h"
+#include "lcd_pages.h"
+#include "tariff.h"
+#include "control.h"
+
+// ════════════════════════════════════════════════════════════════
+// LCD SCREENS
+// The rotating pages (meter, energy, environment, power bar, daily
+// kWh, relay runtime, protection), the message overlay and refresh
+// cost counters, on top of LcdPages + LcdBuffer + LcdDriver. Inputs
+// are the readings in `data` (bump `revision` after changing them),
+// the relay state from Control and the tariff ledger. Shared by
+// main.cpp and the host sim.
+// ════════════════════════════════════════════════════════════════
+
+namespace Screens
+{
+    typedef LcdBuffer<LCD_COLS, LCD_ROWS> Frame;
+
+    struct Data {
+        float voltage = 0.0f;
+        float current = 0.0f;
+        float power = 0.0f;
+        float energy = 0.0f;
+        float frequency = 0.0f;
+        float powerFactor = 0.0f;
+        float temperature = 0.0f;
+        float humidity = 0.0f;
+        bool dataValid = false;
+    };
+
+    Data data;
+    uint32_t revision = 0;              // Bumped whenever data changes (lazy pages)
+
+    LcdDriver *lcd = nullptr;
+    const Tariff::Ledger *ledger = nullptr;
+    Frame buffer;
+    LcdPages<Frame, LCD_MAX_PAGES> pages;
+
+    // Message overlay (splash / alerts) - shown instead of the
+    // rotating pages until it expires
+    uint32_t overlayUntil = 0;
+    bool overlayActive = false;
+
+    // Refresh cost
+    uint32_t refreshUsTotal = 0;
+    uint32_t refreshUsMax = 0;
+
+    // Send only the cells that changed since the last refresh
+    void flush()
+    {
+        uint32_t start = Hal::micros();
+        {
+            PROFILE_SCOPE(Profile::PROBE_LCD);
+            buffer.flush(*lcd);
+        }
+        uint32_t elapsed = Hal::micros() - start;
+
+        refreshUsTotal += elapsed;
+        if (elapsed > refreshUsMax) refreshUsMax = elapsed;
+    }
+
+    // Show a two-line message, held for duration_ms before the rotating
+    // pages resume (non-blocking replacement for print + delay)
+    void showMessage(const char *line1, const char *line2, uint32_t duration_ms)
+    {
+        overlayUntil = Hal::millis() + duration_ms;
+        overlayActive = true;
+
+        buffer.setRow(0, line1);
+        buffer.setRow(1, line2);
+        flush();
+    }
+
+    // Every LCD_UPDATE_INTERVAL
+    void update()
+    {
+        uint32_t now = Hal::millis();
+        if (overlayActive) {
+            if ((int32_t)(now - overlayUntil) < 0) {
+                return;
+            }
+            overlayActive = false;
+            pages.invalidate();
+        }
+
+        if (pages.update(now, buffer)) {
+            flush();
+        }
+    }
+
+    // ════════════════════════════════════════
+    // PAGES
+    // ════════════════════════════════════════
+    uint32_t dataVersion()
+    {
+        return revision + Control::revision;
+    }
+
+    // Relay page shows a running timer: changes every second
+    uint32_t relayPageVersion()
+    {
+        return (Hal::millis() / 1000) * 2 + (Control::relayState ? 1 : 0);
+    }
+
+    void renderMeter(Frame &buf)        // Voltage & Current
+    {
+        buf.printf(0, 0, "V:%.1fV", data.voltage);
+        buf.printf(10, 0, "R:%s", Control::relayState ? "ON" : "OF");
+        buf.printf(0, 1, "I:%.3fA", data.current);
+    }
+
+    void renderEnergy(Frame &buf)       // Power & Energy
+    {
+        buf.printf(0, 0, "P:%.1fW", data.power);
+        buf.printf(0, 1, "E:%.3fkWh", data.energy);
+    }
+
+    void renderEnv(Frame &buf)          // Frequency, PF, Temp, Humidity
+    {
+        buf.printf(0, 0, "F:%.1fHz", data.frequency);
+        buf.printf(9, 0, "PF:%.2f", data.powerFactor);
+        buf.printf(0, 1, "T:%.1fC", data.temperature);
+        buf.printf(9, 1, "H:%.0f%%", data.humidity);
+    }
+
+    void renderPowerBar(Frame &buf)     // Power relative to LCD_BAR_MAX_POWER_W
+    {
+        float power = isnan(data.power) ? 0.0f : data.power;
+        buf.printf(0, 0, "P:%.0fW", power);
+        buf.printf(11, 0, "%3.0f%%", power * 100.0f / LCD_BAR_MAX_POWER_W);
+        LcdBar::render(buf, 0, 1, LCD_COLS, power, LCD_BAR_MAX_POWER_W);
+    }
+
+    void renderDaily(Frame &buf)        // Today / this month kWh + cost
+    {
+        buf.printf(0, 0, "Day %.3fkWh", ledger->day().kwh);
+        buf.printf(0, 1, "Mon %.1f %.0fk", ledger->month().kwh, ledger->month().cost / 1000.0);
+    }
+
+    void renderRelay(Frame &buf)        // Current state duration + total ON time
+    {
+        unsigned long in_state = Control::inStateMs() / 1000;
+        unsigned long on_total = (unsigned long)(Control::onTotalMs() / 1000);
+        buf.printf(0, 0, "RLY %-3s %02lu:%02lu:%02lu", Control::relayState ? "ON" : "OFF",
+                   in_state / 3600, (in_state / 60) % 60, in_state % 60);
+        buf.printf(0, 1, "ON total:%.1fh", on_total / 3600.0f);
+    }
+
+    void renderProtection(Frame &buf)   // Over-temperature / over-current protection state
+    {
+        buf.printf(0, 0, "T>%.0fC I>%.0fA", TEMP_THRESHOLD, PROTECTION_MAX_CURRENT_A);
+        buf.printf(0, 1, "T:%.1fC", data.temperature);
+        buf.print(9, 1, Control::tripped() ? "I TRIP" : Control::tempGuard.offByOverTemp ? "TRIPPED" : "OK");
+    }
+
+    // Panel init, bar glyphs, page registry
+    void begin(LcdDriver &driver, const Tariff::Ledger &energy)
+    {
+        lcd = &driver;
+        ledger = &energy;
+
+        lcd->init();
+        lcd->backlight();
+        LcdBar::loadGlyphs(*lcd);
+        buffer.invalidate();
+
+        pages.add("meter", renderMeter, dataVersion, LCD_DWELL_METER);
+        pages.add("energy", renderEnergy, dataVersion, LCD_DWELL_ENERGY);
+        pages.add("env", renderEnv, dataVersion, LCD_DWELL_ENV);
+        pages.add("bar", renderPowerBar, dataVersion, LCD_DWELL_BAR);
+        pages.add("daily", renderDaily, dataVersion, LCD_DWELL_DAILY);
+        pages.add("relay", renderRelay, relayPageVersion, LCD_DWELL_RELAY);
+        pages.add("prot", renderProtection, dataVersion, LCD_DWELL_PROTECTION);
+    }
+}
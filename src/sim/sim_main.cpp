@@ -0,0 +1,466 @@
+// ════════════════════════════════════════════════════════════════
+// HOST SIMULATION (env:native)
+// Runs the firmware's control and publish modules against the
+// simulated devices of hal_sim.h on a virtual clock. Relay commands,
+// over-temperature guard, TOU schedule, demand outputs and rules go
+// through the same Control code as main.cpp, the LCD through the same
+// Screens pages; protection + power quality stand in for the
+// acquisition task. Plus windowed aggregates, tariff ledger, NILM and
+// anomaly baselines. A day runs in well under a second.
+//
+//   sim_main [hours] [-v] [-r trace.bin]
+//     -v echoes every MQTT publish, -r records a trace (trace.h) for
+//     the replayer
+//
+// Built with HEAP_STATS_WRAP (env:native_heap), any allocation after
+// the first simulated hour - Control, Screens and the publish path
+// included - fails the run (exit code 4). test/test_heap runs the same
+// check as a unit test (SIM_NO_MAIN drops this main()).
+// ════════════════════════════════════════════════════════════════
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../config.h"
+#include "../topics.h"
+#include "../hal_sim.h"
+#include "../metrics.h"
+#include "../heap_stats.h"
+#include "../scheduler.h"
+#include "../lcd_driver.h"
+#include "../protection.h"
+#include "../power_quality.h"
+#include "../control.h"
+#include "../screens.h"
+#include "../aggregate.h"
+#include "../tariff.h"
+#include "../nilm.h"
+#include "../anomaly.h"
+#include "../commands.h"
+#include "../trace.h"
+
+namespace
+{
+    void onMessage(const char *topic, const char *payload);
+
+    // Simulated hardware
+    Hal::SimClock simClock;
+    Hal::SimGpio gpio;
+    Hal::SimPzem meter(simClock, gpio);
+    Hal::SimSht31 climate(simClock, meter);
+    Hal::SimLcd i2c(LCD_I2C_ADDR, SHT31_I2C_ADDR);
+    Hal::SimTransport mqtt(onMessage);
+    LcdDriver lcd(i2c, LCD_I2C_ADDR, LCD_COLS, LCD_ROWS);
+
+    uint32_t simMicros() { return simClock.micros(); }
+    Sched::Scheduler<SCHED_MAX_TASKS> scheduler(simMicros);
+
+    // Acquisition task stand-in, configured as in acquisition.h
+    Protection::Engine<PROTECTION_PRETRIP_SAMPLES> protection(Protection::Limits{
+        PROTECTION_MAX_CURRENT_A, PROTECTION_MAX_POWER_W, true, PROTECTION_CONFIRM_SAMPLES});
+    PowerQuality::Recorder<PQ_PRETRIGGER_SAMPLES, PQ_QUEUE_SIZE> pq(PowerQuality::Limits{
+        PQ_SAG_V, PQ_SWELL_V, PQ_INTERRUPT_V, PQ_HYSTERESIS_V, PQ_INTERRUPT_SAMPLES, PQ_FREQ_LOW_HZ, PQ_FREQ_HIGH_HZ, PQ_HYSTERESIS_HZ});
+
+    // Other firmware modules, configured as in main.cpp
+    const char *const AGG_NAMES[] = {"v", "i", "p", "f", "pf", "temp", "hum"};
+    const uint8_t AGG_DECIMALS[] = {1, 3, 1, 1, 2, 1, 1};
+    Aggregate::Window<7> aggShort(AGG_SHORT_WINDOW_MS, AGG_NAMES, AGG_DECIMALS);
+    Aggregate::Window<7> aggLong(AGG_LONG_WINDOW_MS, AGG_NAMES, AGG_DECIMALS);
+
+    const Tariff::Tier TARIFF_TABLE[] = TARIFF_TIERS;
+    Tariff::Ledger ledger(TARIFF_TABLE, sizeof(TARIFF_TABLE) / sizeof(TARIFF_TABLE[0]), TARIFF_VAT_PERCENT);
+
+    Nilm::Detector<NILM_MAX_SIGNATURES> nilm(Nilm::Config{
+        NILM_NOISE_W, NILM_MIN_STEP_W, NILM_MATCH_RATIO, NILM_MATCH_MIN_W, NILM_STABLE_SAMPLES});
+
+    const float ANOMALY_MIN_SD[] = {ANOMALY_MIN_SD_POWER, ANOMALY_MIN_SD_TEMP};
+    Anomaly::Detector<2> anomaly(Anomaly::Config{
+        ANOMALY_ALPHA, ANOMALY_THRESHOLD, ANOMALY_CLEAR_RATIO, ANOMALY_WARMUP}, ANOMALY_MIN_SD);
+
+    // Trace recording (-r), drained to the file by runFor()
+    Trace::Writer<16384> trace;
+    FILE *traceFile = nullptr;
+
+    // Simulated wall clock: local midnight, 2026-10-19 (UTC+7)
+    uint32_t epochUtc = 0;
+    PowerSample latest;
+    float temperature = NAN;
+    float humidity = NAN;
+
+    struct Counters {
+        uint32_t trips = 0;
+        uint32_t pqEvents = 0;
+        uint32_t nilmEvents = 0;
+        uint32_t anomalies = 0;
+        uint32_t commands = 0;
+    } counters;
+
+    uint32_t utcNow() { return epochUtc + simClock.millis() / 1000; }
+
+    void publish(const char *topic, const char *payload, bool retained = false)
+    {
+        Metrics::publish(mqtt, topic, payload, retained);
+    }
+
+    void publishFloat(const char *topic, float value, uint8_t decimals)
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+        publish(topic, buf);
+    }
+
+    // Control hooks
+    bool protectionTripped() { return protection.tripped(); }
+    void clearProtection() { protection.clear(); }
+    float meterEnergy() { return latest.valid ? latest.energy : NAN; }
+
+    // Same record layout as traceInput() in main.cpp
+    void traceInput(uint8_t type, uint8_t id, const char *payload, float a, float b)
+    {
+        if (!traceFile) return;
+        uint32_t now = simClock.millis();
+        if (type == Trace::TYPE_CLIMATE) trace.climate(now, a, b);
+        else if (type == Trace::TYPE_COMMAND) trace.command(now, id, payload);
+        else trace.check(now, id);
+    }
+
+    // mqttCallback() minus NVS
+    void onMessage(const char *topic, const char *payload)
+    {
+        counters.commands++;
+        switch (Control::handleMessage(topic, payload)) {
+        case Commands::TARGET_RELAY_SCHEDULE: Control::setSchedule(payload); break;
+        case Commands::TARGET_RULES: Control::loadRules(payload); break;
+        }
+    }
+
+    // ════════════════════════════════════════
+    // TASKS
+    // ════════════════════════════════════════
+    void acquisitionTask()
+    {
+        PowerSample s = meter.read();
+        if (traceFile) trace.power(s);
+        latest = s;
+        // Acquisition::poll() cuts the relay, handleProtectionTrip() syncs
+        if (protection.evaluate(s) != Protection::NONE) {
+            gpio.write(RELAY_PIN, true);
+            counters.trips++;
+            Control::tripOff(protection.record());
+        }
+        pq.add(s);
+        if (!s.valid) return;
+
+        const float values[] = {s.voltage, s.current, s.power, s.frequency, s.pf};
+        for (uint8_t m = 0; m < 5; m++) {
+            aggShort.add(m, values[m]);
+            aggLong.add(m, values[m]);
+        }
+
+        Nilm::Event ev;
+        if (nilm.add(s.power, s.pf, s.ms, ev)) {
+            counters.nilmEvents++;
+            char payload[96];
+            snprintf(payload, sizeof(payload), "{\"app\":%d,\"type\":%d,\"dp\":%.0f}", ev.id, ev.type, ev.dp);
+            publish(MQTTTopics::NILM_EVENT, payload);
+        }
+    }
+
+    void powerQualityTask()
+    {
+        PowerQuality::Event<PQ_PRETRIGGER_SAMPLES> ev;
+        static char payload[PQ_EVENT_SIZE];
+        while (pq.take(ev)) {
+            counters.pqEvents++;
+            PowerQuality::formatEvent(ev, payload, sizeof(payload));
+            publish(MQTTTopics::PQ_EVENT, payload);
+        }
+    }
+
+    // pzemReadPublish()
+    void rawPublishTask()
+    {
+        Screens::data.voltage = latest.voltage;
+        Screens::data.current = latest.current;
+        Screens::data.power = latest.power;
+        Screens::data.energy = latest.energy;
+        Screens::data.frequency = latest.frequency;
+        Screens::data.powerFactor = latest.pf;
+        Screens::data.dataValid = latest.valid;
+        Screens::revision++;
+        if (!latest.valid) return;
+        publishFloat(MQTTTopics::VOLTAGE, latest.voltage, 1);
+        publishFloat(MQTTTopics::CURRENT, latest.current, 3);
+        publishFloat(MQTTTopics::POWER, latest.power, 1);
+        publishFloat(MQTTTopics::ENERGY, latest.energy, 3);
+        publishFloat(MQTTTopics::FREQUENCY, latest.frequency, 1);
+        publishFloat(MQTTTopics::POWER_FACTOR, latest.pf, 2);
+    }
+
+    void climateTask()
+    {
+        if (!climate.read(temperature, humidity)) return;
+        traceInput(Trace::TYPE_CLIMATE, 0, nullptr, temperature, humidity);
+        Screens::data.temperature = temperature;
+        Screens::data.humidity = humidity;
+        Screens::revision++;
+        publishFloat(MQTTTopics::TEMPERATURE, temperature, 1);
+        publishFloat(MQTTTopics::HUMIDITY, humidity, 1);
+        aggShort.add(5, temperature);
+        aggShort.add(6, humidity);
+        aggLong.add(5, temperature);
+        aggLong.add(6, humidity);
+    }
+
+    void temperatureTask()
+    {
+        Control::checkTemperature(temperature);
+    }
+
+    void scheduleTask()
+    {
+        Control::scheduleTask(utcNow());
+    }
+
+    void demandTask()
+    {
+        Control::demandTask(latest.valid ? latest.power : NAN);
+    }
+
+    void rulesTask()
+    {
+        Control::rulesTask(latest, temperature, humidity);
+    }
+
+    void closeWindow(Aggregate::Window<7> &window, const char *topic)
+    {
+        static char frame[AGG_FRAME_SIZE];
+        window.close(simClock.millis(), utcNow(), frame, sizeof(frame));
+        publish(topic, frame);
+    }
+
+    void aggregateTask()
+    {
+        uint32_t now = simClock.millis();
+        if (aggShort.due(now)) {
+            uint8_t hour = (uint8_t)(((utcNow() + TOU_UTC_OFFSET_MIN * 60L) / 3600) % 24);
+            const uint8_t sources[] = {2, 5};
+            for (uint8_t m = 0; m < 2; m++) {
+                Anomaly::Event ev;
+                const Aggregate::Welford &st = aggShort.stats(sources[m]);
+                if (st.n && anomaly.add(m, hour, st.mean, ev) && ev.type == Anomaly::EVENT_START) {
+                    counters.anomalies++;
+                }
+            }
+            closeWindow(aggShort, MQTTTopics::AGGREGATE_SHORT);
+        }
+        if (aggLong.due(now)) {
+            closeWindow(aggLong, MQTTTopics::AGGREGATE_LONG);
+        }
+    }
+
+    void tariffTask()
+    {
+        time_t local = (time_t)utcNow() + TOU_UTC_OFFSET_MIN * 60L;
+        struct tm tm;
+        gmtime_r(&local, &tm);
+        int32_t day = (int32_t)(local / 86400);
+        int32_t month = (tm.tm_year + 1900) * 12 + tm.tm_mon;
+        ledger.update(latest.valid ? latest.energy : NAN, day, month);
+    }
+
+    void relayStatsTask()
+    {
+        char frame[RELAY_STATS_SIZE];
+        Control::formatStats(frame, sizeof(frame));
+        publish(MQTTTopics::RELAY_STATS, frame);
+    }
+
+    void metricsTask()
+    {
+        bool ok = false;
+        Metrics::publishReport(mqtt, MQTTTopics::SYSTEM_METRICS, ok);
+    }
+
+    // ════════════════════════════════════════
+    // SCENARIO
+    // ════════════════════════════════════════
+    // Base load always on, fridge cycling, kettle at breakfast, heater
+    // on the TOU-scheduled relay, pump on a demand output 09:00-10:00, a
+    // 2s sag at 03:00 each day. Kettle + heater trips the protection;
+    // an MQTT "ON" at noon releases it. Heater or kettle fire the
+    // overload rule.
+    const char SIM_SCHEDULE[] = "MTWTFSS/06:00-08:00;MTWTFSS/18:00-22:00";
+    const char SIM_RULES[] = "overload: p > 1500 for 5s -> event";
+    int8_t fridge = -1;
+    int8_t kettle = -1;
+
+    void scenarioTask()
+    {
+        uint32_t s = simClock.millis() / 1000;
+        uint32_t day_s = s % 86400;
+        meter.setLoad(fridge, (s / 60) % 45 < 15);
+        meter.setLoad(kettle, day_s >= 6 * 3600 + 900 && day_s < 6 * 3600 + 1080);
+        if (day_s == 3 * 3600) meter.injectVoltage(simClock.millis(), 2000, 185.0f);
+        if (day_s == 9 * 3600) mqtt.inject(MQTTTopics::OUTPUTS_CONTROL, "pump:ON");
+        if (day_s == 10 * 3600) mqtt.inject(MQTTTopics::OUTPUTS_CONTROL, "pump:OFF");
+        if (day_s == 12 * 3600) mqtt.inject(MQTTTopics::RELAY_CONTROL, "ON");
+    }
+
+    void setup()
+    {
+        Hal::bindClock(simClock);
+        int32_t days = Tou::daysFromCivil(2026, 10, 19);
+        epochUtc = (uint32_t)(days * 86400L - TOU_UTC_OFFSET_MIN * 60L);
+
+        meter.addLoad("base", 150.0f, 0.95f, -1, true);
+        fridge = meter.addLoad("fridge", 120.0f, 0.80f);
+        kettle = meter.addLoad("kettle", 1800.0f, 1.00f);
+        meter.addLoad("heater", 1500.0f, 0.99f, RELAY_PIN);
+        meter.addLoad("pump", 750.0f, 0.80f, OUTPUT_PUMP_PIN);
+        meter.setPowerAlarm((uint16_t)PROTECTION_MAX_POWER_W);
+        meter.setReadLatencyUs(0);      // Own task on the device, don't block the others
+
+        for (uint8_t i = 0; i < Commands::ROUTE_COUNT; i++) mqtt.subscribe(Commands::ROUTES[i].topic);
+
+        Control::Hooks hooks = {protectionTripped, clearProtection, meterEnergy, traceInput, nullptr, nullptr};
+        Control::begin(gpio, mqtt, RELAY_PIN, hooks);
+        const Demand::OutputConfig outputs[] = {
+            {"heater", OUTPUT_HEATER_PIN, OUTPUT_HEATER_PRIORITY, OUTPUT_HEATER_LOAD_W, OUTPUT_MIN_ON_MS, OUTPUT_MIN_OFF_MS},
+            {"pump", OUTPUT_PUMP_PIN, OUTPUT_PUMP_PRIORITY, OUTPUT_PUMP_LOAD_W, OUTPUT_MIN_ON_MS, OUTPUT_MIN_OFF_MS},
+        };
+        for (const Demand::OutputConfig &cfg : outputs) Control::addOutput(cfg);
+        Control::setSchedule(SIM_SCHEDULE);
+        Control::loadRules(SIM_RULES);
+
+        climate.begin();
+        Screens::begin(lcd, ledger);
+        aggShort.start(simClock.millis());
+        aggLong.start(simClock.millis());
+
+        scheduler.add("acq", acquisitionTask, PROTECTION_POLL_INTERVAL, Sched::PRIO_CRITICAL);
+        scheduler.add("pq", powerQualityTask, PQ_CHECK_INTERVAL, Sched::PRIO_HIGH);
+        scheduler.add("tou", scheduleTask, TOU_CHECK_INTERVAL, Sched::PRIO_HIGH);
+        scheduler.add("temp", temperatureTask, TEMP_CHECK_INTERVAL, Sched::PRIO_HIGH, TEMP_CHECK_INTERVAL);
+        scheduler.add("demand", demandTask, DEMAND_SAMPLE_INTERVAL, Sched::PRIO_HIGH);
+        scheduler.add("rules", rulesTask, RULES_EVAL_INTERVAL, Sched::PRIO_HIGH);
+        scheduler.add("scenario", scenarioTask, 1000, Sched::PRIO_HIGH);
+        scheduler.add("pzem", rawPublishTask, PZEM_READ_INTERVAL, Sched::PRIO_HIGH);
+        scheduler.add("sht31", climateTask, DHT_READ_INTERVAL, Sched::PRIO_NORMAL);
+        scheduler.add("aggregate", aggregateTask, AGG_SAMPLE_INTERVAL, Sched::PRIO_NORMAL);
+        scheduler.add("tariff", tariffTask, TARIFF_UPDATE_INTERVAL, Sched::PRIO_NORMAL);
+        scheduler.add("lcd", Screens::update, LCD_UPDATE_INTERVAL, Sched::PRIO_NORMAL);
+        scheduler.add("relaystats", relayStatsTask, RELAY_STATS_INTERVAL, Sched::PRIO_LOW, RELAY_STATS_INTERVAL);
+        scheduler.add("metrics", metricsTask, METRICS_PUBLISH_INTERVAL, Sched::PRIO_LOW, METRICS_PUBLISH_INTERVAL);
+    }
+
+    // Run due tasks, then jump the simClock to the next deadline
+    void drainTrace()
+    {
+        uint8_t chunk[1024];
+        size_t n;
+        while ((n = trace.read(chunk, sizeof(chunk))) > 0) fwrite(chunk, 1, n, traceFile);
+    }
+
+    const char *currentTaskName()
+    {
+        int8_t id = scheduler.running();
+        return id >= 0 ? scheduler.task(id).name : nullptr;
+    }
+
+    void runFor(uint32_t duration_ms)
+    {
+        uint64_t end_us = simClock.nowUs() + (uint64_t)duration_ms * 1000;
+        while (simClock.nowUs() < end_us) {
+            {
+                HeapStats::Scope heap("sched");
+                scheduler.run();
+            }
+            {
+                HeapStats::Scope heap("mqtt_loop");
+                mqtt.loop();
+            }
+            if (traceFile && trace.pending() > 8192) drainTrace();
+            uint32_t wait = scheduler.timeToNextUs();
+            simClock.advanceUs(wait > 0 && wait != UINT32_MAX ? wait : 1000);
+        }
+    }
+}
+
+#ifndef SIM_NO_MAIN
+int main(int argc, char **argv)
+{
+    uint32_t hours = 24;
+    const char *tracePath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) mqtt.setEcho(stdout);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) tracePath = argv[++i];
+        else hours = (uint32_t)atoi(argv[i]);
+    }
+    if (tracePath && !(traceFile = fopen(tracePath, "wb"))) {
+        fprintf(stderr, "cannot open %s\n", tracePath);
+        return 1;
+    }
+
+    {
+        HeapStats::Scope heap("setup");
+        setup();
+    }
+    HeapStats::begin(currentTaskName, nullptr);
+    if (traceFile) {
+        // Same session snapshot as startTrace() in main.cpp
+        trace.begin(simClock.millis());
+        char state[24];
+        snprintf(state, sizeof(state), "STATE:%d,%d,%d,%d", Control::relayState, Control::tempGuard.offByOverTemp,
+                 Control::tempGuard.wasOnBeforeTrip, protection.tripped());
+        trace.command(simClock.millis(), Commands::TARGET_RELAY, state);
+    }
+    // Warm-up hour (first aggregates, NILM learning, ...), then steady state
+    uint32_t warmupHours = hours > 1 ? 1 : hours;
+    runFor(warmupHours * 3600000UL);
+    uint32_t warmupAllocs = HeapStats::totalAllocs();
+    runFor((hours - warmupHours) * 3600000UL);
+    uint32_t steadyAllocs = HeapStats::totalAllocs() - warmupAllocs;
+    if (traceFile) {
+        drainTrace();
+        fclose(traceFile);
+        fprintf(stderr, "Trace: %u records, %u lost -> %s\n", (unsigned)trace.records(), (unsigned)trace.lost(),
+                tracePath);
+    }
+
+    char buf[2048];
+    printf("Simulated %u h\n", (unsigned)hours);
+    printf("MQTT: %u publishes, %u bytes, %u retained\n",
+           (unsigned)mqtt.published(), (unsigned)mqtt.bytes(), (unsigned)mqtt.retained());
+    printf("PZEM: %u reads, %u errors, %.3f kWh\n", (unsigned)meter.reads(), (unsigned)meter.errors(), latest.energy);
+    printf("Events: trips %u, pq %u, nilm %u (%u signatures), anomalies %u, relay switches %u\n",
+           (unsigned)counters.trips, (unsigned)counters.pqEvents, (unsigned)counters.nilmEvents,
+           (unsigned)nilm.count(), (unsigned)counters.anomalies, (unsigned)Control::switches);
+    printf("Energy: today %.3f kWh / %.0f VND, month %.3f kWh / %.0f VND\n",
+           ledger.day().kwh, ledger.day().cost, ledger.month().kwh, ledger.month().cost);
+    Control::formatStats(buf, sizeof(buf));
+    printf("Relay: %s\n", buf);
+    Control::loads.formatStatus(buf, sizeof(buf), simClock.millis());
+    printf("Outputs: %s\n", buf);
+    Control::rules.formatStatus(buf, sizeof(buf));
+    printf("Rules: %s\n", buf);
+    printf("LCD: [%s]", i2c.row(0, LCD_COLS));
+    printf(" [%s] (%u I2C transactions)\n", i2c.row(1, LCD_COLS), (unsigned)i2c.transactions());
+    scheduler.formatReport(buf, sizeof(buf));
+    printf("Scheduler: %s\n", buf);
+#ifdef HEAP_STATS_WRAP
+    HeapStats::formatReport(buf, sizeof(buf));
+    printf("Heap: %u allocs before steady state, %u after: %s\n", (unsigned)warmupAllocs, (unsigned)steadyAllocs, buf + 1);
+    if (steadyAllocs) {
+        fprintf(stderr, "FAIL: steady-state loop allocated %u times\n", (unsigned)steadyAllocs);
+        return 4;
+    }
+#else
+    (void)steadyAllocs;
+    printf("Heap: allocation counting off (build without HEAP_STATS_WRAP)\n");
+#endif
+    return 0;
+}
+#endif
@@ -0,0 +1,143 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+// ════════════════════════════════════════════════════════════════
+// TIERED TARIFF ENERGY LEDGER
+// Day and month kWh/cost buckets built from the PZEM cumulative
+// energy register. Only deltas are accumulated, so a register reset
+// (button / MQTT / 9999kWh wrap) doesn't lose or double count energy.
+// Cost is added incrementally at the marginal tier of the month's
+// consumption (EVN residential tiers are monthly), VAT included.
+// Pure logic: the caller passes the local day / month numbers and
+// persists state().
+// ════════════════════════════════════════════════════════════════
+
+namespace Tariff
+{
+    struct Tier {
+        float upToKwh;              // Monthly upper bound, 0 = no bound (last tier)
+        float price;                // Per kWh, before VAT
+    };
+
+    struct Summary {
+        int32_t key = -1;           // Local day number / year * 12 + month - 1
+        double kwh = 0.0;
+        double cost = 0.0;
+    };
+
+    struct State {
+        uint32_t magic;
+        float lastMeterKwh;         // NAN until the first reading
+        Summary day;
+        Summary month;
+    };
+
+    const uint32_t STATE_MAGIC = 0x54524631UL;      // "TRF1"
+
+    enum Closed : uint8_t {
+        CLOSED_NONE = 0,
+        CLOSED_DAY = 1,
+        CLOSED_MONTH = 2
+    };
+
+    // Cost of the first kwh of a month under the tier table (ex. VAT)
+    inline double tieredCost(const Tier *tiers, uint8_t count, double kwh)
+    {
+        double cost = 0.0;
+        double lower = 0.0;
+        for (uint8_t i = 0; i < count && kwh > lower; i++) {
+            bool last = i == count - 1 || tiers[i].upToKwh <= 0.0f;
+            double upper = last ? kwh : (kwh < tiers[i].upToKwh ? kwh : tiers[i].upToKwh);
+            cost += (upper - lower) * tiers[i].price;
+            lower = upper;
+            if (last) break;
+        }
+        return cost;
+    }
+
+    class Ledger
+    {
+    public:
+        Ledger(const Tier *tiers, uint8_t count, float vat_percent)
+            : tiers_(tiers), count_(count), vatFactor_(1.0 + vat_percent / 100.0)
+        {
+            state_.magic = STATE_MAGIC;
+            state_.lastMeterKwh = NAN;
+        }
+
+        // Restore persisted state (false if not a valid ledger record)
+        bool restore(const State &s)
+        {
+            if (s.magic != STATE_MAGIC) return false;
+            state_ = s;
+            return true;
+        }
+
+        // Feed one meter reading. day / month < 0 = local time unknown
+        // (accumulate without rolling over). Returns CLOSED_* flags; the
+        // closed buckets are in closedDay() / closedMonth().
+        uint8_t update(float meter_kwh, int32_t day, int32_t month)
+        {
+            if (!isnan(meter_kwh)) {
+                float last = state_.lastMeterKwh;
+                if (!isnan(last)) {
+                    // Register went backwards: it was reset, count from 0
+                    double delta = meter_kwh >= last ? meter_kwh - last : meter_kwh;
+                    if (meter_kwh < last) resets_++;
+                    add(delta);
+                }
+                state_.lastMeterKwh = meter_kwh;
+            }
+
+            uint8_t closed = CLOSED_NONE;
+            if (day >= 0 && day != state_.day.key) {
+                if (state_.day.key >= 0) {
+                    closedDay_ = state_.day;
+                    closed |= CLOSED_DAY;
+                }
+                state_.day = Summary();
+                state_.day.key = day;
+            }
+            if (month >= 0 && month != state_.month.key) {
+                if (state_.month.key >= 0) {
+                    closedMonth_ = state_.month;
+                    closed |= CLOSED_MONTH;
+                }
+                state_.month = Summary();
+                state_.month.key = month;
+            }
+            return closed;
+        }
+
+        const State &state() const { return state_; }
+        const Summary &day() const { return state_.day; }
+        const Summary &month() const { return state_.month; }
+        const Summary &closedDay() const { return closedDay_; }
+        const Summary &closedMonth() const { return closedMonth_; }
+        uint32_t resets() const { return resets_; }
+
+    private:
+        const Tier *tiers_;
+        uint8_t count_;
+        double vatFactor_;
+        State state_;
+        Summary closedDay_;
+        Summary closedMonth_;
+        uint32_t resets_ = 0;
+
+        void add(double kwh)
+        {
+            if (kwh <= 0.0) return;
+            double before = tieredCost(tiers_, count_, state_.month.kwh);
+            double after = tieredCost(tiers_, count_, state_.month.kwh + kwh);
+            double cost = (after - before) * vatFactor_;
+
+            state_.day.kwh += kwh;
+            state_.day.cost += cost;
+            state_.month.kwh += kwh;
+            state_.month.cost += cost;
+        }
+    };
+}
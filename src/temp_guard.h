@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+
+// ════════════════════════════════════════════════════════════════
+// OVER-TEMPERATURE RELAY GUARD
+// Decision part of checkTemperatureProtection(): turns the relay OFF
+// above the threshold and back ON once the temperature drops below
+// threshold - hysteresis, only if it was ON before and no current /
+// power trip is latched. The caller applies the returned action.
+// ════════════════════════════════════════════════════════════════
+
+namespace TempGuard
+{
+    enum Action : uint8_t {
+        ACTION_NONE = 0,
+        ACTION_TRIP,            // Relay OFF (over temperature)
+        ACTION_RECOVER          // Relay back ON (temperature recovered)
+    };
+
+    struct State {
+        bool offByOverTemp = false;     // Relay bị tắt do quá nhiệt
+        bool wasOnBeforeTrip = false;   // Trạng thái relay trước khi trip
+
+        // Manual OFF / protection trip: no automatic recovery
+        void clear()
+        {
+            offByOverTemp = false;
+            wasOnBeforeTrip = false;
+        }
+    };
+
+    inline uint8_t evaluate(State &st, float temperature, bool relay_on, bool protection_tripped,
+                            float threshold, float hysteresis)
+    {
+        // Skip nếu temperature không hợp lệ
+        if (isnan(temperature) || temperature < -40 || temperature > 125) {
+            return ACTION_NONE;
+        }
+
+        if (temperature > threshold) {
+            if (!relay_on) return ACTION_NONE;
+            st.wasOnBeforeTrip = true;
+            st.offByOverTemp = true;
+            return ACTION_TRIP;
+        }
+
+        if (temperature < threshold - hysteresis && st.offByOverTemp && st.wasOnBeforeTrip &&
+            !protection_tripped) {
+            st.clear();
+            return ACTION_RECOVER;
+        }
+        return ACTION_NONE;
+    }
+}
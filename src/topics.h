@@ -17,6 +17,12 @@ namespace MQTTTopics
     constexpr const char* SYSTEM_IP = "home/system/ip";
     constexpr const char* SYSTEM_UPTIME = "home/system/uptime";
     constexpr const char* SYSTEM_HEAP = "home/system/heap";
+    constexpr const char* SYSTEM_METRICS = "home/system/metrics";
+    constexpr const char* SYSTEM_SCHEDULER = "home/system/scheduler";
+    constexpr const char* SYSTEM_POWER = "home/system/power";
+    constexpr const char* SYSTEM_HEALTH = "home/system/health";
+    constexpr const char* SYSTEM_STALL = "home/system/stall";        // Retained
+    constexpr const char* SYSTEM_LCD = "home/system/lcd";
     
     // ════════════════════════════════════════════════════════════
     // SENSOR TOPICS
@@ -33,6 +39,10 @@ namespace MQTTTopics
     constexpr const char* ENERGY = "home/energy";
     constexpr const char* FREQUENCY = "home/frequency";
     constexpr const char* POWER_FACTOR = "home/powerfactor";
+    constexpr const char* ENERGY_TODAY = "home/energy/today";        // Retained, running
+    constexpr const char* ENERGY_MONTH = "home/energy/month";        // Retained, running
+    constexpr const char* ENERGY_DAILY = "home/energy/daily";        // Retained, last closed day
+    constexpr const char* ENERGY_MONTHLY = "home/energy/monthly";    // Retained, last closed month
     
     // ════════════════════════════════════════════════════════════
     // RELAY CONTROL TOPICS
@@ -41,10 +51,69 @@ namespace MQTTTopics
     constexpr const char* RELAY_STATUS = "home/relay/status";
     constexpr const char* RELAY_EVENT = "home/relay/event";
     constexpr const char* RELAY_STATS = "home/relay/stats";
+    constexpr const char* RELAY_PERSIST = "home/relay/persist";       // NVS write counts
+    constexpr const char* RELAY_SCHEDULE_SET = "home/relay/schedule/set";
+    constexpr const char* RELAY_SCHEDULE = "home/relay/schedule";     // Retained
+    
+    // ════════════════════════════════════════════════════════════
+    // LOAD OUTPUTS / DEMAND LIMITING TOPICS
+    // ════════════════════════════════════════════════════════════
+    constexpr const char* OUTPUTS_CONTROL = "home/outputs/control";  // "heater:ON"
+    constexpr const char* OUTPUTS_STATUS = "home/outputs/status";    // Retained
+    constexpr const char* OUTPUTS_EVENT = "home/outputs/event";      // Shed / restore
+    
+    // ════════════════════════════════════════════════════════════
+    // AUTOMATION RULE TOPICS
+    // ════════════════════════════════════════════════════════════
+    constexpr const char* RULES_SET = "home/rules/set";
+    constexpr const char* RULES_STATUS = "home/rules/status";        // Retained
+    constexpr const char* RULES_EVENT = "home/rules/event";
+    
+    // ════════════════════════════════════════════════════════════
+    // AGGREGATE TOPICS
+    // ════════════════════════════════════════════════════════════
+    constexpr const char* AGGREGATE_SHORT = "home/aggregate/1m";
+    constexpr const char* AGGREGATE_LONG = "home/aggregate/15m";
+    constexpr const char* AGGREGATE_RAW = "home/aggregate/raw";      // ON / OFF raw sensor topics
+    
+    // ════════════════════════════════════════════════════════════
+    // NILM TOPICS
+    // ════════════════════════════════════════════════════════════
+    constexpr const char* NILM_EVENT = "home/nilm/event";            // Per-appliance ON / OFF
+    constexpr const char* NILM_SIGNATURES = "home/nilm/signatures";  // Retained
+    
+    // ════════════════════════════════════════════════════════════
+    // ANOMALY TOPICS
+    // ════════════════════════════════════════════════════════════
+    constexpr const char* ANOMALY_EVENT = "home/anomaly/event";      // Threshold crossings only
     
     // ════════════════════════════════════════════════════════════
     // PZEM RESET TOPICS
     // ════════════════════════════════════════════════════════════
     constexpr const char* PZEM_RESET = "home/pzem/reset";
     constexpr const char* PZEM_STATUS = "home/pzem/status";
+    
+    // ════════════════════════════════════════════════════════════
+    // PROTECTION TOPICS
+    // ════════════════════════════════════════════════════════════
+    constexpr const char* PROTECTION_TRIP = "home/protection/trip";     // Retained
+    constexpr const char* PROTECTION_STATUS = "home/protection/status";
+    
+    // ════════════════════════════════════════════════════════════
+    // POWER QUALITY TOPICS
+    // ════════════════════════════════════════════════════════════
+    constexpr const char* PQ_EVENT = "home/pq/event";                // Sag / swell / frequency events
+    constexpr const char* PQ_STATUS = "home/pq/status";              // Retained, per-class counters
+    
+    // ════════════════════════════════════════════════════════════
+    // TRACE TOPICS
+    // ════════════════════════════════════════════════════════════
+    constexpr const char* TRACE_SET = "home/trace/set";              // SERIAL / FLASH / OFF / DUMP / CLEAR
+    constexpr const char* TRACE_STATUS = "home/trace/status";
+    
+    // ════════════════════════════════════════════════════════════
+    // PROFILING TOPICS (probes only in -DPROFILE builds)
+    // ════════════════════════════════════════════════════════════
+    constexpr const char* PROFILE_DUMP = "home/profile/dump";        // DUMP / RESET
+    constexpr const char* PROFILE_REPORT = "home/profile/report";    // Probe table (cycles)
 }
\ No newline at end of file
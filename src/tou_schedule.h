@@ -0,0 +1,378 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// ════════════════════════════════════════════════════════════════
+// TIME-OF-USE RELAY SCHEDULE
+// Weekly ON windows plus per-date exceptions, evaluated in local time
+// (fixed UTC offset - Vietnam has no DST). Every rule is one packed
+// 32-bit word. The next state change is precomputed, so update() is a
+// single compare until that instant; the scan only runs at a
+// transition, on a rule change or when the clock jumps back.
+// Pure logic: the caller passes UTC seconds (SNTP / RTC or a virtual
+// clock), so it keeps running offline once the time was set.
+// ════════════════════════════════════════════════════════════════
+
+namespace Tou
+{
+    const uint16_t MINUTES_PER_DAY = 1440;
+    const char DAY_LETTERS[8] = "MTWTFSS";      // Monday first
+    const uint32_t CLOCK_STEP_BACK_S = 60;      // Larger backwards jump = clock reset, force an edge
+
+    // Rule word: bits 0-6 weekdays (bit0 = Monday), 7-17 start minute,
+    // 18-28 end minute. end < start wraps past midnight (the weekday
+    // refers to the start day).
+    inline uint32_t packRule(uint8_t days, uint16_t start_min, uint16_t end_min)
+    {
+        return (uint32_t)(days & 0x7F) | ((uint32_t)start_min << 7) | ((uint32_t)end_min << 18);
+    }
+    inline uint8_t ruleDays(uint32_t r) { return r & 0x7F; }
+    inline uint16_t ruleStart(uint32_t r) { return (r >> 7) & 0x7FF; }
+    inline uint16_t ruleEnd(uint32_t r) { return (r >> 18) & 0x7FF; }
+
+    // Exception word: bits 0-15 local day number (days since 1970-01-01),
+    // bit 16 = relay ON all day (else OFF all day)
+    inline uint32_t packException(uint16_t day, bool on)
+    {
+        return (uint32_t)day | (on ? 0x10000UL : 0);
+    }
+    inline uint16_t exceptionDay(uint32_t e) { return e & 0xFFFF; }
+    inline bool exceptionOn(uint32_t e) { return (e >> 16) & 1; }
+
+    // Civil date → days since 1970-01-01 (H. Hinnant's days_from_civil)
+    inline int32_t daysFromCivil(int32_t y, uint32_t m, uint32_t d)
+    {
+        y -= m <= 2;
+        int32_t era = (y >= 0 ? y : y - 399) / 400;
+        uint32_t yoe = (uint32_t)(y - era * 400);
+        uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + (int32_t)doe - 719468;
+    }
+
+    // Gregorian leap years (2100 is not one)
+    inline uint8_t daysInMonth(int32_t y, uint32_t m)
+    {
+        static const uint8_t DAYS[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        if (m == 2 && (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0))) return 29;
+        return DAYS[m - 1];
+    }
+
+    // 0 = Monday (1970-01-01 was a Thursday)
+    inline uint8_t weekday(int32_t day) { return (uint8_t)((day % 7 + 7 + 3) % 7); }
+
+    enum Edge : uint8_t {
+        EDGE_NONE = 0,
+        EDGE_OFF,
+        EDGE_ON
+    };
+
+    template <uint8_t MAX_RULES, uint8_t MAX_EXCEPTIONS>
+    class Schedule
+    {
+    public:
+        // Words needed by serialize(): header + rules + exceptions
+        static const uint8_t MAX_WORDS = 1 + MAX_RULES + MAX_EXCEPTIONS;
+
+        explicit Schedule(int16_t utc_offset_min) : offsetMin_(utc_offset_min) {}
+
+        void clear()
+        {
+            ruleCount_ = 0;
+            exceptionCount_ = 0;
+            dirty_ = true;
+            changed_ = true;
+        }
+
+        bool addRule(uint8_t days, uint16_t start_min, uint16_t end_min)
+        {
+            if (ruleCount_ >= MAX_RULES || (days & 0x7F) == 0) return false;
+            if (start_min >= MINUTES_PER_DAY || end_min >= MINUTES_PER_DAY || start_min == end_min) return false;
+            rules_[ruleCount_++] = packRule(days, start_min, end_min);
+            dirty_ = true;
+            changed_ = true;
+            return true;
+        }
+
+        bool addException(int32_t day, bool on)
+        {
+            if (exceptionCount_ >= MAX_EXCEPTIONS || day < 0 || day > 0xFFFF) return false;
+            exceptions_[exceptionCount_++] = packException((uint16_t)day, on);
+            dirty_ = true;
+            changed_ = true;
+            return true;
+        }
+
+        // Text form, tokens separated by ';' (or newline):
+        //   MTWTF--/22:00-06:00   weekly ON window ('-' = day excluded)
+        //   2026-09-02=OFF        date exception (ON or OFF all day)
+        // Empty text clears the schedule. Nothing changes on a parse error.
+        bool parse(const char *text)
+        {
+            Schedule next(offsetMin_);
+            char token[32];
+            const char *p = text;
+
+            while (*p) {
+                size_t len = strcspn(p, ";\n");
+                if (len >= sizeof(token)) return false;
+                memcpy(token, p, len);
+                token[len] = '\0';
+                p += len;
+                if (*p) p++;
+
+                char *t = token;
+                while (*t == ' ' || *t == '\r') t++;
+                if (*t == '\0') continue;
+                if (!next.parseToken(t)) return false;
+            }
+
+            // Same rules again (retained set topic on reconnect): keep the
+            // primed state, no forced edge
+            if (next.sameRules(*this)) return true;
+
+            next.dirty_ = true;
+            next.changed_ = true;
+            *this = next;
+            return true;
+        }
+
+        size_t format(char *buf, size_t size) const
+        {
+            if (size == 0) return 0;
+            size_t len = 0;
+            buf[0] = '\0';
+            for (uint8_t i = 0; i < ruleCount_ + exceptionCount_; i++) {
+                char token[32];
+                if (i < ruleCount_) {
+                    uint32_t r = rules_[i];
+                    char days[8];
+                    for (uint8_t d = 0; d < 7; d++) {
+                        days[d] = (ruleDays(r) >> d) & 1 ? DAY_LETTERS[d] : '-';
+                    }
+                    days[7] = '\0';
+                    snprintf(token, sizeof(token), "%s/%02u:%02u-%02u:%02u", days,
+                             ruleStart(r) / 60, ruleStart(r) % 60, ruleEnd(r) / 60, ruleEnd(r) % 60);
+                } else {
+                    uint32_t e = exceptions_[i - ruleCount_];
+                    int32_t y;
+                    uint32_t m, d;
+                    civilFromDays(exceptionDay(e), y, m, d);
+                    snprintf(token, sizeof(token), "%04d-%02u-%02u=%s", (int)y, (unsigned)m, (unsigned)d,
+                             exceptionOn(e) ? "ON" : "OFF");
+                }
+                int n = snprintf(buf + len, size - len, "%s%s", i ? ";" : "", token);
+                if (n < 0 || len + n >= size) break;
+                len += n;
+            }
+            return len;
+        }
+
+        // Packed storage: word 0 = rule count | exception count << 8
+        uint8_t serialize(uint32_t *words) const
+        {
+            words[0] = ruleCount_ | ((uint32_t)exceptionCount_ << 8);
+            memcpy(words + 1, rules_, ruleCount_ * sizeof(uint32_t));
+            memcpy(words + 1 + ruleCount_, exceptions_, exceptionCount_ * sizeof(uint32_t));
+            return 1 + ruleCount_ + exceptionCount_;
+        }
+
+        bool deserialize(const uint32_t *words, uint8_t count)
+        {
+            if (count == 0) return false;
+            uint8_t rules = words[0] & 0xFF;
+            uint8_t exceptions = (words[0] >> 8) & 0xFF;
+            if (rules > MAX_RULES || exceptions > MAX_EXCEPTIONS || count != 1 + rules + exceptions) {
+                return false;
+            }
+            memcpy(rules_, words + 1, rules * sizeof(uint32_t));
+            memcpy(exceptions_, words + 1 + rules, exceptions * sizeof(uint32_t));
+            ruleCount_ = rules;
+            exceptionCount_ = exceptions;
+            dirty_ = true;
+            return true;
+        }
+
+        // Desired relay state at a local minute (minutes since epoch)
+        bool desiredAt(int32_t local_min) const
+        {
+            int32_t day = floorDiv(local_min, MINUTES_PER_DAY);
+            uint16_t minute = (uint16_t)(local_min - day * MINUTES_PER_DAY);
+
+            for (uint8_t i = 0; i < exceptionCount_; i++) {
+                if (exceptionDay(exceptions_[i]) == day) return exceptionOn(exceptions_[i]);
+            }
+
+            uint8_t today = 1 << weekday(day);
+            uint8_t yesterday = 1 << weekday(day - 1);
+            for (uint8_t i = 0; i < ruleCount_; i++) {
+                uint32_t r = rules_[i];
+                uint16_t start = ruleStart(r), end = ruleEnd(r);
+                if (start < end) {
+                    if ((ruleDays(r) & today) && minute >= start && minute < end) return true;
+                } else {
+                    if ((ruleDays(r) & today) && minute >= start) return true;
+                    if ((ruleDays(r) & yesterday) && minute < end) return true;
+                }
+            }
+            return false;
+        }
+
+        // Call every tick with UTC seconds. Returns an edge when the
+        // schedule changes state, and once after a rule change or a
+        // backwards clock jump of more than CLOCK_STEP_BACK_S so the
+        // relay follows the current window. SNTP slews of a second or
+        // so only rescan; they don't undo a manual command.
+        // The first call (first valid time after boot, rules from NVS)
+        // only primes the state: the relay state restored at boot stays
+        // until the next real transition. Between edges manual commands
+        // are left alone.
+        uint8_t update(uint32_t utc_s)
+        {
+            if (!dirty_ && utc_s >= lastUtc_ && utc_s < nextUtc_) {
+                lastUtc_ = utc_s;
+                return EDGE_NONE;
+            }
+
+            bool force = changed_ || utc_s + CLOCK_STEP_BACK_S < lastUtc_;
+            bool first = !primed_;
+            int32_t now_min = localMinute(utc_s);
+            bool state = desiredAt(now_min);
+            int32_t next_min = nextTransition(now_min, state);
+            nextUtc_ = (uint32_t)((int64_t)next_min * 60 - offsetMin_ * 60);
+            lastUtc_ = utc_s;
+            dirty_ = false;
+            changed_ = false;
+            primed_ = true;
+            evaluations_++;
+
+            bool edge = force || (!first && state != state_);
+            state_ = state;
+            if (!edge) return EDGE_NONE;
+            if (ruleCount_ == 0 && exceptionCount_ == 0) return EDGE_NONE;
+            return state ? EDGE_ON : EDGE_OFF;
+        }
+
+        bool state() const { return state_; }
+        uint32_t nextTransitionUtc() const { return nextUtc_; }
+        uint8_t ruleCount() const { return ruleCount_; }
+        uint8_t exceptionCount() const { return exceptionCount_; }
+        uint32_t evaluations() const { return evaluations_; }  // Full scans (not ticks)
+        int32_t localMinute(uint32_t utc_s) const
+        {
+            return (int32_t)(((int64_t)utc_s + offsetMin_ * 60) / 60);
+        }
+
+    private:
+        int16_t offsetMin_;
+        uint32_t rules_[MAX_RULES];
+        uint32_t exceptions_[MAX_EXCEPTIONS];
+        uint8_t ruleCount_ = 0;
+        uint8_t exceptionCount_ = 0;
+
+        bool dirty_ = true;             // Recompute the next transition
+        bool changed_ = false;          // Rules edited: edge on the next update
+        bool primed_ = false;
+        bool state_ = false;
+        uint32_t lastUtc_ = 0;
+        uint32_t nextUtc_ = 0;
+        uint32_t evaluations_ = 0;
+
+        bool sameRules(const Schedule &other) const
+        {
+            return ruleCount_ == other.ruleCount_ && exceptionCount_ == other.exceptionCount_ &&
+                   memcmp(rules_, other.rules_, ruleCount_ * sizeof(uint32_t)) == 0 &&
+                   memcmp(exceptions_, other.exceptions_, exceptionCount_ * sizeof(uint32_t)) == 0;
+        }
+
+        static int32_t floorDiv(int32_t a, int32_t b)
+        {
+            int32_t q = a / b;
+            return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+        }
+
+        static void civilFromDays(int32_t z, int32_t &y, uint32_t &m, uint32_t &d)
+        {
+            z += 719468;
+            int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+            uint32_t doe = (uint32_t)(z - era * 146097);
+            uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+            uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+            uint32_t mp = (5 * doy + 2) / 153;
+            d = doy - (153 * mp + 2) / 5 + 1;
+            m = mp < 10 ? mp + 3 : mp - 9;
+            y = (int32_t)yoe + era * 400 + (m <= 2);
+        }
+
+        // State only changes at midnight or a rule start/end, so the first
+        // such candidate within a week where the state differs is the next
+        // transition. With no change in a week, re-check in a day.
+        int32_t nextTransition(int32_t now_min, bool state) const
+        {
+            const int32_t NONE = 0x7FFFFFFF;
+            int32_t today = floorDiv(now_min, MINUTES_PER_DAY);
+            int32_t best = NONE;
+
+            for (int32_t day = today; day <= today + 7; day++) {
+                int32_t base = day * MINUTES_PER_DAY;
+                consider(base, now_min, state, best);
+                for (uint8_t i = 0; i < ruleCount_; i++) {
+                    consider(base + ruleStart(rules_[i]), now_min, state, best);
+                    consider(base + ruleEnd(rules_[i]), now_min, state, best);
+                }
+                if (best < base + MINUTES_PER_DAY) break;   // Later days can't be earlier
+            }
+            return best == NONE ? now_min + MINUTES_PER_DAY : best;
+        }
+
+        void consider(int32_t candidate, int32_t now_min, bool state, int32_t &best) const
+        {
+            if (candidate > now_min && candidate < best && desiredAt(candidate) != state) {
+                best = candidate;
+            }
+        }
+
+        static bool parseTime(const char *s, uint16_t &minutes)
+        {
+            char *end;
+            long h = strtol(s, &end, 10);
+            if (end == s || *end != ':' || h < 0 || h > 23) return false;
+            const char *ms = end + 1;
+            long m = strtol(ms, &end, 10);
+            if (end - ms != 2 || m < 0 || m > 59) return false;
+            minutes = (uint16_t)(h * 60 + m);
+            return true;
+        }
+
+        bool parseToken(const char *t)
+        {
+            // 2026-09-02=OFF
+            int y, m, d, n = 0;
+            char action[4];
+            if (sscanf(t, "%4d-%2d-%2d=%3s%n", &y, &m, &d, action, &n) == 4) {
+                if (t[n] != '\0' || m < 1 || m > 12 || d < 1 || d > daysInMonth(y, m)) return false;
+                bool on = strcmp(action, "ON") == 0;
+                if (!on && strcmp(action, "OFF") != 0) return false;
+                return addException(daysFromCivil(y, m, d), on);
+            }
+
+            // MTWTF--/22:00-06:00
+            if (strlen(t) < 19 || t[7] != '/' || t[13] != '-') return false;
+            uint8_t days = 0;
+            for (uint8_t i = 0; i < 7; i++) {
+                if (t[i] == DAY_LETTERS[i]) days |= 1 << i;
+                else if (t[i] != '-') return false;
+            }
+            char start[6], end[6];
+            memcpy(start, t + 8, 5);
+            start[5] = '\0';
+            memcpy(end, t + 14, 5);
+            end[5] = '\0';
+            uint16_t start_min, end_min;
+            if (t[19] != '\0' || !parseTime(start, start_min) || !parseTime(end, end_min)) return false;
+            return addRule(days, start_min, end_min);
+        }
+    };
+}
@@ -0,0 +1,341 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "protection.h"
+
+// ════════════════════════════════════════════════════════════════
+// SENSOR / COMMAND TRACE
+// Compact binary log of what the relay logic consumed: every PZEM
+// sample, SHT31 readings, inbound MQTT commands and the points where
+// timed checks ran, so a host replayer can feed the exact sequence
+// back with a virtual clock.
+//
+// Stream: "TRC1" + u32 start_ms, then records
+//   [type][dt_ms: zigzag varint, relative to the previous record][body]
+//   POWER    [mask][changed floats]   mask bit i = field i stored
+//                                     (v, i, p, e, f, pf), bit 6 valid,
+//                                     bit 7 alarm; unchanged fields are
+//                                     copied from the previous sample
+//   CLIMATE  [t f32][h f32]
+//   COMMAND  [target][len][payload]
+//   CHECK    [check id]
+//   GAP      [u16 records lost]       next POWER is stored in full
+// Floats are raw little-endian bits, so NaN and rounding replay exactly.
+// The PZEM refreshes about once per second, so most 200ms samples are
+// 3-byte repeats.
+// ════════════════════════════════════════════════════════════════
+
+namespace Trace
+{
+    enum Type : uint8_t {
+        TYPE_POWER = 1,
+        TYPE_CLIMATE,
+        TYPE_COMMAND,
+        TYPE_CHECK,
+        TYPE_GAP
+    };
+
+    enum Check : uint8_t {
+        CHECK_TEMPERATURE = 1           // checkTemperatureProtection()
+    };
+
+    const uint8_t MAGIC[4] = {'T', 'R', 'C', '1'};
+    const uint8_t HEADER_SIZE = 8;
+    const uint8_t PAYLOAD_MAX = 96;     // Longer command payloads are truncated
+    const uint8_t FIELDS = 6;
+    const uint8_t MASK_VALID = 0x40;
+    const uint8_t MASK_ALARM = 0x80;
+    const uint8_t RECORD_MAX = 2 + 5 + 2 + PAYLOAD_MAX;
+
+    struct Record {
+        uint8_t type = 0;
+        uint32_t ms = 0;
+        PowerSample sample;             // POWER
+        float temperature = NAN;        // CLIMATE
+        float humidity = NAN;
+        uint8_t id = 0;                 // COMMAND target / CHECK id
+        char payload[PAYLOAD_MAX + 1] = {0};
+        uint16_t lost = 0;              // GAP
+    };
+
+    inline void fields(const PowerSample &s, float *out)
+    {
+        out[0] = s.voltage;
+        out[1] = s.current;
+        out[2] = s.power;
+        out[3] = s.energy;
+        out[4] = s.frequency;
+        out[5] = s.pf;
+    }
+
+    inline void setFields(PowerSample &s, const float *in)
+    {
+        s.voltage = in[0];
+        s.current = in[1];
+        s.power = in[2];
+        s.energy = in[3];
+        s.frequency = in[4];
+        s.pf = in[5];
+    }
+
+    // Records into a RAM buffer; the caller drains it to serial / flash.
+    // Not thread safe: the caller serializes writers and read().
+    template <uint16_t SIZE>
+    class Writer
+    {
+    public:
+        void begin(uint32_t now_ms)
+        {
+            len_ = 0;
+            records_ = 0;
+            lost_ = 0;
+            pendingLost_ = 0;
+            lastMs_ = now_ms;
+            havePower_ = false;
+            memcpy(buf_, MAGIC, 4);
+            put32(buf_ + 4, now_ms);
+            len_ = HEADER_SIZE;
+        }
+
+        void power(const PowerSample &s)
+        {
+            uint8_t rec[RECORD_MAX];
+            float now[FIELDS];
+            if (pendingLost_) havePower_ = false;   // Follows a GAP: store in full
+            fields(s, now);
+            uint8_t mask = (s.valid ? MASK_VALID : 0) | (s.powerAlarm ? MASK_ALARM : 0);
+            uint8_t n = 0;
+            rec[n++] = 0;                       // Mask, filled below
+            for (uint8_t i = 0; i < FIELDS; i++) {
+                if (havePower_ && memcmp(&now[i], &lastPower_[i], 4) == 0) continue;
+                mask |= 1 << i;
+                put32(rec + n, bits(now[i]));
+                n += 4;
+            }
+            rec[0] = mask;
+            if (emit(TYPE_POWER, s.ms, rec, n)) {
+                memcpy(lastPower_, now, sizeof(now));
+                havePower_ = true;
+            }
+        }
+
+        void climate(uint32_t now_ms, float temperature, float humidity)
+        {
+            uint8_t rec[8];
+            put32(rec, bits(temperature));
+            put32(rec + 4, bits(humidity));
+            emit(TYPE_CLIMATE, now_ms, rec, 8);
+        }
+
+        void command(uint32_t now_ms, uint8_t target, const char *payload)
+        {
+            uint8_t rec[2 + PAYLOAD_MAX];
+            size_t len = strlen(payload);
+            if (len > PAYLOAD_MAX) len = PAYLOAD_MAX;
+            rec[0] = target;
+            rec[1] = (uint8_t)len;
+            memcpy(rec + 2, payload, len);
+            emit(TYPE_COMMAND, now_ms, rec, 2 + len);
+        }
+
+        void check(uint32_t now_ms, uint8_t id) { emit(TYPE_CHECK, now_ms, &id, 1); }
+
+        // Move up to max bytes out of the buffer (oldest first)
+        size_t read(uint8_t *out, size_t max)
+        {
+            size_t n = len_ < max ? len_ : max;
+            memcpy(out, buf_, n);
+            memmove(buf_, buf_ + n, len_ - n);
+            len_ -= n;
+            return n;
+        }
+
+        uint16_t pending() const { return len_; }
+        uint32_t records() const { return records_; }
+        uint32_t lost() const { return lost_; }
+
+    private:
+        uint8_t buf_[SIZE];
+        uint16_t len_ = 0;
+        uint32_t lastMs_ = 0;
+        uint32_t records_ = 0;
+        uint32_t lost_ = 0;
+        uint16_t pendingLost_ = 0;      // Not yet reported by a GAP record
+        float lastPower_[FIELDS];
+        bool havePower_ = false;
+
+        static uint32_t bits(float f)
+        {
+            uint32_t u;
+            memcpy(&u, &f, 4);
+            return u;
+        }
+
+        static void put32(uint8_t *p, uint32_t v)
+        {
+            for (uint8_t i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+        }
+
+        bool append(uint8_t type, uint32_t now_ms, const uint8_t *body, size_t len)
+        {
+            uint8_t head[6];
+            uint8_t n = 0;
+            head[n++] = type;
+            int32_t dt = (int32_t)(now_ms - lastMs_);
+            uint32_t z = ((uint32_t)dt << 1) ^ (uint32_t)(dt >> 31);
+            do {
+                uint8_t b = z & 0x7F;
+                z >>= 7;
+                head[n++] = z ? (b | 0x80) : b;
+            } while (z);
+            if (len_ + n + len > SIZE) return false;
+            memcpy(buf_ + len_, head, n);
+            memcpy(buf_ + len_ + n, body, len);
+            len_ += n + len;
+            lastMs_ = now_ms;
+            records_++;
+            return true;
+        }
+
+        bool emit(uint8_t type, uint32_t now_ms, const uint8_t *body, size_t len)
+        {
+            if (pendingLost_) {
+                uint8_t gap[2] = {(uint8_t)pendingLost_, (uint8_t)(pendingLost_ >> 8)};
+                if (!append(TYPE_GAP, now_ms, gap, 2)) return drop();
+                pendingLost_ = 0;
+            }
+            return append(type, now_ms, body, len) || drop();
+        }
+
+        bool drop()
+        {
+            lost_++;
+            if (pendingLost_ < 0xFFFF) pendingLost_++;
+            return false;
+        }
+    };
+
+    // Walks a captured stream; a new header restarts the time base
+    class Reader
+    {
+    public:
+        Reader(const uint8_t *data, size_t len) : data_(data), len_(len) {}
+
+        bool next(Record &r)
+        {
+            for (;;) {
+                if (pos_ + HEADER_SIZE <= len_ && memcmp(data_ + pos_, MAGIC, 4) == 0) {
+                    lastMs_ = get32(data_ + pos_ + 4);
+                    havePower_ = false;
+                    pos_ += HEADER_SIZE;
+                    sessions_++;
+                    continue;
+                }
+                if (pos_ >= len_) return false;
+                if (!sessions_) return fail();
+
+                size_t p = pos_;
+                r.type = data_[p++];
+                uint32_t z = 0;
+                for (uint8_t shift = 0;; shift += 7) {
+                    if (p >= len_ || shift > 28) return fail();
+                    uint8_t b = data_[p++];
+                    z |= (uint32_t)(b & 0x7F) << shift;
+                    if (!(b & 0x80)) break;
+                }
+                int32_t dt = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+                r.ms = lastMs_ + (uint32_t)dt;
+
+                switch (r.type) {
+                case TYPE_POWER: {
+                    if (p >= len_) return fail();
+                    uint8_t mask = data_[p++];
+                    float v[FIELDS];
+                    for (uint8_t i = 0; i < FIELDS; i++) {
+                        if (mask & (1 << i)) {
+                            if (p + 4 > len_) return fail();
+                            v[i] = getFloat(data_ + p);
+                            p += 4;
+                        } else if (havePower_) {
+                            v[i] = lastPower_[i];
+                        } else {
+                            return fail();
+                        }
+                    }
+                    memcpy(lastPower_, v, sizeof(v));
+                    havePower_ = true;
+                    r.sample = PowerSample();
+                    setFields(r.sample, v);
+                    r.sample.ms = r.ms;
+                    r.sample.valid = mask & MASK_VALID;
+                    r.sample.powerAlarm = mask & MASK_ALARM;
+                    break;
+                }
+                case TYPE_CLIMATE:
+                    if (p + 8 > len_) return fail();
+                    r.temperature = getFloat(data_ + p);
+                    r.humidity = getFloat(data_ + p + 4);
+                    p += 8;
+                    break;
+                case TYPE_COMMAND: {
+                    if (p + 2 > len_ || p + 2 + data_[p + 1] > len_) return fail();
+                    r.id = data_[p];
+                    uint8_t n = data_[p + 1];
+                    memcpy(r.payload, data_ + p + 2, n);
+                    r.payload[n] = '\0';
+                    p += 2 + n;
+                    break;
+                }
+                case TYPE_CHECK:
+                    if (p + 1 > len_) return fail();
+                    r.id = data_[p++];
+                    break;
+                case TYPE_GAP:
+                    if (p + 2 > len_) return fail();
+                    r.lost = (uint16_t)(data_[p] | data_[p + 1] << 8);
+                    p += 2;
+                    havePower_ = false;
+                    break;
+                default:
+                    return fail();
+                }
+                pos_ = p;
+                lastMs_ = r.ms;
+                return true;
+            }
+        }
+
+        bool error() const { return error_; }
+        size_t offset() const { return pos_; }
+        uint32_t sessions() const { return sessions_; }
+
+    private:
+        const uint8_t *data_;
+        size_t len_;
+        size_t pos_ = 0;
+        uint32_t lastMs_ = 0;
+        uint32_t sessions_ = 0;
+        bool error_ = false;
+        float lastPower_[FIELDS];
+        bool havePower_ = false;
+
+        bool fail()
+        {
+            error_ = true;
+            return false;
+        }
+
+        static uint32_t get32(const uint8_t *p)
+        {
+            return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+        }
+
+        static float getFloat(const uint8_t *p)
+        {
+            uint32_t u = get32(p);
+            float f;
+            memcpy(&f, &u, 4);
+            return f;
+        }
+    };
+}
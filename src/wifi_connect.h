@@ -60,32 +60,27 @@ inline void setup_wifi(const char *SSID, const char *PASS)
     Serial.println(WiFi.localIP());
 }
 
+// Called by the scheduler every WIFI_CHECK_INTERVAL. Non-blocking: a
+// reconnect is kicked off here and its outcome reported on the next check.
 inline void checkWiFiConnection()
 {
-    static unsigned long lastCheck = 0;
+    static bool reconnecting = false;
     
-    if (millis() - lastCheck > 30000) {  // Check mỗi 30s
-        lastCheck = millis();
-        
-        if (WiFi.status() != WL_CONNECTED) {
-            Serial.println("WiFi disconnected! Reconnecting...");
-            WiFi.reconnect();
-            
-            // Wait max 10 seconds
-            int timeout = 0;
-            while (WiFi.status() != WL_CONNECTED && timeout < 20) {
-                delay(500);
-                Serial.print(".");
-                timeout++;
-            }
-            
-            if (WiFi.status() == WL_CONNECTED) {
-                Serial.println("\nWiFi reconnected!");
-                Serial.printf("IP: %s, RSSI: %ddBm\n", 
-                             WiFi.localIP().toString().c_str(), WiFi.RSSI());
-            } else {
-                Serial.println("\nWiFi reconnect failed!");
-            }
+    if (WiFi.status() == WL_CONNECTED) {
+        if (reconnecting) {
+            reconnecting = false;
+            Serial.println("WiFi reconnected!");
+            Serial.printf("IP: %s, RSSI: %ddBm\n", 
+                         WiFi.localIP().toString().c_str(), WiFi.RSSI());
         }
+        return;
     }
+    
+    if (reconnecting) {
+        Serial.println("WiFi reconnect failed! Retrying...");
+    } else {
+        Serial.println("WiFi disconnected! Reconnecting...");
+    }
+    WiFi.reconnect();
+    reconnecting = true;
 }
\ No newline at end of file
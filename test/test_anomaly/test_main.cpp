@@ -0,0 +1,155 @@
+// Per-hour EWMA anomaly baselines (src/anomaly.h) - pio test -e native
+#include <unity.h>
+#include "../../src/config.h"
+#include "../../src/anomaly.h"
+
+const uint8_t METRIC_POWER = 0;
+const uint8_t METRIC_TEMP = 1;
+const float MIN_SD[] = {ANOMALY_MIN_SD_POWER, ANOMALY_MIN_SD_TEMP};
+const Anomaly::Config CONFIG = {ANOMALY_ALPHA, ANOMALY_THRESHOLD, ANOMALY_CLEAR_RATIO, ANOMALY_WARMUP};
+
+// Deterministic noise, roughly N(0, 1) (sum of 12 uniforms)
+uint32_t rng = 12345;
+float noise()
+{
+    float sum = 0.0f;
+    for (uint8_t i = 0; i < 12; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        sum += (rng >> 8) / 16777216.0f;
+    }
+    return sum - 6.0f;
+}
+
+struct Window {
+    uint8_t metric;
+    uint32_t from;                  // Minute of the run
+    uint32_t to;
+};
+
+struct Outcome {
+    uint16_t starts;
+    uint16_t ends;
+    uint16_t caught[2];             // Starts inside each injected window
+    uint16_t falsePositives;
+    uint32_t endedAt[2];
+};
+
+// 20 days of 1 min aggregates: base load + evening / morning peaks with
+// noise, temperature with a daily swing. Injected: +1.5 kW for 30 min
+// at 03:00 on day 15, +3 °C for 100 min at 10:00 on day 17.
+Outcome run(Anomaly::Detector<2> &d, bool inject)
+{
+    const Window INJECTED[2] = {
+        {METRIC_POWER, 15 * 1440 + 180, 15 * 1440 + 210},
+        {METRIC_TEMP, 17 * 1440 + 600, 17 * 1440 + 700},
+    };
+    Outcome out = {};
+    rng = 12345;
+
+    for (uint32_t minute = 0; minute < 20 * 1440; minute++) {
+        uint32_t of_day = minute % 1440;
+        uint8_t hour = of_day / 60;
+        float power = 200.0f + (hour >= 18 && hour < 22 ? 1200.0f : 0.0f) +
+                      (hour >= 6 && hour < 8 ? 600.0f : 0.0f) + noise() * 40.0f;
+        float temp = 28.0f + 3.0f * sinf((of_day / 1440.0f - 0.3f) * 6.2832f) + noise() * 0.2f;
+        if (inject && minute >= INJECTED[0].from && minute < INJECTED[0].to) power += 1500.0f;
+        if (inject && minute >= INJECTED[1].from && minute < INJECTED[1].to) temp += 3.0f;
+
+        const float values[2] = {power, temp};
+        for (uint8_t m = 0; m < 2; m++) {
+            Anomaly::Event ev;
+            if (!d.add(m, hour, values[m], ev)) continue;
+            TEST_ASSERT_EQUAL_UINT8(m, ev.metric);
+            TEST_ASSERT_EQUAL_UINT8(hour, ev.hour);
+            if (ev.type == Anomaly::EVENT_END) {
+                out.ends++;
+                out.endedAt[m] = minute;
+                continue;
+            }
+            out.starts++;
+            TEST_ASSERT_GREATER_OR_EQUAL(ANOMALY_THRESHOLD, ev.score);
+            const Window &w = INJECTED[m];
+            if (inject && minute >= w.from && minute < w.to) out.caught[m]++;
+            else out.falsePositives++;
+        }
+    }
+    return out;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_synthetic_run_catches_both_anomalies()
+{
+    Anomaly::Detector<2> d(CONFIG, MIN_SD);
+    Outcome out = run(d, true);
+    TEST_ASSERT_EQUAL_UINT16(1, out.caught[METRIC_POWER]);
+    TEST_ASSERT_GREATER_OR_EQUAL(1, out.caught[METRIC_TEMP]);   // Absorbed in 10:00, flagged again at 11:00
+    TEST_ASSERT_EQUAL_UINT16(0, out.falsePositives);
+
+    // Start / end pairs, all ended shortly after the injection
+    TEST_ASSERT_EQUAL_UINT16(out.starts, out.ends);
+    TEST_ASSERT_LESS_THAN(15 * 1440 + 240, out.endedAt[METRIC_POWER]);
+    TEST_ASSERT_LESS_THAN(17 * 1440 + 760, out.endedAt[METRIC_TEMP]);
+    TEST_ASSERT_FALSE(d.active(METRIC_POWER));
+    TEST_ASSERT_FALSE(d.active(METRIC_TEMP));
+}
+
+void test_normal_days_stay_quiet()
+{
+    Anomaly::Detector<2> d(CONFIG, MIN_SD);
+    Outcome out = run(d, false);
+    TEST_ASSERT_EQUAL_UINT16(0, out.starts);
+}
+
+// Same power judged against its own hour: evening peak is normal at
+// 19:00 and an anomaly at 03:00
+void test_baselines_are_per_hour()
+{
+    Anomaly::Detector<2> d(CONFIG, MIN_SD);
+    Anomaly::Event ev;
+    for (uint16_t i = 0; i < ANOMALY_WARMUP; i++) {
+        d.add(METRIC_POWER, 19, 1400.0f + (i % 5) * 10.0f, ev);
+        d.add(METRIC_POWER, 3, 200.0f + (i % 5) * 10.0f, ev);
+    }
+    TEST_ASSERT_FALSE(d.add(METRIC_POWER, 19, 1420.0f, ev));
+    TEST_ASSERT_TRUE(d.add(METRIC_POWER, 3, 1420.0f, ev));
+    TEST_ASSERT_EQUAL_UINT8(Anomaly::EVENT_START, ev.type);
+    TEST_ASSERT_TRUE(d.active(METRIC_POWER));
+}
+
+// No scoring before the warm-up of an hour slot
+void test_warmup()
+{
+    Anomaly::Detector<2> d(CONFIG, MIN_SD);
+    Anomaly::Event ev;
+    for (uint16_t i = 0; i < ANOMALY_WARMUP - 1; i++) d.add(METRIC_TEMP, 12, 28.0f, ev);
+    TEST_ASSERT_FALSE(d.add(METRIC_TEMP, 12, 40.0f, ev));
+}
+
+void test_model_restore()
+{
+    Anomaly::Detector<2> trained(CONFIG, MIN_SD);
+    run(trained, false);
+    Anomaly::Model<2> saved = trained.model();
+
+    Anomaly::Detector<2> rebooted(CONFIG, MIN_SD);
+    TEST_ASSERT_TRUE(rebooted.restore(saved));
+    Anomaly::Event ev;
+    TEST_ASSERT_TRUE(rebooted.add(METRIC_POWER, 3, 1700.0f, ev));        // Scored at once
+    saved.magic = 0;
+    TEST_ASSERT_FALSE(rebooted.restore(saved));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_synthetic_run_catches_both_anomalies);
+    RUN_TEST(test_normal_days_stay_quiet);
+    RUN_TEST(test_baselines_are_per_hour);
+    RUN_TEST(test_warmup);
+    RUN_TEST(test_model_restore);
+    return UNITY_END();
+}
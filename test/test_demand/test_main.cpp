@@ -0,0 +1,214 @@
+// Demand limiting / load shedding (src/demand.h) - pio test -e native
+#include <unity.h>
+#include "../../src/demand.h"
+
+typedef Demand::Manager<4, 60> Manager;
+
+const float LIMIT_W = 3500.0f;
+const float HYSTERESIS_W = 200.0f;
+const uint32_t SAMPLE_MS = 1000;
+const uint32_t SETTLE_MS = 5000;
+const uint32_t MIN_ON_MS = 60000;
+const uint32_t MIN_OFF_MS = 120000;
+
+// Outputs by pin: relay state as written through the apply hook
+const float LOAD_W[4] = {1500.0f, 1000.0f, 500.0f, 100.0f};
+bool relay[4];
+float baseW = 0.0f;
+
+void apply(const Demand::Output &output, bool on)
+{
+    relay[output.cfg.pin] = on;
+}
+
+// Measured power: base load plus every output whose relay is on
+float housePower()
+{
+    float p = baseW;
+    for (uint8_t i = 0; i < 4; i++) {
+        if (relay[i]) p += LOAD_W[i];
+    }
+    return p;
+}
+
+// Virtual clock
+uint32_t nowMs = 0;
+Demand::Event events[16];
+uint32_t eventMs[16];
+uint8_t eventCount = 0;
+
+void run(Manager &m, uint32_t duration_ms)
+{
+    for (uint32_t end = nowMs + duration_ms; nowMs < end;) {
+        nowMs += SAMPLE_MS;
+        Demand::Event ev;
+        if (m.tick(nowMs, housePower(), ev) && eventCount < 16) {
+            eventMs[eventCount] = nowMs;
+            events[eventCount++] = ev;
+        }
+    }
+}
+
+void addOutputs(Manager &m)
+{
+    m.add(Demand::OutputConfig{"heater", 0, 3, LOAD_W[0], MIN_ON_MS, MIN_OFF_MS});
+    m.add(Demand::OutputConfig{"ac", 1, 2, LOAD_W[1], MIN_ON_MS, MIN_OFF_MS});
+    m.add(Demand::OutputConfig{"pump", 2, 1, LOAD_W[2], MIN_ON_MS, MIN_OFF_MS});
+    m.add(Demand::OutputConfig{"fridge", 3, 0, LOAD_W[3], MIN_ON_MS, MIN_OFF_MS});   // Critical
+}
+
+// Heater, AC, pump, fridge, one settle period apart so each output
+// learns its own step; returns when the heater went on
+uint32_t switchAllOn(Manager &m)
+{
+    uint32_t heaterMs = nowMs;
+    for (uint8_t i = 0; i < 4; i++) {
+        m.request(i, true, nowMs);
+        run(m, SETTLE_MS + SAMPLE_MS);
+    }
+    return heaterMs;
+}
+
+void setUp()
+{
+    for (uint8_t i = 0; i < 4; i++) relay[i] = false;
+    baseW = 0.0f;
+    nowMs = 0;
+    eventCount = 0;
+}
+
+void tearDown() {}
+
+// Right after a switch the rolling average still lags; the projection
+// already includes the whole new load
+void test_projection_over_limit()
+{
+    Manager m(2000.0f, HYSTERESIS_W, SAMPLE_MS, SETTLE_MS, apply);
+    m.add(Demand::OutputConfig{"heater", 0, 1, LOAD_W[0], 0, MIN_OFF_MS});
+    baseW = 1000.0f;
+    run(m, 60000);                                      // Window full at 1 kW
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 1000.0f, m.demandW());
+
+    m.request(0, true, nowMs);
+    TEST_ASSERT_TRUE(relay[0]);
+    run(m, SAMPLE_MS);
+    TEST_ASSERT_LESS_THAN(2000.0f, m.demandW());        // Average: ~1025 W
+    TEST_ASSERT_EQUAL_UINT8(1, eventCount);             // Shed on the projection
+    TEST_ASSERT_EQUAL_UINT8(Demand::ACTION_SHED, events[0].action);
+    TEST_ASSERT_GREATER_THAN(2000.0f, events[0].demandW);
+    TEST_ASSERT_FLOAT_WITHIN(50.0f, 2500.0f, events[0].demandW);
+    TEST_ASSERT_FALSE(relay[0]);
+    TEST_ASSERT_TRUE(m.output(0).shed);
+    TEST_ASSERT_TRUE(m.output(0).wanted);
+}
+
+// Over the limit from the start: nothing is shed before the minimum ON
+// time, then the lowest priority (highest number) goes first
+void test_minimum_on_time_then_priority()
+{
+    Manager m(LIMIT_W, HYSTERESIS_W, SAMPLE_MS, SETTLE_MS, apply);
+    addOutputs(m);
+    baseW = 600.0f;
+    run(m, 60000);
+    uint32_t heaterMs = switchAllOn(m);                 // Over (3600 W) from the pump on
+    TEST_ASSERT_EQUAL_UINT8(0, eventCount);
+    run(m, 120000);
+
+    TEST_ASSERT_EQUAL_UINT8(1, eventCount);
+    TEST_ASSERT_EQUAL_UINT8(Demand::ACTION_SHED, events[0].action);
+    TEST_ASSERT_EQUAL_UINT8(0, events[0].output);       // Heater, priority 3
+    TEST_ASSERT_EQUAL_UINT32(heaterMs + MIN_ON_MS, eventMs[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, LOAD_W[0], events[0].loadW);
+    TEST_ASSERT_TRUE(relay[1] && relay[2] && relay[3]);
+}
+
+// Shed heater then AC as the base load rises; restore in reverse
+// order (most important first) once it falls, after the minimum OFF
+// time and below limit - hysteresis
+void test_shed_and_restore_in_reverse_order()
+{
+    Manager m(LIMIT_W, HYSTERESIS_W, SAMPLE_MS, SETTLE_MS, apply);
+    addOutputs(m);
+    baseW = 600.0f;
+    run(m, 60000);
+    switchAllOn(m);
+    run(m, 120000);                                     // Heater shed: 2200 W
+
+    baseW = 2000.0f;                                    // 3600 W
+    run(m, 300000);
+    TEST_ASSERT_EQUAL_UINT8(2, eventCount);
+    TEST_ASSERT_EQUAL_UINT8(Demand::ACTION_SHED, events[1].action);
+    TEST_ASSERT_EQUAL_UINT8(1, events[1].output);       // AC, priority 2
+    TEST_ASSERT_TRUE(relay[2] && relay[3]);             // Pump and critical fridge stay
+
+    baseW = 0.0f;                                       // 600 W
+    uint32_t dropMs = nowMs;
+    run(m, 600000);
+    TEST_ASSERT_EQUAL_UINT8(4, eventCount);
+    TEST_ASSERT_EQUAL_UINT8(Demand::ACTION_RESTORE, events[2].action);
+    TEST_ASSERT_EQUAL_UINT8(1, events[2].output);       // AC back first
+    TEST_ASSERT_EQUAL_UINT8(Demand::ACTION_RESTORE, events[3].action);
+    TEST_ASSERT_EQUAL_UINT8(0, events[3].output);       // Then the heater
+    TEST_ASSERT_GREATER_OR_EQUAL(SETTLE_MS, eventMs[3] - eventMs[2]);
+    TEST_ASSERT_GREATER_THAN(dropMs, eventMs[2]);
+    TEST_ASSERT_LESS_OR_EQUAL(LIMIT_W - HYSTERESIS_W, events[3].demandW + events[3].loadW);
+    for (uint8_t i = 0; i < 4; i++) TEST_ASSERT_TRUE(relay[i]);
+    TEST_ASSERT_EQUAL_UINT32(1, m.output(0).sheds);
+    TEST_ASSERT_EQUAL_UINT32(1, m.output(1).sheds);
+}
+
+// A shed output isn't restored before its minimum OFF time even when
+// the load drops right away
+void test_minimum_off_time()
+{
+    Manager m(LIMIT_W, HYSTERESIS_W, SAMPLE_MS, SETTLE_MS, apply);
+    addOutputs(m);
+    baseW = 600.0f;
+    run(m, 60000);
+    switchAllOn(m);
+    run(m, MIN_ON_MS);
+    TEST_ASSERT_EQUAL_UINT8(1, eventCount);
+    uint32_t shedMs = eventMs[0];
+
+    baseW = 0.0f;
+    run(m, MIN_OFF_MS + 60000);
+    TEST_ASSERT_EQUAL_UINT8(2, eventCount);
+    TEST_ASSERT_EQUAL_UINT8(Demand::ACTION_RESTORE, events[1].action);
+    TEST_ASSERT_GREATER_OR_EQUAL(MIN_OFF_MS, eventMs[1] - shedMs);
+}
+
+// Priority 0 is never shed; OFF requests clear the shed flag and an
+// explicit request while shed waits for restore
+void test_critical_and_requests()
+{
+    Manager m(LIMIT_W, HYSTERESIS_W, SAMPLE_MS, SETTLE_MS, apply);
+    addOutputs(m);
+    baseW = 5000.0f;
+    m.request(3, true, SAMPLE_MS);
+    run(m, 300000);
+    TEST_ASSERT_EQUAL_UINT8(0, eventCount);
+    TEST_ASSERT_TRUE(relay[3]);
+
+    m.request(0, true, nowMs);
+    run(m, MIN_ON_MS + SAMPLE_MS);
+    TEST_ASSERT_TRUE(m.output(0).shed);
+    m.request(0, true, nowMs);                          // Still shed: stays off
+    TEST_ASSERT_FALSE(relay[0]);
+    m.request(0, false, nowMs);
+    TEST_ASSERT_FALSE(m.output(0).shed);
+    TEST_ASSERT_FALSE(m.output(0).wanted);
+
+    TEST_ASSERT_EQUAL_INT(2, m.find("pump"));
+    TEST_ASSERT_EQUAL_INT(-1, m.find("pum"));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_projection_over_limit);
+    RUN_TEST(test_minimum_on_time_then_priority);
+    RUN_TEST(test_shed_and_restore_in_reverse_order);
+    RUN_TEST(test_minimum_off_time);
+    RUN_TEST(test_critical_and_requests);
+    return UNITY_END();
+}
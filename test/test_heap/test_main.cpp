@@ -0,0 +1,39 @@
+// Steady-state heap gate (src/sim/sim_main.cpp) - pio test -e native_heap
+// Needs the malloc wrap of env:native_heap; under env:native it is ignored.
+#define SIM_NO_MAIN
+#include <unity.h>
+#include "../../src/sim/sim_main.cpp"
+
+void setUp() {}
+void tearDown() {}
+
+// Same run as the sim: a warm-up hour, then no allocation at all for
+// the rest of the day (Control, Screens, publish path included)
+void test_steady_state_loop_does_not_allocate()
+{
+    {
+        HeapStats::Scope heap("setup");
+        setup();
+    }
+    HeapStats::begin(currentTaskName, nullptr);
+    runFor(3600000UL);
+    uint32_t warmup = HeapStats::totalAllocs();
+    runFor(23 * 3600000UL);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, mqtt.published());
+
+#ifdef HEAP_STATS_WRAP
+    char buf[512];
+    HeapStats::formatReport(buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, HeapStats::totalAllocs() - warmup, buf);
+#else
+    (void)warmup;
+    TEST_IGNORE_MESSAGE("allocation counting needs pio test -e native_heap");
+#endif
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_steady_state_loop_does_not_allocate);
+    return UNITY_END();
+}
@@ -0,0 +1,79 @@
+// Publish metrics report (src/metrics.h) - pio test -e native
+#include <unity.h>
+#include <string.h>
+#include "../../src/metrics.h"
+
+HeapStats::Layout layout()
+{
+    HeapStats::Layout l;
+    l.freeBytes = 123456;
+    l.largestBlock = 100000;
+    l.minFree = 90000;
+    return l;
+}
+
+// Brackets / braces balanced outside strings, strings closed
+bool balanced(const char *s)
+{
+    int depth = 0;
+    bool quoted = false;
+    for (; *s; s++) {
+        if (*s == '"') quoted = !quoted;
+        else if (!quoted && (*s == '[' || *s == '{')) depth++;
+        else if (!quoted && (*s == ']' || *s == '}') && --depth < 0) return false;
+    }
+    return depth == 0 && !quoted;
+}
+
+void setUp()
+{
+    HeapStats::begin(nullptr, layout);
+    const char *const TOPICS[] = {"home/pzem/voltage", "home/pzem/current", "home/relay/status"};
+    for (uint16_t i = 0; i < 200; i++) {
+        Metrics::record(TOPICS[i % 3], 40, 100 + i * 37, i % 7 != 0);
+    }
+}
+
+void tearDown() {}
+
+void test_full_report()
+{
+    char buf[METRICS_REPORT_SIZE];
+    size_t len = Metrics::formatReport(buf, sizeof(buf));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL_UINT32(strlen(buf), len);
+    TEST_ASSERT_TRUE(balanced(buf));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "\"hist\":["));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "\"heap\":[123456,100000,90000,19]"));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "[\"home/relay/status\","));
+    TEST_ASSERT_EQUAL_STRING("]]}", buf + len - 3);
+}
+
+// Any buffer size: a complete JSON object (parts dropped) or nothing
+void test_truncation_keeps_json_valid()
+{
+    char full[METRICS_REPORT_SIZE];
+    size_t full_len = Metrics::formatReport(full, sizeof(full));
+    uint16_t shortened = 0;
+
+    for (size_t size = 1; size <= full_len + 1; size++) {
+        char buf[METRICS_REPORT_SIZE];
+        memset(buf, '#', sizeof(buf));
+        size_t len = Metrics::formatReport(buf, size);
+        if (len == 0) continue;
+        TEST_ASSERT_LESS_THAN(size, len);
+        TEST_ASSERT_EQUAL_UINT32(strlen(buf), len);
+        TEST_ASSERT_TRUE_MESSAGE(balanced(buf), buf);
+        TEST_ASSERT_EQUAL_CHAR('}', buf[len - 1]);
+        if (len < full_len) shortened++;
+    }
+    TEST_ASSERT_GREATER_THAN(0, shortened);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_full_report);
+    RUN_TEST(test_truncation_keeps_json_valid);
+    return UNITY_END();
+}
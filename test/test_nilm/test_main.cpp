@@ -0,0 +1,194 @@
+// NILM-lite appliance detection (src/nilm.h) - pio test -e native
+#include <unity.h>
+#include <string.h>
+#include "../../src/config.h"
+#include "../../src/nilm.h"
+
+typedef Nilm::Detector<NILM_MAX_SIGNATURES> Detector;
+
+const Nilm::Config CONFIG = {NILM_NOISE_W, NILM_MIN_STEP_W, NILM_MATCH_RATIO, NILM_MATCH_MIN_W,
+                             NILM_STABLE_SAMPLES};
+
+// Household on a fixed trace: P (W) and Q (var), fed as P / PF at the
+// acquisition rate
+const float BASE_P = 120.0f, BASE_Q = 40.0f;
+const float KETTLE_P = 2000.0f, KETTLE_Q = 0.0f;
+const float FRIDGE_P = 150.0f, FRIDGE_Q = 110.0f;
+const float HEATER_P = 1000.0f, HEATER_Q = 0.0f;
+
+Detector *detector = nullptr;
+uint32_t nowMs = 0;
+Nilm::Event events[16];
+uint8_t eventCount = 0;
+
+// n samples of one level, with a small deterministic ripple
+void hold(float p, float q, uint16_t n)
+{
+    for (uint16_t i = 0; i < n; i++) {
+        float ripple = (float)((i * 7) % 9) - 4.0f;     // ±4 W, inside the noise band
+        float pp = p + ripple;
+        float pf = pp / sqrtf(pp * pp + q * q);
+        Nilm::Event ev;
+        if (detector->add(pp, pf, nowMs, ev) && eventCount < 16) events[eventCount++] = ev;
+        nowMs += NILM_SAMPLE_INTERVAL;
+    }
+}
+
+void setUp()
+{
+    nowMs = 0;
+    eventCount = 0;
+}
+
+void tearDown() {}
+
+void test_reactive_power()
+{
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.0f, Nilm::reactive(100.0f, 1.0f));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 75.0f, Nilm::reactive(100.0f, 0.8f));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.0f, Nilm::reactive(100.0f, NAN));
+}
+
+void test_on_off_events_and_learning()
+{
+    Detector d(CONFIG);
+    detector = &d;
+
+    hold(BASE_P, BASE_Q, 20);                                   // First level: no event
+    hold(BASE_P + KETTLE_P, BASE_Q + KETTLE_Q, 20);             // Kettle ON (new)
+    hold(BASE_P, BASE_Q, 20);                                   // Kettle OFF
+    hold(BASE_P + FRIDGE_P, BASE_Q + FRIDGE_Q, 20);             // Fridge ON (new)
+    hold(BASE_P + FRIDGE_P + KETTLE_P, BASE_Q + FRIDGE_Q, 50);  // Kettle ON (known), 10 s
+    hold(BASE_P + FRIDGE_P, BASE_Q + FRIDGE_Q, 20);             // Kettle OFF
+    hold(BASE_P, BASE_Q, 20);                                   // Fridge OFF
+
+    TEST_ASSERT_EQUAL_UINT8(6, eventCount);
+    const uint8_t TYPES[6] = {Nilm::EVENT_ON, Nilm::EVENT_OFF, Nilm::EVENT_ON,
+                              Nilm::EVENT_ON, Nilm::EVENT_OFF, Nilm::EVENT_OFF};
+    const uint8_t IDS[6] = {0, 0, 1, 0, 0, 1};
+    const bool LEARNED[6] = {true, false, true, false, false, false};
+    for (uint8_t i = 0; i < 6; i++) {
+        TEST_ASSERT_EQUAL_UINT8(TYPES[i], events[i].type);
+        TEST_ASSERT_EQUAL_UINT8(IDS[i], events[i].id);
+        TEST_ASSERT_EQUAL(LEARNED[i], events[i].learned);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(10.0f, KETTLE_P, events[0].dp);
+    TEST_ASSERT_FLOAT_WITHIN(10.0f, -KETTLE_P, events[1].dp);
+    TEST_ASSERT_FLOAT_WITHIN(10.0f, FRIDGE_Q, events[2].dq);
+
+    TEST_ASSERT_EQUAL_UINT8(2, d.count());
+    TEST_ASSERT_EQUAL_UINT32(2, d.learned());
+    TEST_ASSERT_EQUAL_UINT32(6, d.steps());
+    TEST_ASSERT_FLOAT_WITHIN(10.0f, KETTLE_P, d.signature(0).p);
+    TEST_ASSERT_EQUAL_UINT16(4, d.signature(0).count);          // 2 ON + 2 OFF steps
+    TEST_ASSERT_FLOAT_WITHIN(10.0f, FRIDGE_P, d.signature(1).p);
+    TEST_ASSERT_FLOAT_WITHIN(10.0f, FRIDGE_Q, d.signature(1).q);
+    TEST_ASSERT_FALSE(d.signature(0).on);
+    TEST_ASSERT_EQUAL_UINT32(14, d.signature(0).onTotalS);      // 4 s + 10 s
+}
+
+// Load already on at boot: its OFF step has no ON signature
+void test_unmatched_off()
+{
+    Detector d(CONFIG);
+    detector = &d;
+
+    hold(BASE_P + HEATER_P, BASE_Q + HEATER_Q, 20);
+    hold(BASE_P, BASE_Q, 20);
+    TEST_ASSERT_EQUAL_UINT8(1, eventCount);
+    TEST_ASSERT_EQUAL_UINT8(Nilm::EVENT_UNMATCHED_OFF, events[0].type);
+    TEST_ASSERT_FLOAT_WITHIN(10.0f, -HEATER_P, events[0].dp);
+    TEST_ASSERT_EQUAL_UINT8(0, d.count());                      // Nothing learned from it
+}
+
+// Short spikes and small steps are not events
+void test_transients_ignored()
+{
+    Detector d(CONFIG);
+    detector = &d;
+
+    hold(BASE_P, BASE_Q, 20);
+    hold(BASE_P + KETTLE_P, BASE_Q, NILM_STABLE_SAMPLES - 1);  // Inrush, not steady
+    hold(BASE_P, BASE_Q, 20);
+    hold(BASE_P + NILM_MIN_STEP_W / 2, BASE_Q, 20);             // Below the minimum step
+    TEST_ASSERT_EQUAL_UINT8(0, eventCount);
+    TEST_ASSERT_EQUAL_UINT32(0, d.steps());
+}
+
+// Saved table → reboot → same ids, states restart OFF
+void test_restore_round_trip()
+{
+    Detector d(CONFIG);
+    detector = &d;
+    hold(BASE_P, BASE_Q, 20);
+    hold(BASE_P + KETTLE_P, BASE_Q, 20);
+    hold(BASE_P + KETTLE_P + FRIDGE_P, BASE_Q + FRIDGE_Q, 20);
+    hold(BASE_P + KETTLE_P, BASE_Q, 20);
+
+    Nilm::Table<NILM_MAX_SIGNATURES> saved = d.table();
+    TEST_ASSERT_EQUAL_HEX32(Nilm::TABLE_MAGIC, saved.magic);
+    TEST_ASSERT_EQUAL_UINT8(2, saved.count);
+    TEST_ASSERT_TRUE(saved.sigs[0].on);
+
+    Detector rebooted(CONFIG);
+    TEST_ASSERT_TRUE(rebooted.restore(saved));
+    TEST_ASSERT_EQUAL_UINT8(2, rebooted.count());
+    for (uint8_t i = 0; i < 2; i++) {
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, saved.sigs[i].p, rebooted.signature(i).p);
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, saved.sigs[i].q, rebooted.signature(i).q);
+        TEST_ASSERT_EQUAL_UINT16(saved.sigs[i].count, rebooted.signature(i).count);
+        TEST_ASSERT_EQUAL_UINT32(saved.sigs[i].onTotalS, rebooted.signature(i).onTotalS);
+        TEST_ASSERT_FALSE(rebooted.signature(i).on);
+    }
+
+    char before[NILM_TABLE_SIZE], after[NILM_TABLE_SIZE];
+    Detector copy(CONFIG);
+    TEST_ASSERT_TRUE(copy.restore(rebooted.table()));
+    rebooted.formatSignatures(before, sizeof(before), nowMs);
+    copy.formatSignatures(after, sizeof(after), nowMs);
+    TEST_ASSERT_EQUAL_STRING(before, after);
+
+    // Known appliance after the reboot: matched, not learned again
+    detector = &rebooted;
+    eventCount = 0;
+    hold(BASE_P, BASE_Q, 20);
+    hold(BASE_P + FRIDGE_P, BASE_Q + FRIDGE_Q, 20);
+    TEST_ASSERT_EQUAL_UINT8(1, eventCount);
+    TEST_ASSERT_EQUAL_UINT8(Nilm::EVENT_ON, events[0].type);
+    TEST_ASSERT_EQUAL_UINT8(1, events[0].id);
+    TEST_ASSERT_FALSE(events[0].learned);
+
+    saved.magic = 0;
+    TEST_ASSERT_FALSE(rebooted.restore(saved));
+    saved.magic = Nilm::TABLE_MAGIC;
+    saved.count = NILM_MAX_SIGNATURES + 1;
+    TEST_ASSERT_FALSE(rebooted.restore(saved));
+}
+
+// [[id,p,q,count,on,on_total_s],...]
+void test_signature_report()
+{
+    Detector d(CONFIG);
+    detector = &d;
+    hold(BASE_P, BASE_Q, 20);
+    hold(BASE_P + KETTLE_P, BASE_Q, 20);
+    hold(BASE_P + KETTLE_P + FRIDGE_P, BASE_Q + FRIDGE_Q, 20);
+    char buf[NILM_TABLE_SIZE];
+    size_t len = d.formatSignatures(buf, sizeof(buf), nowMs);
+    TEST_ASSERT_EQUAL_UINT32(strlen(buf), len);
+    TEST_ASSERT_EQUAL_INT(0, strncmp(buf, "[[0,2000,", 9));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "],[1,150,110,1,1,"));
+    TEST_ASSERT_EQUAL_STRING("]]", buf + len - 2);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reactive_power);
+    RUN_TEST(test_on_off_events_and_learning);
+    RUN_TEST(test_unmatched_off);
+    RUN_TEST(test_transients_ignored);
+    RUN_TEST(test_restore_round_trip);
+    RUN_TEST(test_signature_report);
+    return UNITY_END();
+}
@@ -0,0 +1,171 @@
+// Automation rule engine (src/rules.h) - pio test -e native
+#include <unity.h>
+#include <string.h>
+#include "../../src/config.h"
+#include "../../src/rules.h"
+
+typedef Rules::Engine<RULES_MAX, RULES_MAX_CODE, RULES_MAX_STACK, RULES_MAX_NESTING> Engine;
+
+uint32_t fakeUs()
+{
+    return 0;
+}
+
+uint8_t fired[8];
+uint8_t firedAction[8];
+uint8_t fireCount = 0;
+
+void onFire(uint8_t rule, uint8_t action)
+{
+    if (fireCount < 8) {
+        fired[fireCount] = rule;
+        firedAction[fireCount] = action;
+    }
+    fireCount++;
+}
+
+float vars[Rules::VAR_COUNT];
+
+void setUp()
+{
+    memset(vars, 0, sizeof(vars));
+    fireCount = 0;
+}
+
+void tearDown() {}
+
+// Evaluate a single-rule condition once with no hold time
+bool holds(Engine &engine, const char *cond)
+{
+    char text[96];
+    snprintf(text, sizeof(text), "r: %s -> event", cond);
+    TEST_ASSERT_TRUE_MESSAGE(engine.load(text), engine.error());
+    fireCount = 0;
+    engine.evaluate(vars, 0, onFire);
+    return fireCount == 1;
+}
+
+// * binds tighter than +, comparisons tighter than &&, && tighter than ||
+void test_precedence()
+{
+    Engine engine(fakeUs);
+    vars[Rules::VAR_POWER] = 10.0f;
+
+    TEST_ASSERT_TRUE(holds(engine, "2 + 3 * 4 == 14"));
+    TEST_ASSERT_TRUE(holds(engine, "(2 + 3) * 4 == 20"));
+    TEST_ASSERT_TRUE(holds(engine, "p - 4 - 3 == 3"));
+    TEST_ASSERT_TRUE(holds(engine, "p / 5 / 2 == 1"));
+    TEST_ASSERT_TRUE(holds(engine, "1 || 0 && 0"));
+    TEST_ASSERT_FALSE(holds(engine, "(1 || 0) && 0"));
+    TEST_ASSERT_TRUE(holds(engine, "-p + 12 == 2"));
+    TEST_ASSERT_TRUE(holds(engine, "!(p > 20) && p >= 10"));
+    TEST_ASSERT_TRUE(holds(engine, "p != 9"));
+}
+
+// The condition must hold for the whole "for" duration, fires once and
+// re-arms after going false
+void test_for_duration()
+{
+    Engine engine(fakeUs);
+    TEST_ASSERT_TRUE(engine.load("hot: temp > 40 for 10s -> relay_off; blip: i > 5 for 200ms -> event"));
+    TEST_ASSERT_EQUAL_UINT32(10000, engine.rule(0).holdMs);
+    TEST_ASSERT_EQUAL_UINT32(200, engine.rule(1).holdMs);
+
+    vars[Rules::VAR_TEMPERATURE] = 45.0f;
+    engine.evaluate(vars, 1000, onFire);
+    engine.evaluate(vars, 10999, onFire);
+    TEST_ASSERT_EQUAL_UINT8(0, fireCount);
+
+    engine.evaluate(vars, 11000, onFire);
+    TEST_ASSERT_EQUAL_UINT8(1, fireCount);
+    TEST_ASSERT_EQUAL_UINT8(0, fired[0]);
+    TEST_ASSERT_EQUAL_UINT8(Rules::ACTION_RELAY_OFF, firedAction[0]);
+
+    // Still true: no second fire
+    engine.evaluate(vars, 30000, onFire);
+    TEST_ASSERT_EQUAL_UINT8(1, fireCount);
+
+    // A dip restarts the hold time
+    vars[Rules::VAR_TEMPERATURE] = 30.0f;
+    engine.evaluate(vars, 31000, onFire);
+    vars[Rules::VAR_TEMPERATURE] = 45.0f;
+    engine.evaluate(vars, 32000, onFire);
+    engine.evaluate(vars, 41000, onFire);
+    TEST_ASSERT_EQUAL_UINT8(1, fireCount);
+    engine.evaluate(vars, 42000, onFire);
+    TEST_ASSERT_EQUAL_UINT8(2, fireCount);
+
+    TEST_ASSERT_TRUE(engine.load("slow: p > 1 for 2m -> relay_on"));
+    TEST_ASSERT_EQUAL_UINT32(120000, engine.rule(0).holdMs);
+}
+
+// Bad input is rejected with a message and leaves the loaded set alone
+void test_errors_keep_previous_rules()
+{
+    Engine engine(fakeUs);
+    TEST_ASSERT_TRUE(engine.load("a: p > 1 -> event"));
+
+    TEST_ASSERT_FALSE(engine.load("b: p > 1"));
+    TEST_ASSERT_EQUAL_STRING("expected 'name: expr -> action'", engine.error());
+    TEST_ASSERT_FALSE(engine.load("b: p > 1 -> explode"));
+    TEST_ASSERT_EQUAL_STRING("unknown action", engine.error());
+    TEST_ASSERT_FALSE(engine.load("b: watts > 1 -> event"));
+    TEST_ASSERT_EQUAL_STRING("unknown variable", engine.error());
+    TEST_ASSERT_FALSE(engine.load("b: (p > 1 -> event"));
+    TEST_ASSERT_EQUAL_STRING("missing ')'", engine.error());
+    TEST_ASSERT_FALSE(engine.load("b: p > 1 for 5h -> event"));
+    TEST_ASSERT_EQUAL_STRING("bad duration", engine.error());
+    TEST_ASSERT_FALSE(engine.load("b: p > 1 2 -> event"));
+    TEST_ASSERT_EQUAL_STRING("unexpected text in condition", engine.error());
+    TEST_ASSERT_FALSE(engine.load("b: 1 + 2 + 3 + 4 + 5 + 6 + 7 + 8 + 9 > 1 -> event"));
+    TEST_ASSERT_EQUAL_STRING("rule too complex", engine.error());
+
+    TEST_ASSERT_EQUAL_UINT8(1, engine.count());
+    TEST_ASSERT_EQUAL_STRING("a", engine.rule(0).name);
+}
+
+// Parentheses and unary operators nest up to RULES_MAX_NESTING levels
+void test_nesting_limit()
+{
+    Engine engine(fakeUs);
+    char text[160];
+
+    // Exactly at the limit
+    char cond[64] = "";
+    for (uint8_t i = 0; i < RULES_MAX_NESTING; i++) strcat(cond, "(");
+    strcat(cond, "p");
+    for (uint8_t i = 0; i < RULES_MAX_NESTING; i++) strcat(cond, ")");
+    snprintf(text, sizeof(text), "ok: %s > 1 -> event", cond);
+    TEST_ASSERT_TRUE_MESSAGE(engine.load(text), engine.error());
+
+    // One more level
+    snprintf(text, sizeof(text), "deep: (%s) > 1 -> event", cond);
+    TEST_ASSERT_FALSE(engine.load(text));
+    TEST_ASSERT_EQUAL_STRING("nesting too deep", engine.error());
+
+    // Unary chains count too
+    TEST_ASSERT_FALSE(engine.load("neg: ---------p > 1 -> event"));
+    TEST_ASSERT_EQUAL_STRING("nesting too deep", engine.error());
+    TEST_ASSERT_TRUE(engine.load("neg: !!p -> event"));
+
+    // Sibling groups don't accumulate
+    TEST_ASSERT_TRUE(engine.load("wide: ((((p)))) + ((((i)))) + ((((v)))) > 1 -> event"));
+
+    // A long run of '(' is rejected before it can exhaust the stack
+    char flood[95] = "x: ";
+    memset(flood + 3, '(', 70);
+    flood[73] = '\0';
+    strcat(flood, "p -> event");
+    TEST_ASSERT_FALSE(engine.load(flood));
+    TEST_ASSERT_EQUAL_STRING("nesting too deep", engine.error());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_precedence);
+    RUN_TEST(test_for_duration);
+    RUN_TEST(test_errors_keep_previous_rules);
+    RUN_TEST(test_nesting_limit);
+    return UNITY_END();
+}
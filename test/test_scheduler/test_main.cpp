@@ -0,0 +1,164 @@
+// Deadline-driven scheduler (src/scheduler.h) - pio test -e native
+#include <unity.h>
+#include <string.h>
+#include "../../src/scheduler.h"
+
+typedef Sched::Scheduler<8> Scheduler;
+
+// Virtual µs clock; tasks advance it to simulate their run time
+uint32_t nowUs = 0;
+uint32_t clockUs() { return nowUs; }
+
+char order[16];
+uint8_t orderLen = 0;
+uint32_t workUs = 0;                // Run time of the next task
+
+void record(char c)
+{
+    if (orderLen < sizeof(order) - 1) order[orderLen++] = c;
+    order[orderLen] = '\0';
+    nowUs += workUs;
+}
+
+void taskA() { record('A'); }
+void taskB() { record('B'); }
+void taskC() { record('C'); }
+void taskD() { record('D'); }
+
+void setUp()
+{
+    nowUs = 0;
+    orderLen = 0;
+    order[0] = '\0';
+    workUs = 0;
+}
+
+void tearDown() {}
+
+// Step the clock in 1ms ticks, calling run() like loop() does
+void runFor(Scheduler &s, uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; i++) {
+        nowUs += 1000;
+        s.run();
+    }
+}
+
+// All due at once: priority first, then the earlier deadline
+void test_priority_order_among_due_tasks()
+{
+    Scheduler s(clockUs);
+    s.add("low", taskA, 100, Sched::PRIO_LOW, 10);
+    s.add("normal", taskB, 100, Sched::PRIO_NORMAL, 30);
+    s.add("critical", taskC, 100, Sched::PRIO_CRITICAL, 50);
+    s.add("normal2", taskD, 100, Sched::PRIO_NORMAL, 20);
+
+    nowUs = 60000;
+    TEST_ASSERT_EQUAL_UINT8(4, s.run());
+    TEST_ASSERT_EQUAL_STRING("CDBA", order);
+    TEST_ASSERT_EQUAL_INT8(Sched::INVALID_TASK, s.running());
+
+    // Nothing due until the earliest re-armed deadline (low, 10 + 100ms)
+    TEST_ASSERT_EQUAL_UINT8(0, s.run());
+    TEST_ASSERT_EQUAL_UINT32(50000, s.timeToNextUs());
+
+    // The slice limit stops a burst after the first task that uses it up
+    nowUs = 160000;
+    workUs = 2000;
+    orderLen = 0;
+    TEST_ASSERT_EQUAL_UINT8(1, s.run(1000));
+    TEST_ASSERT_EQUAL_STRING("C", order);
+}
+
+// Late start beyond maxLatency is a miss, longer than budget an
+// overrun, whole periods behind are skipped (fixed rate, no burst)
+void test_miss_overrun_and_skip_counting()
+{
+    Scheduler s(clockUs);
+    int8_t id = s.add("t", taskA, 100, Sched::PRIO_NORMAL, 0, 20, 5);
+    const Sched::TaskStats &st = s.task(id).stats;
+
+    // On time, within budget
+    s.run();
+    TEST_ASSERT_EQUAL_UINT32(1, st.runs);
+    TEST_ASSERT_EQUAL_UINT32(0, st.misses);
+    TEST_ASSERT_EQUAL_UINT32(0, st.overruns);
+
+    // 20ms late is still inside the latency limit; 21ms is a miss
+    nowUs = 120000;
+    s.run();
+    TEST_ASSERT_EQUAL_UINT32(0, st.misses);
+    nowUs = 221000;
+    s.run();
+    TEST_ASSERT_EQUAL_UINT32(1, st.misses);
+    TEST_ASSERT_EQUAL_INT8(id, s.lastMissTask());
+    TEST_ASSERT_EQUAL_UINT32(21000, s.lastMissLateUs());
+
+    // 6ms of work against a 5ms budget
+    workUs = 6000;
+    nowUs = 300000;
+    s.run();
+    TEST_ASSERT_EQUAL_UINT32(1, st.overruns);
+    TEST_ASSERT_EQUAL_UINT32(6000, st.maxRunUs);
+    workUs = 0;
+
+    // 350ms late: one run, three periods dropped, next due stays on the grid
+    nowUs = 750000;
+    TEST_ASSERT_EQUAL_UINT8(1, s.run());
+    TEST_ASSERT_EQUAL_UINT32(5, st.runs);
+    TEST_ASSERT_EQUAL_UINT32(3, st.skipped);
+    TEST_ASSERT_EQUAL_UINT32(800000, s.task(id).dueUs);
+    TEST_ASSERT_EQUAL_UINT32(2, st.misses);
+}
+
+// before() and the whole scheduler keep working across the 2^32 µs wrap
+void test_wrap_around()
+{
+    TEST_ASSERT_TRUE(Sched::before(0xFFFFFFF0UL, 0x10));
+    TEST_ASSERT_FALSE(Sched::before(0x10, 0xFFFFFFF0UL));
+    TEST_ASSERT_FALSE(Sched::before(5, 5));
+    TEST_ASSERT_TRUE(Sched::before(0x7FFFFFFFUL, 0x80000000UL));
+
+    nowUs = 0xFFFFFFFFUL - 50000;          // 50ms before the wrap
+    Scheduler s(clockUs);
+    int8_t fast = s.add("fast", taskA, 10, Sched::PRIO_HIGH);
+    int8_t slow = s.add("slow", taskB, 40, Sched::PRIO_LOW, 30);
+
+    runFor(s, 200);
+    TEST_ASSERT_TRUE(nowUs < 200000);       // Wrapped
+    TEST_ASSERT_EQUAL_UINT32(21, s.task(fast).stats.runs);
+    TEST_ASSERT_EQUAL_UINT32(5, s.task(slow).stats.runs);
+    TEST_ASSERT_EQUAL_UINT32(0, s.task(fast).stats.misses);
+    TEST_ASSERT_EQUAL_UINT32(0, s.task(slow).stats.misses);
+    TEST_ASSERT_EQUAL_UINT32(0, s.task(fast).stats.skipped);
+    TEST_ASSERT_TRUE(s.timeToNextUs() <= 10000);
+}
+
+// One-shot runs once and is re-armed by start(); stop() takes a task out
+void test_one_shot_and_stop()
+{
+    Scheduler s(clockUs);
+    int8_t once = s.add("once", taskA, 0, Sched::PRIO_NORMAL, 5);
+    int8_t tick = s.add("tick", taskB, 10, Sched::PRIO_NORMAL);
+
+    runFor(s, 30);
+    TEST_ASSERT_EQUAL_UINT32(1, s.task(once).stats.runs);
+    TEST_ASSERT_FALSE(s.isActive(once));
+
+    s.start(once, 2);
+    s.stop(tick);
+    runFor(s, 30);
+    TEST_ASSERT_EQUAL_UINT32(2, s.task(once).stats.runs);
+    TEST_ASSERT_EQUAL_UINT32(4, s.task(tick).stats.runs);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, s.timeToNextUs());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_priority_order_among_due_tasks);
+    RUN_TEST(test_miss_overrun_and_skip_counting);
+    RUN_TEST(test_wrap_around);
+    RUN_TEST(test_one_shot_and_stop);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+// Tiered tariff ledger (src/tariff.h) - pio test -e native
+#include <unity.h>
+#include "../../src/config.h"
+#include "../../src/tariff.h"
+
+const Tariff::Tier TIERS[] = TARIFF_TIERS;     // EVN residential, 6 tiers
+const uint8_t TIER_COUNT = sizeof(TIERS) / sizeof(TIERS[0]);
+const double VAT = 1.0 + TARIFF_VAT_PERCENT / 100.0;
+
+const int32_t DAY = 20745;                     // 2026-10-19
+const int32_t MONTH = 2026 * 12 + 9;           // 2026-10
+
+void setUp() {}
+void tearDown() {}
+
+void test_tiered_cost()
+{
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 0.0, Tariff::tieredCost(TIERS, TIER_COUNT, 0.0));
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 50 * 1806.0, Tariff::tieredCost(TIERS, TIER_COUNT, 50.0));
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 50 * 1806.0 + 50 * 1866.0 + 20 * 2167.0,
+                              Tariff::tieredCost(TIERS, TIER_COUNT, 120.0));
+    // Past the last bound: open-ended tier
+    double upTo400 = 50 * 1806.0 + 50 * 1866.0 + 100 * 2167.0 + 100 * 2729.0 + 100 * 3050.0;
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, upTo400 + 100 * 3151.0, Tariff::tieredCost(TIERS, TIER_COUNT, 500.0));
+}
+
+// First reading only sets the baseline; NAN readings are skipped
+void test_baseline_and_missing_readings()
+{
+    Tariff::Ledger ledger(TIERS, TIER_COUNT, TARIFF_VAT_PERCENT);
+    TEST_ASSERT_EQUAL_UINT8(Tariff::CLOSED_NONE, ledger.update(1234.5f, DAY, MONTH));
+    TEST_ASSERT_DOUBLE_WITHIN(1e-9, 0.0, ledger.day().kwh);
+    ledger.update(NAN, DAY, MONTH);
+    ledger.update(1235.5f, DAY, MONTH);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 1.0, ledger.day().kwh);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-3, 1806.0 * VAT, ledger.day().cost);
+}
+
+// One update spanning tier 1 → tier 2 is priced at both tiers
+void test_tier_boundary_in_one_update()
+{
+    Tariff::Ledger ledger(TIERS, TIER_COUNT, TARIFF_VAT_PERCENT);
+    ledger.update(100.0f, DAY, MONTH);
+    ledger.update(140.0f, DAY, MONTH);                  // Month at 40 kWh
+    double before = ledger.month().cost;
+    ledger.update(160.0f, DAY, MONTH);                  // +20 kWh across 50
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 60.0, ledger.month().kwh);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-3, (10 * 1806.0 + 10 * 1866.0) * VAT, ledger.month().cost - before);
+}
+
+// Register reset (button / MQTT) or 9999.99 kWh wrap: counts from 0,
+// nothing lost or double counted
+void test_register_reset_and_wrap()
+{
+    Tariff::Ledger ledger(TIERS, TIER_COUNT, TARIFF_VAT_PERCENT);
+    ledger.update(9999.0f, DAY, MONTH);
+    ledger.update(9999.5f, DAY, MONTH);
+    ledger.update(0.25f, DAY, MONTH);                   // Wrapped
+    TEST_ASSERT_EQUAL_UINT32(1, ledger.resets());
+    TEST_ASSERT_DOUBLE_WITHIN(1e-3, 0.75, ledger.day().kwh);
+
+    ledger.update(3.0f, DAY, MONTH);
+    ledger.update(0.0f, DAY, MONTH);                    // Reset command
+    ledger.update(1.0f, DAY, MONTH);
+    TEST_ASSERT_EQUAL_UINT32(2, ledger.resets());
+    TEST_ASSERT_DOUBLE_WITHIN(1e-3, 4.5, ledger.day().kwh);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-3, 4.5, ledger.month().kwh);
+}
+
+void test_day_and_month_rollover()
+{
+    Tariff::Ledger ledger(TIERS, TIER_COUNT, TARIFF_VAT_PERCENT);
+    ledger.update(0.0f, -1, -1);
+    ledger.update(2.0f, -1, -1);                        // Time unknown: no rollover
+    TEST_ASSERT_EQUAL_INT32(-1, ledger.day().key);
+
+    TEST_ASSERT_EQUAL_UINT8(Tariff::CLOSED_NONE, ledger.update(60.0f, DAY, MONTH));   // First date
+    TEST_ASSERT_EQUAL_INT32(DAY, ledger.day().key);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 0.0, ledger.day().kwh);   // Bucket starts at the first date
+
+    // Energy up to the first reading of a new day goes to the day
+    // that just ended
+    ledger.update(70.0f, DAY, MONTH);
+    TEST_ASSERT_EQUAL_UINT8(Tariff::CLOSED_DAY, ledger.update(75.0f, DAY + 1, MONTH));
+    TEST_ASSERT_EQUAL_INT32(DAY, ledger.closedDay().key);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 15.0, ledger.closedDay().kwh);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 0.0, ledger.day().kwh);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 15.0, ledger.month().kwh);
+
+    // Month boundary closes both; the new month prices from tier 1 again
+    ledger.update(100.0f, DAY + 1, MONTH);              // Month at 40 kWh
+    uint8_t closed = ledger.update(100.0f, DAY + 13, MONTH + 1);
+    TEST_ASSERT_EQUAL_UINT8(Tariff::CLOSED_DAY | Tariff::CLOSED_MONTH, closed);
+    TEST_ASSERT_EQUAL_INT32(MONTH, ledger.closedMonth().key);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 40.0, ledger.closedMonth().kwh);
+    ledger.update(120.0f, DAY + 13, MONTH + 1);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-3, 20 * 1806.0 * VAT, ledger.month().cost);
+}
+
+// Many small increments add up to the one-shot tiered price with VAT:
+// no drift from the per-update rounding
+void test_vat_rounding()
+{
+    Tariff::Ledger ledger(TIERS, TIER_COUNT, TARIFF_VAT_PERCENT);
+    const float STEP = 0.015625f;                       // Exact in binary
+    float meter = 0.0f;
+    ledger.update(meter, DAY, MONTH);
+    for (uint32_t i = 0; i < 7680; i++) {               // 120 kWh, three tiers
+        meter += STEP;
+        ledger.update(meter, DAY, MONTH);
+    }
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 120.0, ledger.month().kwh);
+    double expected = Tariff::tieredCost(TIERS, TIER_COUNT, 120.0) * VAT;       // 245095.2 VND
+    TEST_ASSERT_DOUBLE_WITHIN(0.01, expected, ledger.month().cost);
+    TEST_ASSERT_DOUBLE_WITHIN(0.01, 245095.2, ledger.month().cost);
+}
+
+void test_restore_state()
+{
+    Tariff::Ledger ledger(TIERS, TIER_COUNT, TARIFF_VAT_PERCENT);
+    ledger.update(10.0f, DAY, MONTH);
+    ledger.update(15.0f, DAY, MONTH);
+    Tariff::State saved = ledger.state();
+
+    Tariff::Ledger rebooted(TIERS, TIER_COUNT, TARIFF_VAT_PERCENT);
+    TEST_ASSERT_TRUE(rebooted.restore(saved));
+    rebooted.update(16.0f, DAY, MONTH);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 6.0, rebooted.day().kwh);
+
+    saved.magic = 0;
+    TEST_ASSERT_FALSE(rebooted.restore(saved));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_tiered_cost);
+    RUN_TEST(test_baseline_and_missing_readings);
+    RUN_TEST(test_tier_boundary_in_one_update);
+    RUN_TEST(test_register_reset_and_wrap);
+    RUN_TEST(test_day_and_month_rollover);
+    RUN_TEST(test_vat_rounding);
+    RUN_TEST(test_restore_state);
+    return UNITY_END();
+}
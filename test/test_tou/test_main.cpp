@@ -0,0 +1,217 @@
+// Time-of-use schedule (src/tou_schedule.h) - pio test -e native
+#include <unity.h>
+#include "../../src/tou_schedule.h"
+
+typedef Tou::Schedule<8, 8> Schedule;
+
+const int16_t VN_OFFSET_MIN = 420;     // UTC+7, no DST
+
+// UTC seconds of a local (UTC+offset) date and time
+uint32_t utcAt(int y, int m, int d, int hh, int mm, int16_t offset_min = VN_OFFSET_MIN)
+{
+    return (uint32_t)((int64_t)Tou::daysFromCivil(y, m, d) * 86400 + hh * 3600 + mm * 60 - offset_min * 60);
+}
+
+// State after priming at t (no edge expected from the first update)
+bool stateAt(const char *text, uint32_t t)
+{
+    Schedule s(VN_OFFSET_MIN);
+    TEST_ASSERT_TRUE(s.parse(text));
+    s.update(t);
+    return s.state();
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_calendar()
+{
+    TEST_ASSERT_EQUAL_INT32(0, Tou::daysFromCivil(1970, 1, 1));
+    TEST_ASSERT_EQUAL_UINT8(3, Tou::weekday(0));                                // Thursday
+    TEST_ASSERT_EQUAL_UINT8(0, Tou::weekday(Tou::daysFromCivil(2026, 10, 19)));  // Monday
+    TEST_ASSERT_EQUAL_UINT8(29, Tou::daysInMonth(2028, 2));
+    TEST_ASSERT_EQUAL_UINT8(28, Tou::daysInMonth(2100, 2));
+    TEST_ASSERT_EQUAL_UINT8(29, Tou::daysInMonth(2000, 2));
+    TEST_ASSERT_EQUAL_UINT8(30, Tou::daysInMonth(2026, 4));
+}
+
+// Window past midnight belongs to its start day
+void test_overnight_rule()
+{
+    const char *night = "MTWTF--/22:00-06:00";
+    TEST_ASSERT_FALSE(stateAt(night, utcAt(2026, 10, 19, 21, 59)));     // Mon
+    TEST_ASSERT_TRUE(stateAt(night, utcAt(2026, 10, 19, 22, 0)));
+    TEST_ASSERT_TRUE(stateAt(night, utcAt(2026, 10, 20, 5, 59)));       // Tue morning
+    TEST_ASSERT_FALSE(stateAt(night, utcAt(2026, 10, 20, 6, 0)));
+    TEST_ASSERT_TRUE(stateAt(night, utcAt(2026, 10, 24, 5, 0)));        // Sat morning, Fri night
+    TEST_ASSERT_FALSE(stateAt(night, utcAt(2026, 10, 24, 23, 0)));      // Sat night
+    TEST_ASSERT_FALSE(stateAt(night, utcAt(2026, 10, 19, 3, 0)));       // Mon morning, Sun night
+
+    Schedule s(VN_OFFSET_MIN);
+    TEST_ASSERT_TRUE(s.parse(night));
+    s.update(utcAt(2026, 10, 19, 23, 0));
+    TEST_ASSERT_EQUAL_UINT32(utcAt(2026, 10, 20, 6, 0), s.nextTransitionUtc());
+}
+
+void test_weekday_mask()
+{
+    const char *weekend = "-----SS/10:00-12:00";
+    TEST_ASSERT_TRUE(stateAt(weekend, utcAt(2026, 10, 24, 11, 0)));     // Sat
+    TEST_ASSERT_TRUE(stateAt(weekend, utcAt(2026, 10, 25, 10, 0)));     // Sun
+    TEST_ASSERT_FALSE(stateAt(weekend, utcAt(2026, 10, 23, 11, 0)));    // Fri
+    TEST_ASSERT_FALSE(stateAt(weekend, utcAt(2026, 10, 24, 12, 0)));    // End is exclusive
+
+    Schedule s(VN_OFFSET_MIN);
+    TEST_ASSERT_FALSE(s.parse("MXWTF--/08:00-09:00"));     // Wrong letter
+    TEST_ASSERT_FALSE(s.parse("-------/08:00-09:00"));     // No day
+    TEST_ASSERT_FALSE(s.parse("MTWTFSS/08:00-08:00"));     // Empty window
+    TEST_ASSERT_FALSE(s.parse("MTWTFSS/24:00-06:00"));
+    TEST_ASSERT_FALSE(s.parse("MTWTFSS/08:0-09:00"));
+}
+
+void test_date_exceptions()
+{
+    const char *text = "MTWTFSS/08:00-18:00;2026-10-21=OFF;2026-10-25=ON";
+    TEST_ASSERT_TRUE(stateAt(text, utcAt(2026, 10, 20, 12, 0)));
+    TEST_ASSERT_FALSE(stateAt(text, utcAt(2026, 10, 21, 12, 0)));       // OFF all day
+    TEST_ASSERT_TRUE(stateAt(text, utcAt(2026, 10, 25, 3, 0)));         // ON all day
+    TEST_ASSERT_TRUE(stateAt(text, utcAt(2026, 10, 25, 23, 59)));
+
+    Schedule s(VN_OFFSET_MIN);
+    TEST_ASSERT_TRUE(s.parse(text));
+    TEST_ASSERT_FALSE(s.parse("2026-02-31=OFF"));
+    TEST_ASSERT_FALSE(s.parse("2026-04-31=OFF"));
+    TEST_ASSERT_FALSE(s.parse("2026-02-29=OFF"));
+    TEST_ASSERT_FALSE(s.parse("2026-13-01=OFF"));
+    TEST_ASSERT_FALSE(s.parse("2026-01-01=OFFX"));
+    TEST_ASSERT_EQUAL_UINT8(2, s.exceptionCount());        // Failed parses change nothing
+    TEST_ASSERT_TRUE(s.parse("2028-02-29=ON"));
+}
+
+// Fixed offset: 22:00 local is 15:00 UTC all year
+void test_utc_offset_without_dst()
+{
+    Schedule s(VN_OFFSET_MIN);
+    TEST_ASSERT_TRUE(s.parse("MTWTFSS/22:00-23:00"));
+    uint32_t winter = (uint32_t)Tou::daysFromCivil(2026, 1, 15) * 86400 + 15 * 3600;
+    uint32_t summer = (uint32_t)Tou::daysFromCivil(2026, 7, 15) * 86400 + 15 * 3600;
+    TEST_ASSERT_EQUAL_UINT32(utcAt(2026, 1, 15, 22, 0), winter);
+    TEST_ASSERT_TRUE(stateAt("MTWTFSS/22:00-23:00", winter));
+    TEST_ASSERT_TRUE(stateAt("MTWTFSS/22:00-23:00", summer));
+    TEST_ASSERT_FALSE(stateAt("MTWTFSS/22:00-23:00", summer - 60));
+
+    // Local day boundary: 2026-10-25 (Sun) starts at 17:00 UTC on the 24th
+    TEST_ASSERT_TRUE(stateAt("------S/00:00-01:00", utcAt(2026, 10, 24, 17, 0, 0)));
+    TEST_ASSERT_FALSE(stateAt("------S/00:00-01:00", utcAt(2026, 10, 24, 16, 59, 0)));
+}
+
+// Rules restored from NVS: the first update only primes, so the relay
+// state restored at boot is kept until the next real transition
+void test_first_update_primes_without_edge()
+{
+    Schedule stored(VN_OFFSET_MIN);
+    TEST_ASSERT_TRUE(stored.parse("MTWTFSS/08:00-09:00"));
+    uint32_t words[Schedule::MAX_WORDS];
+    uint8_t count = stored.serialize(words);
+
+    Schedule s(VN_OFFSET_MIN);
+    TEST_ASSERT_TRUE(s.deserialize(words, count));
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_NONE, s.update(utcAt(2026, 10, 19, 8, 30)));
+    TEST_ASSERT_TRUE(s.state());
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_NONE, s.update(utcAt(2026, 10, 19, 8, 31)));
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_OFF, s.update(utcAt(2026, 10, 19, 9, 0)));
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_ON, s.update(utcAt(2026, 10, 20, 8, 0)));
+
+    // Same rules again (retained set topic): no forced edge
+    TEST_ASSERT_TRUE(s.parse("MTWTFSS/08:00-09:00"));
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_NONE, s.update(utcAt(2026, 10, 20, 8, 1)));
+
+    // Edited rules: the relay follows the current window at once
+    TEST_ASSERT_TRUE(s.parse("MTWTFSS/06:00-07:00"));
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_OFF, s.update(utcAt(2026, 10, 20, 8, 2)));
+
+    // Clock stepped back: re-evaluated with an edge
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_ON, s.update(utcAt(2026, 10, 20, 6, 30)));
+}
+
+// An SNTP correction of a second back must not re-assert the window
+// over a manual command; only a real clock reset forces an edge
+void test_small_step_back_no_edge()
+{
+    Schedule s(VN_OFFSET_MIN);
+    TEST_ASSERT_TRUE(s.parse("MTWTFSS/08:00-09:00"));
+    s.update(utcAt(2026, 10, 19, 8, 30));
+    uint32_t t = utcAt(2026, 10, 19, 8, 40);
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_NONE, s.update(t));
+
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_NONE, s.update(t - 1));
+    TEST_ASSERT_TRUE(s.state());
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_NONE, s.update(t - 1 - Tou::CLOCK_STEP_BACK_S));
+
+    // Stepping back across the window end is a real state change
+    s.update(utcAt(2026, 10, 19, 9, 0));
+    TEST_ASSERT_FALSE(s.state());
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_ON, s.update(utcAt(2026, 10, 19, 9, 0) - 1));
+
+    // More than CLOCK_STEP_BACK_S back: forced even without a change
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_ON, s.update(utcAt(2026, 10, 19, 8, 50)));
+}
+
+// Between transitions update() doesn't rescan
+void test_scans_only_at_transitions()
+{
+    Schedule s(VN_OFFSET_MIN);
+    TEST_ASSERT_TRUE(s.parse("MTWTF--/22:00-06:00;-----SS/10:00-12:00;2026-10-23=OFF"));
+    uint32_t start = utcAt(2026, 10, 19, 0, 0);
+    s.update(start);
+    uint32_t scans = s.evaluations();
+    uint8_t on = 0, off = 0;
+    for (uint32_t t = start; t < start + 7 * 86400; t += 30) {
+        uint8_t edge = s.update(t);
+        if (edge == Tou::EDGE_ON) on++;
+        if (edge == Tou::EDGE_OFF) off++;
+    }
+    // Mon-Thu nights (cut at Fri 00:00 by the exception), Fri night
+    // from Sat 00:00 to 06:00, Sat + Sun 10-12
+    TEST_ASSERT_EQUAL_UINT8(7, on);
+    TEST_ASSERT_EQUAL_UINT8(7, off);
+    TEST_ASSERT_LESS_THAN(32, s.evaluations() - scans);
+}
+
+void test_format_and_storage_round_trip()
+{
+    const char *text = "MTWTF--/22:00-06:00;-----SS/10:00-12:00;2026-09-02=OFF";
+    Schedule s(VN_OFFSET_MIN);
+    TEST_ASSERT_TRUE(s.parse(text));
+    char buf[128];
+    s.format(buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING(text, buf);
+
+    uint32_t words[Schedule::MAX_WORDS];
+    uint8_t count = s.serialize(words);
+    TEST_ASSERT_EQUAL_UINT8(4, count);
+    Schedule copy(VN_OFFSET_MIN);
+    TEST_ASSERT_TRUE(copy.deserialize(words, count));
+    copy.format(buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING(text, buf);
+    TEST_ASSERT_FALSE(copy.deserialize(words, count - 1));
+
+    TEST_ASSERT_TRUE(s.parse(""));
+    TEST_ASSERT_EQUAL_UINT8(0, s.ruleCount());
+    TEST_ASSERT_EQUAL_UINT8(Tou::EDGE_NONE, s.update(utcAt(2026, 10, 19, 23, 0)));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_calendar);
+    RUN_TEST(test_overnight_rule);
+    RUN_TEST(test_weekday_mask);
+    RUN_TEST(test_date_exceptions);
+    RUN_TEST(test_utc_offset_without_dst);
+    RUN_TEST(test_first_update_primes_without_edge);
+    RUN_TEST(test_small_step_back_no_edge);
+    RUN_TEST(test_scans_only_at_transitions);
+    RUN_TEST(test_format_and_storage_round_trip);
+    return UNITY_END();
+}